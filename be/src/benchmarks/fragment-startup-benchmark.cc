@@ -0,0 +1,127 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <iostream>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "common/object-pool.h"
+#include "runtime/disk-io-mgr.h"
+#include "util/benchmark.h"
+#include "util/cpu-info.h"
+#include "util/runtime-profile.h"
+
+using namespace boost;
+using namespace impala;
+using namespace std;
+
+// Benchmark for creating and destroying the small objects of a fragment instance in its
+// ObjectPool, comparing heap allocation with Add() to allocation in the pool with
+// AddInPlace(). Each iteration creates the objects of one fragment instance with
+// NUM_NODES exec nodes, each with a profile, NUM_COUNTERS counters and
+// NUM_SCAN_RANGES scan ranges, and then destroys the pool as the fragment's
+// RuntimeState does when it is closed. The "concurrent" suite starts NUM_THREADS
+// fragment instances at the same time, which is where allocator contention shows.
+// Results from a standalone build of this file with g++ 12 -O2 on a 1-core VM, with
+// stand-ins of similar size for RuntimeProfile, its counters and ScanRange, which need
+// the full backend build. Over 3 runs, AddInPlace() was 1.20X to 1.44X as fast
+// serially and 1.95X to 2.09X with concurrent fragments:
+// Machine Info: Intel(R) Xeon(R) Processor
+// serial:               Function     Rate (iters/ms)          Comparison
+// ----------------------------------------------------------------------
+//                          Add()                11.8                  1X
+//                   AddInPlace()               16.07              1.362X
+//
+// concurrent:           Function     Rate (iters/ms)          Comparison
+// ----------------------------------------------------------------------
+//                          Add()               1.117                  1X
+//                   AddInPlace()               2.176              1.949X
+
+static const int NUM_NODES = 8;
+static const int NUM_COUNTERS = 25;
+static const int NUM_SCAN_RANGES = 100;
+static const int NUM_THREADS = 8;
+
+void StartFragmentHeap(int batch_size) {
+  for (int i = 0; i < batch_size; ++i) {
+    ObjectPool pool;
+    for (int n = 0; n < NUM_NODES; ++n) {
+      pool.Add(new RuntimeProfile(&pool, "ExecNode"));
+      for (int c = 0; c < NUM_COUNTERS; ++c) {
+        pool.Add(new RuntimeProfile::Counter(TUnit::UNIT));
+      }
+      for (int r = 0; r < NUM_SCAN_RANGES; ++r) {
+        pool.Add(new DiskIoMgr::ScanRange());
+      }
+    }
+  }
+}
+
+void StartFragmentInPlace(int batch_size) {
+  for (int i = 0; i < batch_size; ++i) {
+    ObjectPool pool;
+    for (int n = 0; n < NUM_NODES; ++n) {
+      pool.AddInPlace(new (&pool) RuntimeProfile(&pool, "ExecNode"));
+      for (int c = 0; c < NUM_COUNTERS; ++c) {
+        pool.AddInPlace(new (&pool) RuntimeProfile::Counter(TUnit::UNIT));
+      }
+      for (int r = 0; r < NUM_SCAN_RANGES; ++r) {
+        pool.AddInPlace(new (&pool) DiskIoMgr::ScanRange());
+      }
+    }
+  }
+}
+
+void TestHeap(int batch_size, void* data) {
+  StartFragmentHeap(batch_size);
+}
+
+void TestInPlace(int batch_size, void* data) {
+  StartFragmentInPlace(batch_size);
+}
+
+void TestHeapConcurrent(int batch_size, void* data) {
+  thread_group threads;
+  for (int i = 0; i < NUM_THREADS; ++i) {
+    threads.add_thread(new thread(StartFragmentHeap, batch_size));
+  }
+  threads.join_all();
+}
+
+void TestInPlaceConcurrent(int batch_size, void* data) {
+  thread_group threads;
+  for (int i = 0; i < NUM_THREADS; ++i) {
+    threads.add_thread(new thread(StartFragmentInPlace, batch_size));
+  }
+  threads.join_all();
+}
+
+int main(int argc, char **argv) {
+  CpuInfo::Init();
+  cout << Benchmark::GetMachineInfo() << endl;
+
+  Benchmark serial_suite("serial");
+  serial_suite.AddBenchmark("Add()", TestHeap, NULL);
+  serial_suite.AddBenchmark("AddInPlace()", TestInPlace, NULL);
+  cout << serial_suite.Measure() << endl;
+
+  Benchmark concurrent_suite("concurrent");
+  concurrent_suite.AddBenchmark("Add()", TestHeapConcurrent, NULL);
+  concurrent_suite.AddBenchmark("AddInPlace()", TestInPlaceConcurrent, NULL);
+  cout << concurrent_suite.Measure() << endl;
+
+  return 0;
+}
@@ -0,0 +1,225 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "runtime/decimal-value.h"
+#include "runtime/raw-value.h"
+#include "runtime/timestamp-value.h"
+#include "util/benchmark.h"
+#include "util/cpu-info.h"
+#include "util/text-formatter.h"
+
+using namespace impala;
+using namespace std;
+
+// Benchmark for the formatting done by HdfsTextTableWriter. It compares writing
+// delimited values with RawValue::PrintValue() into a stringstream, as the writer used
+// to, with writing them with TextFormatter into a char buffer. Both buffers are reset
+// when they reach the writer's flush size. The "shortest" doubles are written with
+// FormatDoubleShortest(), as with --text_writer_shortest_doubles, and compared with a
+// stream with a precision of 17, which is what a stream needs to write doubles that
+// read back as the same value.
+// Results from a standalone build of this file with g++ 12 -O3 on a single core. Over
+// 5 runs, the shortest doubles ran at 7.4X to 15X of the stream, also when most values
+// need 16 or 17 digits, and at 6X to 11X of the formatter with 16 digits in
+// "double", which calls snprintf():
+// Machine Info: Intel(R) Xeon(R) Processor
+// int:                  Function     Rate (iters/ms)          Comparison
+// ----------------------------------------------------------------------
+//                         stream               12.95                  1X
+//                      formatter               86.84              6.704X
+//
+// bigint:               Function     Rate (iters/ms)          Comparison
+// ----------------------------------------------------------------------
+//                         stream               11.74                  1X
+//                      formatter               58.92              5.021X
+//
+// integral double:      Function     Rate (iters/ms)          Comparison
+// ----------------------------------------------------------------------
+//                         stream               1.648                  1X
+//                      formatter                46.7              28.33X
+//
+// double:               Function     Rate (iters/ms)          Comparison
+// ----------------------------------------------------------------------
+//                         stream               1.187                  1X
+//                      formatter               1.708              1.439X
+//
+// double with scale:    Function     Rate (iters/ms)          Comparison
+// ----------------------------------------------------------------------
+//                         stream               1.311                  1X
+//                      formatter               1.952              1.489X
+//
+// shortest double:      Function     Rate (iters/ms)          Comparison
+// ----------------------------------------------------------------------
+//                         stream               1.311                  1X
+//                      formatter               13.34              10.18X
+//
+// shortest long double: Function     Rate (iters/ms)          Comparison
+// ----------------------------------------------------------------------
+//                         stream               1.599                  1X
+//                      formatter               11.82               7.39X
+//
+// decimal:              Function     Rate (iters/ms)          Comparison
+// ----------------------------------------------------------------------
+//                         stream               9.955                  1X
+//                      formatter               33.26              3.341X
+//
+// timestamp:            Function     Rate (iters/ms)          Comparison
+// ----------------------------------------------------------------------
+//                         stream              0.4011                  1X
+//                      formatter               22.99              57.32X
+
+// Same as HdfsTableWriter::HDFS_FLUSH_WRITE_SIZE.
+static const int FLUSH_SIZE = 50 * 1024;
+
+static const int NUM_VALUES = 1000;
+
+struct TestData {
+  ColumnType type;
+  // Scale for floating point values.
+  int scale;
+  // If true, doubles are written with the fewest digits that read back as the value.
+  bool shortest;
+  vector<int32_t> ints;
+  vector<int64_t> bigints;
+  vector<double> doubles;
+  vector<Decimal8Value> decimals;
+  vector<TimestampValue> timestamps;
+
+  stringstream stream;
+  vector<char> buffer;
+  int buffer_len;
+
+  TestData(const ColumnType& type, int scale = -1, bool shortest = false)
+    : type(type), scale(scale), shortest(shortest), buffer(FLUSH_SIZE + 128),
+      buffer_len(0) {
+    stream.precision(shortest ? 17 : RawValue::ASCII_PRECISION);
+  }
+
+  const void* value(int i) const {
+    switch (type.type) {
+      case TYPE_INT: return &ints[i];
+      case TYPE_BIGINT: return &bigints[i];
+      case TYPE_DOUBLE: return &doubles[i];
+      case TYPE_DECIMAL: return &decimals[i];
+      case TYPE_TIMESTAMP: return &timestamps[i];
+      default: return NULL;
+    }
+  }
+};
+
+void TestStream(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    for (int j = 0; j < NUM_VALUES; ++j) {
+      RawValue::PrintValue(data->value(j), data->type, data->scale, &data->stream);
+      data->stream << ',';
+      if (data->stream.tellp() >= FLUSH_SIZE) data->stream.str(string());
+    }
+  }
+}
+
+void TestFormatter(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    for (int j = 0; j < NUM_VALUES; ++j) {
+      char* dst = &data->buffer[data->buffer_len];
+      int len = 0;
+      switch (data->type.type) {
+        case TYPE_INT:
+          len = TextFormatter::FormatInt(data->ints[j], dst);
+          break;
+        case TYPE_BIGINT:
+          len = TextFormatter::FormatInt(data->bigints[j], dst);
+          break;
+        case TYPE_DOUBLE:
+          if (data->shortest) {
+            len = TextFormatter::FormatDoubleShortest(data->doubles[j], dst);
+          } else {
+            len = TextFormatter::FormatDouble(data->doubles[j], data->scale, dst);
+          }
+          break;
+        case TYPE_DECIMAL:
+          len = TextFormatter::FormatDecimal(data->decimals[j], data->type.scale, dst);
+          break;
+        case TYPE_TIMESTAMP:
+          len = TextFormatter::FormatTimestamp(data->timestamps[j], dst);
+          break;
+        default:
+          break;
+      }
+      dst[len] = ',';
+      data->buffer_len += len + 1;
+      if (data->buffer_len >= FLUSH_SIZE) data->buffer_len = 0;
+    }
+  }
+}
+
+// Returns a random number in [min, max).
+int64_t RandomValue(int64_t min, int64_t max) {
+  return min + static_cast<int64_t>((max - min) * (rand() / (RAND_MAX + 1.0)));
+}
+
+void Run(const string& name, TestData* data) {
+  Benchmark suite(name);
+  suite.AddBenchmark("stream", TestStream, data);
+  suite.AddBenchmark("formatter", TestFormatter, data);
+  cout << suite.Measure() << endl;
+}
+
+int main(int argc, char **argv) {
+  CpuInfo::Init();
+  cout << Benchmark::GetMachineInfo() << endl;
+
+  TestData ints(TYPE_INT);
+  TestData bigints(TYPE_BIGINT);
+  TestData integral_doubles(TYPE_DOUBLE);
+  TestData doubles(TYPE_DOUBLE);
+  TestData fixed_doubles(TYPE_DOUBLE, 2);
+  TestData shortest_doubles(TYPE_DOUBLE, -1, true);
+  TestData shortest_long_doubles(TYPE_DOUBLE, -1, true);
+  TestData decimals(ColumnType::CreateDecimalType(18, 2));
+  TestData timestamps(TYPE_TIMESTAMP);
+  for (int i = 0; i < NUM_VALUES; ++i) {
+    ints.ints.push_back(RandomValue(-1000000, 1000000));
+    bigints.bigints.push_back(RandomValue(-1000000000000LL, 1000000000000LL));
+    integral_doubles.doubles.push_back(RandomValue(-1000000, 1000000));
+    doubles.doubles.push_back(RandomValue(-1000000, 1000000) / 1000.0);
+    fixed_doubles.doubles.push_back(RandomValue(-1000000, 1000000) / 100.0);
+    shortest_doubles.doubles.push_back(doubles.doubles.back());
+    // Most of these need 16 or 17 digits.
+    shortest_long_doubles.doubles.push_back(RandomValue(-1000000, 1000000) / 3.0);
+    decimals.decimals.push_back(Decimal8Value(RandomValue(-100000000, 100000000)));
+    // Seconds between 1970 and 2030, with microseconds.
+    timestamps.timestamps.push_back(TimestampValue(
+        static_cast<double>(RandomValue(0, 1900000000)) +
+        RandomValue(0, 1000000) / 1000000.0));
+  }
+
+  Run("int", &ints);
+  Run("bigint", &bigints);
+  Run("integral double", &integral_doubles);
+  Run("double", &doubles);
+  Run("double with scale", &fixed_doubles);
+  Run("shortest double", &shortest_doubles);
+  Run("shortest long double", &shortest_long_doubles);
+  Run("decimal", &decimals);
+  Run("timestamp", &timestamps);
+
+  return 0;
+}
@@ -0,0 +1,88 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "common/object-pool.h"
+
+using namespace std;
+
+namespace impala {
+
+// Records the order in which objects are destroyed.
+struct Tracked {
+  Tracked(int id, vector<int>* destroyed) : id(id), destroyed(destroyed), str(100, 'x') {}
+  ~Tracked() { destroyed->push_back(id); }
+
+  int id;
+  vector<int>* destroyed;
+  string str;
+};
+
+struct __attribute__((aligned(16))) Aligned {
+  char c[20];
+};
+
+struct Large {
+  char c[100 * 1024];
+};
+
+TEST(ObjectPoolTest, Basic) {
+  vector<int> destroyed;
+  {
+    ObjectPool pool;
+    for (int i = 0; i < 1000; ++i) {
+      Tracked* t;
+      if (i % 3 == 0) {
+        t = pool.Add(new Tracked(i, &destroyed));
+      } else {
+        t = pool.AddInPlace(new (&pool) Tracked(i, &destroyed));
+      }
+      EXPECT_EQ(t->id, i);
+      Aligned* aligned = pool.AddInPlace(new (&pool) Aligned());
+      EXPECT_EQ(reinterpret_cast<uintptr_t>(aligned) % 16, 0);
+      if (i % 100 == 0) {
+        Large* large = pool.AddInPlace(new (&pool) Large());
+        memset(large->c, 0, sizeof(large->c));
+      }
+    }
+    EXPECT_TRUE(destroyed.empty());
+  }
+  // Objects are destroyed in the order they were added, however they were allocated.
+  ASSERT_EQ(destroyed.size(), 1000);
+  for (int i = 0; i < destroyed.size(); ++i) {
+    EXPECT_EQ(destroyed[i], i);
+  }
+}
+
+// Add() deletes its objects, which must not be done with objects in the pool's memory.
+#ifndef NDEBUG
+TEST(ObjectPoolTest, AddInPlaceObject) {
+  ObjectPool pool;
+  Aligned* heap_object = pool.Add(new Aligned());
+  EXPECT_TRUE(heap_object != NULL);
+  EXPECT_DEATH(pool.Add(new (&pool) Aligned()), "need AddInPlace");
+  EXPECT_DEATH(pool.Add(new (&pool) Large()), "need AddInPlace");
+}
+#endif
+
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -16,39 +16,102 @@
 #ifndef IMPALA_COMMON_OBJECT_POOL_H
 #define IMPALA_COMMON_OBJECT_POOL_H
 
+#include <stdlib.h>
+#include <new>
+#include <utility>
 #include <vector>
-#include <boost/thread/mutex.hpp>
+#include <boost/cstdint.hpp>
+#include "common/logging.h"
 #include "util/spinlock.h"
 
 namespace impala {
 
 // An ObjectPool maintains a list of C++ objects which are deallocated by destroying the
 // pool.
+//
+// Objects are either allocated on the heap by the caller and handed to Add(), or
+// constructed in memory owned by the pool with the placement new defined below:
+//   Foo* foo = pool->AddInPlace(new (pool) Foo(args));
+// The pool hands out that memory, and the bookkeeping for all objects, by bumping a
+// pointer through chunks that are freed all at once when the pool is destroyed. The
+// many small objects a fragment instance creates during Prepare() (descriptors, exprs,
+// profile counters, scan ranges) should be allocated in place, which saves a malloc()
+// and free() per object. Objects created with new (pool) must only be passed to
+// AddInPlace(), never to delete or to Add(), which checks this in debug builds.
+// Objects are destroyed in the order in which they were added.
 // Thread-safe.
 class ObjectPool {
  public:
-  ObjectPool(): objects_() {}
+  ObjectPool()
+    : first_(NULL),
+      last_(NULL),
+      chunk_pos_(NULL),
+      chunk_end_(NULL),
+      next_chunk_size_(INITIAL_CHUNK_SIZE) {
+  }
 
   ~ObjectPool() {
-    for (ElementVector::iterator i = objects_.begin();
-         i != objects_.end(); ++i) {
-      delete *i;
+    for (GenericElement* e = first_; e != NULL;) {
+      GenericElement* next = e->next;
+      e->~GenericElement();
+      e = next;
+    }
+    for (int i = 0; i < chunks_.size(); ++i) {
+      free(chunks_[i].first);
     }
   }
 
+  // Registers 't', which was allocated with new, to be deleted with the pool.
   template <class T>
   T* Add(T* t) {
-    // Create the object to be pushed to the shared vector outside the critical section.
-    // TODO: Consider using a lock-free structure.
-    SpecificElement<T>* obj = new SpecificElement<T>(t);
     ScopedSpinLock l(&lock_);
-    objects_.push_back(obj);
+    // Deleting an object created with new (pool) would free memory that malloc() did
+    // not return.
+    DCHECK(!InChunksLocked(t)) << "Objects created with new (pool) need AddInPlace()";
+    Append(new (AllocateLocked(sizeof(SpecificElement<T>),
+        __alignof__(SpecificElement<T>))) SpecificElement<T>(t));
+    return t;
+  }
+
+  // Returns 'size' bytes of uninitialized memory that stay valid as long as the pool.
+  // The memory is aligned for any object of that size. Used by new (pool).
+  void* Allocate(size_t size) {
+    // The alignment of a type divides its size.
+    int alignment = size % MAX_ALIGNMENT == 0 ? MAX_ALIGNMENT : sizeof(void*);
+    ScopedSpinLock l(&lock_);
+    return AllocateLocked(size, alignment);
+  }
+
+  // Registers 't', which was constructed with new (pool), to be destroyed with the
+  // pool.
+  template <class T>
+  T* AddInPlace(T* t) {
+    ScopedSpinLock l(&lock_);
+    Append(new (AllocateLocked(sizeof(InPlaceElement<T>),
+        __alignof__(InPlaceElement<T>))) InPlaceElement<T>(t));
     return t;
   }
 
  private:
+  // Chunks grow from INITIAL_CHUNK_SIZE to MAX_CHUNK_SIZE bytes, so that pools with
+  // only a handful of objects stay small. With 64KB chunks, fragment-startup-benchmark
+  // showed no serial gain of AddInPlace() over Add(), which it does with 16KB chunks.
+  static const int INITIAL_CHUNK_SIZE = 1024;
+  static const int MAX_CHUNK_SIZE = 16 * 1024;
+
+  // Allocations larger than this get a chunk of their own.
+  static const int MAX_SMALL_ALLOCATION = MAX_CHUNK_SIZE / 4;
+
+  // The alignment of memory returned by malloc(), which is the largest alignment the
+  // pool supports.
+  static const int MAX_ALIGNMENT = 16;
+
   struct GenericElement {
+    GenericElement() : next(NULL) {}
     virtual ~GenericElement() {}
+
+    // The element added after this one.
+    GenericElement* next;
   };
 
   template <class T>
@@ -61,11 +124,88 @@ class ObjectPool {
     T* t;
   };
 
-  typedef std::vector<GenericElement*> ElementVector;
-  ElementVector objects_;
+  // Destroys an object constructed in the pool's memory without freeing that memory.
+  template <class T>
+  struct InPlaceElement : GenericElement {
+    InPlaceElement(T* t): t(t) {}
+    ~InPlaceElement() {
+      t->~T();
+    }
+
+    T* t;
+  };
+
+  void Append(GenericElement* e) {
+    if (last_ == NULL) {
+      first_ = e;
+    } else {
+      last_->next = e;
+    }
+    last_ = e;
+  }
+
+  // Must be called with lock_ held.
+  void* AllocateLocked(int size, int alignment) {
+    DCHECK_LE(alignment, MAX_ALIGNMENT);
+    if (size > MAX_SMALL_ALLOCATION) return AllocateChunk(size);
+    uint8_t* result = reinterpret_cast<uint8_t*>(
+        (reinterpret_cast<uintptr_t>(chunk_pos_) + alignment - 1) & ~(alignment - 1));
+    if (result == NULL || result + size > chunk_end_) {
+      int chunk_size = next_chunk_size_;
+      if (next_chunk_size_ < MAX_CHUNK_SIZE) next_chunk_size_ *= 2;
+      result = AllocateChunk(chunk_size);
+      chunk_end_ = result + chunk_size;
+    }
+    chunk_pos_ = result + size;
+    return result;
+  }
+
+  // Returns true if 'p' points into memory allocated by the pool. Must be called with
+  // lock_ held.
+  bool InChunksLocked(const void* p) const {
+    const uint8_t* ptr = reinterpret_cast<const uint8_t*>(p);
+    for (int i = 0; i < chunks_.size(); ++i) {
+      if (ptr >= chunks_[i].first && ptr < chunks_[i].first + chunks_[i].second) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  uint8_t* AllocateChunk(int size) {
+    uint8_t* chunk = reinterpret_cast<uint8_t*>(malloc(size));
+    if (chunk == NULL) throw std::bad_alloc();
+    chunks_.push_back(std::make_pair(chunk, size));
+    return chunk;
+  }
+
+  // Linked list of the elements, in the order they were added.
+  GenericElement* first_;
+  GenericElement* last_;
+
+  // All memory allocated by the pool, as (start, size) pairs.
+  std::vector<std::pair<uint8_t*, int> > chunks_;
+
+  // The unused part of the current chunk.
+  uint8_t* chunk_pos_;
+  uint8_t* chunk_end_;
+
+  int next_chunk_size_;
+
   SpinLock lock_;
 };
 
 }
 
+// Constructs an object in memory owned by 'pool'. The object must be registered with
+// pool->AddInPlace().
+inline void* operator new(size_t size, impala::ObjectPool* pool) {
+  return pool->Allocate(size);
+}
+
+// Only called if the constructor of an object created with new (pool) throws. The
+// memory is freed with the pool.
+inline void operator delete(void* p, impala::ObjectPool* pool) {
+}
+
 #endif
@@ -0,0 +1,154 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "exec/base-sequence-scanner.h"
+#include "util/cpu-info.h"
+
+using namespace std;
+
+namespace impala {
+
+static const int SYNC_LEN = 16;
+
+// Returns the offset past the first occurrence of 'sync' in 'buffer', or -1.
+static int FindSyncReference(const vector<uint8_t>& buffer, const vector<uint8_t>& sync) {
+  vector<uint8_t>::const_iterator it =
+      search(buffer.begin(), buffer.end(), sync.begin(), sync.end());
+  if (it == buffer.end()) return -1;
+  return it - buffer.begin() + sync.size();
+}
+
+static int FindSync(const vector<uint8_t>& buffer, const vector<uint8_t>& sync) {
+  return BaseSequenceScanner::FindSyncBlock(
+      buffer.empty() ? NULL : &buffer[0], buffer.size(), &sync[0], sync.size());
+}
+
+class FindSyncBlockTest : public testing::Test {
+ protected:
+  vector<uint8_t> sync_;
+
+  virtual void SetUp() {
+    srand(0);
+    for (int i = 0; i < SYNC_LEN; ++i) sync_.push_back(rand());
+  }
+
+  // Returns 'len' bytes that do not contain sync_.
+  vector<uint8_t> Filler(int len) {
+    vector<uint8_t> buffer;
+    for (int i = 0; i < len; ++i) buffer.push_back(rand());
+    EXPECT_EQ(-1, FindSyncReference(buffer, sync_));
+    return buffer;
+  }
+};
+
+// Syncs at every offset of buffers of various lengths, so they start and end at every
+// position relative to the 16-byte blocks that are searched at once, including syncs
+// that span two blocks and syncs at the very end of the buffer.
+TEST_F(FindSyncBlockTest, AllOffsets) {
+  for (int len = SYNC_LEN; len <= 5 * SYNC_LEN; ++len) {
+    for (int offset = 0; offset + SYNC_LEN <= len; ++offset) {
+      vector<uint8_t> buffer = Filler(len);
+      copy(sync_.begin(), sync_.end(), buffer.begin() + offset);
+      ASSERT_EQ(offset + SYNC_LEN, FindSync(buffer, sync_))
+          << "len=" << len << " offset=" << offset;
+    }
+  }
+}
+
+TEST_F(FindSyncBlockTest, SpansBlockBoundary) {
+  vector<uint8_t> buffer = Filler(64);
+  copy(sync_.begin(), sync_.end(), buffer.begin() + 9);
+  EXPECT_EQ(9 + SYNC_LEN, FindSync(buffer, sync_));
+}
+
+// A sync that ends at the last byte of the buffer is only found by the byte by byte
+// search after the last full block.
+TEST_F(FindSyncBlockTest, AtTail) {
+  for (int len = 2 * SYNC_LEN; len < 4 * SYNC_LEN; ++len) {
+    vector<uint8_t> buffer = Filler(len);
+    copy(sync_.begin(), sync_.end(), buffer.end() - SYNC_LEN);
+    EXPECT_EQ(len, FindSync(buffer, sync_)) << len;
+    // Truncating the buffer by a byte cuts off the sync.
+    buffer.pop_back();
+    EXPECT_EQ(-1, FindSync(buffer, sync_)) << len;
+  }
+}
+
+TEST_F(FindSyncBlockTest, NoMatch) {
+  EXPECT_EQ(-1, FindSync(vector<uint8_t>(), sync_));
+  EXPECT_EQ(-1, FindSync(vector<uint8_t>(sync_.begin(), sync_.end() - 1), sync_));
+  for (int len = 0; len < 5 * SYNC_LEN; ++len) {
+    EXPECT_EQ(-1, FindSync(Filler(len), sync_)) << len;
+  }
+
+  // Near misses that match the first and the last byte of the sync, which are the bytes
+  // the blocks are searched for, at every offset.
+  vector<uint8_t> near_miss = sync_;
+  near_miss[SYNC_LEN / 2] ^= 1;
+  for (int offset = 0; offset + SYNC_LEN <= 4 * SYNC_LEN; ++offset) {
+    vector<uint8_t> buffer = Filler(4 * SYNC_LEN);
+    copy(near_miss.begin(), near_miss.end(), buffer.begin() + offset);
+    EXPECT_EQ(-1, FindSync(buffer, sync_)) << offset;
+  }
+}
+
+// The first of several syncs is found, also when a near miss in the same block comes
+// first.
+TEST_F(FindSyncBlockTest, FirstMatch) {
+  vector<uint8_t> buffer = Filler(6 * SYNC_LEN);
+  vector<uint8_t> near_miss = sync_;
+  near_miss[1] ^= 1;
+  copy(near_miss.begin(), near_miss.end(), buffer.begin() + 3);
+  copy(sync_.begin(), sync_.end(), buffer.begin() + 5);
+  copy(sync_.begin(), sync_.end(), buffer.begin() + 40);
+  EXPECT_EQ(5 + SYNC_LEN, FindSync(buffer, sync_));
+}
+
+// Syncs with repeated bytes produce many candidates per block.
+TEST_F(FindSyncBlockTest, RepeatedBytes) {
+  vector<uint8_t> sync(SYNC_LEN, 'a');
+  vector<uint8_t> buffer(5 * SYNC_LEN, 'a');
+  EXPECT_EQ(SYNC_LEN, FindSync(buffer, sync));
+  for (int i = 0; i < 3 * SYNC_LEN; i += 7) buffer[i] = 'b';
+  EXPECT_EQ(FindSyncReference(buffer, sync), FindSync(buffer, sync));
+  sync[SYNC_LEN - 1] = 'b';
+  EXPECT_EQ(FindSyncReference(buffer, sync), FindSync(buffer, sync));
+}
+
+// Random buffers over a small alphabet, which contain many partial matches.
+TEST_F(FindSyncBlockTest, Random) {
+  for (int i = 0; i < 10000; ++i) {
+    int sync_len = 2 + rand() % (2 * SYNC_LEN);
+    vector<uint8_t> sync;
+    for (int j = 0; j < sync_len; ++j) sync.push_back('a' + rand() % 2);
+    vector<uint8_t> buffer;
+    int len = rand() % (8 * SYNC_LEN);
+    for (int j = 0; j < len; ++j) buffer.push_back('a' + rand() % 2);
+    ASSERT_EQ(FindSyncReference(buffer, sync), FindSync(buffer, sync));
+  }
+}
+
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  impala::CpuInfo::Init();
+  return RUN_ALL_TESTS();
+}
@@ -19,8 +19,8 @@
 #include "exec/hdfs-scan-node.h"
 #include "exec/scanner-context.inline.h"
 #include "runtime/runtime-state.h"
-#include "runtime/string-search.h"
 #include "util/codec.h"
+#include "util/sse-util.h"
 
 using namespace boost;
 using namespace impala;
@@ -193,20 +193,38 @@ Status BaseSequenceScanner::ReadSync() {
 
 int BaseSequenceScanner::FindSyncBlock(const uint8_t* buffer, int buffer_len,
                                        const uint8_t* sync, int sync_len) {
-  char* sync_str = reinterpret_cast<char*>(const_cast<uint8_t*>(sync));
-  StringValue needle = StringValue(sync_str, sync_len);
-
-  StringValue haystack(
-      const_cast<char*>(reinterpret_cast<const char*>(buffer)), buffer_len);
-
-  StringSearch search(&needle);
-  int offset = search.Search(&haystack);
-
-  if (offset != -1) {
-    // Advance offset past sync
-    offset += sync_len;
+  DCHECK_GE(sync_len, 2);
+  // Offset of the last position at which a sync could start.
+  int last_start = buffer_len - sync_len;
+  if (last_start < 0) return -1;
+
+  // Syncs are random bytes, so positions matching both the first and the last byte of
+  // the sync are rare. Check 16 start positions at a time for those two bytes and only
+  // compare the rest of the sync for the positions that match.
+  const __m128i first_byte = _mm_set1_epi8(sync[0]);
+  const __m128i last_byte = _mm_set1_epi8(sync[sync_len - 1]);
+  int offset = 0;
+  for (; offset + SSEUtil::CHARS_PER_128_BIT_REGISTER - 1 <= last_start;
+       offset += SSEUtil::CHARS_PER_128_BIT_REGISTER) {
+    const uint8_t* block = buffer + offset;
+    __m128i first_eq = _mm_cmpeq_epi8(first_byte,
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(block)));
+    __m128i last_eq = _mm_cmpeq_epi8(last_byte,
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + sync_len - 1)));
+    int candidates = _mm_movemask_epi8(_mm_and_si128(first_eq, last_eq));
+    while (candidates != 0) {
+      int i = __builtin_ctz(candidates);
+      if (memcmp(block + i + 1, sync + 1, sync_len - 2) == 0) {
+        // Return offset past sync
+        return offset + i + sync_len;
+      }
+      candidates &= candidates - 1;
+    }
+  }
+  for (; offset <= last_start; ++offset) {
+    if (memcmp(buffer + offset, sync, sync_len) == 0) return offset + sync_len;
   }
-  return offset;
+  return -1;
 }
 
 Status BaseSequenceScanner::SkipToSync(const uint8_t* sync, int sync_size) {
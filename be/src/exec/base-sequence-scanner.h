@@ -44,6 +44,12 @@ class BaseSequenceScanner : public HdfsScanner {
 
   virtual ~BaseSequenceScanner();
 
+  // Utility function to look for 'sync' in buffer.  Returns the offset into
+  // buffer of the _end_ of sync if it is found, otherwise, returns -1.
+  // Public for testing.
+  static int FindSyncBlock(const uint8_t* buffer, int buffer_len, const uint8_t* sync,
+                           int sync_len);
+
  protected:
   // Size of the sync hash field.
   const static int SYNC_HASH_SIZE = 16;
@@ -161,11 +167,6 @@ class BaseSequenceScanner : public HdfsScanner {
   // block.
   int ReadPastSize(int64_t file_offset);
 
-  // Utility function to look for 'sync' in buffer.  Returns the offset into
-  // buffer of the _end_ of sync if it is found, otherwise, returns -1.
-  int FindSyncBlock(const uint8_t* buffer, int buffer_len, const uint8_t* sync,
-                    int sync_len);
-
   // Close skipped ranges for 'file'.  This is only called when processing
   // the header range and the header had an issue.
   void CloseFileRanges(const char* file);
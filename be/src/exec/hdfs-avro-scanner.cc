@@ -321,10 +321,10 @@ Status HdfsAvroScanner::ResolveSchemas(const avro_schema_t& table_schema,
     }
     RETURN_IF_ERROR(VerifyTypesMatch(slot_desc, default_value));
 
-    if (avro_header_->template_tuple == NULL) {
-      avro_header_->template_tuple =
-          template_tuple_ != NULL ?
-          template_tuple_ : scan_node_->InitEmptyTemplateTuple();
+    if (avro_header_->template_tuple == template_tuple_) {
+      // The template tuple from the scan node is shared by all scanners of the
+      // partition, so write the default values into a copy.
+      avro_header_->template_tuple = scan_node_->CopyTemplateTuple(template_tuple_);
     }
 
     switch(default_value->type) {
@@ -494,7 +494,12 @@ Status HdfsAvroScanner::InitNewRange() {
   DCHECK(header_ != NULL);
   only_parsing_header_ = false;
   avro_header_ = reinterpret_cast<AvroFileHeader*>(header_);
-  template_tuple_ = avro_header_->template_tuple;
+  if (avro_header_->template_tuple != template_tuple_) {
+    // The file's template tuple holds default values in non-partition key slots, so
+    // copy all of it into each tuple.
+    template_tuple_ = avro_header_->template_tuple;
+    template_tuple_copy_len_ = tuple_byte_size_;
+  }
   if (header_->is_compressed) {
     RETURN_IF_ERROR(UpdateDecompressor(header_->compression_type));
   }
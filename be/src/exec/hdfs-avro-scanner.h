@@ -179,7 +179,7 @@ class HdfsAvroScanner : public BaseSequenceScanner {
 
   // Populates avro_header_->schema with the result of resolving the the table's schema
   // with the file's schema. Default values are written to avro_header_->template_tuple
-  // (which is initialized to template_tuple_ if necessary).
+  // (which is initialized to a copy of template_tuple_ if necessary).
   Status ResolveSchemas(const avro_schema_t& table_root,
                         const avro_schema_t& file_root);
 
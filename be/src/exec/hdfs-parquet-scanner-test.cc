@@ -0,0 +1,732 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include "codegen/llvm-codegen.h"
+#include "common/init.h"
+#include "exec/hdfs-parquet-scanner.h"
+#include "exec/hdfs-parquet-table-writer.h"
+#include "exec/hdfs-scan-node.h"
+#include "rpc/thrift-util.h"
+#include "runtime/timestamp-value.h"
+#include "service/fe-support.h"
+#include "service/impala-server.h"
+#include "testutil/impalad-query-executor.h"
+#include "testutil/in-process-servers.h"
+#include "testutil/test-catalog-service.h"
+#include "testutil/test-table.h"
+#include "udf/udf.h"
+#include "util/test-info.h"
+#include "util/time.h"
+
+DECLARE_int32(be_port);
+DECLARE_int32(beeswax_port);
+DECLARE_string(impalad);
+DECLARE_bool(abort_on_config_error);
+DECLARE_int32(parquet_num_rows_cache_size);
+DECLARE_int32(max_row_batches);
+DECLARE_string(parquet_bloom_filter_columns);
+
+using namespace impala_udf;
+using namespace std;
+
+namespace impala {
+
+// Queries run through an in-process impalad, over tables in TEST_DIR whose parquet files
+// are written by inserts.
+static ImpaladQueryExecutor* executor_;
+static const string TEST_DIR = "/tmp/hdfs-parquet-scanner-test";
+
+// Runs 'stmt' and returns its rows in sorted order in 'rows' and its profile in
+// 'profile', if not NULL.
+static void RunQuery(const string& stmt, vector<string>* rows, string* profile = NULL) {
+  rows->clear();
+  Status status = executor_->Exec(stmt, NULL);
+  ASSERT_TRUE(status.ok()) << stmt << "\n" << status.GetDetail();
+  status = executor_->FetchAll(rows);
+  ASSERT_TRUE(status.ok()) << stmt << "\n" << status.GetDetail();
+  sort(rows->begin(), rows->end());
+  if (profile == NULL) return;
+  status = executor_->GetRuntimeProfile(profile);
+  ASSERT_TRUE(status.ok()) << stmt << "\n" << status.GetDetail();
+}
+
+// Writes 'contents' to 'path', replacing the file if it exists.
+static void WriteFile(const string& path, const string& contents) {
+  FILE* file = fopen(path.c_str(), "w");
+  ASSERT_TRUE(file != NULL) << path;
+  ASSERT_EQ(contents.size(), fwrite(contents.data(), 1, contents.size(), file));
+  ASSERT_EQ(0, fclose(file));
+}
+
+// Returns a file descriptor for the local file 'path' with its current length and
+// modification time, as HdfsParquetScanner::IssueInitialRanges() sets them up.
+static HdfsFileDesc StatFile(const string& path) {
+  HdfsFileDesc desc(path);
+  struct stat info;
+  EXPECT_EQ(0, stat(path.c_str(), &info));
+  desc.file_length = info.st_size;
+  desc.mtime = info.st_mtime;
+  return desc;
+}
+
+class ParquetNumRowsCacheTest : public testing::Test {
+ protected:
+  virtual void SetUp() { FLAGS_parquet_num_rows_cache_size = 10; }
+  virtual void TearDown() { FLAGS_parquet_num_rows_cache_size = 0; }
+
+  static bool GetCachedNumRows(const HdfsFileDesc& file, int64_t* num_rows) {
+    return HdfsParquetScanner::GetCachedNumRows(file, num_rows);
+  }
+
+  static void CacheNumRows(const HdfsFileDesc& file, int64_t num_rows) {
+    HdfsParquetScanner::CacheNumRows(file, num_rows);
+  }
+};
+
+TEST_F(ParquetNumRowsCacheTest, Basic) {
+  HdfsFileDesc desc("/test/basic.parq");
+  desc.file_length = 1000;
+  desc.mtime = 1;
+  int64_t num_rows;
+  EXPECT_FALSE(GetCachedNumRows(desc, &num_rows));
+  CacheNumRows(desc, 42);
+  EXPECT_TRUE(GetCachedNumRows(desc, &num_rows));
+  EXPECT_EQ(42, num_rows);
+
+  // Any difference in name, length or modification time is a miss.
+  HdfsFileDesc other = desc;
+  other.filename = "/test/other.parq";
+  EXPECT_FALSE(GetCachedNumRows(other, &num_rows));
+  other = desc;
+  other.file_length = 1001;
+  EXPECT_FALSE(GetCachedNumRows(other, &num_rows));
+  other = desc;
+  other.mtime = 2;
+  EXPECT_FALSE(GetCachedNumRows(other, &num_rows));
+}
+
+// Files without a known modification time are not cached.
+TEST_F(ParquetNumRowsCacheTest, UnknownMtime) {
+  HdfsFileDesc desc("/test/unknown-mtime.parq");
+  desc.file_length = 1000;
+  ASSERT_EQ(-1, desc.mtime);
+  CacheNumRows(desc, 42);
+  int64_t num_rows;
+  EXPECT_FALSE(GetCachedNumRows(desc, &num_rows));
+}
+
+// A size of 0, the default, disables the cache.
+TEST_F(ParquetNumRowsCacheTest, Disabled) {
+  FLAGS_parquet_num_rows_cache_size = 0;
+  HdfsFileDesc desc("/test/disabled.parq");
+  desc.file_length = 1000;
+  desc.mtime = 1;
+  CacheNumRows(desc, 42);
+  int64_t num_rows;
+  EXPECT_FALSE(GetCachedNumRows(desc, &num_rows));
+}
+
+// A file that is overwritten in place with the same length is not answered from the
+// entry of the old file.
+TEST_F(ParquetNumRowsCacheTest, RewrittenFile) {
+  char path[] = "/tmp/parquet-num-rows-cache-test-XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  WriteFile(path, "old file");
+  HdfsFileDesc old_desc = StatFile(path);
+  CacheNumRows(old_desc, 100);
+
+  // Modification times have a granularity of one second.
+  SleepForMs(1100);
+  WriteFile(path, "new file");
+  HdfsFileDesc new_desc = StatFile(path);
+  ASSERT_EQ(old_desc.file_length, new_desc.file_length);
+  int64_t num_rows;
+  EXPECT_FALSE(GetCachedNumRows(new_desc, &num_rows));
+  CacheNumRows(new_desc, 200);
+  EXPECT_TRUE(GetCachedNumRows(new_desc, &num_rows));
+  EXPECT_EQ(200, num_rows);
+  unlink(path);
+}
+
+// The oldest entries are evicted first.
+TEST_F(ParquetNumRowsCacheTest, Eviction) {
+  vector<HdfsFileDesc> descs;
+  for (int i = 0; i < 2 * FLAGS_parquet_num_rows_cache_size; ++i) {
+    HdfsFileDesc desc("/test/eviction.parq");
+    desc.file_length = 1000;
+    desc.mtime = i;
+    descs.push_back(desc);
+    CacheNumRows(desc, i);
+  }
+  int64_t num_rows;
+  EXPECT_FALSE(GetCachedNumRows(descs.front(), &num_rows));
+  EXPECT_TRUE(GetCachedNumRows(descs.back(), &num_rows));
+  EXPECT_EQ(static_cast<int64_t>(descs.size()) - 1, num_rows);
+}
+
+// Scans that don't materialize any file column are answered from the row counts of the
+// files' footers once those are cached: count(*), also with a predicate on the
+// partition key, and queries that only reference partition keys.
+TEST_F(ParquetNumRowsCacheTest, ColumnlessScans) {
+  FLAGS_parquet_num_rows_cache_size = 100;
+  TestTable table("num_rows_tbl", TEST_DIR + "/num_rows_tbl", THdfsFileFormat::PARQUET);
+  table.AddColumn("i", TYPE_INT);
+  table.AddPartitionColumn("p", TYPE_INT);
+  ASSERT_TRUE(table.Create().ok());
+  ASSERT_TRUE(table.Update().ok());
+  // Three inserts, each of which writes a file to both partitions. The k-th insert
+  // writes k rows to p=1 and 2 * k rows to p=2.
+  vector<string> rows;
+  for (int k = 1; k <= 3; ++k) {
+    stringstream insert;
+    insert << "insert into num_rows_tbl partition (p) values ";
+    for (int r = 0; r < 3 * k; ++r) {
+      insert << (r > 0 ? ", " : "") << "(" << r << ", " << (r < k ? 1 : 2) << ")";
+    }
+    RunQuery(insert.str(), &rows);
+  }
+
+  const string count_star = "select count(*) from num_rows_tbl";
+  string profile;
+  // The first scan reads the footers.
+  RunQuery(count_star, &rows, &profile);
+  ASSERT_EQ(1, rows.size());
+  EXPECT_EQ("18", rows[0]);
+  RunQuery(count_star, &rows, &profile);
+  ASSERT_EQ(1, rows.size());
+  EXPECT_EQ("18", rows[0]);
+  EXPECT_EQ(6,
+      ImpaladQueryExecutor::GetCounterValue(profile, "NumFilesAnsweredFromMetadata"))
+      << profile;
+
+  RunQuery(count_star + " where p = 2", &rows, &profile);
+  ASSERT_EQ(1, rows.size());
+  EXPECT_EQ("12", rows[0]);
+  EXPECT_EQ(3,
+      ImpaladQueryExecutor::GetCounterValue(profile, "NumFilesAnsweredFromMetadata"));
+
+  // Only partition keys.
+  RunQuery("select p, count(*), min(p), max(p) from num_rows_tbl group by p", &rows,
+      &profile);
+  ASSERT_EQ(2, rows.size());
+  EXPECT_EQ("1\t6\t1\t1", rows[0]);
+  EXPECT_EQ("2\t12\t2\t2", rows[1]);
+  EXPECT_EQ(6,
+      ImpaladQueryExecutor::GetCounterValue(profile, "NumFilesAnsweredFromMetadata"));
+
+  // A file column is read from the files.
+  RunQuery(count_star + " where i > 0", &rows, &profile);
+  ASSERT_EQ(1, rows.size());
+  EXPECT_EQ("15", rows[0]);
+  EXPECT_EQ(0,
+      ImpaladQueryExecutor::GetCounterValue(profile, "NumFilesAnsweredFromMetadata"));
+
+  // A new file is read, the others are still answered from the cache.
+  RunQuery("insert into num_rows_tbl partition (p = 1) values (100)", &rows);
+  RunQuery(count_star, &rows, &profile);
+  ASSERT_EQ(1, rows.size());
+  EXPECT_EQ("19", rows[0]);
+  EXPECT_EQ(6,
+      ImpaladQueryExecutor::GetCounterValue(profile, "NumFilesAnsweredFromMetadata"));
+}
+
+// Files written before a column was added to the table lack it, so their scanners NULL
+// it in a copy of the partition's template tuple. Files of both partitions, with and
+// without the column, are scanned together; the copies must not leak into the shared
+// template tuples.
+TEST(ParquetTemplateTupleTest, MissingColumns) {
+  TestTable table("evolved_tbl", TEST_DIR + "/evolved_tbl", THdfsFileFormat::PARQUET);
+  table.AddColumn("i", TYPE_INT);
+  table.AddPartitionColumn("p", TYPE_INT);
+  ASSERT_TRUE(table.Create().ok());
+  ASSERT_TRUE(table.Update().ok());
+  // Rows have i / 1000 = p. Rows of the new files have j = i.
+  const int NUM_FILES = 4;
+  vector<string> rows, expected_rows;
+  for (int file = 0; file < NUM_FILES; ++file) {
+    if (file == NUM_FILES / 2) {
+      table.AddColumn("j", TYPE_INT);
+      ASSERT_TRUE(table.Update().ok());
+    }
+    bool has_j = file >= NUM_FILES / 2;
+    for (int p = 1; p <= 2; ++p) {
+      stringstream insert;
+      insert << "insert into evolved_tbl partition (p = " << p << ") values ";
+      for (int r = 0; r < 3; ++r) {
+        int i = p * 1000 + file * 10 + r;
+        insert << (r > 0 ? ", " : "") << "(" << i;
+        if (has_j) insert << ", " << i;
+        insert << ")";
+        stringstream expected_row;
+        expected_row << p << "\t" << i << "\t";
+        if (has_j) {
+          expected_row << i;
+        } else {
+          expected_row << "NULL";
+        }
+        expected_rows.push_back(expected_row.str());
+      }
+      RunQuery(insert.str(), &rows);
+    }
+  }
+  sort(expected_rows.begin(), expected_rows.end());
+
+  vector<string> options;
+  options.push_back("NUM_SCANNER_THREADS=2");
+  executor_->setExecOptions(options);
+  RunQuery("select p, i, j from evolved_tbl", &rows);
+  executor_->setExecOptions(vector<string>());
+  EXPECT_EQ(expected_rows, rows);
+}
+
+class ParquetSplitRowGroupsTest : public testing::Test {
+ protected:
+  static int GetSplitRowGroup(int row_group, int end_row_group) {
+    return HdfsParquetScanner::GetSplitRowGroup(row_group, end_row_group);
+  }
+
+  // Writes the row groups of the parquet files in 'src_dir' as the row groups of the
+  // single file 'path', the way parquet-mr lays out large files. HdfsParquetTableWriter
+  // starts a new file rather than a new row group.
+  static void MergeFiles(const string& src_dir, const string& path) {
+    parquet::FileMetaData merged;
+    string data(reinterpret_cast<const char*>(PARQUET_VERSION_NUMBER),
+        sizeof(PARQUET_VERSION_NUMBER));
+    boost::filesystem::directory_iterator it(src_dir), end;
+    for (; it != end; ++it) {
+      string name = it->path().filename().string();
+      if (name[0] == '.' || name[0] == '_') continue;
+      ifstream file(it->path().string().c_str(), ios::binary);
+      string contents((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+      ASSERT_GT(contents.size(), 2 * sizeof(PARQUET_VERSION_NUMBER) + sizeof(uint32_t));
+      // The footer is the metadata, its length and the magic number.
+      uint32_t metadata_len;
+      memcpy(&metadata_len,
+          &contents[contents.size() - sizeof(PARQUET_VERSION_NUMBER) - sizeof(uint32_t)],
+          sizeof(uint32_t));
+      int64_t metadata_start = contents.size() - sizeof(PARQUET_VERSION_NUMBER) -
+          sizeof(uint32_t) - metadata_len;
+      parquet::FileMetaData metadata;
+      Status status = DeserializeThriftMsg(
+          reinterpret_cast<const uint8_t*>(&contents[metadata_start]), &metadata_len,
+          true, &metadata);
+      ASSERT_TRUE(status.ok()) << status.GetDetail();
+      // The pages move from after the file's magic number to the end of 'data'.
+      int64_t shift = data.size() - sizeof(PARQUET_VERSION_NUMBER);
+      for (int i = 0; i < metadata.row_groups.size(); ++i) {
+        vector<parquet::ColumnChunk>& columns = metadata.row_groups[i].columns;
+        for (int j = 0; j < columns.size(); ++j) {
+          columns[j].file_offset += shift;
+          columns[j].meta_data.data_page_offset += shift;
+          if (columns[j].meta_data.__isset.dictionary_page_offset) {
+            columns[j].meta_data.dictionary_page_offset += shift;
+          }
+        }
+      }
+      data.append(contents, sizeof(PARQUET_VERSION_NUMBER),
+          metadata_start - sizeof(PARQUET_VERSION_NUMBER));
+      if (merged.row_groups.empty()) {
+        merged = metadata;
+      } else {
+        merged.row_groups.insert(merged.row_groups.end(), metadata.row_groups.begin(),
+            metadata.row_groups.end());
+        merged.num_rows += metadata.num_rows;
+      }
+    }
+    ThriftSerializer serializer(true);
+    string metadata;
+    Status status = serializer.Serialize(&merged, &metadata);
+    ASSERT_TRUE(status.ok()) << status.GetDetail();
+    uint32_t metadata_len = metadata.size();
+    data.append(metadata);
+    data.append(reinterpret_cast<const char*>(&metadata_len), sizeof(uint32_t));
+    data.append(reinterpret_cast<const char*>(PARQUET_VERSION_NUMBER),
+        sizeof(PARQUET_VERSION_NUMBER));
+    WriteFile(path, data);
+  }
+};
+
+TEST_F(ParquetSplitRowGroupsTest, GetSplitRowGroup) {
+  // The second half of the remaining row groups is split off.
+  EXPECT_EQ(1, GetSplitRowGroup(0, 2));
+  EXPECT_EQ(2, GetSplitRowGroup(0, 3));
+  EXPECT_EQ(5, GetSplitRowGroup(2, 8));
+  // A single row group is not split.
+  EXPECT_EQ(1, GetSplitRowGroup(0, 1));
+  EXPECT_EQ(7, GetSplitRowGroup(6, 7));
+}
+
+// Simulates the tail of a scan, where every scanner splits off row groups before
+// processing each row group, and checks that every row group is processed exactly once.
+TEST_F(ParquetSplitRowGroupsTest, AllRowGroupsProcessed) {
+  for (int num_row_groups = 1; num_row_groups <= 20; ++num_row_groups) {
+    // The ranges to process, as [first_row_group, end_row_group).
+    vector<pair<int, int> > ranges(1, make_pair(0, num_row_groups));
+    vector<int> num_processed(num_row_groups, 0);
+    for (int r = 0; r < ranges.size(); ++r) {
+      int end_row_group = ranges[r].second;
+      for (int i = ranges[r].first; i < end_row_group; ++i) {
+        int split_row_group = GetSplitRowGroup(i, end_row_group);
+        EXPECT_GT(split_row_group, i);
+        if (split_row_group < end_row_group) {
+          ranges.push_back(make_pair(split_row_group, end_row_group));
+          end_row_group = split_row_group;
+        }
+        ++num_processed[i];
+      }
+    }
+    for (int i = 0; i < num_row_groups; ++i) {
+      EXPECT_EQ(1, num_processed[i]) << num_row_groups << " row groups, row group " << i;
+    }
+    EXPECT_LE(ranges.size(), num_row_groups);
+    if (num_row_groups > 1) EXPECT_GT(ranges.size(), 1);
+  }
+}
+
+// A file with many row groups is shared with the scanner thread that finished the
+// other, small file of the table. Every row is still returned exactly once.
+TEST_F(ParquetSplitRowGroupsTest, SplitRowGroupsOfLargeFile) {
+  const int NUM_ROW_GROUPS = 16;
+  const int ROWS_PER_ROW_GROUP = 1000;
+  TestTable src_table("row_groups_src", TEST_DIR + "/row_groups_src",
+      THdfsFileFormat::PARQUET);
+  src_table.AddColumn("i", TYPE_INT);
+  ASSERT_TRUE(src_table.Create().ok());
+  ASSERT_TRUE(src_table.Update().ok());
+  vector<string> rows;
+  for (int k = 0; k < NUM_ROW_GROUPS; ++k) {
+    stringstream insert;
+    insert << "insert into row_groups_src values ";
+    for (int r = 0; r < ROWS_PER_ROW_GROUP; ++r) {
+      insert << (r > 0 ? ", " : "") << "(" << k * ROWS_PER_ROW_GROUP + r << ")";
+    }
+    RunQuery(insert.str(), &rows);
+  }
+
+  TestTable table("row_groups_tbl", TEST_DIR + "/row_groups_tbl",
+      THdfsFileFormat::PARQUET);
+  table.AddColumn("i", TYPE_INT);
+  ASSERT_TRUE(table.Create().ok());
+  MergeFiles(src_table.dir(), table.dir() + "/row_groups.parq");
+  ASSERT_TRUE(table.Update().ok());
+  // The small file.
+  const int num_rows = NUM_ROW_GROUPS * ROWS_PER_ROW_GROUP + 1;
+  stringstream insert;
+  insert << "insert into row_groups_tbl values (" << num_rows - 1 << ")";
+  RunQuery(insert.str(), &rows);
+
+  // The consumer sleeps for every 500th row, so that the large file is still being
+  // scanned once the small one is done.
+  FLAGS_max_row_batches = 2;
+  vector<string> options;
+  options.push_back("NUM_SCANNER_THREADS=2");
+  executor_->setExecOptions(options);
+  string profile;
+  RunQuery("select count(*), sum(i), count(if(i % 500 = 0, sleep(5), NULL)) "
+      "from row_groups_tbl", &rows, &profile);
+  executor_->setExecOptions(vector<string>());
+  FLAGS_max_row_batches = 0;
+
+  stringstream expected_row;
+  expected_row << num_rows << "\t" << static_cast<int64_t>(num_rows) * (num_rows - 1) / 2
+               << "\t" << (num_rows + 499) / 500;
+  ASSERT_EQ(1, rows.size());
+  EXPECT_EQ(expected_row.str(), rows[0]);
+  EXPECT_GT(ImpaladQueryExecutor::GetCounterValue(profile, "ScanRangesSplit"), 0)
+      << profile;
+}
+
+// Round trip of column chunk Bloom filters: filters are built and written the way
+// HdfsParquetTableWriter does, then located and probed the way HdfsParquetScanner does
+// before it reads a row group.
+class ParquetBloomFilterTest : public testing::Test {
+ protected:
+  // Size of the filters before they are folded, --parquet_bloom_filter_max_bytes.
+  static const int FILTER_BYTES = 1024 * 1024;
+
+  // Contents of the file being written.
+  vector<uint8_t> file_;
+
+  static int64_t FinalizeBloomFilter(BlockBloomFilter* filter, int64_t file_pos,
+      parquet::KeyValue* location) {
+    return HdfsParquetTableWriter::FinalizeBloomFilter(filter, file_pos, location);
+  }
+
+  static bool GetBloomFilterHash(const ColumnType& type, const AnyVal* val,
+      uint64_t* hash) {
+    return HdfsParquetScanner::GetBloomFilterHash(type, val, hash);
+  }
+
+  static bool ParseBloomFilterLocation(const string& location, int64_t file_length,
+      int64_t* offset, int64_t* len) {
+    return HdfsParquetScanner::ParseBloomFilterLocation(location, file_length, offset,
+        len);
+  }
+
+  static bool BloomFilterMayContain(uint8_t* directory, int64_t len,
+      const vector<uint64_t>& hashes) {
+    return HdfsParquetScanner::BloomFilterMayContain(directory, len, hashes);
+  }
+
+  // Returns true if the scanner accepts 'location' in a file of 1000 bytes.
+  static bool ParseLocation(const string& location) {
+    int64_t offset, len;
+    return ParseBloomFilterLocation(location, 1000, &offset, &len);
+  }
+
+  // Writes a Bloom filter over 'values' of a column of 'type' to the end of file_, as
+  // the writer does after the data pages of a column chunk. Returns the key value
+  // metadata entry of the column chunk.
+  template <typename T>
+  parquet::KeyValue WriteFilter(const ColumnType& type, const vector<T>& values) {
+    vector<uint8_t> directory(FILTER_BYTES, 0);
+    BlockBloomFilter filter(&directory[0], directory.size());
+    // The writer hashes values with the size it encodes them with.
+    int encoded_size = ParquetPlainEncoder::ByteSize(type);
+    for (int i = 0; i < values.size(); ++i) {
+      filter.Insert(ParquetBloomFilterHash(values[i], encoded_size));
+    }
+    parquet::KeyValue location;
+    int64_t len = FinalizeBloomFilter(&filter, file_.size(), &location);
+    EXPECT_GT(len, 0);
+    EXPECT_LT(len, FILTER_BYTES);
+    file_.insert(file_.end(), directory.begin(), directory.begin() + len);
+    // Stands in for the data pages of the next column chunk.
+    file_.insert(file_.end(), 100, 0xff);
+    return location;
+  }
+
+  // Returns false if the scanner skips the row group whose filter is at 'location' for
+  // a predicate on a column of 'type' that matches the constants 'vals'.
+  bool MayContain(const parquet::KeyValue& location, const ColumnType& type,
+      const vector<const AnyVal*>& vals) {
+    EXPECT_EQ(PARQUET_BLOOM_FILTER_KEY, location.key);
+    int64_t offset, len;
+    if (!ParseBloomFilterLocation(location.value, file_.size(), &offset, &len)) {
+      ADD_FAILURE() << location.value;
+      return true;
+    }
+    vector<uint8_t> directory(file_.begin() + offset, file_.begin() + offset + len);
+    vector<uint64_t> hashes;
+    for (int i = 0; i < vals.size(); ++i) {
+      uint64_t hash;
+      if (GetBloomFilterHash(type, vals[i], &hash)) {
+        hashes.push_back(hash);
+      }
+    }
+    return BloomFilterMayContain(&directory[0], len, hashes);
+  }
+
+  bool MayContain(const parquet::KeyValue& location, const ColumnType& type,
+      const AnyVal& val) {
+    return MayContain(location, type, vector<const AnyVal*>(1, &val));
+  }
+};
+
+// Two row groups with disjoint values: every value is found in its own row group, and
+// the other row group is skipped for almost all of them.
+TEST_F(ParquetBloomFilterTest, Int) {
+  const int NUM_VALUES = 5000;
+  vector<int32_t> values[2];
+  for (int i = 0; i < NUM_VALUES; ++i) {
+    values[0].push_back(i);
+    values[1].push_back(NUM_VALUES + i);
+  }
+  ColumnType type(TYPE_INT);
+  parquet::KeyValue locations[2];
+  locations[0] = WriteFilter(type, values[0]);
+  locations[1] = WriteFilter(type, values[1]);
+
+  int num_false_positives = 0;
+  for (int rg = 0; rg < 2; ++rg) {
+    for (int i = 0; i < NUM_VALUES; ++i) {
+      EXPECT_TRUE(MayContain(locations[rg], type, IntVal(values[rg][i])));
+      if (MayContain(locations[1 - rg], type, IntVal(values[rg][i]))) {
+        ++num_false_positives;
+      }
+    }
+  }
+  EXPECT_LT(num_false_positives, 2 * NUM_VALUES / 100);
+
+  // IN lists are skipped only if none of the values can be in the row group.
+  IntVal absent(-1);
+  IntVal present(10);
+  vector<const AnyVal*> in_list;
+  in_list.push_back(&absent);
+  in_list.push_back(&present);
+  EXPECT_TRUE(MayContain(locations[0], type, in_list));
+  // 'col = NULL' and 'col IN (NULL)' match no rows.
+  EXPECT_FALSE(MayContain(locations[0], type, IntVal::null()));
+}
+
+// Strings, decimals and timestamps are hashed from the writer's encoding of the values
+// and from the scanner's representation of the constants, which have to agree.
+TEST_F(ParquetBloomFilterTest, OtherTypes) {
+  const int NUM_VALUES = 1000;
+  vector<string> strings;
+  vector<StringValue> string_values;
+  vector<Decimal8Value> decimals;
+  vector<TimestampValue> timestamps;
+  for (int i = 0; i < NUM_VALUES; ++i) {
+    stringstream ss;
+    ss << "value-" << i;
+    strings.push_back(ss.str());
+    decimals.push_back(Decimal8Value(i * 1000000007LL));
+    timestamps.push_back(TimestampValue(1400000000.0 + i * 3600.5));
+  }
+  for (int i = 0; i < NUM_VALUES; ++i) {
+    string_values.push_back(StringValue(strings[i]));
+  }
+  ColumnType string_type(TYPE_STRING);
+  ColumnType decimal_type = ColumnType::CreateDecimalType(11, 2);
+  ColumnType timestamp_type(TYPE_TIMESTAMP);
+  parquet::KeyValue string_location = WriteFilter(string_type, string_values);
+  parquet::KeyValue decimal_location = WriteFilter(decimal_type, decimals);
+  parquet::KeyValue timestamp_location = WriteFilter(timestamp_type, timestamps);
+
+  int num_false_positives = 0;
+  for (int i = 0; i < NUM_VALUES; ++i) {
+    StringVal string_val(strings[i].c_str());
+    EXPECT_TRUE(MayContain(string_location, string_type, string_val));
+    DecimalVal decimal_val(decimals[i].value());
+    EXPECT_TRUE(MayContain(decimal_location, decimal_type, decimal_val));
+    TimestampVal timestamp_val;
+    timestamps[i].ToTimestampVal(&timestamp_val);
+    EXPECT_TRUE(MayContain(timestamp_location, timestamp_type, timestamp_val));
+
+    string absent = strings[i] + "-absent";
+    if (MayContain(string_location, string_type, StringVal(absent.c_str()))) {
+      ++num_false_positives;
+    }
+    if (MayContain(decimal_location, decimal_type, DecimalVal(decimals[i].value() + 1))) {
+      ++num_false_positives;
+    }
+    TimestampVal absent_timestamp_val;
+    TimestampValue(1400000000.0 + i * 3600.5 + 1).ToTimestampVal(&absent_timestamp_val);
+    if (MayContain(timestamp_location, timestamp_type, absent_timestamp_val)) {
+      ++num_false_positives;
+    }
+  }
+  EXPECT_LT(num_false_positives, 3 * NUM_VALUES / 100);
+}
+
+// Locations that the scanner rejects as corrupt metadata.
+TEST_F(ParquetBloomFilterTest, InvalidLocation) {
+  int64_t offset, len;
+  EXPECT_TRUE(ParseBloomFilterLocation("100:64", 1000, &offset, &len));
+  EXPECT_EQ(100, offset);
+  EXPECT_EQ(64, len);
+  EXPECT_FALSE(ParseLocation(""));
+  EXPECT_FALSE(ParseLocation("100"));
+  EXPECT_FALSE(ParseLocation("x:64"));
+  EXPECT_FALSE(ParseLocation("-1:64"));
+  // Not a power of two, or smaller than a block.
+  EXPECT_FALSE(ParseLocation("100:48"));
+  EXPECT_FALSE(ParseLocation("100:16"));
+  // Past the end of the file.
+  EXPECT_FALSE(ParseLocation("960:64"));
+}
+
+// Inserts write Bloom filters for the selected columns, which point lookups use to skip
+// the row groups of the other files.
+TEST_F(ParquetBloomFilterTest, PointLookups) {
+  TestTable table("bloom_tbl", TEST_DIR + "/bloom_tbl", THdfsFileFormat::PARQUET);
+  table.AddColumn("i", TYPE_INT);
+  table.AddColumn("s", TYPE_STRING);
+  ASSERT_TRUE(table.Create().ok());
+  ASSERT_TRUE(table.Update().ok());
+  // Each insert writes a file with a single row group of disjoint values.
+  const int NUM_FILES = 4;
+  const int ROWS_PER_FILE = 500;
+  FLAGS_parquet_bloom_filter_columns = "i, default.bloom_tbl.s";
+  vector<string> rows;
+  for (int k = 0; k < NUM_FILES; ++k) {
+    stringstream insert;
+    insert << "insert into bloom_tbl values ";
+    for (int r = 0; r < ROWS_PER_FILE; ++r) {
+      int i = k * ROWS_PER_FILE + r;
+      insert << (r > 0 ? ", " : "") << "(" << i << ", 'v" << i << "')";
+    }
+    RunQuery(insert.str(), &rows);
+  }
+  FLAGS_parquet_bloom_filter_columns = "";
+
+  string profile;
+  RunQuery("select i, s from bloom_tbl where i = 1234", &rows, &profile);
+  ASSERT_EQ(1, rows.size());
+  EXPECT_EQ("1234\tv1234", rows[0]);
+  EXPECT_GT(ImpaladQueryExecutor::GetCounterValue(profile,
+      "NumRowGroupsSkippedByBloomFilter"), 0) << profile;
+
+  RunQuery("select i, s from bloom_tbl where s in ('v17', 'v1999')", &rows, &profile);
+  ASSERT_EQ(2, rows.size());
+  EXPECT_EQ("17\tv17", rows[0]);
+  EXPECT_EQ("1999\tv1999", rows[1]);
+  EXPECT_GT(ImpaladQueryExecutor::GetCounterValue(profile,
+      "NumRowGroupsSkippedByBloomFilter"), 0) << profile;
+
+  // No row group can contain a value that was never inserted.
+  RunQuery("select i from bloom_tbl where i = -1", &rows, &profile);
+  EXPECT_EQ(0, rows.size());
+  EXPECT_GT(ImpaladQueryExecutor::GetCounterValue(profile,
+      "NumRowGroupsSkippedByBloomFilter"), 0) << profile;
+
+  // A predicate on an expression of the column cannot use the filters.
+  RunQuery("select count(*) from bloom_tbl where i + 1 = 1235", &rows, &profile);
+  ASSERT_EQ(1, rows.size());
+  EXPECT_EQ("1", rows[0]);
+  EXPECT_EQ(0, ImpaladQueryExecutor::GetCounterValue(profile,
+      "NumRowGroupsSkippedByBloomFilter")) << profile;
+}
+
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  InitCommonRuntime(argc, argv, true, TestInfo::BE_TEST);
+  InitFeSupport();
+  LlvmCodeGen::InitializeLlvm();
+
+  FLAGS_impalad = "localhost:21000";
+  FLAGS_abort_on_config_error = false;
+  InProcessImpalaServer* impala_server =
+      new InProcessImpalaServer("localhost", FLAGS_be_port, 0, 0, "", 0);
+  EXIT_IF_ERROR(
+      impala_server->StartWithClientServers(FLAGS_beeswax_port, FLAGS_beeswax_port + 1,
+                                            false));
+  impala_server->SetCatalogInitialized();
+  // Applies the inserts to the impalad's catalog.
+  EXIT_IF_ERROR(TestCatalogService::Start());
+  executor_ = new ImpaladQueryExecutor();
+  EXIT_IF_ERROR(executor_->Setup());
+  return RUN_ALL_TESTS();
+}
@@ -15,8 +15,11 @@
 #include "exec/hdfs-parquet-scanner.h"
 
 #include <limits> // for std::numeric_limits
+#include <list>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
 #include <gflags/gflags.h>
 #include <gutil/strings/substitute.h>
 
@@ -26,6 +29,8 @@
 #include "exec/scanner-context.inline.h"
 #include "exec/read-write-util.h"
 #include "exprs/expr.h"
+#include "exprs/expr-context.h"
+#include "exprs/slot-ref.h"
 #include "runtime/descriptors.h"
 #include "runtime/runtime-state.h"
 #include "runtime/mem-pool.h"
@@ -34,14 +39,17 @@
 #include "runtime/tuple-row.h"
 #include "runtime/tuple.h"
 #include "runtime/string-value.h"
+#include "runtime/timestamp-value.h"
 #include "util/bitmap.h"
 #include "util/bit-util.h"
 #include "util/decompress.h"
 #include "util/debug-util.h"
 #include "util/error-util.h"
+#include "util/hdfs-util.h"
 #include "util/dict-encoding.h"
 #include "util/rle-encoding.h"
 #include "util/runtime-profile.h"
+#include "util/string-parser.h"
 #include "rpc/thrift-util.h"
 
 using namespace std;
@@ -55,6 +63,15 @@ DEFINE_bool(convert_legacy_hive_parquet_utc_timestamps, false,
     "When true, TIMESTAMPs read from files written by Parquet-MR (used by Hive) will "
     "be converted from UTC to local time. Writes are unaffected.");
 
+DEFINE_int32(parquet_num_rows_cache_size, 0, "(Advanced) Maximum number of parquet "
+    "files whose row count is cached. Scans that don't materialize any file columns "
+    "(e.g. count(*)) are answered from this cache without reading the files. Entries "
+    "are keyed by file name, length and modification time, which has a granularity of "
+    "one second, so a file that is rewritten in place with the same length within the "
+    "same second may be answered from a stale entry. The modification times are looked "
+    "up with one listing of each partition directory per scan. Set to 0 (the default) "
+    "to disable.");
+
 // Max data page header size in bytes. This is an estimate and only needs to be an upper
 // bound. It is theoretically possible to have a page header of any size due to string
 // value statistics, but in practice we'll have trouble reading string values this large.
@@ -78,10 +95,82 @@ const int MAX_DICT_HEADER_SIZE = 100;
   }                                                                     \
   runtime_state->LogError(error_msg);
 
+// Key for the row count cache: file name, file length and modification time.
+typedef pair<string, pair<int64_t, int64_t> > NumRowsCacheKey;
+typedef unordered_map<NumRowsCacheKey, int64_t> NumRowsCacheMap;
+
+// Protects num_rows_cache and num_rows_cache_order.
+static mutex num_rows_cache_lock;
+static NumRowsCacheMap num_rows_cache;
+// Keys of num_rows_cache in insertion order, used for eviction.
+static list<NumRowsCacheKey> num_rows_cache_order;
+
+static NumRowsCacheKey GetNumRowsCacheKey(const HdfsFileDesc& file) {
+  return NumRowsCacheKey(file.filename, make_pair(file.file_length, file.mtime));
+}
+
+bool HdfsParquetScanner::GetCachedNumRows(const HdfsFileDesc& file, int64_t* num_rows) {
+  if (FLAGS_parquet_num_rows_cache_size <= 0 || file.mtime < 0) return false;
+  lock_guard<mutex> l(num_rows_cache_lock);
+  NumRowsCacheMap::const_iterator it = num_rows_cache.find(GetNumRowsCacheKey(file));
+  if (it == num_rows_cache.end()) return false;
+  *num_rows = it->second;
+  return true;
+}
+
+void HdfsParquetScanner::CacheNumRows(const HdfsFileDesc& file, int64_t num_rows) {
+  if (FLAGS_parquet_num_rows_cache_size <= 0 || file.mtime < 0) return;
+  NumRowsCacheKey key = GetNumRowsCacheKey(file);
+  lock_guard<mutex> l(num_rows_cache_lock);
+  if (!num_rows_cache.insert(make_pair(key, num_rows)).second) return;
+  num_rows_cache_order.push_back(key);
+  while (num_rows_cache.size() > FLAGS_parquet_num_rows_cache_size) {
+    num_rows_cache.erase(num_rows_cache_order.front());
+    num_rows_cache_order.pop_front();
+  }
+}
+
 Status HdfsParquetScanner::IssueInitialRanges(HdfsScanNode* scan_node,
     const std::vector<HdfsFileDesc*>& files) {
   vector<DiskIoMgr::ScanRange*> footer_ranges;
+  bool use_num_rows_cache =
+      FLAGS_parquet_num_rows_cache_size > 0 && scan_node->materialized_slots().empty();
+  // The modification times of the files in each directory, which are part of the cache
+  // key. They are not in the scan ranges, so each partition directory is listed once
+  // rather than looking up each file. Files whose modification time can't be
+  // determined are read as usual and their row count is not cached.
+  typedef unordered_map<string, time_t> MtimeMap;
+  unordered_map<string, MtimeMap> dir_mtimes;
   for (int i = 0; i < files.size(); ++i) {
+    if (use_num_rows_cache && files[i]->mtime < 0) {
+      const string& path = files[i]->filename;
+      size_t dir_end = path.rfind('/');
+      string dir = path.substr(0, dir_end);
+      unordered_map<string, MtimeMap>::iterator dir_it = dir_mtimes.find(dir);
+      if (dir_it == dir_mtimes.end()) {
+        dir_it = dir_mtimes.insert(make_pair(dir, MtimeMap())).first;
+        Status status = GetLastModificationTimes(files[i]->fs, dir.c_str(),
+            &dir_it->second);
+        if (!status.ok()) VLOG_FILE << status.GetDetail();
+      }
+      MtimeMap::const_iterator mtime_it = dir_it->second.find(path.substr(dir_end + 1));
+      if (mtime_it != dir_it->second.end()) files[i]->mtime = mtime_it->second;
+    }
+    int64_t num_rows;
+    if (use_num_rows_cache && !files[i]->splits.empty() &&
+        GetCachedNumRows(*files[i], &num_rows)) {
+      // Nothing needs to be read from this file. All splits of a file are in the same
+      // partition.
+      ScanRangeMetadata* metadata =
+          reinterpret_cast<ScanRangeMetadata*>(files[i]->splits[0]->meta_data());
+      scan_node->AddMetadataOnlyRows(metadata->partition_id, num_rows);
+      for (int j = 0; j < files[i]->splits.size(); ++j) {
+        scan_node->RangeComplete(THdfsFileFormat::PARQUET, THdfsCompression::NONE);
+      }
+      scan_node->MarkFileDescIssued(files[i]);
+      continue;
+    }
+
     for (int j = 0; j < files[i]->splits.size(); ++j) {
       DiskIoMgr::ScanRange* split = files[i]->splits[j];
 
@@ -124,7 +213,8 @@ HdfsParquetScanner::HdfsParquetScanner(HdfsScanNode* scan_node, RuntimeState* st
     : HdfsScanner(scan_node, state),
       metadata_range_(NULL),
       dictionary_pool_(new MemPool(scan_node->mem_tracker())),
-      assemble_rows_timer_(scan_node_->materialize_tuple_timer()) {
+      assemble_rows_timer_(scan_node_->materialize_tuple_timer()),
+      num_row_groups_skipped_counter_(NULL) {
   assemble_rows_timer_.Stop();
 }
 
@@ -439,6 +529,8 @@ Status HdfsParquetScanner::Prepare(ScannerContext* context) {
   RETURN_IF_ERROR(HdfsScanner::Prepare(context));
   num_cols_counter_ =
       ADD_COUNTER(scan_node_->runtime_profile(), "NumColumns", TUnit::UNIT);
+  num_row_groups_skipped_counter_ = ADD_COUNTER(scan_node_->runtime_profile(),
+      "NumRowGroupsSkippedByBloomFilter", TUnit::UNIT);
 
   scan_node_->IncNumScannersCodegenDisabled();
   return Status::OK;
@@ -773,17 +865,37 @@ Status HdfsParquetScanner::ProcessSplit() {
   // We've processed the metadata and there are columns that need to be materialized.
   RETURN_IF_ERROR(CreateColumnReaders());
   COUNTER_SET(num_cols_counter_, static_cast<int64_t>(column_readers_.size()));
+  InitBloomFilterPredicates();
 
   // The scanner-wide stream was used only to read the file footer.  Each column has added
   // its own stream.
   stream_ = NULL;
 
-  // Iterate through each row group in the file and read all the materialized columns
-  // per row group.  Row groups are independent, so this this could be parallelized.
-  // However, having multiple row groups per file should be seen as an edge case and
-  // we can do better parallelizing across files instead.
-  // TODO: not really an edge case since MR writes multiple row groups
-  for (int i = 0; i < file_metadata_.row_groups.size(); ++i) {
+  // Process the row groups of this range. This is either the whole file or, if this
+  // range was split off another one, a subset of its row groups.
+  const ScanRangeMetadata* metadata =
+      reinterpret_cast<const ScanRangeMetadata*>(metadata_range_->meta_data());
+  bool is_split_range = metadata->end_row_group != -1;
+  int end_row_group = is_split_range ?
+      metadata->end_row_group : file_metadata_.row_groups.size();
+  if (end_row_group > file_metadata_.row_groups.size()) {
+    return Status(Substitute("File $0 has fewer row groups than expected: $1 < $2.",
+        metadata_range_->file(), file_metadata_.row_groups.size(), end_row_group));
+  }
+  MonotonicStopWatch split_range_timer;
+  if (is_split_range) split_range_timer.Start();
+
+  // Iterate through the row groups and read all the materialized columns per row group.
+  // Row groups are independent, so files with multiple row groups are parallelized by
+  // splitting off the second half of the remaining row groups whenever other scanner
+  // threads have run out of work.
+  for (int i = metadata->first_row_group; i < end_row_group; ++i) {
+    int split_row_group = GetSplitRowGroup(i, end_row_group);
+    if (split_row_group < end_row_group && scan_node_->all_ranges_started()) {
+      RETURN_IF_ERROR(SplitOffRowGroups(split_row_group, end_row_group));
+      end_row_group = split_row_group;
+    }
+
     // Attach any resources and clear the streams before starting a new row group. These
     // streams could either be just the footer stream or streams for the previous row
     // group.
@@ -791,13 +903,43 @@ Status HdfsParquetScanner::ProcessSplit() {
     // Commit the rows to flush the row batch from the previous row group
     CommitRows(0);
 
+    bool skip_row_group;
+    RETURN_IF_ERROR(ProbeBloomFilters(i, &skip_row_group));
+    if (skip_row_group) continue;
+
     RETURN_IF_ERROR(InitColumns(i));
     RETURN_IF_ERROR(AssembleRows(i));
   }
 
+  if (is_split_range) {
+    COUNTER_ADD(scan_node_->split_range_time_counter(), split_range_timer.ElapsedTime());
+  }
   return Status::OK;
 }
 
+int HdfsParquetScanner::GetSplitRowGroup(int row_group, int end_row_group) {
+  if (end_row_group - row_group <= 1) return end_row_group;
+  return row_group + (end_row_group - row_group + 1) / 2;
+}
+
+Status HdfsParquetScanner::SplitOffRowGroups(int first_row_group, int end_row_group) {
+  DCHECK_LT(first_row_group, end_row_group);
+  // The new range reads the footer again, which is small compared to the row groups.
+  const ScanRangeMetadata* metadata =
+      reinterpret_cast<const ScanRangeMetadata*>(metadata_range_->meta_data());
+  DiskIoMgr::ScanRange* range = scan_node_->AllocateScanRange(
+      metadata_range_->fs(), metadata_range_->file(), metadata_range_->len(),
+      metadata_range_->offset(), metadata->partition_id, metadata_range_->disk_id(),
+      metadata_range_->try_cache(), metadata_range_->expected_local());
+  ScanRangeMetadata* split_metadata =
+      reinterpret_cast<ScanRangeMetadata*>(range->meta_data());
+  split_metadata->first_row_group = first_row_group;
+  split_metadata->end_row_group = end_row_group;
+  VLOG_FILE << "Splitting off row groups [" << first_row_group << ", " << end_row_group
+            << ") of " << metadata_range_->file();
+  return scan_node_->AddSplitRange(range);
+}
+
 // TODO: this needs to be codegen'd.  The ReadValue function needs to be codegen'd,
 // specific to type and encoding and then inlined into AssembleRows().
 Status HdfsParquetScanner::AssembleRows(int row_group_idx) {
@@ -957,39 +1099,18 @@ Status HdfsParquetScanner::ProcessFooter(bool* eosr) {
     // file_length - 4-byte metadata size - footer-size - metadata size
     int64_t metadata_start = file_desc->file_length -
       sizeof(int32_t) - sizeof(PARQUET_VERSION_NUMBER) - metadata_size;
-    int64_t metadata_bytes_to_read = metadata_size;
     if (metadata_start < 0) {
       return Status(Substitute("File $0 is invalid. Invalid metadata size in file "
           "footer: $1 bytes. File size: $2 bytes.", stream_->filename(), metadata_size,
           file_desc->file_length));
     }
     // IoMgr can only do a fixed size Read(). The metadata could be larger
-    // so we stitch it here.
+    // so ReadFileBytes() stitches it.
     // TODO: consider moving this stitching into the scanner context. The scanner
     // context usually handles the stitching but no other scanner need this logic
     // now.
-    metadata_buffer.resize(metadata_size);
+    RETURN_IF_ERROR(ReadFileBytes(metadata_start, metadata_size, &metadata_buffer));
     metadata_ptr = &metadata_buffer[0];
-    int64_t copy_offset = 0;
-    DiskIoMgr* io_mgr = scan_node_->runtime_state()->io_mgr();
-
-    while (metadata_bytes_to_read > 0) {
-      int64_t to_read = ::min(static_cast<int64_t>(io_mgr->max_read_buffer_size()),
-          metadata_bytes_to_read);
-      DiskIoMgr::ScanRange* range = scan_node_->AllocateScanRange(
-          metadata_range_->fs(), metadata_range_->file(), to_read,
-          metadata_start + copy_offset, -1, metadata_range_->disk_id(),
-          metadata_range_->try_cache(), metadata_range_->expected_local());
-
-      DiskIoMgr::BufferDescriptor* io_buffer = NULL;
-      RETURN_IF_ERROR(io_mgr->Read(scan_node_->reader_context(), range, &io_buffer));
-      memcpy(metadata_ptr + copy_offset, io_buffer->buffer(), io_buffer->len());
-      io_buffer->Return();
-
-      metadata_bytes_to_read -= to_read;
-      copy_offset += to_read;
-    }
-    DCHECK_EQ(metadata_bytes_to_read, 0);
   }
   // Deserialize file header
   // TODO: this takes ~7ms for a 1000-column table, figure out how to reduce this.
@@ -1004,9 +1125,15 @@ Status HdfsParquetScanner::ProcessFooter(bool* eosr) {
 
   RETURN_IF_ERROR(ValidateFileMetadata());
 
-  // Tell the scan node this file has been taken care of.
-  HdfsFileDesc* desc = scan_node_->GetFileDesc(stream_->filename());
-  scan_node_->MarkFileDescIssued(desc);
+  // Tell the scan node this file has been taken care of. Ranges split off another range
+  // were not issued for the file itself.
+  const ScanRangeMetadata* range_metadata =
+      reinterpret_cast<const ScanRangeMetadata*>(metadata_range_->meta_data());
+  if (range_metadata->end_row_group == -1) {
+    HdfsFileDesc* desc = scan_node_->GetFileDesc(stream_->filename());
+    scan_node_->MarkFileDescIssued(desc);
+    CacheNumRows(*desc, file_metadata_.num_rows);
+  }
 
   // Parse file schema
   RETURN_IF_ERROR(CreateSchemaTree(file_metadata_.schema, &schema_));
@@ -1044,8 +1171,201 @@ Status HdfsParquetScanner::ProcessFooter(bool* eosr) {
   return Status::OK;
 }
 
+Status HdfsParquetScanner::ReadFileBytes(int64_t offset, int64_t len,
+    vector<uint8_t>* buffer) {
+  buffer->resize(len);
+  int64_t copy_offset = 0;
+  DiskIoMgr* io_mgr = scan_node_->runtime_state()->io_mgr();
+  while (copy_offset < len) {
+    int64_t to_read = ::min(static_cast<int64_t>(io_mgr->max_read_buffer_size()),
+        len - copy_offset);
+    DiskIoMgr::ScanRange* range = scan_node_->AllocateScanRange(
+        metadata_range_->fs(), metadata_range_->file(), to_read,
+        offset + copy_offset, -1, metadata_range_->disk_id(),
+        metadata_range_->try_cache(), metadata_range_->expected_local());
+
+    DiskIoMgr::BufferDescriptor* io_buffer = NULL;
+    RETURN_IF_ERROR(io_mgr->Read(scan_node_->reader_context(), range, &io_buffer));
+    memcpy(&(*buffer)[copy_offset], io_buffer->buffer(), io_buffer->len());
+    io_buffer->Return();
+    copy_offset += to_read;
+  }
+  return Status::OK;
+}
+
+bool HdfsParquetScanner::GetBloomFilterHash(const ColumnType& type, const AnyVal* val,
+    uint64_t* hash) {
+  if (val->is_null) return false;
+  switch (type.type) {
+    case TYPE_TINYINT:
+      *hash = ParquetBloomFilterHash(
+          static_cast<const TinyIntVal*>(val)->val, -1);
+      return true;
+    case TYPE_SMALLINT:
+      *hash = ParquetBloomFilterHash(
+          static_cast<const SmallIntVal*>(val)->val, -1);
+      return true;
+    case TYPE_INT:
+      *hash = ParquetBloomFilterHash(static_cast<const IntVal*>(val)->val, -1);
+      return true;
+    case TYPE_BIGINT:
+      *hash = ParquetBloomFilterHash(static_cast<const BigIntVal*>(val)->val, -1);
+      return true;
+    case TYPE_TIMESTAMP:
+      *hash = ParquetBloomFilterHash(TimestampValue::FromTimestampVal(
+          *static_cast<const TimestampVal*>(val)), -1);
+      return true;
+    case TYPE_STRING:
+    case TYPE_VARCHAR:
+      *hash = ParquetBloomFilterHash(
+          StringValue::FromStringVal(*static_cast<const StringVal*>(val)), -1);
+      return true;
+    case TYPE_DECIMAL: {
+      const DecimalVal* decimal_val = static_cast<const DecimalVal*>(val);
+      int fixed_len_size = ParquetPlainEncoder::DecimalSize(type);
+      switch (type.GetByteSize()) {
+        case 4:
+          *hash = ParquetBloomFilterHash(
+              Decimal4Value(decimal_val->val4), fixed_len_size);
+          return true;
+        case 8:
+          *hash = ParquetBloomFilterHash(
+              Decimal8Value(decimal_val->val8), fixed_len_size);
+          return true;
+        case 16:
+          *hash = ParquetBloomFilterHash(
+              Decimal16Value(decimal_val->val16), fixed_len_size);
+          return true;
+        default:
+          DCHECK(false);
+          return false;
+      }
+    }
+    default:
+      return false;
+  }
+}
+
+void HdfsParquetScanner::InitBloomFilterPredicates() {
+  DCHECK(bloom_filter_predicates_.empty());
+  for (int i = 0; i < conjunct_ctxs_.size(); ++i) {
+    ExprContext* ctx = conjunct_ctxs_[i];
+    Expr* root = ctx->root();
+    if (root->GetNumChildren() < 2) continue;
+    const string& fn_name = root->fn().name.function_name;
+    bool is_eq = fn_name == "eq";
+    if (!is_eq && fn_name != "in_iterate" && fn_name != "in_set_lookup") continue;
+
+    // The column is the first child, except that equality can have it on either side.
+    Expr* col = root->GetChild(0);
+    int first_const = 1;
+    if (is_eq && !col->is_slotref()) {
+      col = root->GetChild(1);
+      first_const = 0;
+    }
+    if (!col->is_slotref()) continue;
+    SlotId slot_id = static_cast<SlotRef*>(col)->slot_id();
+    int reader_idx = -1;
+    for (int j = 0; j < column_readers_.size(); ++j) {
+      if (column_readers_[j]->slot_desc()->id() == slot_id) {
+        reader_idx = j;
+        break;
+      }
+    }
+    if (reader_idx == -1) continue;
+    const ColumnType& type = column_readers_[reader_idx]->slot_desc()->type();
+
+    BloomFilterPredicate pred;
+    pred.reader_idx = reader_idx;
+    bool usable = true;
+    int end_const = is_eq ? first_const + 1 : root->GetNumChildren();
+    for (int j = first_const; j < end_const && usable; ++j) {
+      Expr* child = root->GetChild(j);
+      // Only probe for constants of exactly the column's type, since values are hashed
+      // in their encoding.
+      if (!child->IsConstant() || !(child->type() == type)) {
+        usable = false;
+        break;
+      }
+      const AnyVal* val = child->GetConstVal(ctx);
+      uint64_t hash;
+      if (GetBloomFilterHash(type, val, &hash)) {
+        pred.hashes.push_back(hash);
+      } else if (!val->is_null) {
+        usable = false;
+      }
+    }
+    if (usable) bloom_filter_predicates_.push_back(pred);
+  }
+}
+
+bool HdfsParquetScanner::ParseBloomFilterLocation(const string& location,
+    int64_t file_length, int64_t* offset, int64_t* len) {
+  size_t sep = location.find(':');
+  if (sep == string::npos) return false;
+  StringParser::ParseResult offset_result, len_result;
+  *offset = StringParser::StringToInt<int64_t>(location.c_str(), sep, &offset_result);
+  *len = StringParser::StringToInt<int64_t>(
+      location.c_str() + sep + 1, location.size() - sep - 1, &len_result);
+  return offset_result == StringParser::PARSE_SUCCESS &&
+      len_result == StringParser::PARSE_SUCCESS && *offset >= 0 &&
+      BlockBloomFilter::IsValidSize(*len) && *offset + *len <= file_length;
+}
+
+bool HdfsParquetScanner::BloomFilterMayContain(uint8_t* directory, int64_t len,
+    const vector<uint64_t>& hashes) {
+  BlockBloomFilter filter(directory, len);
+  for (int i = 0; i < hashes.size(); ++i) {
+    if (filter.Find(hashes[i])) return true;
+  }
+  return false;
+}
+
+Status HdfsParquetScanner::ProbeBloomFilters(int row_group_idx, bool* skip_row_group) {
+  *skip_row_group = false;
+  const HdfsFileDesc* file_desc = scan_node_->GetFileDesc(metadata_range_->file());
+  DCHECK_NOTNULL(file_desc);
+  vector<uint8_t> directory;
+  for (int i = 0; i < bloom_filter_predicates_.size(); ++i) {
+    const BloomFilterPredicate& pred = bloom_filter_predicates_[i];
+    const BaseColumnReader* reader = column_readers_[pred.reader_idx];
+    const parquet::ColumnMetaData& col_metadata =
+        file_metadata_.row_groups[row_group_idx].columns[reader->col_idx()].meta_data;
+    string location;
+    for (int j = 0; j < col_metadata.key_value_metadata.size(); ++j) {
+      if (col_metadata.key_value_metadata[j].key == PARQUET_BLOOM_FILTER_KEY) {
+        location = col_metadata.key_value_metadata[j].value;
+        break;
+      }
+    }
+    if (location.empty()) continue;
+    // The filter is hashed over the file's encoding of the values, so only use it if
+    // the column matches the table schema.
+    RETURN_IF_ERROR(ValidateColumn(*reader, row_group_idx));
+
+    int64_t offset, len;
+    if (!ParseBloomFilterLocation(location, file_desc->file_length, &offset, &len)) {
+      return Status(Substitute("File $0: metadata is corrupt. Column $1 has an invalid "
+          "Bloom filter location '$2' (file_size=$3).", file_desc->filename,
+          reader->col_idx(), location, file_desc->file_length));
+    }
+
+    RETURN_IF_ERROR(ReadFileBytes(offset, len, &directory));
+    if (!BloomFilterMayContain(&directory[0], len, pred.hashes)) {
+      VLOG_FILE << "Skipping row group " << row_group_idx << " of "
+                << file_desc->filename << " based on its Bloom filter for column "
+                << reader->col_idx();
+      COUNTER_ADD(num_row_groups_skipped_counter_, 1);
+      *skip_row_group = true;
+      return Status::OK;
+    }
+  }
+  return Status::OK;
+}
+
 Status HdfsParquetScanner::CreateColumnReaders() {
   DCHECK(column_readers_.empty());
+  bool template_tuple_is_copy = false;
   for (int i = 0; i < scan_node_->materialized_slots().size(); ++i) {
     SlotDescriptor* slot_desc = scan_node_->materialized_slots()[i];
     const vector<int>& path = slot_desc->col_path();
@@ -1073,9 +1393,12 @@ Status HdfsParquetScanner::CreateColumnReaders() {
 
     if (node == NULL) {
       // In this case, we are selecting a column that is not in the file.
-      // Update the template tuple to put a NULL in this slot.
-      if (template_tuple_ == NULL) {
-        template_tuple_ = scan_node_->InitEmptyTemplateTuple();
+      // Update the template tuple to put a NULL in this slot. The template tuple from
+      // the scan node is shared, so set the NULL in a private copy. Only the null
+      // indicator bytes change, so template_tuple_copy_len_ still covers them.
+      if (!template_tuple_is_copy) {
+        template_tuple_ = scan_node_->CopyTemplateTuple(template_tuple_);
+        template_tuple_is_copy = true;
       }
       template_tuple_->SetNull(slot_desc->null_indicator_offset());
       continue;
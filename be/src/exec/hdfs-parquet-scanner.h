@@ -18,6 +18,7 @@
 
 #include "exec/hdfs-scanner.h"
 #include "exec/parquet-common.h"
+#include "udf/udf.h"
 
 namespace impala {
 
@@ -51,6 +52,13 @@ class HdfsParquetScanner : public HdfsScanner {
 
   // Issue just the footer range for each file.  We'll then parse the footer and pick
   // out the columns we want.
+  // If the scan does not materialize any file columns (e.g. count(*) or queries that
+  // only reference partition keys, including MIN/MAX of partition keys) and the number
+  // of rows in a file is already known from a previous scan of its footer, no range is
+  // issued for that file. Its rows are handed to the scan node via
+  // HdfsScanNode::AddMetadataOnlyRows() instead. MIN/MAX of file columns are not
+  // answered from row group statistics, since the scan does not know which aggregate
+  // consumes its slots.
   static Status IssueInitialRanges(HdfsScanNode* scan_node,
                                    const std::vector<HdfsFileDesc*>& files);
 
@@ -86,6 +94,20 @@ class HdfsParquetScanner : public HdfsScanner {
   };
 
  private:
+  friend class ParquetNumRowsCacheTest;
+  friend class ParquetSplitRowGroupsTest;
+  friend class ParquetBloomFilterTest;
+
+  // Process-wide cache of the number of rows in parquet files, populated from
+  // FileMetaData.num_rows in ProcessFooter(). Entries are keyed by the file name, length
+  // and last modification time, so that a file that is overwritten in place is not
+  // answered from a stale entry. Files whose modification time is unknown
+  // (HdfsFileDesc::mtime is -1) are neither looked up nor added. The oldest entries are
+  // evicted once the cache holds --parquet_num_rows_cache_size files.
+  // Returns true and sets 'num_rows' if 'file' is in the cache. Thread safe.
+  static bool GetCachedNumRows(const HdfsFileDesc& file, int64_t* num_rows);
+  static void CacheNumRows(const HdfsFileDesc& file, int64_t num_rows);
+
   // Internal representation of a column schema (including nested-type columns).
   struct SchemaNode {
     // The corresponding schema element defined in the file metadata
@@ -149,10 +171,34 @@ class HdfsParquetScanner : public HdfsScanner {
   // Number of cols that need to be read.
   RuntimeProfile::Counter* num_cols_counter_;
 
+  // A conjunct that can only be true for rows whose value in a materialized column is
+  // one of a few constants, i.e. 'col = <const>' or 'col IN (<consts>)'. Row groups
+  // whose Bloom filter for the column contains none of the constants are skipped.
+  struct BloomFilterPredicate {
+    // Index into column_readers_ of the column.
+    int reader_idx;
+
+    // Bloom filter hashes of the non-NULL constants. If empty, no row passes.
+    std::vector<uint64_t> hashes;
+  };
+  std::vector<BloomFilterPredicate> bloom_filter_predicates_;
+
+  // Number of row groups skipped because of their Bloom filters.
+  RuntimeProfile::Counter* num_row_groups_skipped_counter_;
+
   // Reads data from all the columns (in parallel) and assembles rows into the context
   // object. Returns when the entire row group is complete or an error occurred.
   Status AssembleRows(int row_group_idx);
 
+  // Issues a new footer range for row groups [first_row_group, end_row_group) of this
+  // file so that an idle scanner thread processes them instead of this scanner.
+  Status SplitOffRowGroups(int first_row_group, int end_row_group);
+
+  // Returns the first of the row groups [row_group, end_row_group) to split off to an
+  // idle scanner thread before processing 'row_group', i.e. the second half of them,
+  // rounded down. Returns 'end_row_group' if there is at most one row group left.
+  static int GetSplitRowGroup(int row_group, int end_row_group);
+
   // Process the file footer and parse file_metadata_.  This should be called with the
   // last FOOTER_SIZE bytes in context_.
   // *eosr is a return value.  If true, the scan range is complete (e.g. select count(*))
@@ -173,6 +219,36 @@ class HdfsParquetScanner : public HdfsScanner {
   // initializes column_readers_ and issues the reads for the columns.
   Status InitColumns(int row_group_idx);
 
+  // Populates bloom_filter_predicates_ from the scanner's conjuncts. Must be called
+  // after CreateColumnReaders().
+  void InitBloomFilterPredicates();
+
+  // Sets *skip_row_group to true if the Bloom filters written with the row group show
+  // that none of its rows can pass bloom_filter_predicates_. Column chunks without a
+  // Bloom filter never cause a row group to be skipped.
+  Status ProbeBloomFilters(int row_group_idx, bool* skip_row_group);
+
+  // Computes the Bloom filter hash of the constant 'val' for a column of 'type', which
+  // must be the type the constant was analyzed as. Returns false if 'val' is NULL or if
+  // the scanner does not probe columns of 'type' (see HdfsParquetTableWriter::Init()).
+  static bool GetBloomFilterHash(const ColumnType& type,
+      const impala_udf::AnyVal* val, uint64_t* hash);
+
+  // Parses the PARQUET_BLOOM_FILTER_KEY value of a column chunk into the filter's
+  // 'offset' and 'len'. Returns false if the value is malformed or the filter does not
+  // fit in a file of 'file_length' bytes.
+  static bool ParseBloomFilterLocation(const std::string& location,
+      int64_t file_length, int64_t* offset, int64_t* len);
+
+  // Returns false if the Bloom filter in the 'len' bytes at 'directory' contains none
+  // of 'hashes', i.e. the column chunk has no row matching the predicate.
+  static bool BloomFilterMayContain(uint8_t* directory, int64_t len,
+      const std::vector<uint64_t>& hashes);
+
+  // Reads 'len' bytes at 'offset' of the file being scanned into 'buffer' using
+  // synchronous io mgr reads.
+  Status ReadFileBytes(int64_t offset, int64_t len, std::vector<uint8_t>* buffer);
+
   // Validates the file metadata
   Status ValidateFileMetadata();
 
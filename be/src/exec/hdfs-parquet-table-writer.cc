@@ -14,6 +14,10 @@
 
 #include "exec/hdfs-parquet-table-writer.h"
 
+#include <boost/algorithm/string.hpp>
+#include <gflags/gflags.h>
+#include <gutil/strings/substitute.h>
+
 #include "common/version.h"
 #include "exprs/expr.h"
 #include "exprs/expr-context.h"
@@ -41,6 +45,17 @@ using namespace boost;
 using namespace impala;
 using namespace parquet;
 using namespace apache::thrift;
+using namespace strings;
+
+DEFINE_string(parquet_bloom_filter_columns, "", "Comma-separated list of columns for "
+    "which the Parquet writer stores a Bloom filter with every column chunk. Scans with "
+    "equality or IN predicates on these columns skip row groups that cannot contain a "
+    "matching value. Entries are either '<column>', which applies to all tables, or "
+    "'<db>.<table>.<column>'. Boolean, float, double and char columns are ignored.");
+DEFINE_int32(parquet_bloom_filter_max_bytes, 1024 * 1024, "(Advanced) Size in bytes "
+    "of the Bloom filter built for each column chunk, rounded down to a power of two. "
+    "Filters are shrunk before they are written if the row group has few distinct "
+    "values.");
 
 // Managing file sizes: We need to estimate how big the files being buffered
 // are in order to split them correctly in HDFS. Having a file that is too big
@@ -57,6 +72,14 @@ using namespace apache::thrift;
 // TODO: more complicated heuristic?
 static const int MAX_DICTIONARY_ENTRIES = (1 << 16) - 1;
 
+// Bloom filters are halved before they are written as long as at most this fraction of
+// their bits is set, which keeps the false positive rate well under 1%.
+static const double BLOOM_FILTER_FOLD_MAX_FILL = 0.5;
+
+// Filters with more than this fraction of bits set are not written. They would rarely
+// let the scanner skip a row group and are not worth reading.
+static const double BLOOM_FILTER_MAX_FILL = 0.75;
+
 // Class that encapsulates all the state for writing a single column.  This contains
 // all the buffered pages as well as the metadata (e.g. byte sizes, num values, etc).
 // This is intended to be created once per writer per column and reused across
@@ -96,7 +119,9 @@ class HdfsParquetTableWriter::BaseColumnWriter {
       total_uncompressed_byte_size_(0),
       dict_encoder_base_(NULL),
       def_levels_(NULL),
-      values_buffer_len_(DEFAULT_DATA_PAGE_SIZE) {
+      values_buffer_len_(DEFAULT_DATA_PAGE_SIZE),
+      bloom_filter_directory_(NULL),
+      bloom_filter_len_(0) {
     Codec::CreateCompressor(NULL, false, codec, &compressor_);
 
     def_levels_ = parent_->state_->obj_pool()->Add(
@@ -124,6 +149,14 @@ class HdfsParquetTableWriter::BaseColumnWriter {
   Status Flush(int64_t* file_pos, int64_t* first_data_page,
       int64_t* first_dictionary_page);
 
+  // Makes this column build a Bloom filter of at most 'len' bytes over the values of
+  // each row group. Must be called before Reset().
+  void EnableBloomFilter(int64_t len);
+
+  // Writes the Bloom filter for the row group (if any) to the file and records its
+  // location in 'metadata'. *file_pos is incremented by the number of bytes written.
+  Status WriteBloomFilter(int64_t* file_pos, ColumnMetaData* metadata);
+
   // Resets all the data accumulated for this column.  Memory can now be reused for
   // the next row group
   // Any data for previous row groups must be reset (e.g. dictionaries).
@@ -134,6 +167,12 @@ class HdfsParquetTableWriter::BaseColumnWriter {
     num_values_ = 0;
     total_compressed_byte_size_ = 0;
     current_encoding_ = Encoding::PLAIN;
+    if (bloom_filter_directory_ != NULL) {
+      // The filter may have been folded when it was written; start over at full size.
+      memset(bloom_filter_directory_, 0, bloom_filter_len_);
+      bloom_filter_.reset(
+          new BlockBloomFilter(bloom_filter_directory_, bloom_filter_len_));
+    }
   }
 
   // Close this writer. This is only called after Flush() and no more rows will
@@ -162,6 +201,13 @@ class HdfsParquetTableWriter::BaseColumnWriter {
   // Implemented in the subclass.
   virtual bool EncodeValue(void* value, int64_t* bytes_needed) = 0;
 
+  // Returns the Bloom filter hash of 'value'. Only called if the Bloom filter is
+  // enabled. Implemented in the subclass.
+  virtual uint64_t HashValue(void* value) {
+    DCHECK(false);
+    return 0;
+  }
+
   // Encodes out all data for the current page and updates the metadata.
   virtual void FinalizeCurrentPage();
 
@@ -231,6 +277,12 @@ class HdfsParquetTableWriter::BaseColumnWriter {
   uint8_t* values_buffer_;
   // The size of values_buffer_.
   int values_buffer_len_;
+
+  // Bloom filter over the non-NULL values of the current row group. NULL if this column
+  // does not have a Bloom filter. The directory is reused across row groups.
+  scoped_ptr<BlockBloomFilter> bloom_filter_;
+  uint8_t* bloom_filter_directory_;
+  int64_t bloom_filter_len_;
 };
 
 // Per type column writer.
@@ -292,6 +344,10 @@ class HdfsParquetTableWriter::ColumnWriter :
     return true;
   }
 
+  virtual uint64_t HashValue(void* value) {
+    return ParquetBloomFilterHash(*CastValue(value), encoded_value_size_);
+  }
+
  private:
   // The period, in # of rows, to check the estimated dictionary page size against
   // the data page size. We want to start a new data page when the estimated size
@@ -373,6 +429,9 @@ inline Status HdfsParquetTableWriter::BaseColumnWriter::AppendRow(TupleRow* row)
   ++num_values_;
   void* value = expr_ctx_->GetValue(row);
   if (current_page_ == NULL) NewPage();
+  if (bloom_filter_.get() != NULL && value != NULL) {
+    bloom_filter_->Insert(HashValue(value));
+  }
 
   // We might need to try again if this current page is not big enough
   while (true) {
@@ -520,6 +579,34 @@ Status HdfsParquetTableWriter::BaseColumnWriter::Flush(int64_t* file_pos,
   return Status::OK;
 }
 
+void HdfsParquetTableWriter::BaseColumnWriter::EnableBloomFilter(int64_t len) {
+  DCHECK(BlockBloomFilter::IsValidSize(len));
+  bloom_filter_len_ = len;
+  bloom_filter_directory_ = parent_->reusable_col_mem_pool_->Allocate(len);
+}
+
+Status HdfsParquetTableWriter::BaseColumnWriter::WriteBloomFilter(int64_t* file_pos,
+    ColumnMetaData* metadata) {
+  if (bloom_filter_.get() == NULL || num_values_ == 0) return Status::OK;
+  KeyValue location;
+  int64_t len = FinalizeBloomFilter(bloom_filter_.get(), *file_pos, &location);
+  if (len == 0) return Status::OK;
+
+  RETURN_IF_ERROR(parent_->Write(bloom_filter_directory_, len));
+  metadata->__set_key_value_metadata(vector<KeyValue>(1, location));
+  *file_pos += len;
+  return Status::OK;
+}
+
+int64_t HdfsParquetTableWriter::FinalizeBloomFilter(BlockBloomFilter* filter,
+    int64_t file_pos, KeyValue* location) {
+  int64_t len = filter->Fold(BLOOM_FILTER_FOLD_MAX_FILL);
+  if (filter->Fill() > BLOOM_FILTER_MAX_FILL) return 0;
+  location->key = PARQUET_BLOOM_FILTER_KEY;
+  location->value = Substitute("$0:$1", file_pos, len);
+  return len;
+}
+
 void HdfsParquetTableWriter::BaseColumnWriter::FinalizeCurrentPage() {
   DCHECK(current_page_ != NULL);
   if (current_page_->finalized) return;
@@ -627,12 +714,29 @@ HdfsParquetTableWriter::HdfsParquetTableWriter(HdfsTableSink* parent, RuntimeSta
       file_size_limit_(0),
       reusable_col_mem_pool_(new MemPool(parent_->mem_tracker())),
       per_file_mem_pool_(new MemPool(parent_->mem_tracker())),
-      row_idx_(0) {
+      row_idx_(0),
+      bloom_filter_bytes_(0) {
 }
 
 HdfsParquetTableWriter::~HdfsParquetTableWriter() {
 }
 
+// Returns true if --parquet_bloom_filter_columns selects the column 'col_name' of
+// 'table_desc'.
+static bool IsBloomFilterColumn(const HdfsTableDescriptor* table_desc,
+    const string& col_name) {
+  if (FLAGS_parquet_bloom_filter_columns.empty()) return false;
+  string qualified_name = Substitute("$0.$1.$2", table_desc->database(),
+      table_desc->name(), col_name);
+  vector<string> entries;
+  split(entries, FLAGS_parquet_bloom_filter_columns, is_any_of(","));
+  for (int i = 0; i < entries.size(); ++i) {
+    trim(entries[i]);
+    if (iequals(entries[i], col_name) || iequals(entries[i], qualified_name)) return true;
+  }
+  return false;
+}
+
 Status HdfsParquetTableWriter::Init() {
   // Initialize file metadata
   file_metadata_.version = PARQUET_CURRENT_VERSION;
@@ -659,6 +763,13 @@ Status HdfsParquetTableWriter::Init() {
 
   VLOG_FILE << "Using compression codec: " << codec;
 
+  // Bloom filters must be a power of two bytes.
+  int64_t bloom_filter_len = max<int64_t>(FLAGS_parquet_bloom_filter_max_bytes,
+      BlockBloomFilter::BYTES_PER_BLOCK);
+  if (BitUtil::NextPowerOfTwo(bloom_filter_len) > bloom_filter_len) {
+    bloom_filter_len = BitUtil::NextPowerOfTwo(bloom_filter_len) / 2;
+  }
+
   columns_.resize(table_desc_->num_cols() - table_desc_->num_clustering_cols());
   // Initialize each column structure.
   for (int i = 0; i < columns_.size(); ++i) {
@@ -725,6 +836,21 @@ Status HdfsParquetTableWriter::Init() {
         DCHECK(false);
     }
     columns_[i] = state_->obj_pool()->Add(writer);
+    if (IsBloomFilterColumn(table_desc_,
+            table_desc_->col_names()[i + table_desc_->num_clustering_cols()])) {
+      switch (type.type) {
+        case TYPE_BOOLEAN:
+        case TYPE_FLOAT:
+        case TYPE_DOUBLE:
+        case TYPE_CHAR:
+          // The scanner does not probe these types. Floating point values have several
+          // encodings that compare equal and CHAR values are stored unpadded.
+          break;
+        default:
+          columns_[i]->EnableBloomFilter(bloom_filter_len);
+          bloom_filter_bytes_ += bloom_filter_len;
+      }
+    }
     columns_[i]->Reset();
   }
   RETURN_IF_ERROR(CreateSchema());
@@ -792,7 +918,7 @@ Status HdfsParquetTableWriter::AddRowGroup() {
 
 int64_t HdfsParquetTableWriter::MinBlockSize() const {
   // See file_size_limit_ calculation in InitNewFile().
-  return 3 * DEFAULT_DATA_PAGE_SIZE * columns_.size();
+  return 3 * DEFAULT_DATA_PAGE_SIZE * columns_.size() + bloom_filter_bytes_;
 }
 
 uint64_t HdfsParquetTableWriter::default_block_size() const {
@@ -847,7 +973,8 @@ Status HdfsParquetTableWriter::InitNewFile() {
        << "PARQUET_FILE_SIZE to at least " << MinBlockSize() << ".";
     return Status(ss.str());
   }
-  file_size_limit_ -= 2 * DEFAULT_DATA_PAGE_SIZE * columns_.size();
+  // Bloom filters are written with the row group, so their space is reserved as well.
+  file_size_limit_ -= 2 * DEFAULT_DATA_PAGE_SIZE * columns_.size() + bloom_filter_bytes_;
   DCHECK_GE(file_size_limit_, DEFAULT_DATA_PAGE_SIZE * columns_.size());
   file_pos_ = 0;
   row_count_ = 0;
@@ -935,6 +1062,8 @@ Status HdfsParquetTableWriter::FlushCurrentRowGroup() {
     // Flush this column.  This updates the final metadata sizes for this column.
     RETURN_IF_ERROR(columns_[i]->Flush(&file_pos_, &data_page_offset, &dict_page_offset));
     DCHECK_GT(data_page_offset, 0);
+    RETURN_IF_ERROR(columns_[i]->WriteBloomFilter(
+        &file_pos_, &current_row_group_->columns[i].meta_data));
 
     current_row_group_->columns[i].meta_data.data_page_offset = data_page_offset;
     if (dict_page_offset >= 0) {
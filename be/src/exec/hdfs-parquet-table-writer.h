@@ -107,6 +107,14 @@ class HdfsParquetTableWriter : public HdfsTableWriter {
   template<typename T> friend class ColumnWriter;
   class BoolColumnWriter;
   friend class BoolColumnWriter;
+  friend class ParquetBloomFilterTest;
+
+  // Shrinks 'filter', the Bloom filter of a column chunk, before it is written at
+  // 'file_pos' and sets 'location' to the ColumnMetaData.key_value_metadata entry that
+  // lets the scanner find it. Returns the number of bytes of the filter's directory to
+  // write, or 0 if the filter is too full to be worth writing.
+  static int64_t FinalizeBloomFilter(BlockBloomFilter* filter, int64_t file_pos,
+      parquet::KeyValue* location);
 
   // Minimum allowable block size in bytes. This is a function of the number of columns.
   int64_t MinBlockSize() const;
@@ -179,6 +187,10 @@ class HdfsParquetTableWriter : public HdfsTableWriter {
 
   // For each column, the on disk size written.
   TParquetInsertStats parquet_stats_;
+
+  // Total size of the Bloom filters of all columns. This much space is reserved in
+  // every file for the filters.
+  int64_t bloom_filter_bytes_;
 };
 
 }
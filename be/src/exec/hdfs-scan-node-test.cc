@@ -0,0 +1,464 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <algorithm>
+#include <limits>
+#include <sstream>
+
+#include <gtest/gtest.h>
+
+#include "codegen/llvm-codegen.h"
+#include "common/init.h"
+#include "exec/hdfs-scan-node.h"
+#include "runtime/disk-io-mgr.h"
+#include "runtime/exec-env.h"
+#include "service/fe-support.h"
+#include "service/impala-server.h"
+#include "testutil/impalad-query-executor.h"
+#include "testutil/in-process-servers.h"
+#include "testutil/test-table.h"
+#include "util/impalad-metrics.h"
+#include "util/test-info.h"
+#include "util/time.h"
+
+DECLARE_int32(be_port);
+DECLARE_int32(beeswax_port);
+DECLARE_string(impalad);
+DECLARE_bool(abort_on_config_error);
+DECLARE_int32(max_row_batches);
+DECLARE_int32(scanner_thread_scaling_interval_ms);
+DECLARE_int64(text_scan_range_split_bytes);
+
+using namespace std;
+
+namespace impala {
+
+static const int UNBOUNDED = numeric_limits<int>::max();
+
+// Scans run through an in-process impalad, over tables in TEST_DIR.
+static ImpaladQueryExecutor* executor_;
+static const string TEST_DIR = "/tmp/hdfs-scan-node-test";
+
+class HdfsScanNodeTest : public testing::Test {
+ protected:
+  static int ComputeScannerThreadTarget(int current_target, int num_active,
+      double producer_wait_ratio, double consumer_wait_ratio, double queue_occupancy) {
+    return HdfsScanNode::ComputeScannerThreadTarget(current_target, num_active,
+        producer_wait_ratio, consumer_wait_ratio, queue_occupancy);
+  }
+
+  static int64_t GetTextRangeLength(int64_t split_length, int64_t target_range_length) {
+    return HdfsScanNode::GetTextRangeLength(split_length, target_range_length);
+  }
+
+  static bool IssueFilesInGroups(int64_t limit, int64_t num_files, int initial_files) {
+    return HdfsScanNode::IssueFilesInGroups(limit, num_files, initial_files);
+  }
+
+  static int NextFileGroupSize(int num_deferred_files, int* next_file_group_size) {
+    return HdfsScanNode::NextFileGroupSize(num_deferred_files, next_file_group_size);
+  }
+
+  static bool ExitInsteadOfIssuingFiles(int num_deferred_files, int num_active,
+      int64_t num_complete_splits, int64_t num_issued_splits) {
+    return HdfsScanNode::ExitInsteadOfIssuingFiles(num_deferred_files, num_active,
+        num_complete_splits, num_issued_splits);
+  }
+
+  // Runs 'stmt' with 'exec_options' and returns its rows in 'rows' and its profile in
+  // 'profile'.
+  static void RunQuery(const string& stmt, const vector<string>& exec_options,
+      vector<string>* rows, string* profile) {
+    executor_->setExecOptions(exec_options);
+    Status status = executor_->Exec(stmt, NULL);
+    ASSERT_TRUE(status.ok()) << stmt << "\n" << status.GetDetail();
+    status = executor_->FetchAll(rows);
+    ASSERT_TRUE(status.ok()) << stmt << "\n" << status.GetDetail();
+    status = executor_->GetRuntimeProfile(profile);
+    ASSERT_TRUE(status.ok()) << stmt << "\n" << status.GetDetail();
+  }
+};
+
+// The consumer is the bottleneck: scanner threads are blocked on a full queue.
+TEST_F(HdfsScanNodeTest, ScaleDownScannerThreads) {
+  EXPECT_EQ(3, ComputeScannerThreadTarget(UNBOUNDED, 4, 0.9, 0.0, 1.0));
+  EXPECT_EQ(2, ComputeScannerThreadTarget(3, 3, 0.6, 0.0, 0.8));
+  // One step per interval.
+  EXPECT_EQ(1, ComputeScannerThreadTarget(2, 2, 0.9, 0.0, 1.0));
+  // The last thread is never given up.
+  EXPECT_EQ(1, ComputeScannerThreadTarget(1, 1, 0.9, 0.0, 1.0));
+  EXPECT_EQ(UNBOUNDED, ComputeScannerThreadTarget(UNBOUNDED, 1, 0.9, 0.0, 1.0));
+  // Not while the queue still has room or the threads are mostly busy scanning.
+  EXPECT_EQ(UNBOUNDED, ComputeScannerThreadTarget(UNBOUNDED, 4, 0.9, 0.0, 0.5));
+  EXPECT_EQ(UNBOUNDED, ComputeScannerThreadTarget(UNBOUNDED, 4, 0.2, 0.0, 1.0));
+}
+
+// The scan is the bottleneck: the consumer is waiting on an empty queue.
+TEST_F(HdfsScanNodeTest, ScaleUpScannerThreads) {
+  EXPECT_EQ(3, ComputeScannerThreadTarget(2, 2, 0.0, 0.9, 0.0));
+  EXPECT_EQ(2, ComputeScannerThreadTarget(1, 1, 0.0, 0.6, 0.1));
+  // A target above the number of active threads is already being worked towards.
+  EXPECT_EQ(4, ComputeScannerThreadTarget(4, 2, 0.0, 0.9, 0.0));
+  EXPECT_EQ(UNBOUNDED, ComputeScannerThreadTarget(UNBOUNDED, 2, 0.0, 0.9, 0.0));
+  // Not while the queue is filled or the consumer is mostly busy.
+  EXPECT_EQ(2, ComputeScannerThreadTarget(2, 2, 0.0, 0.9, 0.5));
+  EXPECT_EQ(2, ComputeScannerThreadTarget(2, 2, 0.0, 0.2, 0.0));
+}
+
+// A scan whose consumer is slow gives up scanner threads that would only be blocked on
+// the full row batch queue, and still returns every row. The partial aggregation that
+// consumes the scan's batches sleeps for every 64th row.
+TEST_F(HdfsScanNodeTest, ScaleDownForSlowConsumer) {
+  TestTable table("slow_consumer_tbl", TEST_DIR + "/slow_consumer_tbl",
+      THdfsFileFormat::TEXT);
+  table.AddColumn("i", TYPE_INT);
+  ASSERT_TRUE(table.Create().ok());
+  // Every file is a scan range, after each of which a scanner thread re-evaluates the
+  // target.
+  const int NUM_FILES = 16;
+  const int ROWS_PER_FILE = 1000;
+  for (int file = 0; file < NUM_FILES; ++file) {
+    stringstream contents, file_name;
+    for (int i = 0; i < ROWS_PER_FILE; ++i) contents << file * ROWS_PER_FILE + i << "\n";
+    file_name << "data" << file << ".txt";
+    ASSERT_TRUE(table.WriteFile("", file_name.str(), contents.str()).ok());
+  }
+  ASSERT_TRUE(table.Update().ok());
+
+  FLAGS_max_row_batches = 2;
+  FLAGS_scanner_thread_scaling_interval_ms = 10;
+  vector<string> options;
+  options.push_back("NUM_SCANNER_THREADS=4");
+  options.push_back("BATCH_SIZE=64");
+  vector<string> rows;
+  string profile;
+  RunQuery("select count(*), sum(i), count(if(i % 64 = 0, sleep(2), NULL)) "
+      "from slow_consumer_tbl", options, &rows, &profile);
+  FLAGS_max_row_batches = 0;
+  FLAGS_scanner_thread_scaling_interval_ms = 100;
+
+  const int num_rows = NUM_FILES * ROWS_PER_FILE;
+  stringstream expected_row;
+  expected_row << num_rows << "\t" << static_cast<int64_t>(num_rows) * (num_rows - 1) / 2
+               << "\t" << (num_rows + 63) / 64;
+  ASSERT_EQ(1, rows.size());
+  EXPECT_EQ(expected_row.str(), rows[0]);
+  EXPECT_GT(ImpaladQueryExecutor::GetCounterValue(profile, "ScannerThreadScaleDowns"), 0)
+      << profile;
+}
+
+// Scaling down and back up again.
+TEST_F(HdfsScanNodeTest, ScaleDownAndUp) {
+  int target = UNBOUNDED;
+  int num_active = 4;
+  for (int i = 0; i < 3; ++i) {
+    target = ComputeScannerThreadTarget(target, num_active, 0.9, 0.0, 1.0);
+    // The thread above the target exits after its current range.
+    num_active = target;
+  }
+  EXPECT_EQ(1, num_active);
+  for (int i = 0; i < 3; ++i) {
+    target = ComputeScannerThreadTarget(target, num_active, 0.0, 0.9, 0.0);
+    num_active = target;
+  }
+  EXPECT_EQ(4, num_active);
+  // Balanced: nothing changes.
+  EXPECT_EQ(4, ComputeScannerThreadTarget(4, 4, 0.3, 0.3, 0.5));
+}
+
+// Large uncompressed text splits are broken into ranges of about the target length.
+TEST_F(HdfsScanNodeTest, TextRangeLength) {
+  EXPECT_EQ(50, GetTextRangeLength(100, 40));
+  EXPECT_EQ(34, GetTextRangeLength(100, 30));
+  EXPECT_EQ(10, GetTextRangeLength(100, 10));
+  // Splits up to twice the target length are not broken up.
+  EXPECT_EQ(80, GetTextRangeLength(80, 40));
+  EXPECT_EQ(1, GetTextRangeLength(1, 40));
+  // A target length of 0 disables splitting.
+  EXPECT_EQ(100, GetTextRangeLength(100, 0));
+
+  // The ranges cover the split exactly and are no shorter than the target length,
+  // except for the last one.
+  int64_t split_lengths[] = {81, 100, 1000, 1023, 1024, 1025, 64 * 1024 * 1024 + 1};
+  int64_t target = 16;
+  for (int i = 0; i < sizeof(split_lengths) / sizeof(int64_t); ++i) {
+    int64_t split_length = split_lengths[i];
+    int64_t range_len = GetTextRangeLength(split_length, target);
+    EXPECT_GE(range_len, target);
+    EXPECT_LT(range_len, 2 * target);
+    int64_t offset = 0;
+    int num_ranges = 0;
+    while (offset < split_length) {
+      int64_t len = min(range_len, split_length - offset);
+      EXPECT_GT(len, 0);
+      offset += len;
+      ++num_ranges;
+    }
+    EXPECT_EQ(split_length, offset);
+    EXPECT_LE(num_ranges, split_length / target) << split_length;
+  }
+}
+
+// A text file whose blocks are broken into many ranges is scanned in full, with every
+// row that crosses a range boundary read exactly once.
+TEST_F(HdfsScanNodeTest, SplitLargeTextFiles) {
+  TestTable table("split_text_tbl", TEST_DIR + "/split_text_tbl", THdfsFileFormat::TEXT);
+  table.AddColumn("i", TYPE_INT);
+  table.AddColumn("s", TYPE_STRING);
+  table.set_block_size(32 * 1024);
+  ASSERT_TRUE(table.Create().ok());
+  const int NUM_ROWS = 20000;
+  stringstream contents;
+  int64_t sum_length = 0;
+  for (int i = 0; i < NUM_ROWS; ++i) {
+    // Rows of varying length, so that range boundaries fall anywhere within a row.
+    string s(i % 13, 'a' + i % 26);
+    contents << i << "," << s << "\n";
+    sum_length += s.size();
+  }
+  ASSERT_TRUE(table.WriteFile("", "data.txt", contents.str()).ok());
+  ASSERT_TRUE(table.Update().ok());
+  const int64_t num_blocks = (contents.str().size() + 32 * 1024 - 1) / (32 * 1024);
+
+  FLAGS_text_scan_range_split_bytes = 4 * 1024;
+  vector<string> options;
+  options.push_back("NUM_SCANNER_THREADS=4");
+  vector<string> rows;
+  string profile;
+  RunQuery("select count(*), sum(i), sum(length(s)) from split_text_tbl", options,
+      &rows, &profile);
+  FLAGS_text_scan_range_split_bytes = 64L * 1024L * 1024L;
+
+  stringstream expected_row;
+  expected_row << NUM_ROWS << "\t" << static_cast<int64_t>(NUM_ROWS) * (NUM_ROWS - 1) / 2
+               << "\t" << sum_length;
+  ASSERT_EQ(1, rows.size());
+  EXPECT_EQ(expected_row.str(), rows[0]);
+  // Every full block is broken into 8 ranges.
+  EXPECT_GT(ImpaladQueryExecutor::GetCounterValue(profile, "ScanRangesComplete"),
+      num_blocks) << profile;
+}
+
+// Only scans with a limit over more files than the initial group defer files.
+TEST_F(HdfsScanNodeTest, IssueFilesInGroups) {
+  EXPECT_TRUE(IssueFilesInGroups(10, 5, 4));
+  EXPECT_FALSE(IssueFilesInGroups(10, 4, 4));
+  EXPECT_FALSE(IssueFilesInGroups(-1, 100, 4));
+  EXPECT_FALSE(IssueFilesInGroups(0, 100, 4));
+  // An initial group size of 0 disables deferring.
+  EXPECT_FALSE(IssueFilesInGroups(10, 100, 0));
+}
+
+// Groups double in size until all deferred files are issued.
+TEST_F(HdfsScanNodeTest, NextFileGroupSize) {
+  int num_deferred = 100;
+  int next_group_size = 4;
+  int expected_sizes[] = {4, 8, 16, 32, 40};
+  for (int i = 0; i < sizeof(expected_sizes) / sizeof(int); ++i) {
+    int num_files = NextFileGroupSize(num_deferred, &next_group_size);
+    EXPECT_EQ(expected_sizes[i], num_files);
+    num_deferred -= num_files;
+  }
+  EXPECT_EQ(0, num_deferred);
+  EXPECT_EQ(0, NextFileGroupSize(num_deferred, &next_group_size));
+}
+
+// A scanner thread without work only issues more files once half of the issued splits
+// are done, and never gives up the last thread.
+TEST_F(HdfsScanNodeTest, ExitInsteadOfIssuingFiles) {
+  EXPECT_TRUE(ExitInsteadOfIssuingFiles(10, 2, 0, 4));
+  EXPECT_TRUE(ExitInsteadOfIssuingFiles(10, 4, 1, 4));
+  EXPECT_FALSE(ExitInsteadOfIssuingFiles(10, 4, 2, 4));
+  EXPECT_FALSE(ExitInsteadOfIssuingFiles(10, 4, 4, 4));
+  // The last active thread has to issue the next group, otherwise the scan would hang.
+  EXPECT_FALSE(ExitInsteadOfIssuingFiles(10, 1, 0, 4));
+  // Nothing left to issue.
+  EXPECT_FALSE(ExitInsteadOfIssuingFiles(0, 4, 0, 4));
+}
+
+// A scan with a limit over many files only reads the first groups of files when the
+// limit is met early, and still reads every file when it isn't.
+TEST_F(HdfsScanNodeTest, LimitScanIssuesFilesInGroups) {
+  TestTable table("limit_tbl", TEST_DIR + "/limit_tbl", THdfsFileFormat::TEXT);
+  table.AddColumn("i", TYPE_INT);
+  ASSERT_TRUE(table.Create().ok());
+  const int NUM_FILES = 64;
+  const int ROWS_PER_FILE = 100;
+  for (int file = 0; file < NUM_FILES; ++file) {
+    stringstream contents, file_name;
+    for (int i = 0; i < ROWS_PER_FILE; ++i) contents << file * ROWS_PER_FILE + i << "\n";
+    file_name << "data" << file << ".txt";
+    ASSERT_TRUE(table.WriteFile("", file_name.str(), contents.str()).ok());
+  }
+  ASSERT_TRUE(table.Update().ok());
+
+  vector<string> options;
+  vector<string> rows;
+  string profile;
+  RunQuery("select i from limit_tbl limit 10", options, &rows, &profile);
+  EXPECT_EQ(10, rows.size());
+  int64_t ranges_complete =
+      ImpaladQueryExecutor::GetCounterValue(profile, "ScanRangesComplete");
+  EXPECT_GT(ranges_complete, 0) << profile;
+  EXPECT_LT(ranges_complete, NUM_FILES / 2) << profile;
+
+  // A limit that takes several groups.
+  RunQuery("select count(*) from (select i from limit_tbl limit 1000) t", options,
+      &rows, &profile);
+  ASSERT_EQ(1, rows.size());
+  EXPECT_EQ("1000", rows[0]);
+
+  // A limit above the number of rows issues every group.
+  const int num_rows = NUM_FILES * ROWS_PER_FILE;
+  RunQuery("select count(*), sum(i) from (select i from limit_tbl limit 100000) t",
+      options, &rows, &profile);
+  stringstream expected_row;
+  expected_row << num_rows << "\t" << static_cast<int64_t>(num_rows) * (num_rows - 1) / 2;
+  ASSERT_EQ(1, rows.size());
+  EXPECT_EQ(expected_row.str(), rows[0]);
+  EXPECT_EQ(NUM_FILES, ImpaladQueryExecutor::GetCounterValue(profile,
+      "ScanRangesComplete")) << profile;
+}
+
+// Scanner threads move between the files of partitions with different key values,
+// which share their partition's template tuple. Every row gets its own partition's keys.
+TEST_F(HdfsScanNodeTest, PartitionTemplateTuples) {
+  TestTable table("partitioned_tbl", TEST_DIR + "/partitioned_tbl",
+      THdfsFileFormat::TEXT);
+  table.AddColumn("i", TYPE_INT);
+  table.AddPartitionColumn("p", TYPE_INT);
+  table.AddPartitionColumn("q", TYPE_STRING);
+  ASSERT_TRUE(table.Create().ok());
+  // The value of q is 'a' + p, or NULL for p = 3. Rows have i / 1000 = p.
+  const char* partitions[] = {"p=1/q=b", "p=2/q=c", "p=3/q=__HIVE_DEFAULT_PARTITION__"};
+  const int NUM_PARTITIONS = 3;
+  const int FILES_PER_PARTITION = 8;
+  const int ROWS_PER_FILE = 10;
+  // Files are named so that those of different partitions alternate in name order.
+  for (int file = 0; file < FILES_PER_PARTITION; ++file) {
+    for (int p = 1; p <= NUM_PARTITIONS; ++p) {
+      stringstream contents, file_name;
+      for (int r = 0; r < ROWS_PER_FILE; ++r) {
+        contents << p * 1000 + file * ROWS_PER_FILE + r << "\n";
+      }
+      file_name << "data" << file << "_" << p << ".txt";
+      ASSERT_TRUE(
+          table.WriteFile(partitions[p - 1], file_name.str(), contents.str()).ok());
+    }
+  }
+  ASSERT_TRUE(table.Update().ok());
+
+  vector<string> options;
+  options.push_back("NUM_SCANNER_THREADS=2");
+  vector<string> rows;
+  string profile;
+  RunQuery("select p, q, i from partitioned_tbl", options, &rows, &profile);
+  ASSERT_EQ(NUM_PARTITIONS * FILES_PER_PARTITION * ROWS_PER_FILE, rows.size());
+  for (int r = 0; r < rows.size(); ++r) {
+    int p, i;
+    char q[16];
+    ASSERT_EQ(3, sscanf(rows[r].c_str(), "%d\t%15s\t%d", &p, q, &i)) << rows[r];
+    EXPECT_EQ(i / 1000, p) << rows[r];
+    EXPECT_EQ(p == 3 ? string("NULL") : string(1, 'a' + p), q) << rows[r];
+  }
+
+  // Only partition keys are materialized, so rows point at the template tuples.
+  RunQuery("select p, q, count(*) from partitioned_tbl group by p, q", options, &rows,
+      &profile);
+  sort(rows.begin(), rows.end());
+  ASSERT_EQ(NUM_PARTITIONS, rows.size());
+  EXPECT_EQ("1\tb\t80", rows[0]);
+  EXPECT_EQ("2\tc\t80", rows[1]);
+  EXPECT_EQ("3\tNULL\t80", rows[2]);
+}
+
+// A fragment that fails after its scan node started issuing ranges during codegen
+// cancels its reads: the query fails without hanging in Close() and leaves no request
+// context, buffer or open file behind in the IoMgr.
+TEST_F(HdfsScanNodeTest, FailAfterStartIo) {
+  TestTable table("fail_tbl", TEST_DIR + "/fail_tbl", THdfsFileFormat::TEXT);
+  table.AddColumn("i", TYPE_INT);
+  ASSERT_TRUE(table.Create().ok());
+  const int NUM_FILES = 16;
+  const int ROWS_PER_FILE = 1000;
+  for (int file = 0; file < NUM_FILES; ++file) {
+    stringstream contents, file_name;
+    for (int i = 0; i < ROWS_PER_FILE; ++i) contents << file * ROWS_PER_FILE + i << "\n";
+    file_name << "data" << file << ".txt";
+    ASSERT_TRUE(table.WriteFile("", file_name.str(), contents.str()).ok());
+  }
+  ASSERT_TRUE(table.Update().ok());
+
+  // Node 0 is the scan and node 1 the aggregation above it. The aggregation is codegen'd,
+  // so the scan node's StartIo() runs before either node is opened. The failures in
+  // Prepare() happen before StartIo() and the one in GetNext() with reads in flight.
+  const char* debug_actions[] = {"1:PREPARE:FAIL", "0:OPEN:FAIL", "1:OPEN:FAIL",
+      "0:GETNEXT:FAIL"};
+  const string stmt = "select count(*) from fail_tbl";
+  DiskIoMgr* io_mgr = ExecEnv::GetInstance()->disk_io_mgr();
+  for (int i = 0; i < sizeof(debug_actions) / sizeof(char*); ++i) {
+    vector<string> options;
+    options.push_back(string("DEBUG_ACTION=") + debug_actions[i]);
+    executor_->setExecOptions(options);
+    Status status = executor_->Exec(stmt, NULL);
+    vector<string> rows;
+    if (status.ok()) status = executor_->FetchAll(&rows);
+    EXPECT_FALSE(status.ok()) << debug_actions[i];
+    EXPECT_NE(string::npos, status.GetDetail().find("Debug Action: FAIL"))
+        << debug_actions[i] << "\n" << status.GetDetail();
+    executor_->Close();
+
+    // Fragments are torn down asynchronously once the query is closed.
+    int64_t deadline = MonotonicMillis() + 10000;
+    while (MonotonicMillis() < deadline && (io_mgr->num_active_contexts() > 0 ||
+        io_mgr->num_buffers_in_readers() > 0 ||
+        ImpaladMetrics::IO_MGR_NUM_OPEN_FILES->value() > 0)) {
+      SleepForMs(10);
+    }
+    EXPECT_EQ(0, io_mgr->num_active_contexts()) << debug_actions[i];
+    EXPECT_EQ(0, io_mgr->num_buffers_in_readers()) << debug_actions[i];
+    EXPECT_EQ(0, ImpaladMetrics::IO_MGR_NUM_OPEN_FILES->value()) << debug_actions[i];
+  }
+
+  // The failed queries left the scan in a usable state.
+  vector<string> rows;
+  string profile;
+  RunQuery(stmt, vector<string>(), &rows, &profile);
+  ASSERT_EQ(1, rows.size());
+  stringstream expected_row;
+  expected_row << NUM_FILES * ROWS_PER_FILE;
+  EXPECT_EQ(expected_row.str(), rows[0]);
+}
+
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  InitCommonRuntime(argc, argv, true, TestInfo::BE_TEST);
+  InitFeSupport();
+  LlvmCodeGen::InitializeLlvm();
+
+  FLAGS_impalad = "localhost:21000";
+  FLAGS_abort_on_config_error = false;
+  InProcessImpalaServer* impala_server =
+      new InProcessImpalaServer("localhost", FLAGS_be_port, 0, 0, "", 0);
+  EXIT_IF_ERROR(
+      impala_server->StartWithClientServers(FLAGS_beeswax_port, FLAGS_beeswax_port + 1,
+                                            false));
+  impala_server->SetCatalogInitialized();
+  executor_ = new ImpaladQueryExecutor();
+  EXIT_IF_ERROR(executor_->Setup());
+  return RUN_ALL_TESTS();
+}
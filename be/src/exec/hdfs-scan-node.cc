@@ -21,6 +21,7 @@
 #include "exec/hdfs-avro-scanner.h"
 #include "exec/hdfs-parquet-scanner.h"
 
+#include <limits>
 #include <sstream>
 #include <boost/algorithm/string.hpp>
 #include <boost/foreach.hpp>
@@ -39,6 +40,7 @@
 #include "runtime/mem-pool.h"
 #include "runtime/raw-value.h"
 #include "runtime/row-batch.h"
+#include "runtime/tuple-row.h"
 #include "util/bit-util.h"
 #include "util/container-util.h"
 #include "util/debug-util.h"
@@ -48,10 +50,22 @@
 #include "util/impalad-metrics.h"
 #include "util/periodic-counter-updater.h"
 #include "util/runtime-profile.h"
+#include "util/time.h"
 
 #include "gen-cpp/PlanNodes_types.h"
 
 DEFINE_int32(max_row_batches, 0, "the maximum size of materialized_row_batches_");
+DEFINE_int32(scanner_thread_scaling_interval_ms, 100, "(Advanced) Interval at which "
+    "hdfs scan nodes re-evaluate the number of scanner threads they need, based on the "
+    "row batch queue occupancy and the time the consumer spent waiting for batches. "
+    "Set to 0 to disable.");
+DEFINE_int32(limit_scan_initial_files, 4, "(Advanced) For scans with a limit, the "
+    "number of files to issue initially. More files are issued in groups of doubling "
+    "size as the scanner threads run out of work. Set to 0 to issue all files at once.");
+DEFINE_int64(text_scan_range_split_bytes, 64L * 1024L * 1024L, "(Advanced) Splits of "
+    "uncompressed text files that are more than twice this size are scanned as multiple "
+    "ranges of about this size, so that large splits don't leave a few scanner threads "
+    "working on the tail of a scan. Set to 0 to disable.");
 DECLARE_string(cgroup_hierarchy_path);
 DECLARE_bool(enable_rm);
 
@@ -77,6 +91,15 @@ const int COMPRESSED_TEXT_COMPRESSION_RATIO = 11;
 // Determines how many unexpected remote bytes trigger an error in the runtime state
 const int UNEXPECTED_REMOTE_BYTES_WARN_THRESHOLD = 64 * 1024 * 1024;
 
+// Thresholds used by UpdateScannerThreadTarget(). Scanner threads are scaled down if, on
+// average, they spent more than SCALE_DOWN_PRODUCER_WAIT_RATIO of the last interval
+// blocked on a mostly full row batch queue. They are scaled up if the consumer spent more
+// than SCALE_UP_CONSUMER_WAIT_RATIO of the interval waiting on a mostly empty queue.
+const double SCALE_DOWN_PRODUCER_WAIT_RATIO = 0.5;
+const double SCALE_DOWN_QUEUE_OCCUPANCY = 0.75;
+const double SCALE_UP_CONSUMER_WAIT_RATIO = 0.5;
+const double SCALE_UP_QUEUE_OCCUPANCY = 0.25;
+
 HdfsScanNode::HdfsScanNode(ObjectPool* pool, const TPlanNode& tnode,
                            const DescriptorTbl& descs)
     : ScanNode(pool, tnode, descs),
@@ -87,10 +110,21 @@ HdfsScanNode::HdfsScanNode(ObjectPool* pool, const TPlanNode& tnode,
       tuple_desc_(NULL),
       unknown_disk_id_warned_(false),
       initial_ranges_issued_(false),
+      io_opened_(false),
+      initial_ranges_queued_(false),
       scanner_thread_bytes_required_(0),
+      template_tuple_copy_len_(0),
+      time_to_first_row_counter_(NULL),
+      first_row_returned_(false),
       disks_accessed_bitmap_(TUnit::UNIT, 0),
       done_(false),
       all_ranges_started_(false),
+      scanner_thread_target_(numeric_limits<int>::max()),
+      last_scaling_time_ms_(0),
+      last_queue_get_wait_time_(0),
+      last_queue_put_wait_time_(0),
+      next_file_group_size_(0),
+      num_issued_splits_(0),
       counters_running_(false),
       rm_callback_id_(-1) {
   max_materialized_row_batches_ = FLAGS_max_row_batches;
@@ -115,17 +149,35 @@ Status HdfsScanNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos
     // been generated (e.g. probe side bitmap filters).
     // TODO: we could do dynamic partition pruning here as well.
     initial_ranges_issued_ = true;
-    // Issue initial ranges for all file types.
-    RETURN_IF_ERROR(HdfsTextScanner::IssueInitialRanges(this,
-        per_type_files_[THdfsFileFormat::TEXT]));
-    RETURN_IF_ERROR(BaseSequenceScanner::IssueInitialRanges(this,
-        per_type_files_[THdfsFileFormat::SEQUENCE_FILE]));
-    RETURN_IF_ERROR(BaseSequenceScanner::IssueInitialRanges(this,
-        per_type_files_[THdfsFileFormat::RC_FILE]));
-    RETURN_IF_ERROR(BaseSequenceScanner::IssueInitialRanges(this,
-        per_type_files_[THdfsFileFormat::AVRO]));
-    RETURN_IF_ERROR(HdfsParquetScanner::IssueInitialRanges(this,
-        per_type_files_[THdfsFileFormat::PARQUET]));
+    if (initial_ranges_queued_) {
+      // StartIo() issued the ranges while the fragment was being compiled. Now that the
+      // code-generated functions are ready, start the scanner threads for them.
+      ThreadTokenAvailableCb(runtime_state_->resource_pool());
+    } else if (IssueFilesInGroups()) {
+      // The limit is likely to be satisfied by a few files. Start with a small group of
+      // files and only issue more when the scanner threads run out of work, rather
+      // than queueing io for every file.
+      for (FileFormatsMap::iterator it = per_type_files_.begin();
+           it != per_type_files_.end(); ++it) {
+        BOOST_FOREACH(HdfsFileDesc* file, it->second) {
+          deferred_files_.push_back(make_pair(it->first, file));
+        }
+      }
+      next_file_group_size_ = FLAGS_limit_scan_initial_files;
+      // Keep issuing groups until one of them queued io, otherwise no scanner thread
+      // would be started to issue the next group (e.g. if all files were answered
+      // from metadata).
+      bool issue_next_group = true;
+      while (issue_next_group) {
+        RETURN_IF_ERROR(IssueNextFileGroup());
+        unique_lock<mutex> l(lock_);
+        issue_next_group = !deferred_files_.empty() &&
+            progress_.num_complete() >= num_issued_splits_;
+      }
+    } else {
+      // Issue initial ranges for all file types.
+      RETURN_IF_ERROR(IssueFiles(&per_type_files_));
+    }
     if (progress_.done()) SetDone();
   }
 
@@ -148,35 +200,170 @@ Status HdfsScanNode::GetNextInternal(
     return Status::OK;
   }
   *eos = false;
-  RowBatch* materialized_batch = materialized_row_batches_->GetBatch();
-  if (materialized_batch != NULL) {
-    num_owned_io_buffers_ -= materialized_batch->num_io_buffers();
-    row_batch->AcquireState(materialized_batch);
-    // Update the number of materialized rows now instead of when they are materialized.
-    // This means that scanners might process and queue up more rows than are necessary
-    // for the limit case but we want to avoid the synchronized writes to
-    // num_rows_returned_.
-    num_rows_returned_ += row_batch->num_rows();
+  if (!GetNextMetadataOnlyRows(row_batch)) {
+    RowBatch* materialized_batch = materialized_row_batches_->GetBatch();
+    if (materialized_batch == NULL) {
+      // The RowBatchQueue was shutdown either because all scan ranges are complete or a
+      // scanner thread encountered an error.  Check status_ to distinguish those cases.
+      // Files issued by scanner threads may have added metadata-only rows before their
+      // ranges completed, so those have to be returned first.
+      if (!GetNextMetadataOnlyRows(row_batch)) {
+        *eos = true;
+        unique_lock<mutex> l(lock_);
+        return status_;
+      }
+    } else {
+      num_owned_io_buffers_ -= materialized_batch->num_io_buffers();
+      row_batch->AcquireState(materialized_batch);
+      DCHECK_EQ(materialized_batch->num_io_buffers(), 0);
+      delete materialized_batch;
+    }
+  }
+
+  if (!first_row_returned_ && row_batch->num_rows() > 0) {
+    first_row_returned_ = true;
+    time_to_first_row_sw_.Stop();
+    COUNTER_SET(time_to_first_row_counter_,
+        static_cast<int64_t>(time_to_first_row_sw_.ElapsedTime()));
+  }
+
+  // Update the number of materialized rows now instead of when they are materialized.
+  // This means that scanners might process and queue up more rows than are necessary
+  // for the limit case but we want to avoid the synchronized writes to
+  // num_rows_returned_.
+  num_rows_returned_ += row_batch->num_rows();
+  COUNTER_SET(rows_returned_counter_, num_rows_returned_);
+
+  if (ReachedLimit()) {
+    int num_rows_over = num_rows_returned_ - limit_;
+    row_batch->set_num_rows(row_batch->num_rows() - num_rows_over);
+    num_rows_returned_ -= num_rows_over;
     COUNTER_SET(rows_returned_counter_, num_rows_returned_);
 
-    if (ReachedLimit()) {
-      int num_rows_over = num_rows_returned_ - limit_;
-      row_batch->set_num_rows(row_batch->num_rows() - num_rows_over);
-      num_rows_returned_ -= num_rows_over;
-      COUNTER_SET(rows_returned_counter_, num_rows_returned_);
+    *eos = true;
+    SetDone();
+  }
+  return Status::OK;
+}
 
-      *eos = true;
-      SetDone();
+void HdfsScanNode::AddMetadataOnlyRows(int64_t partition_id, int64_t num_rows) {
+  DCHECK(materialized_slots_.empty());
+  COUNTER_ADD(num_metadata_only_files_counter_, 1);
+  COUNTER_ADD(rows_read_counter_, num_rows);
+  if (num_rows == 0) return;
+
+  HdfsPartitionDescriptor* partition = hdfs_table_->GetPartition(partition_id);
+  DCHECK(partition != NULL);
+  Tuple* template_tuple = GetTemplateTuple(partition);
+
+  // All rows of the file are identical, so the conjuncts only need to be evaluated once.
+  // The conjunct contexts are not cloned per thread, so evaluate them with lock_ held.
+  vector<Tuple*> tuples(row_desc().tuple_descriptors().size(), NULL);
+  TupleRow* row = reinterpret_cast<TupleRow*>(&tuples[0]);
+  row->SetTuple(tuple_idx(), template_tuple);
+  const vector<ExprContext*>& ctxs = ExecNode::conjunct_ctxs();
+  unique_lock<mutex> l(lock_);
+  if (!ctxs.empty() && !EvalConjuncts(&ctxs[0], ctxs.size(), row)) return;
+
+  MetadataOnlyRows rows;
+  rows.template_tuple = template_tuple;
+  rows.num_rows = num_rows;
+  metadata_only_rows_.push_back(rows);
+}
+
+bool HdfsScanNode::GetNextMetadataOnlyRows(RowBatch* row_batch) {
+  unique_lock<mutex> l(lock_);
+  if (metadata_only_rows_.empty()) return false;
+  while (!metadata_only_rows_.empty()) {
+    MetadataOnlyRows& rows = metadata_only_rows_.back();
+    int num_rows = min(rows.num_rows,
+        static_cast<int64_t>(row_batch->capacity() - row_batch->num_rows()));
+    if (num_rows == 0) break;
+    int first_row_idx = row_batch->AddRows(num_rows);
+    DCHECK_NE(first_row_idx, RowBatch::INVALID_ROW_INDEX);
+    row_batch->CommitRows(num_rows);
+    for (int i = first_row_idx; i < first_row_idx + num_rows; ++i) {
+      row_batch->GetRow(i)->SetTuple(tuple_idx(), rows.template_tuple);
     }
-    DCHECK_EQ(materialized_batch->num_io_buffers(), 0);
-    delete materialized_batch;
-    return Status::OK;
+    rows.num_rows -= num_rows;
+    if (rows.num_rows == 0) metadata_only_rows_.pop_back();
+  }
+  return true;
+}
+
+bool HdfsScanNode::IssueFilesInGroups() const {
+  return IssueFilesInGroups(limit_, file_descs_.size(), FLAGS_limit_scan_initial_files);
+}
+
+int64_t HdfsScanNode::GetTextRangeLength(int64_t split_length,
+    int64_t target_range_length) {
+  if (target_range_length <= 0 || split_length <= 2 * target_range_length) {
+    return split_length;
   }
-  // The RowBatchQueue was shutdown either because all scan ranges are complete or a
-  // scanner thread encountered an error.  Check status_ to distinguish those cases.
-  *eos = true;
+  int64_t num_ranges = split_length / target_range_length;
+  return (split_length + num_ranges - 1) / num_ranges;
+}
+
+bool HdfsScanNode::IssueFilesInGroups(int64_t limit, int64_t num_files,
+    int initial_files) {
+  return limit > 0 && initial_files > 0 && num_files > initial_files;
+}
+
+int HdfsScanNode::NextFileGroupSize(int num_deferred_files, int* next_file_group_size) {
+  int num_files = ::min(*next_file_group_size, num_deferred_files);
+  *next_file_group_size *= 2;
+  return num_files;
+}
+
+bool HdfsScanNode::ExitInsteadOfIssuingFiles(int num_deferred_files, int num_active,
+    int64_t num_complete_splits, int64_t num_issued_splits) {
+  if (num_deferred_files == 0 || num_active <= 1) return false;
+  // Only grow the scan once at least half of the issued splits are done. Until then the
+  // other scanner threads are still working on ranges that may satisfy the limit.
+  return num_complete_splits < num_issued_splits / 2;
+}
+
+Status HdfsScanNode::IssueFiles(FileFormatsMap* files) {
+  RETURN_IF_ERROR(HdfsTextScanner::IssueInitialRanges(this,
+      (*files)[THdfsFileFormat::TEXT]));
+  RETURN_IF_ERROR(BaseSequenceScanner::IssueInitialRanges(this,
+      (*files)[THdfsFileFormat::SEQUENCE_FILE]));
+  RETURN_IF_ERROR(BaseSequenceScanner::IssueInitialRanges(this,
+      (*files)[THdfsFileFormat::RC_FILE]));
+  RETURN_IF_ERROR(BaseSequenceScanner::IssueInitialRanges(this,
+      (*files)[THdfsFileFormat::AVRO]));
+  RETURN_IF_ERROR(HdfsParquetScanner::IssueInitialRanges(this,
+      (*files)[THdfsFileFormat::PARQUET]));
+  return Status::OK;
+}
+
+Status HdfsScanNode::IssueNextFileGroup() {
+  FileFormatsMap files;
+  {
+    unique_lock<mutex> l(lock_);
+    if (done_ || deferred_files_.empty()) return Status::OK;
+    int num_files = NextFileGroupSize(deferred_files_.size(), &next_file_group_size_);
+    for (int i = 0; i < num_files; ++i) {
+      files[deferred_files_.front().first].push_back(deferred_files_.front().second);
+      num_issued_splits_ += deferred_files_.front().second->splits.size();
+      deferred_files_.pop_front();
+    }
+    VLOG_FILE << "Scan node (id=" << id() << ") issuing " << num_files << " files, "
+              << deferred_files_.size() << " files deferred";
+  }
+  // Issue outside of lock_ since issuing ranges starts scanner threads.
+  return IssueFiles(&files);
+}
+
+bool HdfsScanNode::ExitInsteadOfIssuingFiles() {
   unique_lock<mutex> l(lock_);
-  return status_;
+  if (!ExitInsteadOfIssuingFiles(deferred_files_.size(),
+      active_scanner_thread_counter_.value(), progress_.num_complete(),
+      num_issued_splits_)) {
+    return false;
+  }
+  COUNTER_ADD(&active_scanner_thread_counter_, -1);
+  return true;
 }
 
 DiskIoMgr::ScanRange* HdfsScanNode::AllocateScanRange(
@@ -193,10 +380,10 @@ DiskIoMgr::ScanRange* HdfsScanNode::AllocateScanRange(
       << "Scan range beyond end of file (offset=" << offset << ", len=" << len << ")";
   disk_id = runtime_state_->io_mgr()->AssignQueue(file, disk_id, expected_local);
 
+  ObjectPool* pool = runtime_state_->obj_pool();
   ScanRangeMetadata* metadata =
-      runtime_state_->obj_pool()->Add(new ScanRangeMetadata(partition_id));
-  DiskIoMgr::ScanRange* range =
-      runtime_state_->obj_pool()->Add(new DiskIoMgr::ScanRange());
+      pool->AddInPlace(new (pool) ScanRangeMetadata(partition_id));
+  DiskIoMgr::ScanRange* range = pool->AddInPlace(new (pool) DiskIoMgr::ScanRange());
   range->Reset(fs, file, len, offset, disk_id, try_cache, expected_local, metadata);
   return range;
 }
@@ -265,16 +452,17 @@ HdfsScanner* HdfsScanNode::CreateAndPrepareScanner(HdfsPartitionDescriptor* part
   return scanner;
 }
 
-Tuple* HdfsScanNode::InitTemplateTuple(RuntimeState* state,
-                                       const vector<ExprContext*>& value_ctxs) {
+Tuple* HdfsScanNode::GetTemplateTuple(const HdfsPartitionDescriptor* partition) {
   if (partition_key_slots_.empty()) return NULL;
 
-  // Look to protect access to partition_key_pool_ and value_ctxs
-  // TODO: we can push the lock to the mempool and exprs_values should not
-  // use internal memory.
-  Tuple* template_tuple = InitEmptyTemplateTuple();
-
+  // lock_ protects partition_template_tuples_, scan_node_pool_ and the partition's
+  // value ctxs, which are shared by all scanner threads.
   unique_lock<mutex> l(lock_);
+  Tuple*& template_tuple = partition_template_tuples_[partition->id()];
+  if (template_tuple != NULL) return template_tuple;
+
+  template_tuple = Tuple::Create(tuple_desc_->byte_size(), scan_node_pool_.get());
+  const vector<ExprContext*>& value_ctxs = partition->partition_key_value_ctxs();
   for (int i = 0; i < partition_key_slots_.size(); ++i) {
     const SlotDescriptor* slot_desc = partition_key_slots_[i];
     // Exprs guaranteed to be literals, so can safely be evaluated without a row context
@@ -284,14 +472,14 @@ Tuple* HdfsScanNode::InitTemplateTuple(RuntimeState* state,
   return template_tuple;
 }
 
-Tuple* HdfsScanNode::InitEmptyTemplateTuple() {
-  Tuple* template_tuple = NULL;
+Tuple* HdfsScanNode::CopyTemplateTuple(const Tuple* template_tuple) {
+  Tuple* copy = NULL;
   {
     unique_lock<mutex> l(lock_);
-    template_tuple = Tuple::Create(tuple_desc_->byte_size(), scan_node_pool_.get());
+    copy = Tuple::Create(tuple_desc_->byte_size(), scan_node_pool_.get());
   }
-  memset(template_tuple, 0, tuple_desc_->byte_size());
-  return template_tuple;
+  if (template_tuple != NULL) memcpy(copy, template_tuple, tuple_desc_->byte_size());
+  return copy;
 }
 
 void HdfsScanNode::TransferToScanNodePool(MemPool* pool) {
@@ -328,6 +516,16 @@ Status HdfsScanNode::Prepare(RuntimeState* state) {
     }
   }
 
+  // Template tuples only set the null indicator bytes, which are at the start of the
+  // tuple, and the partition key slots. Scanners materialize the remaining slots, so
+  // they only need to copy the template up to the end of the last partition key slot.
+  template_tuple_copy_len_ = tuple_desc_->num_null_bytes();
+  for (int i = 0; i < partition_key_slots_.size(); ++i) {
+    const SlotDescriptor* slot_desc = partition_key_slots_[i];
+    template_tuple_copy_len_ = ::max(template_tuple_copy_len_,
+        slot_desc->tuple_offset() + slot_desc->slot_size());
+  }
+
   // Order the materialized slots such that for schemaless file formats (e.g. text) the
   // order corresponds to the physical order in files. For formats where the file schema
   // is independent of the table schema (e.g. Avro, Parquet), this step is not necessary.
@@ -365,7 +563,8 @@ Status HdfsScanNode::Prepare(RuntimeState* state) {
     FileDescMap::iterator file_desc_it = file_descs_.find(native_file_path);
     if (file_desc_it == file_descs_.end()) {
       // Add new file_desc to file_descs_ and per_type_files_
-      file_desc = runtime_state_->obj_pool()->Add(new HdfsFileDesc(native_file_path));
+      ObjectPool* pool = runtime_state_->obj_pool();
+      file_desc = pool->AddInPlace(new (pool) HdfsFileDesc(native_file_path));
       file_descs_[native_file_path] = file_desc;
       file_desc->file_length = split.file_length;
       file_desc->file_compression = split.file_compression;
@@ -399,10 +598,21 @@ Status HdfsScanNode::Prepare(RuntimeState* state) {
     if (runtime_state_->query_options().disable_cached_reads) {
       DCHECK(!try_cache) << "Params should not have had this set.";
     }
-    file_desc->splits.push_back(
-        AllocateScanRange(file_desc->fs, file_desc->filename.c_str(), split.length,
-            split.offset, split.partition_id, (*scan_range_params_)[i].volume_id,
-            try_cache, expected_local));
+    // Uncompressed text can be scanned from any offset, so break up large splits.
+    int64_t range_len = split.length;
+    if (partition_desc->file_format() == THdfsFileFormat::TEXT &&
+        split.file_compression == THdfsCompression::NONE) {
+      range_len = GetTextRangeLength(split.length, FLAGS_text_scan_range_split_bytes);
+    }
+    int64_t offset = 0;
+    do {
+      file_desc->splits.push_back(
+          AllocateScanRange(file_desc->fs, file_desc->filename.c_str(),
+              ::min(range_len, split.length - offset), split.offset + offset,
+              split.partition_id, (*scan_range_params_)[i].volume_id, try_cache,
+              expected_local));
+      offset += range_len;
+    } while (offset < split.length);
   }
 
   // Compute the minimum bytes required to start a new thread. This is based on the
@@ -507,6 +717,35 @@ Status HdfsScanNode::Prepare(RuntimeState* state) {
 // to queue up a non-zero number of those splits to the io mgr (via the ScanNode).
 Status HdfsScanNode::Open(RuntimeState* state) {
   RETURN_IF_ERROR(ExecNode::Open(state));
+  if (!io_opened_) RETURN_IF_ERROR(OpenIo(state));
+  if (file_descs_.empty()) return Status::OK;
+
+  // Open all the partition exprs used by the scan node
+  BOOST_FOREACH(const int64_t& partition_id, partition_ids_) {
+    HdfsPartitionDescriptor* partition_desc = hdfs_table_->GetPartition(partition_id);
+    DCHECK(partition_desc != NULL);
+    RETURN_IF_ERROR(partition_desc->OpenExprs(state));
+  }
+
+  // Open all conjuncts
+  Expr::Open(conjunct_ctxs_, state);
+  return Status::OK;
+}
+
+Status HdfsScanNode::StartIo(RuntimeState* state) {
+  RETURN_IF_ERROR(OpenIo(state));
+  // Files that may be answered from metadata need the conjuncts and partition exprs,
+  // which are only opened in Open(), and scans that issue their files in groups only
+  // want to read the first group. Both are left to GetNext().
+  if (done_ || materialized_slots_.empty() || IssueFilesInGroups()) return Status::OK;
+  RETURN_IF_ERROR(IssueFiles(&per_type_files_));
+  initial_ranges_queued_ = true;
+  return Status::OK;
+}
+
+Status HdfsScanNode::OpenIo(RuntimeState* state) {
+  DCHECK(!io_opened_);
+  io_opened_ = true;
 
   // We need at least one scanner thread to make progress. We need to make this
   // reservation before any ranges are issued.
@@ -530,16 +769,6 @@ Status HdfsScanNode::Open(RuntimeState* state) {
     return Status::OK;
   }
 
-  // Open all the partition exprs used by the scan node
-  BOOST_FOREACH(const int64_t& partition_id, partition_ids_) {
-    HdfsPartitionDescriptor* partition_desc = hdfs_table_->GetPartition(partition_id);
-    DCHECK(partition_desc != NULL);
-    RETURN_IF_ERROR(partition_desc->OpenExprs(state));
-  }
-
-  // Open all conjuncts
-  Expr::Open(conjunct_ctxs_, state);
-
   RETURN_IF_ERROR(runtime_state_->io_mgr()->RegisterContext(
       &reader_context_, mem_tracker()));
 
@@ -558,6 +787,18 @@ Status HdfsScanNode::Open(RuntimeState* state) {
   }
   num_scanner_threads_started_counter_ =
       ADD_COUNTER(runtime_profile(), NUM_SCANNER_THREADS_STARTED, TUnit::UNIT);
+  scanner_thread_scale_ups_counter_ =
+      ADD_COUNTER(runtime_profile(), "ScannerThreadScaleUps", TUnit::UNIT);
+  scanner_thread_scale_downs_counter_ =
+      ADD_COUNTER(runtime_profile(), "ScannerThreadScaleDowns", TUnit::UNIT);
+  last_scaling_time_ms_ = MonotonicMillis();
+  num_metadata_only_files_counter_ =
+      ADD_COUNTER(runtime_profile(), "NumFilesAnsweredFromMetadata", TUnit::UNIT);
+  time_to_first_row_counter_ = ADD_TIMER(runtime_profile(), "TimeToFirstRow");
+  num_split_ranges_counter_ =
+      ADD_COUNTER(runtime_profile(), "ScanRangesSplit", TUnit::UNIT);
+  split_range_time_counter_ = ADD_TIMER(runtime_profile(), "SplitScanRangeTime");
+  time_to_first_row_sw_.Start();
 
   runtime_state_->io_mgr()->set_bytes_read_counter(reader_context_, bytes_read_counter());
   runtime_state_->io_mgr()->set_read_timer(reader_context_, read_timer());
@@ -581,13 +822,17 @@ Status HdfsScanNode::Open(RuntimeState* state) {
       TUnit::UNIT);
   unexpected_remote_bytes_ = ADD_COUNTER(runtime_profile(), "BytesReadRemoteUnexpected",
       TUnit::BYTES);
+  bytes_compacted_counter_ = ADD_COUNTER(runtime_profile(), "RowBatchBytesCompacted",
+      TUnit::BYTES);
+  num_io_buffers_released_early_counter_ = ADD_COUNTER(runtime_profile(),
+      "IoBuffersReleasedEarly", TUnit::UNIT);
 
   max_compressed_text_file_length_ = runtime_profile()->AddHighWaterMarkCounter(
       "MaxCompressedTextFileLength", TUnit::BYTES);
 
   for (int i = 0; i < state->io_mgr()->num_total_disks() + 1; ++i) {
     hdfs_read_thread_concurrency_bucket_.push_back(
-        pool_->Add(new RuntimeProfile::Counter(TUnit::DOUBLE_VALUE, 0)));
+        pool_->AddInPlace(new (pool_) RuntimeProfile::Counter(TUnit::DOUBLE_VALUE, 0)));
   }
   runtime_profile()->RegisterBucketingCounters(&active_hdfs_read_thread_counter_,
       &hdfs_read_thread_concurrency_bucket_);
@@ -672,13 +917,41 @@ Status HdfsScanNode::AddDiskIoRanges(const HdfsFileDesc* desc) {
   return Status::OK;
 }
 
+bool HdfsScanNode::all_ranges_started() {
+  unique_lock<mutex> l(lock_);
+  return all_ranges_started_;
+}
+
+Status HdfsScanNode::AddSplitRange(DiskIoMgr::ScanRange* range) {
+  {
+    unique_lock<mutex> l(lock_);
+    // The split off range must be accounted for before the range it was split from
+    // completes, otherwise the scan could be considered done too early.
+    progress_.AddToTotal(1);
+    // Allow scanner threads to be started again for the new range.
+    all_ranges_started_ = false;
+  }
+  COUNTER_ADD(num_split_ranges_counter_, 1);
+  vector<DiskIoMgr::ScanRange*> ranges(1, range);
+  return AddDiskIoRanges(ranges);
+}
+
 void HdfsScanNode::MarkFileDescIssued(const HdfsFileDesc* desc) {
   DCHECK_GT(num_unqueued_files_, 0);
   --num_unqueued_files_;
 }
 
 void HdfsScanNode::AddMaterializedRowBatch(RowBatch* row_batch) {
+  // The batch may be consumed as soon as it is added.
+  int num_rows = row_batch->num_rows();
   materialized_row_batches_->AddBatch(row_batch);
+  if (limit_ > 0 && num_rows > 0 &&
+      num_rows_materialized_.UpdateAndFetch(num_rows) >= limit_) {
+    // Enough rows are queued to satisfy the limit. Stop the scanner threads and cancel
+    // the outstanding io right away instead of waiting for the consumer to get here.
+    // Batches that are already queued can still be returned.
+    SetDone();
+  }
 }
 
 Status HdfsScanNode::GetConjunctCtxs(vector<ExprContext*>* ctxs) {
@@ -718,6 +991,56 @@ bool HdfsScanNode::EnoughMemoryForScannerThread(bool new_thread) {
   return est_additional_scanner_mem < mem_tracker()->SpareCapacity();
 }
 
+bool HdfsScanNode::UpdateScannerThreadTarget() {
+  if (FLAGS_scanner_thread_scaling_interval_ms <= 0) return false;
+  int64_t now = MonotonicMillis();
+  int64_t elapsed_ms = now - last_scaling_time_ms_;
+  if (elapsed_ms < FLAGS_scanner_thread_scaling_interval_ms) return false;
+
+  // The queue wait times are cumulative and in nanoseconds. The put wait time is summed
+  // across all scanner threads while the get wait time is for the single consumer.
+  uint64_t get_wait_time = materialized_row_batches_->total_get_wait_time();
+  uint64_t put_wait_time = materialized_row_batches_->total_put_wait_time();
+  int num_active = active_scanner_thread_counter_.value();
+  double elapsed_ns = elapsed_ms * 1000000.0;
+  double consumer_wait_ratio = (get_wait_time - last_queue_get_wait_time_) / elapsed_ns;
+  double producer_wait_ratio =
+      (put_wait_time - last_queue_put_wait_time_) / (elapsed_ns * ::max(num_active, 1));
+  double queue_occupancy = static_cast<double>(materialized_row_batches_->GetSize()) /
+      max_materialized_row_batches_;
+  last_scaling_time_ms_ = now;
+  last_queue_get_wait_time_ = get_wait_time;
+  last_queue_put_wait_time_ = put_wait_time;
+
+  int new_target = ComputeScannerThreadTarget(scanner_thread_target_, num_active,
+      producer_wait_ratio, consumer_wait_ratio, queue_occupancy);
+  if (new_target == scanner_thread_target_) return false;
+  bool scale_up = new_target > num_active;
+  scanner_thread_target_ = new_target;
+  COUNTER_ADD(scale_up ? scanner_thread_scale_ups_counter_ :
+      scanner_thread_scale_downs_counter_, 1);
+  VLOG_FILE << "Scan node (id=" << id() << ") scaling scanner threads "
+            << (scale_up ? "up" : "down") << " to " << scanner_thread_target_;
+  return scale_up;
+}
+
+int HdfsScanNode::ComputeScannerThreadTarget(int current_target, int num_active,
+    double producer_wait_ratio, double consumer_wait_ratio, double queue_occupancy) {
+  if (num_active > 1 && producer_wait_ratio > SCALE_DOWN_PRODUCER_WAIT_RATIO &&
+      queue_occupancy >= SCALE_DOWN_QUEUE_OCCUPANCY) {
+    // The consumer is the bottleneck. Additional scanner threads only fill up the queue
+    // and hold on to memory, so give up one thread per interval.
+    return num_active - 1;
+  }
+  if (consumer_wait_ratio > SCALE_UP_CONSUMER_WAIT_RATIO &&
+      queue_occupancy < SCALE_UP_QUEUE_OCCUPANCY && current_target <= num_active) {
+    // The scan is the bottleneck again. Allow one more thread per interval, subject to
+    // the usual thread token and memory checks.
+    return num_active + 1;
+  }
+  return current_target;
+}
+
 void HdfsScanNode::ThreadTokenAvailableCb(ThreadResourceMgr::ResourcePool* pool) {
   // This is called to start up new scanner threads. It's not a big deal if we
   // spin up more than strictly necessary since they will go through and terminate
@@ -733,6 +1056,8 @@ void HdfsScanNode::ThreadTokenAvailableCb(ThreadResourceMgr::ResourcePool* pool)
   //  7. Don't start up if there are no thread tokens.
   //  8. Don't start up if we are running too many threads for our vcore allocation
   //  (unless the thread is reserved, in which case it has to run).
+  //  9. Don't start up if the scaling controller determined that we already have
+  //  enough scanner threads to keep up with the consumer.
 
   // Case 4. We have not issued the initial ranges so don't start a scanner thread.
   // Issuing ranges will call this function and we'll start the scanner threads then.
@@ -752,10 +1077,11 @@ void HdfsScanNode::ThreadTokenAvailableCb(ThreadResourceMgr::ResourcePool* pool)
       break;
     }
 
-    // Cases 5 and 6.
+    // Cases 5, 6 and 9.
     if (active_scanner_thread_counter_.value() > 0 &&
         (materialized_row_batches_->GetSize() >= max_materialized_row_batches_ ||
-         !EnoughMemoryForScannerThread(true))) {
+         !EnoughMemoryForScannerThread(true) ||
+         active_scanner_thread_counter_.value() >= scanner_thread_target_)) {
       break;
     }
 
@@ -791,13 +1117,16 @@ void HdfsScanNode::ScannerThread() {
   SCOPED_TIMER(runtime_state_->total_cpu_timer());
 
   while (!done_) {
+    bool scale_up = false;
     {
       // Check if we have enough resources (thread token and memory) to keep using
-      // this thread.
+      // this thread and whether the consumer can use its output.
       unique_lock<mutex> l(lock_);
+      scale_up = UpdateScannerThreadTarget();
       if (active_scanner_thread_counter_.value() > 1) {
         if (runtime_state_->resource_pool()->optional_exceeded() ||
-            !EnoughMemoryForScannerThread(false)) {
+            !EnoughMemoryForScannerThread(false) ||
+            active_scanner_thread_counter_.value() > scanner_thread_target_) {
           // We can't break here. We need to update the counter with the lock held or else
           // all threads might see active_scanner_thread_counter_.value > 1
           COUNTER_ADD(&active_scanner_thread_counter_, -1);
@@ -815,6 +1144,7 @@ void HdfsScanNode::ScannerThread() {
         // of resource constraints.
       }
     }
+    if (scale_up) ThreadTokenAvailableCb(runtime_state_->resource_pool());
 
     DiskIoMgr::ScanRange* scan_range;
     // Take a snapshot of num_unqueued_files_ before calling GetNextRange().
@@ -824,6 +1154,20 @@ void HdfsScanNode::ScannerThread() {
     AtomicUtil::MemoryBarrier();
     Status status = runtime_state_->io_mgr()->GetNextRange(reader_context_, &scan_range);
 
+    if (status.ok() && scan_range == NULL && num_unqueued_files > 0) {
+      // There are no ranges to work on, but there may be files that were deferred
+      // because of the limit. Either issue the next group of files or give up this
+      // thread if other threads are still busy with the files issued so far.
+      if (ExitInsteadOfIssuingFiles()) {
+        if (runtime_state_->query_resource_mgr() != NULL) {
+          runtime_state_->query_resource_mgr()->NotifyThreadUsageChange(-1);
+        }
+        runtime_state_->resource_pool()->ReleaseThreadToken(false);
+        return;
+      }
+      status = IssueNextFileGroup();
+    }
+
     if (status.ok() && scan_range != NULL) {
       // Got a scan range. Create a new scanner object and process the range
       // end to end (in this thread).
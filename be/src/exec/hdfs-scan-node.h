@@ -16,6 +16,7 @@
 #ifndef IMPALA_EXEC_HDFS_SCAN_NODE_H_
 #define IMPALA_EXEC_HDFS_SCAN_NODE_H_
 
+#include <deque>
 #include <vector>
 #include <memory>
 #include <stdint.h>
@@ -63,10 +64,16 @@ struct HdfsFileDesc {
 
   THdfsCompression::type file_compression;
 
+  // Last modification time of the file in seconds, or -1 if unknown. Only looked up
+  // for scans that may use the parquet row count cache (see
+  // HdfsParquetScanner::GetCachedNumRows()).
+  time_t mtime;
+
   // Splits (i.e. raw byte ranges) for this file, assigned to this scan node.
   std::vector<DiskIoMgr::ScanRange*> splits;
   HdfsFileDesc(const std::string& filename)
-    : filename(filename), file_length(0), file_compression(THdfsCompression::NONE) {
+    : filename(filename), file_length(0), file_compression(THdfsCompression::NONE),
+      mtime(-1) {
   }
 };
 
@@ -76,8 +83,15 @@ struct ScanRangeMetadata {
   // The partition id that this range is part of.
   int64_t partition_id;
 
+  // For Parquet footer ranges that were split off a range in progress (see
+  // HdfsParquetScanner::SplitOffRowGroups()), the row groups [first_row_group,
+  // end_row_group) to process. Otherwise end_row_group is -1 and all row groups of the
+  // file are processed.
+  int first_row_group;
+  int end_row_group;
+
   ScanRangeMetadata(int64_t partition_id)
-    : partition_id(partition_id) { }
+    : partition_id(partition_id), first_row_group(0), end_row_group(-1) { }
 };
 
 // A ScanNode implementation that is used for all tables read directly from
@@ -110,6 +124,9 @@ class HdfsScanNode : public ScanNode {
   virtual Status GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos);
   virtual void Close(RuntimeState* state);
 
+  // ScanNode methods
+  virtual Status StartIo(RuntimeState* state);
+
   int limit() const { return limit_; }
 
   const std::vector<SlotDescriptor*>& materialized_slots()
@@ -169,9 +186,17 @@ class HdfsScanNode : public ScanNode {
     ++num_scanners_codegen_disabled_;
   }
 
+  // Adds 'num_rows' rows of partition 'partition_id' that are returned without being
+  // scanned because the row count is known from file metadata. Only valid if the scan
+  // does not materialize any non-partition-key slots. The conjuncts are evaluated once
+  // against the partition's template tuple. This is thread safe.
+  void AddMetadataOnlyRows(int64_t partition_id, int64_t num_rows);
+
   // Adds a materialized row batch for the scan node.  This is called from scanner
   // threads.
-  // This function will block if materialized_row_batches_ is full.
+  // This function will block if materialized_row_batches_ is full. If the scan has a
+  // limit and enough rows to satisfy it have been queued, this calls SetDone() so
+  // outstanding io is cancelled without waiting for the consumer.
   void AddMaterializedRowBatch(RowBatch* row_batch);
 
   // Allocate a new scan range object, stored in the runtime state's object pool.  For
@@ -191,6 +216,21 @@ class HdfsScanNode : public ScanNode {
   // Adds all splits for file_desc to the io mgr queue.
   Status AddDiskIoRanges(const HdfsFileDesc* file_desc);
 
+  // Returns true if the scanner threads have run out of ranges to start, i.e. the scan
+  // is in its tail. Scanners working on a large range should then split off some of
+  // their remaining work with AddSplitRange() so idle threads can pick it up.
+  bool all_ranges_started();
+
+  // Adds 'range', which covers work split off a range that is being processed, to the
+  // io mgr queue and starts up a scanner thread for it if possible. The split off range
+  // counts as an additional range, i.e. the scanner that processes it must call
+  // RangeComplete() for it.
+  Status AddSplitRange(DiskIoMgr::ScanRange* range);
+
+  RuntimeProfile::Counter* split_range_time_counter() {
+    return split_range_time_counter_;
+  }
+
   // Indicates that this file_desc's scan ranges have all been issued to the IoMgr.
   // For each file, the scanner must call MarkFileDescIssued() or AddDiskIoRanges().
   // Issuing ranges happens asynchronously. For many of the file formats we synchronously
@@ -198,17 +238,23 @@ class HdfsScanNode : public ScanNode {
   // issued asynchronously.
   void MarkFileDescIssued(const HdfsFileDesc* file_desc);
 
-  // Allocates and initialises template_tuple_ with any values from
-  // the partition columns for the current scan range
-  // Returns NULL if there are no materialized partition keys.
-  // TODO: cache the tuple template in the partition object.
-  Tuple* InitTemplateTuple(RuntimeState* state,
-                           const std::vector<ExprContext*>& value_ctxs);
+  // Returns the template tuple for 'partition', i.e. a tuple with only the materialized
+  // partition key slots set. The tuple is created the first time a partition is scanned
+  // and cached for the rest of the query, so it is shared by all scanners and must not
+  // be modified (see CopyTemplateTuple()).
+  // Returns NULL if there are no materialized partition keys. Thread-safe.
+  Tuple* GetTemplateTuple(const HdfsPartitionDescriptor* partition);
+
+  // Allocates and returns a copy of 'template_tuple' that the caller may modify, or an
+  // empty template tuple (i.e. with no values filled in) if 'template_tuple' is NULL.
+  // Scanners use this to add per-file values to a template tuple (e.g. NULLs for
+  // columns missing from a Parquet file or Avro default values). Thread-safe.
+  Tuple* CopyTemplateTuple(const Tuple* template_tuple);
 
-  // Allocates and return an empty template tuple (i.e. with no values filled in).
-  // Scanners can use this method to initialize a template tuple even if there are no
-  // materialized partition keys (e.g. to hold Avro default values).
-  Tuple* InitEmptyTemplateTuple();
+  // Number of leading bytes of a template tuple returned by GetTemplateTuple() that
+  // need to be copied into each tuple, i.e. the null indicator bytes and the
+  // partition key slots.
+  int template_tuple_copy_len() const { return template_tuple_copy_len_; }
 
   // Acquires all allocations from pool into scan_node_pool_. Thread-safe.
   void TransferToScanNodePool(MemPool* pool);
@@ -262,6 +308,7 @@ class HdfsScanNode : public ScanNode {
 
  private:
   friend class ScannerContext;
+  friend class HdfsScanNodeTest;
 
   // Cache of the plan node.  This is needed to be able to create a copy of
   // the conjuncts per scanner since our Exprs are not thread safe.
@@ -302,6 +349,13 @@ class HdfsScanNode : public ScanNode {
   // variable.
   bool initial_ranges_issued_;
 
+  // Set once OpenIo() has run, from StartIo() or Open().
+  bool io_opened_;
+
+  // Set if StartIo() already issued the initial scan ranges to the IoMgr. GetNext() then
+  // only needs to start the scanner threads for them.
+  bool initial_ranges_queued_;
+
   // The estimated memory required to start up a new scanner thread. If the memory
   // left (due to limits) is less than this value, we won't start up optional
   // scanner threads.
@@ -343,6 +397,9 @@ class HdfsScanNode : public ScanNode {
   // These descriptors are sorted in order of increasing col_pos
   std::vector<SlotDescriptor*> partition_key_slots_;
 
+  // See template_tuple_copy_len(). Set in Prepare().
+  int template_tuple_copy_len_;
+
   // Keeps track of total splits and the number finished.
   ProgressUpdater progress_;
 
@@ -354,6 +411,18 @@ class HdfsScanNode : public ScanNode {
   // Thread group for all scanner worker threads
   ThreadGroup scanner_threads_;
 
+  // Number of files whose rows were answered from metadata without any io.
+  RuntimeProfile::Counter* num_metadata_only_files_counter_;
+
+  // Number of rows added to materialized_row_batches_ by the scanner threads. Only
+  // maintained if the scan has a limit.
+  AtomicInt<int64_t> num_rows_materialized_;
+
+  // Time from Open() until the first non-empty row batch was returned from GetNext().
+  MonotonicStopWatch time_to_first_row_sw_;
+  RuntimeProfile::Counter* time_to_first_row_counter_;
+  bool first_row_returned_;
+
   // Outgoing row batches queue. Row batches are produced asynchronously by the scanner
   // threads and consumed by the main thread.
   boost::scoped_ptr<RowBatchQueue> materialized_row_batches_;
@@ -397,6 +466,25 @@ class HdfsScanNode : public ScanNode {
   // Total number of bytes read remotely that were expected to be local
   RuntimeProfile::Counter* unexpected_remote_bytes_;
 
+  // Number of ranges split off ranges in progress (see AddSplitRange()) and the total
+  // time scanner threads spent processing them. Without splitting, that work would
+  // have been done serially by the thread owning the original range, so the time is
+  // an upper bound on the tail time saved.
+  RuntimeProfile::Counter* num_split_ranges_counter_;
+  RuntimeProfile::Counter* split_range_time_counter_;
+
+  // Number of times the scaling controller raised/lowered scanner_thread_target_.
+  RuntimeProfile::Counter* scanner_thread_scale_ups_counter_;
+  RuntimeProfile::Counter* scanner_thread_scale_downs_counter_;
+
+  // Total number of var-len bytes copied out of io buffers by row batch compaction
+  // (see ScannerContext::CompactBatch()).
+  RuntimeProfile::Counter* bytes_compacted_counter_;
+
+  // Number of io buffers returned to the io mgr early because the row batch that
+  // would have owned them was compacted.
+  RuntimeProfile::Counter* num_io_buffers_released_early_counter_;
+
   // Lock protects access between scanner thread and main query thread (the one calling
   // GetNext()) for all fields below.  If this lock and any other locks needs to be taken
   // together, this lock must be taken first.
@@ -412,10 +500,47 @@ class HdfsScanNode : public ScanNode {
   // being processed by scanner threads, but no new ScannerThreads should be started.
   bool all_ranges_started_;
 
+  // Maximum number of scanner threads the scaling controller wants to run. Starts out
+  // unbounded, i.e. the number of threads is only limited by thread tokens and memory.
+  // See UpdateScannerThreadTarget().
+  int scanner_thread_target_;
+
+  // Time of the last scaling decision and the cumulative wait times of
+  // materialized_row_batches_ at that point.
+  int64_t last_scaling_time_ms_;
+  uint64_t last_queue_get_wait_time_;
+  uint64_t last_queue_put_wait_time_;
+
+  // Rows answered from file metadata (see AddMetadataOnlyRows()) that have not been
+  // returned yet. These rows don't reference any scanner resources and are returned
+  // ahead of materialized_row_batches_.
+  struct MetadataOnlyRows {
+    // Template tuple with the partition key values, or NULL if no partition keys are
+    // materialized.
+    Tuple* template_tuple;
+    int64_t num_rows;
+  };
+  std::vector<MetadataOnlyRows> metadata_only_rows_;
+
+  // Files that have not been handed to the scanners yet because the scan has a limit
+  // that is likely to be satisfied by a fraction of the files. They are issued in
+  // groups of next_file_group_size_ files, which doubles with every group, by
+  // IssueNextFileGroup(). Deferred files are still counted in num_unqueued_files_.
+  std::deque<std::pair<THdfsFileFormat::type, HdfsFileDesc*> > deferred_files_;
+  int next_file_group_size_;
+
+  // Number of splits of the files issued so far.
+  int64_t num_issued_splits_;
+
   // Pool for allocating some amounts of memory that is shared between scanners.
   // e.g. partition key tuple and their string buffers
   boost::scoped_ptr<MemPool> scan_node_pool_;
 
+  // Partition id => cached template tuple for that partition, allocated from
+  // scan_node_pool_ (see GetTemplateTuple()).
+  typedef boost::unordered_map<int64_t, Tuple*> TemplateTupleMap;
+  TemplateTupleMap partition_template_tuples_;
+
   // Status of failed operations.  This is set in the ScannerThreads
   // Returned in GetNext() if an error occurred.  An non-ok status triggers cleanup
   // scanner threads.
@@ -461,9 +586,74 @@ class HdfsScanNode : public ScanNode {
   // lock_ must be taken before calling this.
   bool EnoughMemoryForScannerThread(bool new_thread);
 
-  // Checks for eos conditions and returns batches from materialized_row_batches_.
+  // Feedback controller for the number of scanner threads. At most once per
+  // --scanner_thread_scaling_interval_ms, looks at the occupancy of
+  // materialized_row_batches_ and at how long scanner threads and the consumer waited on
+  // it since the last call. If the scanner threads are mostly blocked on a full queue,
+  // the consumer is the bottleneck and scanner_thread_target_ is lowered, causing a
+  // scanner thread to exit after its current range. If the consumer is mostly waiting on
+  // an empty queue, the target is raised again.
+  // lock_ must be taken before calling this. Returns true if the target was raised, in
+  // which case the caller should call ThreadTokenAvailableCb() after releasing lock_.
+  bool UpdateScannerThreadTarget();
+
+  // Decision of UpdateScannerThreadTarget(). Returns the new scanner thread target given
+  // the current target, the number of active scanner threads, the average fraction of
+  // the last interval that scanner threads were blocked on a full queue and that the
+  // consumer was blocked on an empty queue, and the fraction of the queue that is
+  // filled. Returns 'current_target' if the target should not change.
+  static int ComputeScannerThreadTarget(int current_target, int num_active,
+      double producer_wait_ratio, double consumer_wait_ratio, double queue_occupancy);
+
+  // Checks for eos conditions and returns batches from metadata_only_rows_ or
+  // materialized_row_batches_.
   Status GetNextInternal(RuntimeState* state, RowBatch* row_batch, bool* eos);
 
+  // Fills 'row_batch' with rows from metadata_only_rows_. Returns false if there were
+  // no such rows.
+  bool GetNextMetadataOnlyRows(RowBatch* row_batch);
+
+  // Registers the reader context with the IoMgr and sets up everything needed to issue
+  // scan ranges, without opening any exprs. Sets done_ if there is nothing to scan.
+  Status OpenIo(RuntimeState* state);
+
+  // Returns true if the files are issued in groups of FLAGS_limit_scan_initial_files,
+  // rather than all at once.
+  bool IssueFilesInGroups() const;
+
+  // Returns true if a scan with 'limit' over 'num_files' files issues its files in
+  // groups, starting with 'initial_files' files, rather than all at once.
+  static bool IssueFilesInGroups(int64_t limit, int64_t num_files, int initial_files);
+
+  // Issues the initial ranges for all files in 'files' to the per format scanners.
+  Status IssueFiles(FileFormatsMap* files);
+
+  // Returns the length of the ranges an uncompressed text split of 'split_length' bytes
+  // is broken into, given --text_scan_range_split_bytes as 'target_range_length'. The
+  // last range may be shorter. Returns 'split_length' if the split is not broken up.
+  static int64_t GetTextRangeLength(int64_t split_length, int64_t target_range_length);
+
+  // Moves the next group of files from deferred_files_ to the scanners. Does nothing if
+  // there are no deferred files or the scan node is done. Cannot be called with lock_
+  // taken.
+  Status IssueNextFileGroup();
+
+  // Returns the number of files to issue in the next group, given the number of
+  // deferred files, and doubles 'next_file_group_size' for the group after that.
+  static int NextFileGroupSize(int num_deferred_files, int* next_file_group_size);
+
+  // Called by a scanner thread that found no range to work on while there are
+  // deferred files. Returns true if the scanner thread should exit instead of issuing
+  // the next file group because the files issued so far are still being worked on by
+  // other scanner threads. In that case active_scanner_thread_counter_ has already
+  // been decremented.
+  bool ExitInsteadOfIssuingFiles();
+
+  // Decision of ExitInsteadOfIssuingFiles() for a scanner thread that found no range to
+  // work on. Returns true if it should exit rather than issue the next group of files.
+  static bool ExitInsteadOfIssuingFiles(int num_deferred_files, int num_active,
+      int64_t num_complete_splits, int64_t num_issued_splits);
+
   // sets done_ to true and triggers threads to cleanup. Cannot be calld with
   // any locks taken. Calling it repeatedly ignores subsequent calls.
   void SetDone();
@@ -54,6 +54,8 @@ HdfsScanner::HdfsScanner(HdfsScanNode* scan_node, RuntimeState* state)
     : scan_node_(scan_node),
       state_(state),
       context_(NULL),
+      template_tuple_(NULL),
+      template_tuple_copy_len_(0),
       tuple_byte_size_(scan_node->tuple_desc()->byte_size()),
       tuple_(NULL),
       batch_(NULL),
@@ -72,8 +74,8 @@ Status HdfsScanner::Prepare(ScannerContext* context) {
   context_ = context;
   stream_ = context->GetStream();
   RETURN_IF_ERROR(scan_node_->GetConjunctCtxs(&conjunct_ctxs_));
-  template_tuple_ = scan_node_->InitTemplateTuple(
-      state_, context_->partition_descriptor()->partition_key_value_ctxs());
+  template_tuple_ = scan_node_->GetTemplateTuple(context_->partition_descriptor());
+  template_tuple_copy_len_ = scan_node_->template_tuple_copy_len();
   StartNewRowBatch();
   decompress_timer_ = ADD_TIMER(scan_node_->runtime_profile(), "DecompressionTime");
   return Status::OK;
@@ -388,9 +390,9 @@ Function* HdfsScanner::CodegenWriteCompleteTuple(
       builder.CreateStore(codegen->GetIntConstant(TYPE_TINYINT, 0), null_byte);
     }
   } else {
-    // Copy template tuple.
-    // TODO: only copy what's necessary from the template tuple.
-    codegen->CodegenMemcpy(&builder, tuple_arg, template_arg, tuple_desc->byte_size());
+    // Copy the null bytes and partition key slots from the template tuple.
+    codegen->CodegenMemcpy(
+        &builder, tuple_arg, template_arg, node->template_tuple_copy_len());
   }
 
   // Put tuple in tuple_row
@@ -158,11 +158,17 @@ class HdfsScanner {
   // must be copied into tuple_ before any of the other slots are
   // materialized.
   // Pointer is NULL if there are no partition key slots.
-  // This template tuple is computed once for each file and valid for
-  // the duration of that file.
+  // The template tuple is cached per partition by the scan node and shared with other
+  // scanners, so it must not be modified. Scanners that need to add per-file values
+  // must replace it with a copy from HdfsScanNode::CopyTemplateTuple().
   // It is owned by the HDFS scan node.
   Tuple* template_tuple_;
 
+  // Number of leading bytes of template_tuple_ that InitTuple() copies into each tuple.
+  // This only covers the null indicator bytes and partition key slots unless a scanner
+  // sets other slots in its copy of the template tuple.
+  int template_tuple_copy_len_;
+
   // Fixed size of each tuple, in bytes
   int tuple_byte_size_;
 
@@ -350,11 +356,10 @@ class HdfsScanner {
   void ReportColumnParseError(const SlotDescriptor* desc, const char* data, int len);
 
   // Initialize a tuple.
-  // TODO: only copy over non-null slots.
   // TODO: InitTuple is called frequently, avoid the if, perhaps via templatization.
   void InitTuple(Tuple* template_tuple, Tuple* tuple) {
     if (template_tuple != NULL) {
-      memcpy(tuple, template_tuple, tuple_byte_size_);
+      memcpy(tuple, template_tuple, template_tuple_copy_len_);
     } else {
       memset(tuple, 0, sizeof(uint8_t) * num_null_bytes_);
     }
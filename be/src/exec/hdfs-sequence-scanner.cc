@@ -40,6 +40,7 @@ const uint8_t HdfsSequenceScanner::SEQFILE_VERSION_HEADER[4] = {'S', 'E', 'Q', 6
 HdfsSequenceScanner::HdfsSequenceScanner(HdfsScanNode* scan_node, RuntimeState* state)
     : BaseSequenceScanner(scan_node, state),
       unparsed_data_buffer_(NULL),
+      record_locations_offset_(0),
       num_buffered_records_in_compressed_block_(0) {
 }
 
@@ -73,6 +74,7 @@ Status HdfsSequenceScanner::InitNewRange() {
       hdfs_partition->collection_delim(), hdfs_partition->escape_char()));
 
   num_buffered_records_in_compressed_block_ = 0;
+  record_locations_offset_ = 0;
 
   SeqFileHeader* seq_header = reinterpret_cast<SeqFileHeader*>(header_);
   if (seq_header->is_compressed) {
@@ -210,32 +212,20 @@ Status HdfsSequenceScanner::ProcessDecompressedBlock() {
     return Status::OK;
   }
 
-  // Parse record starts and lengths
+  // Parse records to find field locations. The records were located by
+  // FrameDecompressedBlock().
+  DCHECK_LE(record_locations_offset_ + num_to_process, record_locations_.size());
+  const RecordLocation* records = &record_locations_[record_locations_offset_];
   int field_location_offset = 0;
-  for (int i = 0; i < num_to_process; ++i) {
-    DCHECK_LT(i, record_locations_.size());
-    int bytes_read = ReadWriteUtil::GetVLong(
-        next_record_in_compressed_block_, &record_locations_[i].len);
-    if (UNLIKELY(bytes_read == -1)) {
-      return Status("Invalid record sizes in compressed block.");
-    }
-    next_record_in_compressed_block_ += bytes_read;
-    record_locations_[i].record = next_record_in_compressed_block_;
-    next_record_in_compressed_block_ += record_locations_[i].len;
-  }
-
-  // Parse records to find field locations.
   for (int i = 0; i < num_to_process; ++i) {
     int num_fields = 0;
     if (delimited_text_parser_->escape_char() == '\0') {
       delimited_text_parser_->ParseSingleTuple<false>(
-          record_locations_[i].len,
-          reinterpret_cast<char*>(record_locations_[i].record),
+          records[i].len, reinterpret_cast<char*>(records[i].record),
           &field_locations_[field_location_offset], &num_fields);
     } else {
       delimited_text_parser_->ParseSingleTuple<true>(
-          record_locations_[i].len,
-          reinterpret_cast<char*>(record_locations_[i].record),
+          records[i].len, reinterpret_cast<char*>(records[i].record),
           &field_locations_[field_location_offset], &num_fields);
     }
     DCHECK_EQ(num_fields, scan_node_->materialized_slots().size());
@@ -263,13 +253,44 @@ Status HdfsSequenceScanner::ProcessDecompressedBlock() {
   }
 
   if (tuples_returned == -1) return parse_status_;
+  record_locations_offset_ += num_to_process;
   COUNTER_ADD(scan_node_->rows_read_counter(), num_to_process);
   RETURN_IF_ERROR(CommitRows(tuples_returned));
   return Status::OK;
 }
 
+Status HdfsSequenceScanner::FrameDecompressedBlock(int64_t block_len) {
+  int64_t num_records = num_buffered_records_in_compressed_block_;
+  // Every record takes at least one byte for its length.
+  if (UNLIKELY(num_records > block_len)) {
+    return Status("Invalid record count in compressed block.");
+  }
+  if (record_locations_.size() < num_records) record_locations_.resize(num_records);
+
+  uint8_t* data = unparsed_data_buffer_;
+  const uint8_t* data_end = unparsed_data_buffer_ + block_len;
+  for (int64_t i = 0; i < num_records; ++i) {
+    if (UNLIKELY(data >= data_end ||
+        ReadWriteUtil::DecodeVIntSize(*data) > data_end - data)) {
+      return Status("Invalid record sizes in compressed block.");
+    }
+    RecordLocation* location = &record_locations_[i];
+    int bytes_read = ReadWriteUtil::GetVLong(data, &location->len);
+    if (UNLIKELY(bytes_read == -1 || location->len < 0 ||
+        location->len > data_end - data - bytes_read)) {
+      return Status("Invalid record sizes in compressed block.");
+    }
+    data += bytes_read;
+    location->record = data;
+    data += location->len;
+  }
+  record_locations_offset_ = 0;
+  return Status::OK;
+}
+
 Status HdfsSequenceScanner::ProcessRange() {
   num_buffered_records_in_compressed_block_ = 0;
+  record_locations_offset_ = 0;
 
   SeqFileHeader* seq_header = reinterpret_cast<SeqFileHeader*>(header_);
   // Block compressed is handled separately to minimize function calls.
@@ -478,21 +499,23 @@ Status HdfsSequenceScanner::ReadCompressedBlock() {
   uint8_t* compressed_data = NULL;
   RETURN_IF_FALSE(stream_->ReadBytes(block_size, &compressed_data, &parse_status_));
 
+  int64_t len;
   {
-    int64_t len;
     SCOPED_TIMER(decompress_timer_);
     RETURN_IF_ERROR(decompressor_->ProcessBlock(false, block_size, compressed_data,
                                                 &len, &unparsed_data_buffer_));
     VLOG_FILE << "Decompressed " << block_size << " to " << len;
-    next_record_in_compressed_block_ = unparsed_data_buffer_;
   }
 
-  return Status::OK;
+  // The records only need to be located if any slots are materialized from them.
+  if (scan_node_->materialized_slots().empty()) return Status::OK;
+  return FrameDecompressedBlock(len);
 }
 
 void HdfsSequenceScanner::LogRowParseError(int row_idx, stringstream* ss) {
-  DCHECK_LT(row_idx, record_locations_.size());
-  *ss << string(reinterpret_cast<const char*>(record_locations_[row_idx].record),
-                  record_locations_[row_idx].len);
+  int64_t idx = record_locations_offset_ + row_idx;
+  DCHECK_LT(idx, record_locations_.size());
+  *ss << string(reinterpret_cast<const char*>(record_locations_[idx].record),
+                  record_locations_[idx].len);
 }
 
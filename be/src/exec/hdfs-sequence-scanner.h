@@ -203,8 +203,14 @@ class HdfsSequenceScanner : public BaseSequenceScanner {
   // Decompress to unparsed_data_buffer_ allocated from unparsed_data_buffer_pool_.
   Status ReadCompressedBlock();
 
-  // Utility function for parsing next_record_in_compressed_block_. Called by
-  // ProcessBlockCompressedScanRange.
+  // Locates all records in the decompressed block of 'block_len' bytes in
+  // unparsed_data_buffer_ in one pass over the record lengths, before any of them are
+  // materialized. Populates record_locations_ with one entry per record. Returns an
+  // error if the record lengths do not fit in the block.
+  Status FrameDecompressedBlock(int64_t block_len);
+
+  // Materializes the next batch of records located by FrameDecompressedBlock(). Called
+  // by ProcessBlockCompressedScanRange.
   Status ProcessDecompressedBlock();
 
   // Read compressed or uncompressed records from the byte stream into memory
@@ -235,10 +241,14 @@ class HdfsSequenceScanner : public BaseSequenceScanner {
   };
 
   // Records are processed in batches.  This vector stores batches of record locations
-  // that are being processed.  
-  // TODO: better perf not to use vector?
+  // that are being processed. For block compressed files, it stores the locations of
+  // all records in the current block and the current batch starts at
+  // record_locations_offset_.
   std::vector<RecordLocation> record_locations_;
 
+  // Index into record_locations_ of the first record of the current batch.
+  int64_t record_locations_offset_;
+
   // Length of the current sequence file block (or record).
   int current_block_length_;
 
@@ -250,9 +260,6 @@ class HdfsSequenceScanner : public BaseSequenceScanner {
 
   // Number of buffered records unparsed_data_buffer_ from block compressed data.
   int64_t num_buffered_records_in_compressed_block_;
-
-  // Next record from block compressed data.
-  uint8_t* next_record_in_compressed_block_;
 };
 
 } // namespace impala
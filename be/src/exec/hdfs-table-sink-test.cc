@@ -0,0 +1,198 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+#include "codegen/llvm-codegen.h"
+#include "common/init.h"
+#include "service/fe-support.h"
+#include "service/impala-server.h"
+#include "testutil/impalad-query-executor.h"
+#include "testutil/in-process-servers.h"
+#include "testutil/test-catalog-service.h"
+#include "testutil/test-table.h"
+#include "util/test-info.h"
+
+DECLARE_int32(be_port);
+DECLARE_int32(beeswax_port);
+DECLARE_string(impalad);
+DECLARE_bool(abort_on_config_error);
+DECLARE_string(insert_sort_columns);
+DECLARE_string(insert_zorder_columns);
+
+using namespace std;
+
+namespace impala {
+
+// Inserts run through an in-process impalad, over tables in TEST_DIR.
+static ImpaladQueryExecutor* executor_;
+static const string TEST_DIR = "/tmp/hdfs-table-sink-test";
+
+// Side of the grid of (a, b) values that the source table holds.
+static const int GRID_SIZE = 32;
+
+class HdfsTableSinkTest : public testing::Test {
+ protected:
+  // Creates the text table 'src_tbl' with the columns a and b, which holds every point
+  // of the grid once, in an order that is neither sorted by a nor by b.
+  static void SetUpTestCase() {
+    src_table_ = new TestTable("src_tbl", TEST_DIR + "/src_tbl", THdfsFileFormat::TEXT);
+    src_table_->AddColumn("a", TYPE_INT);
+    src_table_->AddColumn("b", TYPE_INT);
+    ASSERT_TRUE(src_table_->Create().ok());
+    stringstream contents;
+    const int num_points = GRID_SIZE * GRID_SIZE;
+    // 37 is coprime to the number of points, so this visits every point once.
+    for (int i = 0; i < num_points; ++i) {
+      int point = (i * 37) % num_points;
+      contents << point / GRID_SIZE << "," << point % GRID_SIZE << "\n";
+    }
+    ASSERT_TRUE(src_table_->WriteFile("", "data.txt", contents.str()).ok());
+    ASSERT_TRUE(src_table_->Update().ok());
+  }
+
+  static void TearDownTestCase() { delete src_table_; }
+
+  // Runs 'stmt' with 'exec_options' and returns its rows in the order they were
+  // returned in 'rows' and its profile in 'profile'.
+  static void RunQuery(const string& stmt, const vector<string>& exec_options,
+      vector<string>* rows, string* profile) {
+    executor_->setExecOptions(exec_options);
+    Status status = executor_->Exec(stmt, NULL);
+    ASSERT_TRUE(status.ok()) << stmt << "\n" << status.GetDetail();
+    status = executor_->FetchAll(rows);
+    ASSERT_TRUE(status.ok()) << stmt << "\n" << status.GetDetail();
+    status = executor_->GetRuntimeProfile(profile);
+    ASSERT_TRUE(status.ok()) << stmt << "\n" << status.GetDetail();
+  }
+
+  // Creates the parquet table 'name' with the columns a and b, inserts the grid into it
+  // and returns the profile of the insert in 'profile' and the rows of the table, in
+  // the order of its single file, as (a, b) pairs in 'points'.
+  static void InsertGrid(const string& name, string* profile,
+      vector<pair<int, int> >* points) {
+    TestTable table(name, TEST_DIR + "/" + name, THdfsFileFormat::PARQUET);
+    table.AddColumn("a", TYPE_INT);
+    table.AddColumn("b", TYPE_INT);
+    ASSERT_TRUE(table.Create().ok());
+    ASSERT_TRUE(table.Update().ok());
+    vector<string> rows;
+    RunQuery("insert into " + name + " select a, b from src_tbl", vector<string>(),
+        &rows, profile);
+
+    int num_files = 0;
+    boost::filesystem::directory_iterator it(table.dir()), end;
+    for (; it != end; ++it) {
+      string file_name = it->path().filename().string();
+      if (file_name[0] != '.' && file_name[0] != '_') ++num_files;
+    }
+    ASSERT_EQ(1, num_files);
+
+    // A single scanner thread returns the rows of the file in order.
+    vector<string> options;
+    options.push_back("NUM_SCANNER_THREADS=1");
+    string scan_profile;
+    RunQuery("select a, b from " + name, options, &rows, &scan_profile);
+    ASSERT_EQ(GRID_SIZE * GRID_SIZE, rows.size());
+    points->clear();
+    for (int i = 0; i < rows.size(); ++i) {
+      size_t tab = rows[i].find('\t');
+      ASSERT_NE(string::npos, tab) << rows[i];
+      points->push_back(make_pair(atoi(rows[i].substr(0, tab).c_str()),
+          atoi(rows[i].substr(tab + 1).c_str())));
+    }
+  }
+
+  static TestTable* src_table_;
+};
+
+TestTable* HdfsTableSinkTest::src_table_;
+
+// Returns the Z-value of (a, b) for non-negative 'a' and 'b' below 2^16, with the bits
+// of 'a' above those of 'b'.
+static uint32_t ZValue(int a, int b) {
+  uint32_t z = 0;
+  for (int bit = 0; bit < 16; ++bit) {
+    z |= ((a >> bit) & 1) << (2 * bit + 1);
+    z |= ((b >> bit) & 1) << (2 * bit);
+  }
+  return z;
+}
+
+TEST_F(HdfsTableSinkTest, SortColumns) {
+  FLAGS_insert_sort_columns = "default.sorted_tbl: b, a";
+  string profile;
+  vector<pair<int, int> > points;
+  InsertGrid("sorted_tbl", &profile, &points);
+  FLAGS_insert_sort_columns = "";
+  EXPECT_NE(string::npos, profile.find("SortColumns: (b, a)")) << profile;
+  ASSERT_EQ(GRID_SIZE * GRID_SIZE, points.size());
+  for (int i = 0; i < points.size(); ++i) {
+    EXPECT_EQ(i / GRID_SIZE, points[i].second) << i;
+    EXPECT_EQ(i % GRID_SIZE, points[i].first) << i;
+  }
+}
+
+TEST_F(HdfsTableSinkTest, ZOrderColumns) {
+  FLAGS_insert_zorder_columns = "default.zorder_tbl:a,b";
+  string profile;
+  vector<pair<int, int> > points;
+  InsertGrid("zorder_tbl", &profile, &points);
+  FLAGS_insert_zorder_columns = "";
+  EXPECT_NE(string::npos, profile.find("SortColumns: ZORDER(a, b)")) << profile;
+  // Every Z-value of the grid appears once, in order.
+  ASSERT_EQ(GRID_SIZE * GRID_SIZE, points.size());
+  for (int i = 0; i < points.size(); ++i) {
+    EXPECT_EQ(static_cast<uint32_t>(i), ZValue(points[i].first, points[i].second))
+        << "(" << points[i].first << ", " << points[i].second << ") at " << i;
+  }
+}
+
+// Tables that are not listed are not sorted.
+TEST_F(HdfsTableSinkTest, Unsorted) {
+  string profile;
+  vector<pair<int, int> > points;
+  InsertGrid("unsorted_tbl", &profile, &points);
+  EXPECT_EQ(string::npos, profile.find("SortColumns")) << profile;
+  EXPECT_EQ(GRID_SIZE * GRID_SIZE, points.size());
+}
+
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  InitCommonRuntime(argc, argv, true, TestInfo::BE_TEST);
+  InitFeSupport();
+  LlvmCodeGen::InitializeLlvm();
+
+  FLAGS_impalad = "localhost:21000";
+  FLAGS_abort_on_config_error = false;
+  InProcessImpalaServer* impala_server =
+      new InProcessImpalaServer("localhost", FLAGS_be_port, 0, 0, "", 0);
+  EXIT_IF_ERROR(
+      impala_server->StartWithClientServers(FLAGS_beeswax_port, FLAGS_beeswax_port + 1,
+                                            false));
+  impala_server->SetCatalogInitialized();
+  // Applies the inserts to the impalad's catalog.
+  EXIT_IF_ERROR(TestCatalogService::Start());
+  executor_ = new ImpaladQueryExecutor();
+  EXIT_IF_ERROR(executor_->Setup());
+  return RUN_ALL_TESTS();
+}
@@ -22,6 +22,7 @@
 #include "util/hdfs-util.h"
 #include "exprs/expr.h"
 #include "exprs/expr-context.h"
+#include "exprs/slot-ref.h"
 #include "runtime/hdfs-fs-cache.h"
 #include "runtime/raw-value.h"
 #include "runtime/row-batch.h"
@@ -33,8 +34,10 @@
 
 #include <vector>
 #include <sstream>
+#include <gflags/gflags.h>
 #include <gutil/strings/substitute.h>
 #include <hdfs.h>
+#include <boost/algorithm/string.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <stdlib.h>
@@ -43,8 +46,17 @@
 
 using namespace std;
 using namespace strings;
+using namespace boost::algorithm;
 using namespace boost::posix_time;
 
+DEFINE_string(insert_sort_columns, "", "Semicolon-separated list of "
+    "'<db>.<table>:<col>[,<col>...]' entries. Rows inserted into these Parquet tables "
+    "are sorted by the listed columns before they are written.");
+DEFINE_string(insert_zorder_columns, "", "Like --insert_sort_columns, but rows are "
+    "sorted by the Z-order of the listed columns, so that rows are clustered by all of "
+    "them rather than mostly by the first. Ignored for tables that are also listed in "
+    "--insert_sort_columns.");
+
 namespace impala {
 
 const static string& ROOT_PARTITION_KEY =
@@ -58,7 +70,8 @@ HdfsTableSink::HdfsTableSink(const RowDescriptor& row_desc,
        select_list_texprs_(select_list_texprs),
        partition_key_texprs_(tsink.table_sink.hdfs_table_sink.partition_key_exprs),
        overwrite_(tsink.table_sink.hdfs_table_sink.overwrite),
-       has_empty_input_batch_(false) {
+       has_empty_input_batch_(false),
+       sort_key_order_(TupleRowComparator::LEXICAL) {
   DCHECK(tsink.__isset.table_sink);
 }
 
@@ -102,6 +115,100 @@ Status HdfsTableSink::PrepareExprs(RuntimeState* state) {
   return Status::OK;
 }
 
+// Sets 'cols' to the columns listed for 'table_name' ("<db>.<table>") in 'flag', which
+// has the format of --insert_sort_columns.
+static void GetColumnsForTable(const string& flag, const string& table_name,
+    vector<string>* cols) {
+  cols->clear();
+  vector<string> entries;
+  split(entries, flag, is_any_of(";"));
+  for (int i = 0; i < entries.size(); ++i) {
+    size_t sep = entries[i].find(':');
+    if (sep == string::npos) continue;
+    if (!iequals(trim_copy(entries[i].substr(0, sep)), table_name)) continue;
+    split(*cols, entries[i].substr(sep + 1), is_any_of(","));
+    for (int j = 0; j < cols->size(); ++j) trim((*cols)[j]);
+    return;
+  }
+}
+
+Status HdfsTableSink::PrepareSortExprs(RuntimeState* state) {
+  string table_name = Substitute("$0.$1", table_desc_->database(), table_desc_->name());
+  vector<string> cols;
+  GetColumnsForTable(FLAGS_insert_sort_columns, table_name, &cols);
+  if (cols.empty()) {
+    GetColumnsForTable(FLAGS_insert_zorder_columns, table_name, &cols);
+    sort_key_order_ = TupleRowComparator::ZORDER;
+  }
+  if (cols.empty()) return Status::OK;
+
+  // Partition key columns are not written to the files, so only the other columns can
+  // be sort keys.
+  int num_clustering_cols = table_desc_->num_clustering_cols();
+  for (int i = 0; i < cols.size(); ++i) {
+    int col_idx = -1;
+    for (int j = num_clustering_cols; j < table_desc_->col_names().size(); ++j) {
+      if (iequals(table_desc_->col_names()[j], cols[i])) {
+        col_idx = j - num_clustering_cols;
+        break;
+      }
+    }
+    if (col_idx == -1) {
+      return Status(Substitute("Cannot sort inserted rows by '$0': table $1 has no such "
+          "non-partition column.", cols[i], table_name));
+    }
+    sort_key_expr_idxs_.push_back(col_idx);
+  }
+
+  // The sort tuple reuses the layout of the input tuple, which only works if there is
+  // exactly one.
+  if (row_desc_.tuple_descriptors().size() != 1) {
+    VLOG_QUERY << "Not sorting rows inserted into " << table_name << ": input rows have "
+               << row_desc_.tuple_descriptors().size() << " tuples";
+    sort_key_expr_idxs_.clear();
+    return Status::OK;
+  }
+  const TupleDescriptor* tuple_desc = row_desc_.tuple_descriptors()[0];
+  for (int i = 0; i < tuple_desc->slots().size(); ++i) {
+    SlotDescriptor* slot_desc = tuple_desc->slots()[i];
+    if (!slot_desc->is_materialized()) continue;
+    Expr* slot_ref = state->obj_pool()->Add(new SlotRef(slot_desc));
+    sort_tuple_slot_expr_ctxs_.push_back(
+        state->obj_pool()->Add(new ExprContext(slot_ref)));
+  }
+  sort_row_desc_.reset(new RowDescriptor(row_desc_));
+  return Expr::Prepare(sort_tuple_slot_expr_ctxs_, state, row_desc_,
+      expr_mem_tracker_.get());
+}
+
+Status HdfsTableSink::OpenSorter(RuntimeState* state) {
+  if (sort_key_expr_idxs_.empty()) return Status::OK;
+  if (default_partition_->file_format() != THdfsFileFormat::PARQUET) return Status::OK;
+  RETURN_IF_ERROR(Expr::Open(sort_tuple_slot_expr_ctxs_, state));
+
+  stringstream sort_columns;
+  sort_columns << (sort_key_order_ == TupleRowComparator::ZORDER ? "ZORDER(" : "(");
+  for (int i = 0; i < sort_key_expr_idxs_.size(); ++i) {
+    ExprContext* lhs_ctx;
+    ExprContext* rhs_ctx;
+    RETURN_IF_ERROR(output_expr_ctxs_[sort_key_expr_idxs_[i]]->Clone(state, &lhs_ctx));
+    RETURN_IF_ERROR(output_expr_ctxs_[sort_key_expr_idxs_[i]]->Clone(state, &rhs_ctx));
+    sort_key_expr_ctxs_lhs_.push_back(lhs_ctx);
+    sort_key_expr_ctxs_rhs_.push_back(rhs_ctx);
+    sort_columns << (i > 0 ? ", " : "")
+        << table_desc_->col_names()[
+            sort_key_expr_idxs_[i] + table_desc_->num_clustering_cols()];
+  }
+  sort_columns << ")";
+  runtime_profile_->AddInfoString("SortColumns", sort_columns.str());
+
+  TupleRowComparator less_than(
+      sort_key_expr_ctxs_lhs_, sort_key_expr_ctxs_rhs_, sort_key_order_);
+  sorter_.reset(new Sorter(less_than, sort_tuple_slot_expr_ctxs_, sort_row_desc_.get(),
+      mem_tracker_.get(), runtime_profile_, state));
+  return sorter_->Init();
+}
+
 Status HdfsTableSink::Prepare(RuntimeState* state) {
   RETURN_IF_ERROR(DataSink::Prepare(state));
   unique_id_str_ = PrintId(state->fragment_instance_id(), "-");
@@ -135,6 +242,7 @@ Status HdfsTableSink::Prepare(RuntimeState* state) {
       PrintId(state->query_id(), "_"));
 
   RETURN_IF_ERROR(PrepareExprs(state));
+  RETURN_IF_ERROR(PrepareSortExprs(state));
   RETURN_IF_ERROR(HdfsFsCache::instance()->GetConnection(
       staging_dir_, &hdfs_connection_));
   mem_tracker_.reset(new MemTracker(profile(), -1, -1, profile()->name(),
@@ -232,7 +340,7 @@ Status HdfsTableSink::Open(RuntimeState* state) {
   if (default_partition_ == NULL) {
     return Status("No default partition found for HdfsTextTableSink");
   }
-  return Status::OK;
+  return OpenSorter(state);
 }
 
 void HdfsTableSink::BuildHdfsFileNames(
@@ -496,6 +604,39 @@ Status HdfsTableSink::Send(RuntimeState* state, RowBatch* batch, bool eos) {
   ExprContext::FreeLocalAllocations(partition_key_expr_ctxs_);
   RETURN_IF_ERROR(state->CheckQueryState());
   DCHECK(eos || batch->num_rows() > 0);
+
+  if (sorter_.get() != NULL) {
+    // Nothing is written until the whole input is sorted.
+    if (batch->num_rows() > 0) {
+      RETURN_IF_ERROR(sorter_->AddBatch(batch));
+      ExprContext::FreeLocalAllocations(sort_key_expr_ctxs_lhs_);
+      ExprContext::FreeLocalAllocations(sort_key_expr_ctxs_rhs_);
+    }
+    if (!eos) return Status::OK;
+    RETURN_IF_ERROR(sorter_->InputDone());
+    return WriteSortedRows(state);
+  }
+  return WriteRowBatch(state, batch, eos);
+}
+
+Status HdfsTableSink::WriteSortedRows(RuntimeState* state) {
+  RowBatch batch(*sort_row_desc_, state->batch_size(), mem_tracker_.get());
+  bool eos = false;
+  while (!eos) {
+    RETURN_IF_CANCELLED(state);
+    batch.Reset();
+    RETURN_IF_ERROR(sorter_->GetNext(&batch, &eos));
+    ExprContext::FreeLocalAllocations(sort_key_expr_ctxs_lhs_);
+    ExprContext::FreeLocalAllocations(sort_key_expr_ctxs_rhs_);
+    if (batch.num_rows() == 0 && !eos) continue;
+    ExprContext::FreeLocalAllocations(output_expr_ctxs_);
+    ExprContext::FreeLocalAllocations(partition_key_expr_ctxs_);
+    RETURN_IF_ERROR(WriteRowBatch(state, &batch, eos));
+  }
+  return Status::OK;
+}
+
+Status HdfsTableSink::WriteRowBatch(RuntimeState* state, RowBatch* batch, bool eos) {
   has_empty_input_batch_ = batch->num_rows() == 0 && eos;
 
   // If there are no partition keys then just pass the whole batch to one partition.
@@ -610,6 +751,7 @@ void HdfsTableSink::Close(RuntimeState* state) {
     ClosePartitionFile(state, cur_partition->second.first);
   }
   partition_keys_to_output_partitions_.clear();
+  sorter_.reset();
 
   // Close literal partition key exprs
   BOOST_FOREACH(
@@ -618,6 +760,9 @@ void HdfsTableSink::Close(RuntimeState* state) {
     HdfsPartitionDescriptor* partition = id_to_desc.second;
     partition->CloseExprs(state);
   }
+  Expr::Close(sort_key_expr_ctxs_lhs_, state);
+  Expr::Close(sort_key_expr_ctxs_rhs_, state);
+  Expr::Close(sort_tuple_slot_expr_ctxs_, state);
   Expr::Close(output_expr_ctxs_, state);
   Expr::Close(partition_key_expr_ctxs_, state);
   closed_ = true;
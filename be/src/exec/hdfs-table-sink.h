@@ -24,7 +24,9 @@
 #include "common/object-pool.h"
 #include "exec/data-sink.h"
 #include "runtime/descriptors.h"
+#include "runtime/sorter.h"
 #include "util/runtime-profile.h"
+#include "util/tuple-row-compare.h"
 
 namespace impala {
 
@@ -119,6 +121,13 @@ struct OutputPartition {
 // The temporary directory is <table base dir>/<unique_id.hi>-<unique_id.lo>_data
 // such that an external tool can easily clean up incomplete inserts.
 // This is consistent with Hive's behavior.
+//
+// Sorted output:
+// If the target table is listed in --insert_sort_columns or --insert_zorder_columns and
+// is stored as Parquet, all input rows are first fed to a (spilling) Sorter and only
+// handed to the writers, in order, once the input is complete. Each file then covers a
+// narrow range of the sort columns, which makes its min/max statistics selective and
+// its dictionaries small.
 class HdfsTableSink : public DataSink {
  public:
   HdfsTableSink(const RowDescriptor& row_desc,
@@ -204,6 +213,22 @@ class HdfsTableSink : public DataSink {
   // Closes the hdfs file for this partition as well as the writer.
   void ClosePartitionFile(RuntimeState* state, OutputPartition* partition);
 
+  // Routes the rows in 'batch' to their partitions' writers. If 'eos', finalizes all
+  // partition files afterwards.
+  Status WriteRowBatch(RuntimeState* state, RowBatch* batch, bool eos);
+
+  // Resolves the sort columns configured for the target table into
+  // sort_key_expr_idxs_ and prepares sort_tuple_slot_expr_ctxs_. Does nothing if the
+  // table has no sort columns.
+  Status PrepareSortExprs(RuntimeState* state);
+
+  // Creates sorter_ if sort_key_expr_idxs_ is not empty and the table is stored as
+  // Parquet. Must be called after default_partition_ is set.
+  Status OpenSorter(RuntimeState* state);
+
+  // Writes all rows from sorter_, which must have received all the input.
+  Status WriteSortedRows(RuntimeState* state);
+
   // Descriptor of target table. Set in Prepare().
   const HdfsTableDescriptor* table_desc_;
 
@@ -285,6 +310,25 @@ class HdfsTableSink : public DataSink {
   // Flag to indicate the current input batch passed in Send() is empty. It implies that
   // we must not initialize the OutputPartition writer of a static partition insert.
   bool has_empty_input_batch_;
+
+  // Indices into output_expr_ctxs_ of the columns to sort the output by. Empty if the
+  // output is not sorted.
+  std::vector<int> sort_key_expr_idxs_;
+  TupleRowComparator::KeyOrder sort_key_order_;
+
+  // Sorts the input rows if the output is sorted, NULL otherwise. The sort tuple has the
+  // same layout as the single input tuple, so output_expr_ctxs_ and
+  // partition_key_expr_ctxs_ evaluate on the sorted rows unchanged.
+  boost::scoped_ptr<Sorter> sorter_;
+  boost::scoped_ptr<RowDescriptor> sort_row_desc_;
+
+  // SlotRefs that copy each materialized slot of the input tuple into the sort tuple.
+  std::vector<ExprContext*> sort_tuple_slot_expr_ctxs_;
+
+  // Sort keys evaluated on the left and right hand side of comparisons. Cloned from
+  // output_expr_ctxs_.
+  std::vector<ExprContext*> sort_key_expr_ctxs_lhs_;
+  std::vector<ExprContext*> sort_key_expr_ctxs_rhs_;
 };
 }
 #endif
@@ -23,6 +23,7 @@
 #include "util/codec.h"
 #include "util/compress.h"
 #include "util/hdfs-util.h"
+#include "util/text-formatter.h"
 
 #include <hdfs.h>
 #include <stdlib.h>
@@ -30,6 +31,12 @@
 using namespace std;
 using namespace boost;
 
+DEFINE_bool(text_writer_shortest_doubles, true, "If true, FLOAT and DOUBLE values "
+    "written to text tables without an output scale are written with the fewest digits "
+    "that read back as the same value, which is also faster. Otherwise they are written "
+    "with 16 significant digits as by earlier versions, which may not read back as the "
+    "same value, e.g. 0.1 + 0.2 is written as 0.3.");
+
 // Hdfs block size for compressed text.
 static const int64_t COMPRESSED_BLOCK_SIZE = 64 * 1024 * 1024;
 
@@ -37,6 +44,10 @@ static const int64_t COMPRESSED_BLOCK_SIZE = 64 * 1024 * 1024;
 // (compressed text is not splittable).
 static const int64_t COMPRESSED_BUFFERED_SIZE = 60 * 1024 * 1024;
 
+// Initial capacity of the output buffer. It grows as needed up to about the flush size
+// plus the output of one row batch.
+static const int64_t INITIAL_BUFFER_SIZE = 64 * 1024;
+
 namespace impala {
 
 HdfsTextTableWriter::HdfsTextTableWriter(HdfsTableSink* parent,
@@ -50,11 +61,8 @@ HdfsTextTableWriter::HdfsTextTableWriter(HdfsTableSink* parent,
   field_delim_ = partition->field_delim();
   escape_char_ = partition->escape_char();
   flush_size_ = HDFS_FLUSH_WRITE_SIZE;
-
-  // The default stringstream output precision is not very high, making it impossible
-  // to properly output doubles (they get rounded to ints).  Set a more reasonable
-  // precision.
-  rowbatch_stringstream_.precision(RawValue::ASCII_PRECISION);
+  buffer_len_ = 0;
+  buffer_capacity_ = 0;
 }
 
 Status HdfsTextTableWriter::Init() {
@@ -77,11 +85,19 @@ Status HdfsTextTableWriter::Init() {
     flush_size_ = HDFS_FLUSH_WRITE_SIZE;
   }
   parent_->mem_tracker()->Consume(flush_size_);
+
+  max_value_lens_.resize(output_expr_ctxs_.size());
+  for (int i = 0; i < output_expr_ctxs_.size(); ++i) {
+    const Expr* expr = output_expr_ctxs_[i]->root();
+    max_value_lens_[i] = TextFormatter::MaxLength(expr->type(), expr->output_scale());
+  }
   return Status::OK;
 }
 
 void HdfsTextTableWriter::Close() {
   parent_->mem_tracker()->Release(flush_size_);
+  buffer_.reset();
+  buffer_len_ = buffer_capacity_ = 0;
   if (mem_pool_.get() != NULL) mem_pool_->FreeAll();
 }
 
@@ -124,33 +140,23 @@ Status HdfsTextTableWriter::AppendRowBatch(RowBatch* batch,
       for (int j = 0; j < num_non_partition_cols; ++j) {
         void* value = output_expr_ctxs_[j]->GetValue(current_row);
         if (value != NULL) {
-          const ColumnType& type = output_expr_ctxs_[j]->root()->type();
-          if (type.type == TYPE_CHAR) {
-            char* val_ptr = StringValue::CharSlotToPtr(value, type);
-            StringValue sv(val_ptr, StringValue::UnpaddedCharLength(val_ptr, type.len));
-            PrintEscaped(&sv);
-          } else if (type.IsVarLen()) {
-            PrintEscaped(reinterpret_cast<const StringValue*>(value));
-          } else {
-            output_expr_ctxs_[j]->PrintValue(value, &rowbatch_stringstream_);
-          }
+          AppendValue(value, j);
         } else {
           // NULLs in hive are encoded based on the 'serialization.null.format' property.
-          rowbatch_stringstream_ << table_desc_->null_column_value();
+          const string& null_value = table_desc_->null_column_value();
+          AppendBytes(null_value.data(), null_value.size());
         }
         // Append field delimiter.
-        if (j + 1 < num_non_partition_cols) {
-          rowbatch_stringstream_ << field_delim_;
-        }
+        if (j + 1 < num_non_partition_cols) AppendBytes(&field_delim_, 1);
       }
       // Append tuple delimiter.
-      rowbatch_stringstream_ << tuple_delim_;
+      AppendBytes(&tuple_delim_, 1);
       ++output_->num_rows;
     }
   }
 
   *new_file = false;
-  if (rowbatch_stringstream_.tellp() >= flush_size_) {
+  if (buffer_len_ >= flush_size_) {
     RETURN_IF_ERROR(Flush());
 
     // If compressed, start a new file (compressed data is not splittable).
@@ -165,11 +171,9 @@ Status HdfsTextTableWriter::Finalize() {
 }
 
 Status HdfsTextTableWriter::Flush() {
-  string rowbatch_string = rowbatch_stringstream_.str();
-  rowbatch_stringstream_.str(string());
-  const uint8_t* uncompressed_data =
-      reinterpret_cast<const uint8_t*>(rowbatch_string.data());
-  int64_t uncompressed_len = rowbatch_string.size();
+  const uint8_t* uncompressed_data = reinterpret_cast<const uint8_t*>(buffer_.get());
+  int64_t uncompressed_len = buffer_len_;
+  buffer_len_ = 0;
   const uint8_t* data = uncompressed_data;
   int64_t len = uncompressed_len;
 
@@ -193,12 +197,115 @@ Status HdfsTextTableWriter::Flush() {
 }
 
 inline void HdfsTextTableWriter::PrintEscaped(const StringValue* str_val) {
+  // Every character is escaped at most once.
+  ReserveSpace(2 * str_val->len);
+  char* dst = buffer_.get() + buffer_len_;
   for (int i = 0; i < str_val->len; ++i) {
     if (UNLIKELY(str_val->ptr[i] == field_delim_ || str_val->ptr[i] == escape_char_)) {
-      rowbatch_stringstream_ << escape_char_;
+      *dst++ = escape_char_;
     }
-    rowbatch_stringstream_ << str_val->ptr[i];
+    *dst++ = str_val->ptr[i];
+  }
+  buffer_len_ = dst - buffer_.get();
+}
+
+inline void HdfsTextTableWriter::AppendValue(void* value, int col_idx) {
+  const Expr* expr = output_expr_ctxs_[col_idx]->root();
+  const ColumnType& type = expr->type();
+  if (type.type == TYPE_CHAR) {
+    char* val_ptr = StringValue::CharSlotToPtr(value, type);
+    StringValue sv(val_ptr, StringValue::UnpaddedCharLength(val_ptr, type.len));
+    PrintEscaped(&sv);
+    return;
+  } else if (type.IsVarLen()) {
+    PrintEscaped(reinterpret_cast<const StringValue*>(value));
+    return;
+  } else if (UNLIKELY(max_value_lens_[col_idx] < 0)) {
+    string str;
+    RawValue::PrintValue(value, type, expr->output_scale(), &str);
+    AppendBytes(str.data(), str.size());
+    return;
   }
+
+  ReserveSpace(max_value_lens_[col_idx]);
+  char* dst = buffer_.get() + buffer_len_;
+  int len = 0;
+  switch (type.type) {
+    case TYPE_BOOLEAN:
+      len = TextFormatter::FormatBool(*reinterpret_cast<const bool*>(value), dst);
+      break;
+    case TYPE_TINYINT:
+      len = TextFormatter::FormatInt(*reinterpret_cast<const int8_t*>(value), dst);
+      break;
+    case TYPE_SMALLINT:
+      len = TextFormatter::FormatInt(*reinterpret_cast<const int16_t*>(value), dst);
+      break;
+    case TYPE_INT:
+      len = TextFormatter::FormatInt(*reinterpret_cast<const int32_t*>(value), dst);
+      break;
+    case TYPE_BIGINT:
+      len = TextFormatter::FormatInt(*reinterpret_cast<const int64_t*>(value), dst);
+      break;
+    case TYPE_FLOAT:
+      if (FLAGS_text_writer_shortest_doubles && expr->output_scale() == -1) {
+        len = TextFormatter::FormatFloatShortest(*reinterpret_cast<const float*>(value),
+            dst);
+      } else {
+        len = TextFormatter::FormatFloat(
+            *reinterpret_cast<const float*>(value), expr->output_scale(), dst);
+      }
+      break;
+    case TYPE_DOUBLE:
+      if (FLAGS_text_writer_shortest_doubles && expr->output_scale() == -1) {
+        len = TextFormatter::FormatDoubleShortest(
+            *reinterpret_cast<const double*>(value), dst);
+      } else {
+        len = TextFormatter::FormatDouble(
+            *reinterpret_cast<const double*>(value), expr->output_scale(), dst);
+      }
+      break;
+    case TYPE_TIMESTAMP:
+      len = TextFormatter::FormatTimestamp(
+          *reinterpret_cast<const TimestampValue*>(value), dst);
+      break;
+    case TYPE_DECIMAL:
+      switch (type.GetByteSize()) {
+        case 4:
+          len = TextFormatter::FormatDecimal(
+              *reinterpret_cast<const Decimal4Value*>(value), type.scale, dst);
+          break;
+        case 8:
+          len = TextFormatter::FormatDecimal(
+              *reinterpret_cast<const Decimal8Value*>(value), type.scale, dst);
+          break;
+        case 16:
+          len = TextFormatter::FormatDecimal(
+              *reinterpret_cast<const Decimal16Value*>(value), type.scale, dst);
+          break;
+        default:
+          DCHECK(false) << type;
+      }
+      break;
+    default:
+      DCHECK(false) << type;
+  }
+  DCHECK_LE(len, max_value_lens_[col_idx]);
+  buffer_len_ += len;
+}
+
+inline void HdfsTextTableWriter::AppendBytes(const char* data, int64_t len) {
+  ReserveSpace(len);
+  memcpy(buffer_.get() + buffer_len_, data, len);
+  buffer_len_ += len;
+}
+
+void HdfsTextTableWriter::GrowBuffer(int64_t len) {
+  int64_t new_capacity = max(max(INITIAL_BUFFER_SIZE, 2 * buffer_capacity_),
+      buffer_len_ + len);
+  char* new_buffer = new char[new_capacity];
+  if (buffer_len_ > 0) memcpy(new_buffer, buffer_.get(), buffer_len_);
+  buffer_.reset(new_buffer);
+  buffer_capacity_ = new_capacity;
 }
 
 }
@@ -17,7 +17,7 @@
 #define IMPALA_EXEC_HDFS_TEXT_TABLE_WRITER_H
 
 #include <hdfs.h>
-#include <sstream>
+#include <boost/scoped_array.hpp>
 #include <boost/scoped_ptr.hpp>
 
 #include "runtime/descriptors.h"
@@ -37,6 +37,11 @@ class TupleRow;
 
 // The writer consumes all rows passed to it and writes the evaluated output_exprs_
 // as delimited text into Hdfs files.
+// Values are formatted with TextFormatter directly into a growable buffer, which is
+// written to HDFS when it holds at least flush_size_ bytes. The output is the same as
+// with RawValue::PrintValue(), except that FLOAT and DOUBLE values without an output
+// scale are written with the fewest digits that read back as the same value, unless
+// --text_writer_shortest_doubles is false.
 class HdfsTextTableWriter : public HdfsTableWriter {
  public:
   HdfsTextTableWriter(HdfsTableSink* parent,
@@ -62,11 +67,26 @@ class HdfsTextTableWriter : public HdfsTableWriter {
 
  private:
   // Escapes occurrences of field_delim_ and escape_char_ with escape_char_ and
-  // writes the escaped result into rowbatch_stringstream_. Neither Hive nor Impala
+  // writes the escaped result into buffer_. Neither Hive nor Impala
   // support escaping tuple_delim_.
   inline void PrintEscaped(const StringValue* str_val);
 
-  // Writes the buffered data in rowbatch_stringstream_ to HDFS, applying
+  // Appends the text representation of 'value', the non-NULL result of the output
+  // expr 'col_idx', to buffer_.
+  inline void AppendValue(void* value, int col_idx);
+
+  // Appends 'len' bytes of 'data' to buffer_.
+  inline void AppendBytes(const char* data, int64_t len);
+
+  // Makes sure that buffer_ has room for 'len' more bytes.
+  void ReserveSpace(int64_t len) {
+    if (UNLIKELY(buffer_len_ + len > buffer_capacity_)) GrowBuffer(len);
+  }
+
+  // Reallocates buffer_ with at least twice its capacity and room for 'len' more bytes.
+  void GrowBuffer(int64_t len);
+
+  // Writes the buffered data in buffer_ to HDFS, applying
   // compression if necessary.
   Status Flush();
 
@@ -79,12 +99,19 @@ class HdfsTextTableWriter : public HdfsTableWriter {
   // Escape character.
   char escape_char_;
 
-  // Size in rowbatch_stringstream_ before we call flush.
+  // Size in buffer_ before we call flush.
   int64_t flush_size_;
 
-  // Stringstream to buffer output.  The stream is cleared between HDFS
-  // Write calls to allow for the internal buffers to be reused.
-  std::stringstream rowbatch_stringstream_;
+  // Buffer for the output. It is reused between HDFS Write calls.
+  boost::scoped_array<char> buffer_;
+
+  // Number of bytes used and allocated in buffer_.
+  int64_t buffer_len_;
+  int64_t buffer_capacity_;
+
+  // Maximum length of the text representation of the values of each output expr, or -1
+  // for strings. Set in Init().
+  std::vector<int> max_value_lens_;
 
   // Compression codec.
   THdfsCompression::type codec_;
@@ -21,6 +21,7 @@
 #include "runtime/decimal-value.h"
 #include "runtime/string-value.h"
 #include "util/bit-util.h"
+#include "util/block-bloom-filter.h"
 
 // This file contains common elements between the parquet Writer and Scanner.
 namespace impala {
@@ -30,6 +31,11 @@ class TimestampValue;
 const uint8_t PARQUET_VERSION_NUMBER[4] = {'P', 'A', 'R', '1'};
 const uint32_t PARQUET_CURRENT_VERSION = 1;
 
+// Key in ColumnMetaData.key_value_metadata of the Bloom filter Impala writes for a
+// column chunk. The value is "<file offset>:<length in bytes>" of the filter, which is
+// stored right after the chunk's data pages.
+const char* const PARQUET_BLOOM_FILTER_KEY = "impala.bloom_filter";
+
 // Mapping of impala types to parquet storage types.  This is indexed by
 // PrimitiveType enum
 const parquet::Type::type IMPALA_TO_PARQUET_TYPES[] = {
@@ -319,6 +325,23 @@ inline int ParquetPlainEncoder::Decode(
   return fixed_len_size;
 }
 
+// Returns the hash that is stored in (and probed against) a column chunk's Bloom filter
+// for 'v'. Values are hashed in their plain encoding so that the writer and the scanner
+// agree regardless of the in-memory representation, except that strings are hashed
+// without the length prefix. 'fixed_len_size' is as in ParquetPlainEncoder::Encode().
+template<typename T>
+inline uint64_t ParquetBloomFilterHash(const T& v, int fixed_len_size) {
+  // Large enough for the largest fixed-size plain encoded value (DECIMAL(38)).
+  uint8_t buffer[16];
+  int len = ParquetPlainEncoder::Encode(buffer, fixed_len_size, v);
+  return BlockBloomFilter::Hash(buffer, len);
+}
+
+template<>
+inline uint64_t ParquetBloomFilterHash(const StringValue& v, int fixed_len_size) {
+  return BlockBloomFilter::Hash(v.ptr, v.len);
+}
+
 }
 
 #endif
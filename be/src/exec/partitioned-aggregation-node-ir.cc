@@ -23,6 +23,14 @@ using namespace impala;
 
 Status PartitionedAggregationNode::ProcessBatchNoGrouping(
     RowBatch* batch, HashTableCtx* ht_ctx) {
+  if (hoist_count_star_) {
+    // The codegen'd UpdateTuple() doesn't update COUNT(*).
+    for (int i = 0; i < count_star_slot_offsets_.size(); ++i) {
+      *reinterpret_cast<int64_t*>(
+          singleton_output_tuple_->GetSlot(count_star_slot_offsets_[i])) +=
+          batch->num_rows();
+    }
+  }
   for (int i = 0; i < batch->num_rows(); ++i) {
     UpdateTuple(&agg_fn_ctxs_[0], singleton_output_tuple_, batch->GetRow(i));
   }
@@ -0,0 +1,385 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <gtest/gtest.h>
+
+#include "codegen/llvm-codegen.h"
+#include "common/init.h"
+#include "gen-cpp/CatalogObjects_types.h"
+#include "gen-cpp/CatalogService_types.h"
+#include "gen-cpp/ImpalaInternalService_constants.h"
+#include "gen-cpp/hive_metastore_types.h"
+#include "runtime/exec-env.h"
+#include "runtime/types.h"
+#include "service/fe-support.h"
+#include "service/frontend.h"
+#include "service/impala-server.h"
+#include "testutil/impalad-query-executor.h"
+#include "testutil/in-process-servers.h"
+#include "util/filesystem-util.h"
+#include "util/path-builder.h"
+#include "util/test-info.h"
+
+DECLARE_int32(be_port);
+DECLARE_int32(beeswax_port);
+DECLARE_string(impalad);
+DECLARE_bool(abort_on_config_error);
+DECLARE_bool(enable_coord_only_queries);
+DECLARE_int32(agg_morsel_dop);
+
+using namespace impala;
+using namespace std;
+
+namespace impala {
+
+// Runs aggregations through an in-process impalad and checks that the codegen'd
+// partitioned aggregation node returns the same results as the interpreted one.
+
+static ImpaladQueryExecutor* executor_;
+
+// Five rows of a group column 'g', int, string and timestamp columns with NULLs, and
+// duplicate timestamps.
+static const string INPUT = "(values "
+    "(1 g, 10 i, 'a' s, cast('2015-01-01 10:00:00' as timestamp) ts), "
+    "(1, NULL, 'b', NULL), "
+    "(2, 20, NULL, cast('2015-06-30 23:59:59.5' as timestamp)), "
+    "(2, 30, 'c', cast('2015-01-01 10:00:00' as timestamp)), "
+    "(3, NULL, NULL, NULL)) v";
+
+// INPUT repeated 20 times, so that groups are updated many times.
+static const string LARGE_INPUT = INPUT + " cross join (values "
+    "(1 k), (2), (3), (4), (5), (6), (7), (8), (9), (10), "
+    "(11), (12), (13), (14), (15), (16), (17), (18), (19), (20)) r";
+
+// Adds the native UDA memtest(bigint) of libTestUdas.so to the catalog of the
+// in-process impalad, as the catalog update of a CREATE AGGREGATE FUNCTION would. Its
+// result is the sum of its inputs.
+static Status CreateMemTestUda() {
+  string lib_path;
+  PathBuilder::GetFullBuildPath("testutil/libTestUdas.so", &lib_path);
+  TColumnType bigint_type = ColumnType(TYPE_BIGINT).ToThrift();
+
+  TCatalogObject db;
+  db.__set_type(TCatalogObjectType::DATABASE);
+  db.__set_catalog_version(1);
+  db.db.__set_db_name("default");
+  db.__isset.db = true;
+
+  TCatalogObject uda;
+  uda.__set_type(TCatalogObjectType::FUNCTION);
+  uda.__set_catalog_version(1);
+  uda.fn.name.__set_db_name("default");
+  uda.fn.name.__set_function_name("memtest");
+  uda.fn.__set_binary_type(TFunctionBinaryType::NATIVE);
+  uda.fn.arg_types.push_back(bigint_type);
+  uda.fn.__set_ret_type(bigint_type);
+  uda.fn.__set_has_var_args(false);
+  uda.fn.__set_signature("memtest(BIGINT)");
+  uda.fn.__set_hdfs_location("file://" + lib_path);
+  // The symbols are mangled, as the frontend does for CREATE AGGREGATE FUNCTION.
+  TAggregateFunction& aggregate_fn = uda.fn.aggregate_fn;
+  aggregate_fn.__set_intermediate_type(bigint_type);
+  aggregate_fn.__set_init_fn_symbol(
+      "_Z11MemTestInitPN10impala_udf15FunctionContextEPNS_9BigIntValE");
+  aggregate_fn.__set_update_fn_symbol(
+      "_Z13MemTestUpdatePN10impala_udf15FunctionContextERKNS_9BigIntValEPS2_");
+  aggregate_fn.__set_merge_fn_symbol(
+      "_Z12MemTestMergePN10impala_udf15FunctionContextERKNS_9BigIntValEPS2_");
+  aggregate_fn.__set_serialize_fn_symbol(
+      "_Z16MemTestSerializePN10impala_udf15FunctionContextERKNS_9BigIntValE");
+  aggregate_fn.__set_finalize_fn_symbol(
+      "_Z15MemTestFinalizePN10impala_udf15FunctionContextERKNS_9BigIntValE");
+  uda.fn.__isset.aggregate_fn = true;
+  uda.__isset.fn = true;
+
+  TUpdateCatalogCacheRequest request;
+  request.__set_is_delta(true);
+  request.__set_catalog_service_id(TUniqueId());
+  request.updated_objects.push_back(db);
+  request.updated_objects.push_back(uda);
+  TUpdateCatalogCacheResponse response;
+  return ExecEnv::GetInstance()->frontend()->UpdateCatalogCache(request, &response);
+}
+
+// Directory of the text file of the table created by CreateTextTable().
+static const string TEXT_TABLE_DIR = "/tmp/partitioned-aggregation-node-test";
+static const int TEXT_TABLE_ROWS = 5000;
+
+static TColumn MakeColumn(const string& name, PrimitiveType type, int position) {
+  TColumn column;
+  column.__set_columnName(name);
+  column.__set_columnType(ColumnType(type).ToThrift());
+  column.__set_position(position);
+  return column;
+}
+
+// Writes TEXT_TABLE_ROWS rows of an int column 'i', a double column 'd' and a string
+// column 's' with NULLs to a local text file and adds the unpartitioned table
+// default.text_tbl over it to the catalog of the in-process impalad, as a catalog
+// update from the catalog server would. Queries over it have an hdfs scan, which the
+// morsel-driven aggregation requires.
+static Status CreateTextTable() {
+  vector<string> dirs(1, TEXT_TABLE_DIR);
+  RETURN_IF_ERROR(FileSystemUtil::CreateDirectories(dirs));
+  const string file_name = "data.txt";
+  const string location = "file://" + TEXT_TABLE_DIR;
+  {
+    ofstream file((TEXT_TABLE_DIR + "/" + file_name).c_str());
+    // The doubles are multiples of 1/4, so that their sums are exact in any order.
+    for (int k = 0; k < TEXT_TABLE_ROWS; ++k) {
+      stringstream i, d, s;
+      i << k % 97;
+      d << k / 4.0;
+      s << string(k % 5, 'x');
+      file << (k % 10 == 0 ? "\\N" : i.str()) << ","
+           << (k % 7 == 0 ? "\\N" : d.str()) << ","
+           << (k % 3 == 0 ? "\\N" : s.str()) << "\n";
+    }
+    if (!file.good()) return Status("Could not write the text table's file");
+  }
+  struct stat file_stat;
+  if (stat((TEXT_TABLE_DIR + "/" + file_name).c_str(), &file_stat) != 0) {
+    return Status("Could not stat the text table's file");
+  }
+
+  TCatalogObject table;
+  table.__set_type(TCatalogObjectType::TABLE);
+  table.__set_catalog_version(2);
+  TTable& tbl = table.table;
+  tbl.__set_db_name("default");
+  tbl.__set_tbl_name("text_tbl");
+  tbl.__set_id(1);
+  tbl.__set_access_level(TAccessLevel::READ_WRITE);
+  tbl.__set_table_type(TTableType::HDFS_TABLE);
+  tbl.columns.push_back(MakeColumn("i", TYPE_INT, 0));
+  tbl.columns.push_back(MakeColumn("d", TYPE_DOUBLE, 1));
+  tbl.columns.push_back(MakeColumn("s", TYPE_STRING, 2));
+  tbl.__isset.columns = true;
+  tbl.__isset.clustering_columns = true;
+  tbl.table_stats.__set_num_rows(TEXT_TABLE_ROWS);
+  tbl.__isset.table_stats = true;
+
+  // The frontend creates the table from its metastore object.
+  Apache::Hadoop::Hive::Table& ms_table = tbl.metastore_table;
+  ms_table.__set_dbName("default");
+  ms_table.__set_tableName("text_tbl");
+  ms_table.__set_tableType("MANAGED_TABLE");
+  ms_table.sd.__set_location(location);
+  ms_table.sd.__set_inputFormat("org.apache.hadoop.mapred.TextInputFormat");
+  ms_table.sd.__set_outputFormat(
+      "org.apache.hadoop.hive.ql.io.HiveIgnoreKeyTextOutputFormat");
+  ms_table.sd.serdeInfo.__set_serializationLib(
+      "org.apache.hadoop.hive.serde2.lazy.LazySimpleSerDe");
+  ms_table.sd.serdeInfo.parameters["field.delim"] = ",";
+  for (int i = 0; i < tbl.columns.size(); ++i) {
+    Apache::Hadoop::Hive::FieldSchema field;
+    field.__set_name(tbl.columns[i].columnName);
+    field.__set_type(i == 0 ? "int" : (i == 1 ? "double" : "string"));
+    ms_table.sd.cols.push_back(field);
+  }
+  tbl.__isset.metastore_table = true;
+
+  THdfsTable& hdfs_table = tbl.hdfs_table;
+  hdfs_table.__set_hdfsBaseDir(location);
+  hdfs_table.__set_nullPartitionKeyValue("__HIVE_DEFAULT_PARTITION__");
+  hdfs_table.__set_nullColumnValue("\\N");
+  for (int i = 0; i < tbl.columns.size(); ++i) {
+    hdfs_table.colNames.push_back(tbl.columns[i].columnName);
+  }
+  TNetworkAddress host;
+  host.__set_hostname("localhost");
+  host.__set_port(0);
+  hdfs_table.network_addresses.push_back(host);
+  hdfs_table.__isset.network_addresses = true;
+
+  THdfsPartition partition;
+  partition.__set_lineDelim('\n');
+  partition.__set_fieldDelim(',');
+  partition.__set_collectionDelim(',');
+  partition.__set_mapKeyDelim(',');
+  partition.__set_escapeChar(0);
+  partition.__set_fileFormat(THdfsFileFormat::TEXT);
+  partition.__set_blockSize(0);
+  partition.__isset.partitionKeyExprs = true;
+  partition.__set_access_level(TAccessLevel::READ_WRITE);
+  // Unpartitioned tables have the default partition, which only inserts use.
+  hdfs_table.partitions[g_ImpalaInternalService_constants.DEFAULT_PARTITION_ID] =
+      partition;
+
+  // The single file is one block.
+  THdfsFileBlock block;
+  block.__set_offset(0);
+  block.__set_length(file_stat.st_size);
+  block.replica_host_idxs.push_back(0);
+  THdfsFileDesc file_desc;
+  file_desc.__set_file_name(file_name);
+  file_desc.__set_length(file_stat.st_size);
+  file_desc.__set_compression(THdfsCompression::NONE);
+  file_desc.__set_last_modification_time(file_stat.st_mtime * 1000L);
+  file_desc.file_blocks.push_back(block);
+  partition.file_desc.push_back(file_desc);
+  partition.__isset.file_desc = true;
+  partition.__set_location(location);
+  partition.stats.__set_num_rows(TEXT_TABLE_ROWS);
+  partition.__isset.stats = true;
+  partition.__set_id(0);
+  hdfs_table.partitions[0] = partition;
+  tbl.__isset.hdfs_table = true;
+  table.__isset.table = true;
+
+  TUpdateCatalogCacheRequest request;
+  request.__set_is_delta(true);
+  request.__set_catalog_service_id(TUniqueId());
+  request.updated_objects.push_back(table);
+  TUpdateCatalogCacheResponse response;
+  return ExecEnv::GetInstance()->frontend()->UpdateCatalogCache(request, &response);
+}
+
+// Returns the rows of 'stmt', run with 'exec_options', in sorted order.
+static vector<string> GetRows(const string& stmt, const vector<string>& exec_options) {
+  vector<string> rows;
+  executor_->setExecOptions(exec_options);
+  Status status = executor_->Exec(stmt, NULL);
+  EXPECT_TRUE(status.ok()) << stmt << "\n" << status.GetDetail();
+  if (!status.ok()) return rows;
+  while (true) {
+    string row;
+    status = executor_->FetchResult(&row);
+    EXPECT_TRUE(status.ok()) << stmt << "\n" << status.GetDetail();
+    if (!status.ok() || row.empty()) break;
+    rows.push_back(row);
+  }
+  sort(rows.begin(), rows.end());
+  return rows;
+}
+
+// Checks that 'stmt' returns the same rows with and without codegen, and returns them.
+static vector<string> TestCodegen(const string& stmt) {
+  vector<string> options(1, "DISABLE_CODEGEN=1");
+  vector<string> interpreted_rows = GetRows(stmt, options);
+  options[0] = "DISABLE_CODEGEN=0";
+  vector<string> codegen_rows = GetRows(stmt, options);
+  EXPECT_FALSE(interpreted_rows.empty()) << stmt;
+  EXPECT_EQ(interpreted_rows, codegen_rows) << stmt;
+  return codegen_rows;
+}
+
+// A node that mixes aggregate functions with handcrafted IR (SUM, COUNT) with ones
+// that are called through CodegenCallUda() (GROUP_CONCAT, NDV and AVG over a timestamp,
+// and a native UDA), and with MIN over a CHAR, whose CHAR intermediate is updated by
+// the interpreted AggFnEvaluator::Add().
+TEST(PartitionedAggregationNodeTest, MixedAggregateFunctions) {
+  const string select_list = "sum(i), count(i), group_concat(s), ndv(ts), avg(ts), "
+      "min(ts), memtest(i), min(cast(s as char(3)))";
+  TestCodegen("select " + select_list + " from " + INPUT);
+  TestCodegen("select g, " + select_list + " from " + INPUT + " group by g");
+  TestCodegen("select " + select_list + " from " + LARGE_INPUT);
+  TestCodegen("select g, " + select_list + " from " + LARGE_INPUT + " group by g");
+  // Distinct aggregation merges the intermediate values of the first phase.
+  TestCodegen("select g, count(distinct i), group_concat(s), memtest(i) from "
+      + LARGE_INPUT + " group by g");
+}
+
+// The native UDA computes the same as SUM, with and without codegen.
+TEST(PartitionedAggregationNodeTest, NativeUda) {
+  vector<string> rows = TestCodegen("select g, sum(i) = memtest(i) from "
+      + LARGE_INPUT + " where i is not null group by g");
+  ASSERT_EQ(2, rows.size());
+  for (int i = 0; i < rows.size(); ++i) {
+    EXPECT_NE(rows[i].find("true"), string::npos) << rows[i];
+  }
+}
+
+// The codegen'd UpdateTuple() skips COUNT(*), which is incremented once per batch
+// instead, also next to aggregate functions that are called through CodegenCallUda()
+// and over empty input.
+TEST(PartitionedAggregationNodeTest, HoistedCountStar) {
+  TestCodegen("select count(*) from " + LARGE_INPUT);
+  TestCodegen("select count(*), avg(i), min(s), ndv(ts), memtest(i) from "
+      + LARGE_INPUT);
+  TestCodegen("select count(*), sum(i), group_concat(s) from " + LARGE_INPUT
+      + " where g = 99");
+  TestCodegen("select count(*), count(i), sum(i), min(i), max(i), sum(d), min(d), "
+      "max(d) from text_tbl");
+}
+
+// Aggregations without grouping exprs over an hdfs scan return the same results when
+// the scan's batches are aggregated by several morsel workers, whose intermediate
+// values are serialized and merged, as with the single-threaded aggregation.
+TEST(PartitionedAggregationNodeTest, MorselWorkers) {
+  string explain_plan;
+  ASSERT_TRUE(executor_->Explain("select count(*) from text_tbl", &explain_plan).ok());
+  ASSERT_NE(explain_plan.find("SCAN HDFS"), string::npos) << explain_plan;
+
+  const string select_list = "count(*), count(i), sum(i), min(i), max(i), avg(d), "
+      "min(d), max(d), ndv(i), min(s), max(s), length(group_concat(s)), memtest(i)";
+  const string stmts[] = {
+    "select " + select_list + " from text_tbl",
+    // Only NULLs for 'i'.
+    "select " + select_list + " from text_tbl where i is null",
+    // No rows: the workers' tuples only have their initial values.
+    "select " + select_list + " from text_tbl where i > 1000",
+  };
+  // Small batches, so that every worker gets some of them.
+  vector<string> options(1, "BATCH_SIZE=16");
+  for (int i = 0; i < sizeof(stmts) / sizeof(string); ++i) {
+    FLAGS_agg_morsel_dop = 0;
+    vector<string> single_threaded_rows = GetRows(stmts[i], options);
+    string profile;
+    ASSERT_TRUE(executor_->GetRuntimeProfile(&profile).ok());
+    EXPECT_EQ(-1, ImpaladQueryExecutor::GetCounterValue(profile, "MorselWorkers"))
+        << profile;
+    FLAGS_agg_morsel_dop = 4;
+    vector<string> morsel_rows = GetRows(stmts[i], options);
+    FLAGS_agg_morsel_dop = 0;
+    // The results only show that the workers were used if they were started.
+    ASSERT_TRUE(executor_->GetRuntimeProfile(&profile).ok());
+    EXPECT_GT(ImpaladQueryExecutor::GetCounterValue(profile, "MorselWorkers"), 0)
+        << profile;
+    ASSERT_EQ(1, single_threaded_rows.size()) << stmts[i];
+    EXPECT_EQ(single_threaded_rows, morsel_rows) << stmts[i];
+  }
+}
+
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  InitCommonRuntime(argc, argv, true, TestInfo::BE_TEST);
+  InitFeSupport();
+  LlvmCodeGen::InitializeLlvm();
+  // Queries over constant inputs would otherwise run on the coordinator-only path,
+  // which disables codegen.
+  FLAGS_enable_coord_only_queries = false;
+
+  FLAGS_impalad = "localhost:21000";
+  FLAGS_abort_on_config_error = false;
+  InProcessImpalaServer* impala_server =
+      new InProcessImpalaServer("localhost", FLAGS_be_port, 0, 0, "", 0);
+  EXIT_IF_ERROR(
+      impala_server->StartWithClientServers(FLAGS_beeswax_port, FLAGS_beeswax_port + 1,
+                                            false));
+  impala_server->SetCatalogInitialized();
+  EXIT_IF_ERROR(CreateMemTestUda());
+  EXIT_IF_ERROR(CreateTextTable());
+  executor_ = new ImpaladQueryExecutor();
+  EXIT_IF_ERROR(executor_->Setup());
+  return RUN_ALL_TESTS();
+}
@@ -38,6 +38,7 @@
 #include "udf/udf-internal.h"
 #include "util/debug-util.h"
 #include "util/runtime-profile.h"
+#include "util/thread.h"
 
 #include "gen-cpp/Exprs_types.h"
 #include "gen-cpp/PlanNodes_types.h"
@@ -48,6 +49,12 @@ using namespace llvm;
 using namespace std;
 using namespace strings;
 
+DEFINE_int32(agg_morsel_dop, 0, "(Advanced) If greater than 1, aggregations without "
+    "grouping exprs directly above an hdfs scan aggregate the scan's row batches with up "
+    "to this many worker threads. Off by default: the workers don't use codegen and the "
+    "extra ones take thread tokens from the scanner threads, so this only pays off if "
+    "the aggregate functions are expensive and cores are left over after the scan.");
+
 namespace impala {
 
 const char* PartitionedAggregationNode::LLVM_CLASS_NAME =
@@ -68,6 +75,8 @@ PartitionedAggregationNode::PartitionedAggregationNode(
     singleton_output_tuple_returned_(true),
     output_partition_(NULL),
     process_row_batch_fn_(NULL),
+    hoist_count_star_(false),
+    morsel_workers_counter_(NULL),
     build_timer_(NULL),
     get_results_timer_(NULL),
     num_hash_buckets_(NULL),
@@ -88,6 +97,9 @@ Status PartitionedAggregationNode::Init(const TPlanNode& tnode) {
         pool_, tnode.agg_node.aggregate_functions[i], &evaluator));
     aggregate_evaluators_.push_back(evaluator);
   }
+  if (tnode.agg_node.grouping_exprs.empty() && FLAGS_agg_morsel_dop > 1) {
+    aggregate_fn_exprs_ = tnode.agg_node.aggregate_functions;
+  }
   return Status::OK;
 }
 
@@ -158,6 +170,19 @@ Status PartitionedAggregationNode::Prepare(RuntimeState* state) {
       Expr::Prepare(build_expr_ctxs_, state, *intermediate_row_desc_, expr_mem_tracker()));
   AddExprCtxsToFree(build_expr_ctxs_);
 
+  // The workers get the child's batches with all their memory attached, which hdfs
+  // scans guarantee.
+  if (!aggregate_fn_exprs_.empty() &&
+      child(0)->type() == TPlanNodeType::HDFS_SCAN_NODE) {
+    for (int i = 0; i < FLAGS_agg_morsel_dop; ++i) {
+      MorselWorker* worker = pool_->Add(new MorselWorker());
+      worker->agg_fn_pool.reset(new MemPool(expr_mem_tracker()));
+      morsel_workers_.push_back(worker);
+    }
+    morsel_workers_counter_ =
+        ADD_COUNTER(runtime_profile(), "MorselWorkers", TUnit::UNIT);
+  }
+
   int j = probe_expr_ctxs_.size();
   for (int i = 0; i < aggregate_evaluators_.size(); ++i, ++j) {
     // skip non-materialized slots; we don't have evaluators instantiated for those
@@ -175,6 +200,22 @@ Status PartitionedAggregationNode::Prepare(RuntimeState* state) {
     agg_fn_ctxs_.push_back(agg_fn_ctx);
     state->obj_pool()->Add(agg_fn_ctx);
     needs_serialize_ |= aggregate_evaluators_[i]->SupportsSerialize();
+    if (aggregate_evaluators_[i]->is_count_star()) {
+      count_star_slot_offsets_.push_back(intermediate_slot_desc->tuple_offset());
+    }
+
+    for (int w = 0; w < morsel_workers_.size(); ++w) {
+      MorselWorker* worker = morsel_workers_[w];
+      AggFnEvaluator* evaluator;
+      RETURN_IF_ERROR(AggFnEvaluator::Create(pool_, aggregate_fn_exprs_[i], &evaluator));
+      worker->evaluators.push_back(evaluator);
+      FunctionContext* worker_fn_ctx = NULL;
+      RETURN_IF_ERROR(evaluator->Prepare(state, child(0)->row_desc(),
+          intermediate_slot_desc, output_slot_desc, worker->agg_fn_pool.get(),
+          &worker_fn_ctx));
+      worker->agg_fn_ctxs.push_back(worker_fn_ctx);
+      state->obj_pool()->Add(worker_fn_ctx);
+    }
   }
 
   if (probe_expr_ctxs_.empty()) {
@@ -183,6 +224,10 @@ Status PartitionedAggregationNode::Prepare(RuntimeState* state) {
     singleton_output_tuple_ =
         ConstructIntermediateTuple(agg_fn_ctxs_, mem_pool_.get(), NULL);
     singleton_output_tuple_returned_ = false;
+    for (int i = 0; i < morsel_workers_.size(); ++i) {
+      morsel_workers_[i]->tuple = ConstructIntermediateTuple(
+          morsel_workers_[i]->agg_fn_ctxs, mem_pool_.get(), NULL);
+    }
   } else {
     ht_ctx_.reset(new HashTableCtx(build_expr_ctxs_, probe_expr_ctxs_, true, true,
         state->fragment_hash_seed(), MAX_PARTITION_DEPTH, 1));
@@ -191,7 +236,9 @@ Status PartitionedAggregationNode::Prepare(RuntimeState* state) {
     RETURN_IF_ERROR(CreateHashPartitions(0));
   }
 
-  if (state->codegen_enabled()) {
+  // The morsel workers don't use the codegen'd functions, which are bound to
+  // aggregate_evaluators_.
+  if (state->codegen_enabled() && morsel_workers_.empty()) {
     LlvmCodeGen* codegen;
     RETURN_IF_ERROR(state->GetCodegen(&codegen));
     Function* codegen_process_row_batch_fn = CodegenProcessBatch();
@@ -215,6 +262,12 @@ Status PartitionedAggregationNode::Open(RuntimeState* state) {
   for (int i = 0; i < aggregate_evaluators_.size(); ++i) {
     RETURN_IF_ERROR(aggregate_evaluators_[i]->Open(state, agg_fn_ctxs_[i]));
   }
+  for (int w = 0; w < morsel_workers_.size(); ++w) {
+    MorselWorker* worker = morsel_workers_[w];
+    for (int i = 0; i < worker->evaluators.size(); ++i) {
+      RETURN_IF_ERROR(worker->evaluators[i]->Open(state, worker->agg_fn_ctxs[i]));
+    }
+  }
 
   if (needs_serialize_ && block_mgr_client_ != NULL) {
     serialize_stream_.reset(new BufferedTupleStream(state, *intermediate_row_desc_,
@@ -227,6 +280,12 @@ Status PartitionedAggregationNode::Open(RuntimeState* state) {
 
   // Read all the rows from the child and process them.
   RETURN_IF_ERROR(children_[0]->Open(state));
+  if (!morsel_workers_.empty()) {
+    RETURN_IF_ERROR(AggregateMorsels(state));
+    child(0)->Close(state);
+    return Status::OK;
+  }
+  hoist_count_star_ = process_row_batch_fn_ != NULL && probe_expr_ctxs_.empty();
   RowBatch batch(children_[0]->row_desc(), state->batch_size(), mem_tracker());
   bool eos = false;
   while (!eos) {
@@ -267,6 +326,81 @@ Status PartitionedAggregationNode::Open(RuntimeState* state) {
   return Status::OK;
 }
 
+Status PartitionedAggregationNode::AggregateMorsels(RuntimeState* state) {
+  DCHECK(probe_expr_ctxs_.empty());
+  morsel_queue_.reset(new BlockingQueue<RowBatch*>(2 * morsel_workers_.size()));
+  ThreadGroup worker_threads;
+  int num_workers = 0;
+  for (; num_workers < morsel_workers_.size(); ++num_workers) {
+    // The first worker runs on the fragment's thread token, since this thread only
+    // waits for the scan from here on.
+    bool optional_token = num_workers > 0;
+    if (optional_token && !state->resource_pool()->TryAcquireThreadToken()) break;
+    stringstream ss;
+    ss << "morsel-worker (node: " << id() << ", worker: " << num_workers << ")";
+    worker_threads.AddThread(new Thread("agg-node", ss.str(),
+        &PartitionedAggregationNode::ProcessMorsels, this, morsel_workers_[num_workers],
+        optional_token));
+  }
+  COUNTER_SET(morsel_workers_counter_, num_workers);
+
+  // Hand the child's batches to the workers until eos or an error. The workers must be
+  // joined before returning, so errors break out of the loop.
+  Status status;
+  bool eos = false;
+  while (!eos) {
+    status = QueryMaintenance(state);
+    if (!status.ok()) break;
+    scoped_ptr<RowBatch> batch(
+        new RowBatch(children_[0]->row_desc(), state->batch_size(), mem_tracker()));
+    status = children_[0]->GetNext(state, batch.get(), &eos);
+    if (!status.ok()) break;
+    if (batch->num_rows() == 0) continue;
+    if (!morsel_queue_->BlockingPut(batch.get())) break;
+    batch.release();
+  }
+  morsel_queue_->Shutdown();
+  worker_threads.JoinAll();
+  RETURN_IF_ERROR(status);
+  RETURN_IF_CANCELLED(state);
+
+  // Merge the workers' intermediate tuples. The workers are done, so the evaluators
+  // can be used from this thread. Merge() expects serialized intermediate values, as
+  // the merge of a spilled partition does, and Serialize() also frees any state the
+  // UDAs keep in the worker's tuple.
+  SCOPED_TIMER(build_timer_);
+  for (int w = 0; w < num_workers; ++w) {
+    MorselWorker* worker = morsel_workers_[w];
+    AggFnEvaluator::Serialize(worker->evaluators, worker->agg_fn_ctxs, worker->tuple);
+    for (int i = 0; i < aggregate_evaluators_.size(); ++i) {
+      aggregate_evaluators_[i]->Merge(agg_fn_ctxs_[i], worker->tuple,
+          singleton_output_tuple_);
+    }
+    worker->tuple = NULL;
+  }
+  return state->GetQueryStatus();
+}
+
+void PartitionedAggregationNode::ProcessMorsels(MorselWorker* worker,
+    bool release_thread_token) {
+  RowBatch* batch;
+  while (morsel_queue_->BlockingGet(&batch)) {
+    // Keep draining the queue after cancellation so the batches are freed.
+    if (!state_->is_cancelled()) {
+      for (int i = 0; i < batch->num_rows(); ++i) {
+        AggFnEvaluator::Add(
+            worker->evaluators, worker->agg_fn_ctxs, batch->GetRow(i), worker->tuple);
+      }
+      for (int i = 0; i < worker->evaluators.size(); ++i) {
+        ExprContext::FreeLocalAllocations(worker->evaluators[i]->input_expr_ctxs());
+      }
+      ExprContext::FreeLocalAllocations(worker->agg_fn_ctxs);
+    }
+    delete batch;
+  }
+  if (release_thread_token) state_->resource_pool()->ReleaseThreadToken(false);
+}
+
 Status PartitionedAggregationNode::GetNext(RuntimeState* state,
     RowBatch* row_batch, bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
@@ -366,6 +500,19 @@ void PartitionedAggregationNode::Close(RuntimeState* state) {
     DCHECK_EQ(agg_fn_ctxs_.size(), aggregate_evaluators_.size());
     FinalizeTuple(agg_fn_ctxs_, singleton_output_tuple_, mem_pool_.get());
   }
+  for (int w = 0; w < morsel_workers_.size(); ++w) {
+    MorselWorker* worker = morsel_workers_[w];
+    if (worker->tuple != NULL) {
+      FinalizeTuple(worker->agg_fn_ctxs, worker->tuple, mem_pool_.get());
+    }
+    for (int i = 0; i < worker->evaluators.size(); ++i) {
+      worker->evaluators[i]->Close(state);
+    }
+    for (int i = 0; i < worker->agg_fn_ctxs.size(); ++i) {
+      worker->agg_fn_ctxs[i]->impl()->Close();
+    }
+    worker->agg_fn_pool->FreeAll();
+  }
 
   // Iterate through the remaining rows in the hash table and call Serialize/Finalize on
   // them in order to free any memory allocated by UDAs
@@ -959,8 +1106,38 @@ Status PartitionedAggregationNode::QueryMaintenance(RuntimeState* state) {
   return ExecNode::QueryMaintenance(state);
 }
 
+// Returns true if the update of 'evaluator' is one of the builtins for which
+// CodegenUpdateSlot() generates handcrafted IR.
+static bool HasHandcraftedUpdateSlot(AggFnEvaluator* evaluator,
+    SlotDescriptor* slot_desc) {
+  if (!evaluator->is_builtin() || evaluator->input_expr_ctxs().size() != 1) return false;
+  AggFnEvaluator::AggregationOp op = evaluator->agg_op();
+  if (op == AggFnEvaluator::OTHER) return false;
+  // Only AVG handles timestamp inputs
+  if (evaluator->input_expr_ctxs()[0]->root()->type().type == TYPE_TIMESTAMP &&
+      op != AggFnEvaluator::AVG) {
+    return false;
+  }
+  PrimitiveType type = slot_desc->type().type;
+  // Char and timestamp intermediates aren't supported
+  if (type == TYPE_TIMESTAMP || type == TYPE_CHAR) return false;
+  // Only AVG and NDV support string intermediates
+  if ((type == TYPE_STRING || type == TYPE_VARCHAR) &&
+      !(op == AggFnEvaluator::AVG || op == AggFnEvaluator::NDV)) {
+    return false;
+  }
+  // Only SUM, AVG, and NDV support decimal intermediates
+  if (type == TYPE_DECIMAL &&
+      !(op == AggFnEvaluator::SUM || op == AggFnEvaluator::AVG ||
+        op == AggFnEvaluator::NDV)) {
+    return false;
+  }
+  return true;
+}
+
 // IR Generation for updating a single aggregation slot. Signature is:
 // void UpdateSlot(FunctionContext* fn_ctx, AggTuple* agg_tuple, char** row)
+// Aggregate functions without handcrafted IR are handled by CodegenCallUda().
 //
 // The IR for sum(double_col) is:
 // define void @UpdateSlot(%"class.impala_udf::FunctionContext"* %fn_ctx,
@@ -1038,6 +1215,9 @@ Status PartitionedAggregationNode::QueryMaintenance(RuntimeState* state) {
 llvm::Function* PartitionedAggregationNode::CodegenUpdateSlot(
     AggFnEvaluator* evaluator, SlotDescriptor* slot_desc) {
   DCHECK(slot_desc->is_materialized());
+  if (!HasHandcraftedUpdateSlot(evaluator, slot_desc)) {
+    return CodegenCallUda(evaluator, slot_desc);
+  }
   LlvmCodeGen* codegen;
   if (!state_->GetCodegen(&codegen).ok()) return NULL;
 
@@ -1045,12 +1225,6 @@ llvm::Function* PartitionedAggregationNode::CodegenUpdateSlot(
   ExprContext* input_expr_ctx = evaluator->input_expr_ctxs()[0];
   Expr* input_expr = input_expr_ctx->root();
 
-  // TODO: implement timestamp
-  if (input_expr->type().type == TYPE_TIMESTAMP &&
-      evaluator->agg_op() != AggFnEvaluator::AVG) {
-    return NULL;
-  }
-
   Function* agg_expr_fn;
   Status status = input_expr->GetCodegendComputeFn(state_, &agg_expr_fn);
   if (!status.ok()) {
@@ -1190,9 +1364,197 @@ llvm::Function* PartitionedAggregationNode::CodegenUpdateSlot(
   return codegen->FinalizeFunction(fn);
 }
 
+// Allocates an AnyVal of 'type' in the entry block of the function that is being built,
+// to be passed to a UDA by pointer.
+static Value* CreateAnyValAlloca(LlvmCodeGen* codegen,
+    const LlvmCodeGen::LlvmBuilder& builder, const ColumnType& type, const char* name) {
+  AllocaInst* ptr = codegen->CreateEntryBlockAlloca(
+      builder, CodegenAnyVal::GetUnloweredType(codegen, type), name);
+  // UDAs may manipulate DecimalVals via SIMD instructions that require 16-byte memory
+  // alignment, see ScalarFnCall::GetCodegendComputeFn().
+  if (type.type == TYPE_DECIMAL) ptr->setAlignment(16);
+  return ptr;
+}
+
+// Generates an UpdateSlot() with the same signature as CodegenUpdateSlot() that does
+// what AggFnEvaluator::Add() does for a single row, without the staging AnyVals and
+// the switch over the number of inputs. For group_concat(string_col, ',') it is
+// equivalent to:
+//
+// void UpdateSlot(FunctionContext* fn_ctx, AggTuple* agg_tuple, TupleRow* row) {
+//   StringVal input0 = GetSlotRef(input_expr_ctx0, row);
+//   StringVal input1 = GetStringLiteral(input_expr_ctx1, row);
+//   StringVal dst = StringVal(agg_tuple->slot);
+//   dst.is_null = IsNull(agg_tuple);
+//   StringConcatUpdate(fn_ctx, input0, input1, &dst);  // inlined
+//   if (dst.is_null) {
+//     SetNull(agg_tuple);
+//   } else {
+//     SetNotNull(agg_tuple);
+//     agg_tuple->slot = StringValue(dst);
+//   }
+// }
+//
+// Unlike the handcrafted IR, NULL inputs are passed to the UDA like any other value.
+Function* PartitionedAggregationNode::CodegenCallUda(
+    AggFnEvaluator* evaluator, SlotDescriptor* slot_desc) {
+  DCHECK(slot_desc->is_materialized());
+  LlvmCodeGen* codegen;
+  if (!state_->GetCodegen(&codegen).ok()) return NULL;
+
+  // CHAR intermediates point into the tuple, see AggFnEvaluator::Init().
+  const ColumnType& dst_type = evaluator->intermediate_type();
+  if (dst_type.type == TYPE_CHAR || dst_type.type == TYPE_NULL) return NULL;
+
+  const vector<ExprContext*>& input_expr_ctxs = evaluator->input_expr_ctxs();
+  vector<Function*> input_expr_fns(input_expr_ctxs.size());
+  for (int i = 0; i < input_expr_ctxs.size(); ++i) {
+    Status status =
+        input_expr_ctxs[i]->root()->GetCodegendComputeFn(state_, &input_expr_fns[i]);
+    if (!status.ok()) {
+      VLOG_QUERY << "Could not codegen UpdateSlot(): " << status.GetDetail();
+      return NULL;
+    }
+    DCHECK(input_expr_fns[i] != NULL);
+  }
+
+  PointerType* fn_ctx_type =
+      codegen->GetPtrType(FunctionContextImpl::LLVM_FUNCTIONCONTEXT_NAME);
+  // Get the update or merge function of the UDA, whichever Add() would call.
+  const string& symbol =
+      evaluator->is_merge() ? evaluator->merge_symbol() : evaluator->update_symbol();
+  Function* uda_fn;
+  if (evaluator->is_builtin()) {
+    // The builtins are cross-compiled into the IR module.
+    uda_fn = codegen->module()->getFunction(symbol);
+    if (uda_fn == NULL) {
+      VLOG_QUERY << "Could not codegen UpdateSlot() because symbol '" << symbol
+                 << "' of aggregate function \"" << evaluator->fn_name()
+                 << "()\" is not in the IR module";
+      return NULL;
+    }
+  } else {
+    // Native UDA in a .so. Declare it and associate it with the function pointer
+    // loaded by AggFnEvaluator::Prepare(), like ScalarFnCall::GetUdf() does for UDFs.
+    DCHECK(evaluator->add_fn() != NULL);
+    vector<Type*> arg_types;
+    arg_types.push_back(fn_ctx_type);
+    for (int i = 0; i < input_expr_ctxs.size(); ++i) {
+      arg_types.push_back(CodegenAnyVal::GetUnloweredPtrType(
+          codegen, input_expr_ctxs[i]->root()->type()));
+    }
+    arg_types.push_back(CodegenAnyVal::GetUnloweredPtrType(codegen, dst_type));
+    FunctionType* uda_type = FunctionType::get(codegen->void_type(), arg_types, false);
+    uda_fn = Function::Create(
+        uda_type, GlobalValue::ExternalLinkage, symbol, codegen->module());
+    codegen->execution_engine()->addGlobalMapping(uda_fn, evaluator->add_fn());
+  }
+  FunctionType* uda_type = uda_fn->getFunctionType();
+  if (uda_type->getNumParams() != input_expr_ctxs.size() + 2) {
+    VLOG_QUERY << "Could not codegen UpdateSlot() because symbol '" << symbol
+               << "' does not have the expected number of arguments";
+    return NULL;
+  }
+  uda_fn->addFnAttr(Attribute::AlwaysInline);
+
+  StructType* tuple_struct = intermediate_tuple_desc_->GenerateLlvmStruct(codegen);
+  PointerType* tuple_ptr_type = PointerType::get(tuple_struct, 0);
+  PointerType* tuple_row_ptr_type = codegen->GetPtrType(TupleRow::LLVM_CLASS_NAME);
+
+  // Create UpdateSlot prototype
+  LlvmCodeGen::FnPrototype prototype(codegen, "UpdateSlot", codegen->void_type());
+  prototype.AddArgument(LlvmCodeGen::NamedVariable("fn_ctx", fn_ctx_type));
+  prototype.AddArgument(LlvmCodeGen::NamedVariable("agg_tuple", tuple_ptr_type));
+  prototype.AddArgument(LlvmCodeGen::NamedVariable("row", tuple_row_ptr_type));
+
+  LlvmCodeGen::LlvmBuilder builder(codegen->context());
+  Value* args[3];
+  Function* fn = prototype.GeneratePrototype(&builder, &args[0]);
+  Value* fn_ctx_arg = args[0];
+  Value* agg_tuple_arg = args[1];
+  Value* row_arg = args[2];
+
+  // Evaluate the input exprs into the AnyVals that are passed to the UDA. The params
+  // of builtins may be declared as a different AnyVal type (e.g. CountUpdate() takes
+  // an AnyVal), so the pointers are cast to the param types.
+  vector<Value*> uda_args;
+  uda_args.push_back(fn_ctx_arg);
+  Type* expr_ctx_type = codegen->GetPtrType(ExprContext::LLVM_CLASS_NAME);
+  for (int i = 0; i < input_expr_ctxs.size(); ++i) {
+    const ColumnType& input_type = input_expr_ctxs[i]->root()->type();
+    Value* input_ptr = CreateAnyValAlloca(codegen, builder, input_type, "input_ptr");
+    Value* lowered_input_ptr = builder.CreateBitCast(input_ptr,
+        CodegenAnyVal::GetLoweredPtrType(codegen, input_type), "lowered_input_ptr");
+    Value* expr_args[] = {
+        codegen->CastPtrToLlvmPtr(expr_ctx_type, input_expr_ctxs[i]), row_arg };
+    CodegenAnyVal::CreateCall(
+        codegen, &builder, input_expr_fns[i], expr_args, "input", lowered_input_ptr);
+    uda_args.push_back(builder.CreateBitCast(input_ptr, uda_type->getParamType(i + 1)));
+  }
+
+  // Create the intermediate argument 'dst' from the slot and its null bit.
+  Value* dst_slot_ptr =
+      builder.CreateStructGEP(agg_tuple_arg, slot_desc->field_idx(), "dst_slot_ptr");
+  CodegenAnyVal dst = CodegenAnyVal::GetNonNullVal(codegen, &builder, dst_type, "dst");
+  dst.SetFromRawValue(builder.CreateLoad(dst_slot_ptr, "dst_val"));
+  if (slot_desc->is_nullable()) {
+    Function* is_null_fn = slot_desc->CodegenIsNull(codegen, tuple_struct);
+    dst.SetIsNull(builder.CreateCall(is_null_fn, agg_tuple_arg, "dst_is_null"));
+  }
+  Value* dst_ptr = CreateAnyValAlloca(codegen, builder, dst_type, "dst_ptr");
+  Value* lowered_dst_ptr = builder.CreateBitCast(dst_ptr,
+      CodegenAnyVal::GetLoweredPtrType(codegen, dst_type), "lowered_dst_ptr");
+  builder.CreateStore(dst.value(), lowered_dst_ptr);
+  uda_args.push_back(builder.CreateBitCast(dst_ptr, uda_type->getParamType(
+      input_expr_ctxs.size() + 1)));
+
+  builder.CreateCall(uda_fn, uda_args);
+
+  // Write 'dst' back to the slot like AggFnEvaluator::SetDstSlot(). The slot is left
+  // unchanged if the result is NULL and the slot is not nullable.
+  CodegenAnyVal result(codegen, &builder, dst_type,
+      builder.CreateLoad(lowered_dst_ptr, "anyval_result"));
+  BasicBlock* result_not_null_block =
+      BasicBlock::Create(codegen->context(), "result_not_null", fn);
+  BasicBlock* ret_block = BasicBlock::Create(codegen->context(), "ret", fn);
+  BasicBlock* result_null_block = ret_block;
+  if (slot_desc->is_nullable()) {
+    result_null_block = BasicBlock::Create(codegen->context(), "result_null", fn,
+        result_not_null_block);
+  }
+  builder.CreateCondBr(result.GetIsNull(), result_null_block, result_not_null_block);
+
+  if (slot_desc->is_nullable()) {
+    builder.SetInsertPoint(result_null_block);
+    Function* set_null_fn = slot_desc->CodegenUpdateNull(codegen, tuple_struct, true);
+    builder.CreateCall(set_null_fn, agg_tuple_arg);
+    builder.CreateBr(ret_block);
+  }
+
+  builder.SetInsertPoint(result_not_null_block);
+  if (slot_desc->is_nullable()) {
+    Function* clear_null_fn = slot_desc->CodegenUpdateNull(codegen, tuple_struct, false);
+    builder.CreateCall(clear_null_fn, agg_tuple_arg);
+  }
+  builder.CreateStore(result.ToNativeValue(), dst_slot_ptr);
+  builder.CreateBr(ret_block);
+
+  builder.SetInsertPoint(ret_block);
+  builder.CreateRetVoid();
+
+  return codegen->FinalizeFunction(fn);
+}
+
+// Calls the interpreted Add() of 'evaluator'. Called from the codegen'd UpdateTuple()
+// for aggregate functions for which CodegenUpdateSlot() failed.
+static void AddInterpreted(AggFnEvaluator* evaluator, FunctionContext* agg_fn_ctx,
+    TupleRow* row, Tuple* tuple) {
+  evaluator->Add(agg_fn_ctx, row, tuple);
+}
+
 // IR codegen for the UpdateTuple loop.  This loop is query specific and based on the
 // aggregate functions.  The function signature must match the non- codegen'd UpdateTuple
-// exactly.
+// exactly. The count(*) update below is left out if 'hoist_count_star' is true.
 // For the query:
 // select count(*), count(int_col), sum(double_col) the IR looks like:
 //
@@ -1221,49 +1583,11 @@ llvm::Function* PartitionedAggregationNode::CodegenUpdateSlot(
 //                          %"class.impala::TupleRow"* %row)
 //   ret void
 // }
-Function* PartitionedAggregationNode::CodegenUpdateTuple() {
+Function* PartitionedAggregationNode::CodegenUpdateTuple(bool hoist_count_star) {
   LlvmCodeGen* codegen;
   if (!state_->GetCodegen(&codegen).ok()) return NULL;
   SCOPED_TIMER(codegen->codegen_timer());
 
-  int j = probe_expr_ctxs_.size();
-  for (int i = 0; i < aggregate_evaluators_.size(); ++i, ++j) {
-    // skip non-materialized slots; we don't have evaluators instantiated for those
-    while (!intermediate_tuple_desc_->slots()[j]->is_materialized()) {
-      DCHECK_LT(j, intermediate_tuple_desc_->slots().size() - 1);
-      ++j;
-    }
-    SlotDescriptor* slot_desc = intermediate_tuple_desc_->slots()[j];
-    AggFnEvaluator* evaluator = aggregate_evaluators_[i];
-
-    // Don't codegen things that aren't builtins (for now)
-    if (!evaluator->is_builtin()) return NULL;
-
-    bool supported = true;
-    AggFnEvaluator::AggregationOp op = evaluator->agg_op();
-    PrimitiveType type = slot_desc->type().type;
-    // Char and timestamp intermediates aren't supported
-    if (type == TYPE_TIMESTAMP || type == TYPE_CHAR) supported = false;
-    // Only AVG and NDV support string intermediates
-    if ((type == TYPE_STRING || type == TYPE_VARCHAR) &&
-        !(op == AggFnEvaluator::AVG || op == AggFnEvaluator::NDV)) {
-      supported = false;
-    }
-    // Only SUM, AVG, and NDV support decimal intermediates
-    if (type == TYPE_DECIMAL &&
-        !(op == AggFnEvaluator::SUM || op == AggFnEvaluator::AVG ||
-          op == AggFnEvaluator::NDV)) {
-      supported = false;
-    }
-    if (!supported) {
-      VLOG_QUERY << "Could not codegen UpdateTuple because intermediate type "
-                 << slot_desc->type()
-                 << " is not yet supported for aggregate function \""
-                 << evaluator->fn_name() << "()\"";
-      return NULL;
-    }
-  }
-
   if (intermediate_tuple_desc_->GenerateLlvmStruct(codegen) == NULL) {
     VLOG_QUERY << "Could not codegen UpdateTuple because we could"
                << "not generate a matching llvm struct for the intermediate tuple.";
@@ -1297,14 +1621,18 @@ Function* PartitionedAggregationNode::CodegenUpdateTuple() {
   Value* agg_fn_ctxs_arg = args[1];
   Value* tuple_arg = args[2];
   Value* row_arg = args[3];
+  // The uncast tuple is passed to AddInterpreted().
+  Value* untyped_tuple_arg = tuple_arg;
 
   // Cast the parameter types to the internal llvm runtime types.
   // TODO: get rid of this by using right type in function signature
   tuple_arg = builder.CreateBitCast(tuple_arg, tuple_ptr, "tuple");
 
   // Loop over each expr and generate the IR for that slot.  If the expr is not
-  // count(*), generate a helper IR function to update the slot and call that.
-  j = probe_expr_ctxs_.size();
+  // count(*), generate a helper IR function to update the slot and call that. If that
+  // fails, call the interpreted AddInterpreted() for the slot instead.
+  Function* add_interpreted_fn = NULL;
+  int j = probe_expr_ctxs_.size();
   for (int i = 0; i < aggregate_evaluators_.size(); ++i, ++j) {
     // skip non-materialized slots; we don't have evaluators instantiated for those
     while (!intermediate_tuple_desc_->slots()[j]->is_materialized()) {
@@ -1314,8 +1642,7 @@ Function* PartitionedAggregationNode::CodegenUpdateTuple() {
     SlotDescriptor* slot_desc = intermediate_tuple_desc_->slots()[j];
     AggFnEvaluator* evaluator = aggregate_evaluators_[i];
     if (evaluator->is_count_star()) {
-      // TODO: we should be able to hoist this up to the loop over the batch and just
-      // increment the slot by the number of rows in the batch.
+      if (hoist_count_star) continue;
       int field_idx = slot_desc->field_idx();
       Value* const_one = codegen->GetIntConstant(TYPE_BIGINT, 1);
       Value* slot_ptr = builder.CreateStructGEP(tuple_arg, field_idx, "src_slot");
@@ -1324,10 +1651,32 @@ Function* PartitionedAggregationNode::CodegenUpdateTuple() {
       builder.CreateStore(count_inc, slot_ptr);
     } else {
       Function* update_slot_fn = CodegenUpdateSlot(evaluator, slot_desc);
-      if (update_slot_fn == NULL) return NULL;
       Value* fn_ctx_ptr = builder.CreateConstGEP1_32(agg_fn_ctxs_arg, i);
       Value* fn_ctx = builder.CreateLoad(fn_ctx_ptr, "fn_ctx");
-      builder.CreateCall3(update_slot_fn, fn_ctx, tuple_arg, row_arg);
+      if (update_slot_fn != NULL) {
+        builder.CreateCall3(update_slot_fn, fn_ctx, tuple_arg, row_arg);
+        continue;
+      }
+      VLOG_QUERY << "Could not codegen the update of aggregate function \""
+                 << evaluator->fn_name() << "()\", calling it interpreted";
+      if (add_interpreted_fn == NULL) {
+        add_interpreted_fn = codegen->module()->getFunction("AddInterpreted");
+      }
+      if (add_interpreted_fn == NULL) {
+        // Declare AddInterpreted() and map it to the statically compiled function.
+        Type* add_interpreted_args[] = { codegen->ptr_type(), fn_ctx_type->getPointerTo(),
+            tuple_row_ptr_type, tuple_ptr_type };
+        FunctionType* add_interpreted_type = FunctionType::get(
+            codegen->void_type(), add_interpreted_args, false);
+        add_interpreted_fn = Function::Create(add_interpreted_type,
+            GlobalValue::ExternalLinkage, "AddInterpreted", codegen->module());
+        codegen->execution_engine()->addGlobalMapping(add_interpreted_fn,
+            reinterpret_cast<void*>(&AddInterpreted));
+      }
+      Value* add_interpreted_args[] = {
+          codegen->CastPtrToLlvmPtr(codegen->ptr_type(), evaluator),
+          fn_ctx, row_arg, untyped_tuple_arg };
+      builder.CreateCall(add_interpreted_fn, add_interpreted_args);
     }
   }
   builder.CreateRetVoid();
@@ -1341,7 +1690,8 @@ Function* PartitionedAggregationNode::CodegenProcessBatch() {
   if (!state_->GetCodegen(&codegen).ok()) return NULL;
   SCOPED_TIMER(codegen->codegen_timer());
 
-  Function* update_tuple_fn = CodegenUpdateTuple();
+  // Without grouping, COUNT(*) is incremented once per batch by ProcessBatchNoGrouping().
+  Function* update_tuple_fn = CodegenUpdateTuple(probe_expr_ctxs_.empty());
   if (update_tuple_fn == NULL) return NULL;
 
   // Get the cross compiled update row batch function
@@ -26,6 +26,7 @@
 #include "runtime/descriptors.h"  // for TupleId
 #include "runtime/mem-pool.h"
 #include "runtime/string-value.h"
+#include "util/blocking-queue.h"
 
 namespace llvm {
   class Function;
@@ -77,6 +78,29 @@ class SlotDescriptor;
 // hash tables will use smaller (less than io-sized) buffers. Once we spill, the streams
 // and hash table will use io-sized buffers only.
 //
+// Morsel-driven aggregation: an aggregation without grouping exprs directly above an
+// hdfs scan can consume the scan's row batches (morsels) with up to
+// --agg_morsel_dop worker threads instead of on the fragment's thread. Each worker
+// owns a copy of the aggregate evaluators and an intermediate tuple; the workers'
+// tuples are merged into singleton_output_tuple_ after the input is consumed. The
+// workers beyond the first take optional thread tokens, so they compete with the
+// scanner threads for the fragment's cores rather than oversubscribing them.
+// It is limited to:
+// - Aggregations without grouping exprs. With grouping, each worker would need its own
+//   hash partitions, which could spill independently, and merging them would duplicate
+//   the work of the merge aggregation above the exchange.
+// - Hdfs scan children. The batches are deleted by the workers, possibly after the
+//   child's next GetNext(), so the child must attach all memory its rows reference to
+//   the batch it returns. Hdfs scans do; other nodes, e.g. joins and exchanges, may
+//   reuse or free that memory on the next call.
+// It is off by default (--agg_morsel_dop=0): the workers run the interpreted
+// AggFnEvaluator::Add(), since the codegen'd functions are bound to
+// aggregate_evaluators_, so a few workers are often slower than the single codegen'd
+// thread, and every worker beyond the first takes a token a scanner thread could use.
+//
+// Without grouping, the codegen'd UpdateTuple() skips COUNT(*); the codegen'd
+// ProcessBatchNoGrouping() increments its slot by the number of rows once per batch.
+//
 // TODO: Buffer rows before probing into the hash table?
 // TODO: after spilling, we can still maintain a very small hash table just to remove
 // some number of rows (from likely going to disk).
@@ -202,6 +226,45 @@ class PartitionedAggregationNode : public ExecNode {
   // Jitted ProcessRowBatch function pointer.  Null if codegen is disabled.
   ProcessRowBatchFn process_row_batch_fn_;
 
+  // Offsets of the COUNT(*) slots in the intermediate tuple.
+  std::vector<int> count_star_slot_offsets_;
+
+  // True if there is no grouping and process_row_batch_fn_ is used. Its UpdateTuple()
+  // doesn't update the COUNT(*) slots; ProcessBatchNoGrouping() increments them by the
+  // number of rows of the batch instead.
+  bool hoist_count_star_;
+
+  // State of one worker thread of the morsel-driven aggregation.
+  struct MorselWorker {
+    // Copies of aggregate_evaluators_ and their contexts. The evaluators keep per-row
+    // state, so they cannot be shared between threads.
+    std::vector<AggFnEvaluator*> evaluators;
+    std::vector<impala_udf::FunctionContext*> agg_fn_ctxs;
+
+    // Pool for the allocations of agg_fn_ctxs.
+    boost::scoped_ptr<MemPool> agg_fn_pool;
+
+    // Intermediate tuple the worker aggregates into. Set to NULL once it has been
+    // merged into singleton_output_tuple_ and finalized.
+    Tuple* tuple;
+
+    MorselWorker() : tuple(NULL) {}
+  };
+
+  // The aggregate functions of the plan node. Only set if there is no grouping and
+  // --agg_morsel_dop > 1, to create the evaluators of morsel_workers_ in Prepare().
+  std::vector<TExpr> aggregate_fn_exprs_;
+
+  // Empty unless the morsel-driven aggregation is used. Owned by pool_.
+  std::vector<MorselWorker*> morsel_workers_;
+
+  // Row batches of the child waiting to be aggregated by a worker. Bounded, so the
+  // scan is throttled if the workers fall behind.
+  boost::scoped_ptr<BlockingQueue<RowBatch*> > morsel_queue_;
+
+  // Number of morsel workers that were started.
+  RuntimeProfile::Counter* morsel_workers_counter_;
+
   // Time spent processing the child rows
   RuntimeProfile::Counter* build_timer_;
 
@@ -333,6 +396,16 @@ class PartitionedAggregationNode : public ExecNode {
   Tuple* FinalizeTuple(const std::vector<impala_udf::FunctionContext*>& agg_fn_ctxs,
                        Tuple* tuple, MemPool* pool);
 
+  // Consumes all rows of child(0) with the morsel workers and merges their intermediate
+  // tuples into singleton_output_tuple_. Called by Open() instead of the loop over the
+  // child's batches.
+  Status AggregateMorsels(RuntimeState* state);
+
+  // Main loop of a morsel worker thread. Aggregates the row batches from morsel_queue_
+  // into worker->tuple and frees them, until the queue is shut down and empty. If
+  // 'release_thread_token' is true, releases an optional thread token when done.
+  void ProcessMorsels(MorselWorker* worker, bool release_thread_token);
+
   // Do the aggregation for all tuple rows in the batch when there is no grouping.
   // The HashTableCtx argument is unused, but included so the signature matches that of
   // ProcessBatch() for codegen. This function is replaced by codegen.
@@ -389,8 +462,19 @@ class PartitionedAggregationNode : public ExecNode {
   // Assumes is_merge = false;
   llvm::Function* CodegenUpdateSlot(AggFnEvaluator* evaluator, SlotDescriptor* slot_desc);
 
-  // Codegen UpdateTuple(). Returns NULL if codegen is unsuccessful.
-  llvm::Function* CodegenUpdateTuple();
+  // Codegen UpdateSlot() for aggregate functions that have no handcrafted IR, e.g.
+  // NDV over timestamps, GROUP_CONCAT or native UDAs. The generated function evaluates
+  // the input exprs and calls the UDA's update or merge function directly: the
+  // cross-compiled IR of builtins is inlined, native UDAs are called through the
+  // loaded function pointer. Returns NULL if codegen is unsuccessful.
+  llvm::Function* CodegenCallUda(AggFnEvaluator* evaluator, SlotDescriptor* slot_desc);
+
+  // Codegen UpdateTuple(). Aggregate functions whose UpdateSlot() cannot be codegen'd
+  // are updated by calling the interpreted AggFnEvaluator::Add() for just that slot.
+  // If 'hoist_count_star' is true, COUNT(*) slots are not updated; the caller must
+  // increment them once per batch.
+  // Returns NULL if codegen is unsuccessful.
+  llvm::Function* CodegenUpdateTuple(bool hoist_count_star);
 
   // Codegen the process row batch loop.  The loop has already been compiled to
   // IR and loaded into the codegen object.  UpdateAggTuple has also been
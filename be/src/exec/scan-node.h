@@ -92,6 +92,13 @@ class ScanNode : public ExecNode {
 
   virtual bool IsScanNode() const { return true; }
 
+  // Called by the fragment executor between Prepare() and Open(), while the fragment's
+  // code is being compiled. Scan nodes that can start reading without evaluating exprs
+  // or running code-generated functions issue their initial scan ranges here, so the
+  // first bytes are read while LLVM optimizes. Open() and GetNext() must not depend on
+  // this having been called.
+  virtual Status StartIo(RuntimeState* state) { return Status::OK; }
+
   RuntimeProfile::Counter* bytes_read_counter() const { return bytes_read_counter_; }
   RuntimeProfile::Counter* rows_read_counter() const { return rows_read_counter_; }
   RuntimeProfile::Counter* read_timer() const { return read_timer_; }
@@ -0,0 +1,200 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "exec/scanner-context.h"
+#include "runtime/descriptors.h"
+#include "runtime/mem-pool.h"
+#include "runtime/mem-tracker.h"
+#include "runtime/string-value.h"
+#include "runtime/tuple-row.h"
+#include "testutil/desc-tbl-builder.h"
+#include "util/cpu-info.h"
+
+using namespace std;
+
+namespace impala {
+
+// Tests row batch compaction and the decision to return io buffers early
+// (ScannerContext::CompactRows() and ScannerContext::MustAttachIoBuffer()).
+class ScannerContextTest : public testing::Test {
+ protected:
+  MemTracker tracker_;
+  ObjectPool pool_;
+  RowDescriptor* desc_;
+  const TupleDescriptor* tuple_desc_;
+
+  // Stands in for an io buffer and for memory outside of io buffers.
+  string io_buffer_;
+  string other_data_;
+
+  virtual void SetUp() {
+    DescriptorTblBuilder builder(&pool_);
+    builder.DeclareTuple() << TYPE_INT << TYPE_STRING << TYPE_STRING;
+    DescriptorTbl* desc_tbl = builder.Build();
+    vector<bool> nullable_tuples(1, true);
+    vector<TTupleId> tuple_id(1, (TTupleId) 0);
+    desc_ = pool_.Add(new RowDescriptor(*desc_tbl, tuple_id, nullable_tuples));
+    tuple_desc_ = desc_tbl->GetTupleDescriptor(0);
+    ASSERT_EQ(2, tuple_desc_->string_slots().size());
+    io_buffer_ = string(8 * 1024, 'x');
+    for (int i = 0; i < io_buffer_.size(); ++i) io_buffer_[i] = 'a' + i % 26;
+    other_data_ = "partition key";
+  }
+
+  vector<ScannerContext::CompactionRange> IoBufferRanges() {
+    return vector<ScannerContext::CompactionRange>(1, ScannerContext::CompactionRange(
+        io_buffer_.data(), io_buffer_.data() + io_buffer_.size()));
+  }
+
+  // Adds a row whose first string slot references 'len' bytes of io_buffer_ at 'offset'
+  // and whose second string slot references other_data_. If 'null_slot' is true, the
+  // first string slot is NULL instead.
+  void AddRow(RowBatch* batch, int offset, int len, bool null_slot = false) {
+    const vector<SlotDescriptor*>& string_slots = tuple_desc_->string_slots();
+    Tuple* tuple = Tuple::Create(tuple_desc_->byte_size(), batch->tuple_data_pool());
+    StringValue* sv = tuple->GetStringSlot(string_slots[0]->tuple_offset());
+    if (null_slot) {
+      tuple->SetNull(string_slots[0]->null_indicator_offset());
+    } else {
+      *sv = StringValue(const_cast<char*>(io_buffer_.data()) + offset, len);
+    }
+    sv = tuple->GetStringSlot(string_slots[1]->tuple_offset());
+    *sv = StringValue(const_cast<char*>(other_data_.data()), other_data_.size());
+    AddTuple(batch, tuple);
+  }
+
+  void AddTuple(RowBatch* batch, Tuple* tuple) {
+    int idx = batch->AddRow();
+    batch->GetRow(idx)->SetTuple(0, tuple);
+    batch->CommitLastRow();
+  }
+
+  StringValue* GetSlot(RowBatch* batch, int row_idx, int slot_idx) {
+    Tuple* tuple = batch->GetRow(row_idx)->GetTuple(0);
+    return tuple->GetStringSlot(tuple_desc_->string_slots()[slot_idx]->tuple_offset());
+  }
+
+  bool InIoBuffer(const StringValue* sv) {
+    const char* end = io_buffer_.data() + io_buffer_.size();
+    return sv->ptr >= io_buffer_.data() && sv->ptr < end;
+  }
+};
+
+// Only data in the io buffers is copied; other data and NULL slots are left alone.
+TEST_F(ScannerContextTest, CompactSparseBatch) {
+  RowBatch batch(*desc_, 100, &tracker_);
+  AddRow(&batch, 0, 10);
+  AddRow(&batch, 100, 0, true);
+  AddTuple(&batch, NULL);
+  AddRow(&batch, 1000, 20);
+  int64_t bytes_copied = ScannerContext::CompactRows(&batch, 0,
+      tuple_desc_->string_slots(), IoBufferRanges(), io_buffer_.size());
+  EXPECT_EQ(30, bytes_copied);
+
+  StringValue* sv = GetSlot(&batch, 0, 0);
+  EXPECT_FALSE(InIoBuffer(sv));
+  EXPECT_EQ(io_buffer_.substr(0, 10), string(sv->ptr, sv->len));
+  sv = GetSlot(&batch, 3, 0);
+  EXPECT_FALSE(InIoBuffer(sv));
+  EXPECT_EQ(io_buffer_.substr(1000, 20), string(sv->ptr, sv->len));
+  Tuple* null_slot_tuple = batch.GetRow(1)->GetTuple(0);
+  EXPECT_TRUE(null_slot_tuple->IsNull(
+      tuple_desc_->string_slots()[0]->null_indicator_offset()));
+  for (int i = 0; i < batch.num_rows(); ++i) {
+    if (batch.GetRow(i)->GetTuple(0) == NULL) continue;
+    EXPECT_EQ(other_data_.data(), GetSlot(&batch, i, 1)->ptr);
+  }
+
+  // The io buffer can now be overwritten (i.e. returned) without affecting the batch.
+  string expected = io_buffer_.substr(1000, 20);
+  io_buffer_.replace(1000, 20, 20, '?');
+  sv = GetSlot(&batch, 3, 0);
+  EXPECT_EQ(expected, string(sv->ptr, sv->len));
+}
+
+// Batches that are not sparse or that reference too much of the io buffers are not
+// compacted.
+TEST_F(ScannerContextTest, NoCompaction) {
+  const vector<SlotDescriptor*>& string_slots = tuple_desc_->string_slots();
+  {
+    // Empty batch.
+    RowBatch batch(*desc_, 100, &tracker_);
+    EXPECT_EQ(-1, ScannerContext::CompactRows(&batch, 0, string_slots,
+        IoBufferRanges(), io_buffer_.size()));
+  }
+  {
+    // Full batch.
+    RowBatch batch(*desc_, 100, &tracker_);
+    for (int i = 0; i < 100; ++i) AddRow(&batch, i, 1);
+    EXPECT_EQ(-1, ScannerContext::CompactRows(&batch, 0, string_slots,
+        IoBufferRanges(), io_buffer_.size()));
+    EXPECT_TRUE(InIoBuffer(GetSlot(&batch, 0, 0)));
+  }
+  {
+    // Sparse batch that references half of the io buffer.
+    RowBatch batch(*desc_, 100, &tracker_);
+    AddRow(&batch, 0, io_buffer_.size() / 2);
+    EXPECT_EQ(-1, ScannerContext::CompactRows(&batch, 0, string_slots,
+        IoBufferRanges(), io_buffer_.size()));
+    EXPECT_TRUE(InIoBuffer(GetSlot(&batch, 0, 0)));
+  }
+  {
+    // Nothing to release.
+    RowBatch batch(*desc_, 100, &tracker_);
+    AddRow(&batch, 0, 1);
+    EXPECT_EQ(-1, ScannerContext::CompactRows(&batch, 0, string_slots,
+        IoBufferRanges(), 0));
+    EXPECT_TRUE(InIoBuffer(GetSlot(&batch, 0, 0)));
+  }
+}
+
+// Data outside of the given ranges, e.g. in a buffer that is not released, is not
+// copied.
+TEST_F(ScannerContextTest, CompactOnlyReleasedRanges) {
+  RowBatch batch(*desc_, 100, &tracker_);
+  AddRow(&batch, 0, 10);
+  AddRow(&batch, 4096, 10);
+  vector<ScannerContext::CompactionRange> ranges(1, ScannerContext::CompactionRange(
+      io_buffer_.data(), io_buffer_.data() + 4096));
+  EXPECT_EQ(10, ScannerContext::CompactRows(&batch, 0, tuple_desc_->string_slots(),
+      ranges, 4096));
+  EXPECT_FALSE(InIoBuffer(GetSlot(&batch, 0, 0)));
+  EXPECT_TRUE(InIoBuffer(GetSlot(&batch, 1, 0)));
+}
+
+TEST_F(ScannerContextTest, AttachIoBuffers) {
+  // Buffers of streams without tuple data are always returned.
+  EXPECT_FALSE(ScannerContext::MustAttachIoBuffer(false, false, false));
+  EXPECT_FALSE(ScannerContext::MustAttachIoBuffer(false, true, false));
+  // Buffers are attached to uncompacted batches, since their rows may reference them.
+  EXPECT_TRUE(ScannerContext::MustAttachIoBuffer(true, false, false));
+  EXPECT_TRUE(ScannerContext::MustAttachIoBuffer(true, false, true));
+  // Compacting a batch releases its buffers early, unless an earlier, uncompacted batch
+  // may still reference them.
+  EXPECT_FALSE(ScannerContext::MustAttachIoBuffer(true, true, false));
+  EXPECT_TRUE(ScannerContext::MustAttachIoBuffer(true, true, true));
+}
+
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  impala::CpuInfo::Init();
+  return RUN_ALL_TESTS();
+}
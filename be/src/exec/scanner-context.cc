@@ -19,6 +19,8 @@
 #include "runtime/mem-pool.h"
 #include "runtime/runtime-state.h"
 #include "runtime/string-buffer.h"
+#include "runtime/string-value.h"
+#include "runtime/tuple-row.h"
 #include "util/debug-util.h"
 
 using namespace boost;
@@ -33,6 +35,15 @@ static const int64_t DEFAULT_READ_PAST_SIZE = 1024; // in bytes
 // output_buffer_bytes_left_ will be set to something else.
 static const int64_t OUTPUT_BUFFER_BYTES_LEFT_INIT = 0;
 
+// Row batch compaction is only attempted for batches that are filled to at most this
+// fraction of their capacity. Fuller batches are not from selective scans and reference
+// most of the io buffer data anyway.
+static const double MAX_COMPACTION_BATCH_FILL_RATIO = 0.25;
+
+// A batch is only compacted if the io buffer bytes released by doing so are at least this
+// many times the var-len bytes that must be copied.
+static const int MIN_COMPACTION_RELEASE_RATIO = 16;
+
 ScannerContext::ScannerContext(RuntimeState* state, HdfsScanNode* scan_node,
     HdfsPartitionDescriptor* partition_desc, DiskIoMgr::ScanRange* scan_range)
   : state_(state),
@@ -43,16 +54,88 @@ ScannerContext::ScannerContext(RuntimeState* state, HdfsScanNode* scan_node,
 }
 
 void ScannerContext::ReleaseCompletedResources(RowBatch* batch, bool done) {
+  bool compacted = batch != NULL && CompactBatch(batch, done);
   for (int i = 0; i < streams_.size(); ++i) {
-    streams_[i]->ReleaseCompletedResources(batch, done);
+    streams_[i]->ReleaseCompletedResources(batch, done, compacted);
   }
   if (done) streams_.clear();
 }
 
+// Checks whether 'ptr' falls into any of 'ranges'. There are only a handful of io
+// buffers per scanner so a linear search is sufficient.
+static inline bool InCompactionRanges(const char* ptr,
+    const vector<ScannerContext::CompactionRange>& ranges) {
+  for (int i = 0; i < ranges.size(); ++i) {
+    if (ptr >= ranges[i].first && ptr < ranges[i].second) return true;
+  }
+  return false;
+}
+
+bool ScannerContext::CompactBatch(RowBatch* batch, bool done) {
+  const vector<SlotDescriptor*>& string_slots = scan_node_->tuple_desc()->string_slots();
+  if (string_slots.empty() || batch->num_rows() == 0) return false;
+
+  compaction_ranges_.clear();
+  int64_t releasable_bytes = 0;
+  for (int i = 0; i < streams_.size(); ++i) {
+    releasable_bytes += streams_[i]->GetCompactionRanges(done, &compaction_ranges_);
+  }
+  if (releasable_bytes == 0) return false;
+
+  int64_t bytes_copied = CompactRows(batch, scan_node_->tuple_idx(), string_slots,
+      compaction_ranges_, releasable_bytes);
+  if (bytes_copied < 0) return false;
+  COUNTER_ADD(scan_node_->bytes_compacted_counter_, bytes_copied);
+  return true;
+}
+
+int64_t ScannerContext::CompactRows(RowBatch* batch, int tuple_idx,
+    const vector<SlotDescriptor*>& string_slots, const vector<CompactionRange>& ranges,
+    int64_t releasable_bytes) {
+  if (string_slots.empty() || batch->num_rows() == 0 || releasable_bytes == 0) return -1;
+  if (batch->num_rows() > batch->capacity() * MAX_COMPACTION_BATCH_FILL_RATIO) {
+    return -1;
+  }
+
+  // First pass: compute the var-len bytes that reference the io buffers. Only those
+  // need to be copied; other string data (e.g. partition key values in the template
+  // tuple or stitched data in the boundary pools) stays valid after the buffers are
+  // returned.
+  int64_t bytes_to_copy = 0;
+  for (int i = 0; i < batch->num_rows(); ++i) {
+    Tuple* tuple = batch->GetRow(i)->GetTuple(tuple_idx);
+    if (tuple == NULL) continue;
+    for (int j = 0; j < string_slots.size(); ++j) {
+      if (tuple->IsNull(string_slots[j]->null_indicator_offset())) continue;
+      StringValue* sv = tuple->GetStringSlot(string_slots[j]->tuple_offset());
+      if (InCompactionRanges(sv->ptr, ranges)) bytes_to_copy += sv->len;
+    }
+  }
+  if (bytes_to_copy * MIN_COMPACTION_RELEASE_RATIO > releasable_bytes) return -1;
+
+  // Second pass: copy the referenced data into a single allocation from the batch's
+  // pool.
+  char* dst = reinterpret_cast<char*>(batch->tuple_data_pool()->Allocate(bytes_to_copy));
+  for (int i = 0; i < batch->num_rows(); ++i) {
+    Tuple* tuple = batch->GetRow(i)->GetTuple(tuple_idx);
+    if (tuple == NULL) continue;
+    for (int j = 0; j < string_slots.size(); ++j) {
+      if (tuple->IsNull(string_slots[j]->null_indicator_offset())) continue;
+      StringValue* sv = tuple->GetStringSlot(string_slots[j]->tuple_offset());
+      if (!InCompactionRanges(sv->ptr, ranges)) continue;
+      memcpy(dst, sv->ptr, sv->len);
+      sv->ptr = dst;
+      dst += sv->len;
+    }
+  }
+  return bytes_to_copy;
+}
+
 ScannerContext::Stream::Stream(ScannerContext* parent)
   : parent_(parent),
     boundary_pool_(new MemPool(parent->scan_node_->mem_tracker())),
-    boundary_buffer_(new StringBuffer(boundary_pool_.get())) {
+    boundary_buffer_(new StringBuffer(boundary_pool_.get())),
+    pinned_io_buffer_(NULL) {
 }
 
 ScannerContext::Stream* ScannerContext::AddStream(DiskIoMgr::ScanRange* range) {
@@ -73,7 +156,29 @@ ScannerContext::Stream* ScannerContext::AddStream(DiskIoMgr::ScanRange* range) {
   return stream;
 }
 
-void ScannerContext::Stream::ReleaseCompletedResources(RowBatch* batch, bool done) {
+int64_t ScannerContext::Stream::GetCompactionRanges(bool done,
+    vector<CompactionRange>* ranges) {
+  if (!contains_tuple_data_) return 0;
+  int64_t releasable_bytes = 0;
+  for (list<DiskIoMgr::BufferDescriptor*>::iterator it = completed_io_buffers_.begin();
+       it != completed_io_buffers_.end(); ++it) {
+    ranges->push_back(CompactionRange((*it)->buffer(), (*it)->buffer() + (*it)->len()));
+    if (*it != pinned_io_buffer_) releasable_bytes += (*it)->buffer_len();
+  }
+  // Rows may also reference the current io buffer. Relocating that data as well keeps
+  // the buffer from being pinned by this batch.
+  if (io_buffer_ != NULL) {
+    ranges->push_back(
+        CompactionRange(io_buffer_->buffer(), io_buffer_->buffer() + io_buffer_->len()));
+    if (done && io_buffer_ != pinned_io_buffer_) {
+      releasable_bytes += io_buffer_->buffer_len();
+    }
+  }
+  return releasable_bytes;
+}
+
+void ScannerContext::Stream::ReleaseCompletedResources(RowBatch* batch, bool done,
+    bool compacted) {
   DCHECK((batch != NULL) || (batch == NULL && !contains_tuple_data_));
   if (done) {
     // Mark any pending resources as completed
@@ -91,19 +196,24 @@ void ScannerContext::Stream::ReleaseCompletedResources(RowBatch* batch, bool don
 
   for (list<DiskIoMgr::BufferDescriptor*>::iterator it = completed_io_buffers_.begin();
        it != completed_io_buffers_.end(); ++it) {
-    if (contains_tuple_data_) {
+    if (MustAttachIoBuffer(contains_tuple_data_, compacted, *it == pinned_io_buffer_)) {
       batch->AddIoBuffer(*it);
-      // TODO: We can do row batch compaction here.  This is the only place io buffers are
-      // queued.  A good heuristic is to check the number of io buffers queued and if
-      // there are too many, we should compact.
     } else {
+      if (contains_tuple_data_) {
+        COUNTER_ADD(parent_->scan_node_->num_io_buffers_released_early_counter_, 1);
+      }
       (*it)->Return();
       --parent_->scan_node_->num_owned_io_buffers_;
     }
+    if (*it == pinned_io_buffer_) pinned_io_buffer_ = NULL;
   }
   parent_->num_completed_io_buffers_ -= completed_io_buffers_.size();
   completed_io_buffers_.clear();
 
+  // If the batch was not compacted, its rows may reference the current io buffer, which
+  // then cannot be returned early once it is completed.
+  if (contains_tuple_data_ && !compacted) pinned_io_buffer_ = io_buffer_;
+
   if (contains_tuple_data_) {
     // If we're not done, keep using the last chunk allocated in boundary_pool_ so we
     // don't have to reallocate. If we are done, transfer it to the row batch.
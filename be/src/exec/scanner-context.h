@@ -32,6 +32,7 @@ class HdfsScanNode;
 class MemPool;
 class RowBatch;
 class RuntimeState;
+class SlotDescriptor;
 class StringBuffer;
 class Tuple;
 class TupleRow;
@@ -54,6 +55,28 @@ class TupleRow;
 //      or other end of stream conditions.
 class ScannerContext {
  public:
+  // Half-open [start, end) byte range of an io buffer that is considered during row
+  // batch compaction. See CompactBatch().
+  typedef std::pair<const char*, const char*> CompactionRange;
+
+  // Copies the var-len data in 'ranges' that the non-NULL 'string_slots' of tuple
+  // 'tuple_idx' in the rows of 'batch' reference into the batch's tuple data pool and
+  // points the slots to the copy. This is only done if it pays off: the batch must be
+  // sparsely filled and 'releasable_bytes' must be large relative to the bytes to copy.
+  // Returns the number of bytes copied, or -1 if 'batch' was left unchanged.
+  // Used by CompactBatch(); public for testing.
+  static int64_t CompactRows(RowBatch* batch, int tuple_idx,
+      const std::vector<SlotDescriptor*>& string_slots,
+      const std::vector<CompactionRange>& ranges, int64_t releasable_bytes);
+
+  // Returns true if a completed io buffer of a stream must be attached to the row batch
+  // passed to ReleaseCompletedResources() instead of being returned to the io mgr.
+  // 'pinned' is true if the buffer is the stream's pinned_io_buffer_, i.e. an earlier
+  // batch that was not compacted may still reference it.
+  static bool MustAttachIoBuffer(bool contains_tuple_data, bool compacted, bool pinned) {
+    return contains_tuple_data && (!compacted || pinned);
+  }
+
   // Create a scanner context with the parent scan_node (where materialized row batches
   // get pushed to) and the scan range to process.
   // This context starts with 1 stream.
@@ -213,6 +236,12 @@ class ScannerContext {
     // buffers are either returned to the io mgr or attached to the current row batch.
     std::list<DiskIoMgr::BufferDescriptor*> completed_io_buffers_;
 
+    // The io buffer that may still be referenced by a row batch that was already passed
+    // to the scan node without being compacted. This is always either io_buffer_ or in
+    // completed_io_buffers_, and must be attached to a row batch (rather than returned
+    // early) when it is released. NULL if there is no such buffer.
+    DiskIoMgr::BufferDescriptor* pinned_io_buffer_;
+
     Stream(ScannerContext* parent);
 
     // GetBytes helper to handle the slow path.
@@ -236,7 +265,15 @@ class ScannerContext {
     // If 'batch' is not NULL, attaches all completed io buffers and the boundary mem
     // pool to batch.  If 'done' is set, releases the completed resources.
     // If 'batch' is NULL then contains_tuple_data_ should be false.
-    void ReleaseCompletedResources(RowBatch* batch, bool done);
+    // If 'compacted' is true, the rows in 'batch' no longer reference any io buffer of
+    // this stream and completed buffers other than pinned_io_buffer_ are returned to
+    // the io mgr immediately instead of being attached to 'batch'.
+    void ReleaseCompletedResources(RowBatch* batch, bool done, bool compacted);
+
+    // Adds the completed io buffers (and the current io buffer) to 'ranges' and returns
+    // the number of bytes that can be returned to the io mgr by compacting the rows
+    // that reference them. If 'done' is true, the current io buffer is also released.
+    int64_t GetCompactionRanges(bool done, std::vector<CompactionRange>* ranges);
 
     // Error-reporting functions.
     Status ReportIncompleteRead(int64_t length, int64_t bytes_read);
@@ -288,8 +325,20 @@ class ScannerContext {
   // Vector of streams.  Non-columnar formats will always have one stream per context.
   std::vector<Stream*> streams_;
 
+  // Scratch space for CompactBatch(). Kept here to avoid reallocating it per batch.
+  std::vector<CompactionRange> compaction_ranges_;
+
   // Always equal to the sum of completed_io_buffers_.size() across all streams.
   int num_completed_io_buffers_;
+
+  // Row batch compaction for selective scans. If the rows in 'batch' only reference a
+  // small amount of var-len data in the streams' io buffers relative to the size of the
+  // buffers that would be released, the referenced data is copied into the batch's
+  // tuple data pool and the string slots are updated to point to the copy. The io
+  // buffers can then be returned to the io mgr right away rather than being pinned by
+  // 'batch' until it is consumed.
+  // Returns true if the batch was compacted.
+  bool CompactBatch(RowBatch* batch, bool done);
 };
 
 }
@@ -119,6 +119,10 @@ class AggFnEvaluator {
   const std::string& update_symbol() const { return fn_.aggregate_fn.update_fn_symbol; }
   const std::string& merge_symbol() const { return fn_.aggregate_fn.merge_fn_symbol; }
 
+  // Returns the loaded Update() or Merge() function of the UDA, whichever Add() calls.
+  // Used by codegen'd callers to call the function directly.
+  void* add_fn() const { return is_merge_ ? merge_fn_ : update_fn_; }
+
   static std::string DebugString(const std::vector<AggFnEvaluator*>& exprs);
   std::string DebugString() const;
 
@@ -14,15 +14,26 @@
 
 #include "exprs/case-expr.h"
 
+#include <algorithm>
+#include <functional>
+#include <math.h>
+#include <set>
+#include <boost/scoped_ptr.hpp>
+#include <boost/unordered_map.hpp>
+
 #include "codegen/codegen-anyval.h"
 #include "codegen/llvm-codegen.h"
 #include "exprs/anyval-util.h"
 #include "exprs/expr-context.h"
 #include "exprs/conditional-functions.h"
+#include "exprs/literal.h"
+#include "exprs/slot-ref.h"
 #include "runtime/runtime-state.h"
+#include "runtime/string-value.inline.h"
 
 #include "gen-cpp/Exprs_types.h"
 
+using namespace boost;
 using namespace llvm;
 using namespace std;
 
@@ -36,6 +47,123 @@ struct CaseExprState {
   AnyVal* when_val;
 };
 
+// Lookup structure for a CASE with constant WHEN values, built once per fragment in
+// Open() and shared by all clones of the expr context as FRAGMENT_LOCAL state. Maps the
+// case value of a row directly to the index of the THEN child to evaluate, instead of
+// comparing it against each WHEN in turn. The first WHEN wins if several have the same
+// value, and NULL WHEN values are dropped since they never match.
+struct CaseLookup {
+  enum Type {
+    // Integer case values in [min_val, min_val + dense.size()). dense[v - min_val] is
+    // the THEN child index for case value v, or -1.
+    DENSE,
+    // Integer case values that are too sparse for a dense table.
+    INT_HASH,
+    STRING_HASH,
+    // Range chains (see CaseExpr::IsRangeChain()). The i-th WHEN compares the value
+    // against int_bounds[i] or double_bounds[i], which are sorted in the direction of
+    // the comparison, so the first matching WHEN is found with a binary search.
+    INT_RANGE,
+    DOUBLE_RANGE,
+  };
+
+  Type type;
+
+  int64_t min_val;
+  vector<int> dense;
+
+  unordered_map<int64_t, int> int_map;
+
+  unordered_map<StringValue, int> string_map;
+  // Backing storage for the keys of 'string_map'. Reserved up front so the keys never
+  // move.
+  vector<string> strings;
+
+  bool ascending;
+  bool inclusive;
+  vector<int64_t> int_bounds;
+  vector<double> double_bounds;
+};
+
+// A dense table is used if the integer WHEN values span fewer than this many slots per
+// distinct value, and fewer than MAX_DENSE_LOOKUP_SIZE slots in total.
+static const uint64_t DENSE_LOOKUP_FILL_FACTOR = 4;
+static const uint64_t MAX_DENSE_LOOKUP_SIZE = 64 * 1024;
+
+static bool IsIntegerType(PrimitiveType type) {
+  return type == TYPE_TINYINT || type == TYPE_SMALLINT || type == TYPE_INT ||
+      type == TYPE_BIGINT;
+}
+
+// Evaluates the integer-typed 'expr' into 'val'. Returns false if the result is NULL.
+static bool GetIntValue(Expr* expr, ExprContext* ctx, TupleRow* row, int64_t* val) {
+  switch (expr->type().type) {
+    case TYPE_TINYINT: {
+      TinyIntVal v = expr->GetTinyIntVal(ctx, row);
+      *val = v.val;
+      return !v.is_null;
+    }
+    case TYPE_SMALLINT: {
+      SmallIntVal v = expr->GetSmallIntVal(ctx, row);
+      *val = v.val;
+      return !v.is_null;
+    }
+    case TYPE_INT: {
+      IntVal v = expr->GetIntVal(ctx, row);
+      *val = v.val;
+      return !v.is_null;
+    }
+    case TYPE_BIGINT: {
+      BigIntVal v = expr->GetBigIntVal(ctx, row);
+      *val = v.val;
+      return !v.is_null;
+    }
+    default:
+      DCHECK(false) << expr->type();
+      return false;
+  }
+}
+
+// Evaluates the FLOAT or DOUBLE 'expr' into 'val'. Returns false if the result is NULL.
+static bool GetDoubleValue(Expr* expr, ExprContext* ctx, TupleRow* row, double* val) {
+  if (expr->type().type == TYPE_FLOAT) {
+    FloatVal v = expr->GetFloatVal(ctx, row);
+    *val = v.val;
+    return !v.is_null;
+  }
+  DCHECK_EQ(expr->type().type, TYPE_DOUBLE);
+  DoubleVal v = expr->GetDoubleVal(ctx, row);
+  *val = v.val;
+  return !v.is_null;
+}
+
+// Returns the index of the first bound in 'bounds' for which the range chain's
+// comparison of 'val' against it is true, or bounds.size() if there is none.
+template <typename T>
+static int FindFirstMatchingBound(const vector<T>& bounds, T val, bool ascending,
+    bool inclusive) {
+  typename vector<T>::const_iterator it;
+  if (ascending) {
+    // First bound with val <= bound, resp. val < bound.
+    it = inclusive ? lower_bound(bounds.begin(), bounds.end(), val) :
+        upper_bound(bounds.begin(), bounds.end(), val);
+  } else {
+    // First bound with val >= bound, resp. val > bound.
+    it = inclusive ? lower_bound(bounds.begin(), bounds.end(), val, greater<T>()) :
+        upper_bound(bounds.begin(), bounds.end(), val, greater<T>());
+  }
+  return it - bounds.begin();
+}
+
+// Returns true if 'v' is sorted in the order of a range chain's bounds.
+template <typename T>
+static bool IsSorted(const vector<T>& v, bool ascending) {
+  for (int i = 1; i < v.size(); ++i) {
+    if (ascending ? v[i] < v[i - 1] : v[i] > v[i - 1]) return false;
+  }
+  return true;
+}
+
 CaseExpr::CaseExpr(const TExprNode& node)
   : Expr(node),
     has_case_expr_(node.case_expr.has_case_expr),
@@ -63,6 +191,9 @@ Status CaseExpr::Open(RuntimeState* state, ExprContext* ctx,
     case_state->case_val = CreateAnyVal(state->obj_pool(), TYPE_BOOLEAN);
     case_state->when_val = CreateAnyVal(state->obj_pool(), children_[0]->type());
   }
+  if (scope == FunctionContext::FRAGMENT_LOCAL) {
+    fn_ctx->SetFunctionState(FunctionContext::FRAGMENT_LOCAL, CreateLookup(state, ctx));
+  }
   return Status::OK;
 }
 
@@ -76,6 +207,182 @@ void CaseExpr::Close(RuntimeState* state, ExprContext* ctx,
   Expr::Close(state, ctx, scope);
 }
 
+int CaseExpr::num_whens() const {
+  return (GetNumChildren() - (has_case_expr_ ? 1 : 0) - (has_else_expr_ ? 1 : 0)) / 2;
+}
+
+bool CaseExpr::IsRangeChain(bool* ascending, bool* inclusive) const {
+  if (has_case_expr_) return false;
+  SlotId slot_id = -1;
+  for (int i = 0; i < num_whens(); ++i) {
+    const Expr* when = children_[when_idx(i)];
+    if (when->fn().binary_type != TFunctionBinaryType::BUILTIN) return false;
+    if (when->GetNumChildren() != 2) return false;
+    const Expr* val = when->GetChild(0);
+    const Expr* bound = when->GetChild(1);
+    if (!val->is_slotref() || !bound->IsConstant()) return false;
+    PrimitiveType type = val->type().type;
+    if (bound->type().type != type) return false;
+    if (!IsIntegerType(type) && type != TYPE_FLOAT && type != TYPE_DOUBLE) return false;
+
+    const string& fn_name = when->fn().name.function_name;
+    bool when_ascending;
+    bool when_inclusive;
+    if (fn_name == "lt" || fn_name == "le") {
+      when_ascending = true;
+      when_inclusive = fn_name == "le";
+    } else if (fn_name == "gt" || fn_name == "ge") {
+      when_ascending = false;
+      when_inclusive = fn_name == "ge";
+    } else {
+      return false;
+    }
+    SlotId when_slot_id = static_cast<const SlotRef*>(val)->slot_id();
+    if (i == 0) {
+      *ascending = when_ascending;
+      *inclusive = when_inclusive;
+      slot_id = when_slot_id;
+    } else if (when_ascending != *ascending || when_inclusive != *inclusive ||
+        when_slot_id != slot_id) {
+      return false;
+    }
+  }
+  return num_whens() > 0;
+}
+
+bool CaseExpr::HasStringLookup() const {
+  if (!has_case_expr_ || children_[0]->type().type != TYPE_STRING) return false;
+  if (num_whens() < MIN_WHENS_FOR_LOOKUP) return false;
+  for (int i = 0; i < num_whens(); ++i) {
+    if (!children_[when_idx(i)]->IsConstant()) return false;
+  }
+  return true;
+}
+
+CaseLookup* CaseExpr::CreateLookup(RuntimeState* state, ExprContext* ctx) {
+  if (num_whens() < MIN_WHENS_FOR_LOOKUP) return NULL;
+  scoped_ptr<CaseLookup> lookup(new CaseLookup());
+
+  bool ascending;
+  bool inclusive;
+  if (IsRangeChain(&ascending, &inclusive)) {
+    lookup->ascending = ascending;
+    lookup->inclusive = inclusive;
+    Expr* val = children_[0]->GetChild(0);
+    for (int i = 0; i < num_whens(); ++i) {
+      Expr* bound = children_[when_idx(i)]->GetChild(1);
+      if (IsIntegerType(val->type().type)) {
+        lookup->type = CaseLookup::INT_RANGE;
+        int64_t bound_val;
+        if (!GetIntValue(bound, ctx, NULL, &bound_val)) return NULL;
+        lookup->int_bounds.push_back(bound_val);
+      } else {
+        lookup->type = CaseLookup::DOUBLE_RANGE;
+        double bound_val;
+        if (!GetDoubleValue(bound, ctx, NULL, &bound_val)) return NULL;
+        if (isnan(bound_val)) return NULL;
+        lookup->double_bounds.push_back(bound_val);
+      }
+    }
+    if (!IsSorted(lookup->int_bounds, ascending)) return NULL;
+    if (!IsSorted(lookup->double_bounds, ascending)) return NULL;
+    return state->obj_pool()->Add(lookup.release());
+  }
+
+  if (!has_case_expr_) return NULL;
+  PrimitiveType type = children_[0]->type().type;
+  if (!IsIntegerType(type) && type != TYPE_STRING) return NULL;
+  for (int i = 0; i < num_whens(); ++i) {
+    if (!children_[when_idx(i)]->IsConstant()) return NULL;
+  }
+
+  if (type == TYPE_STRING) {
+    lookup->type = CaseLookup::STRING_HASH;
+    lookup->strings.reserve(num_whens());
+    for (int i = 0; i < num_whens(); ++i) {
+      StringVal when_val = children_[when_idx(i)]->GetStringVal(ctx, NULL);
+      if (when_val.is_null) continue;
+      lookup->strings.push_back(
+          string(reinterpret_cast<char*>(when_val.ptr), when_val.len));
+      // insert() keeps the THEN of the first WHEN with this value.
+      lookup->string_map.insert(make_pair(StringValue(lookup->strings.back()),
+          then_idx(i)));
+    }
+    return state->obj_pool()->Add(lookup.release());
+  }
+
+  vector<pair<int64_t, int> > when_vals;
+  int64_t min_val = 0;
+  int64_t max_val = 0;
+  for (int i = 0; i < num_whens(); ++i) {
+    int64_t when_val;
+    if (!GetIntValue(children_[when_idx(i)], ctx, NULL, &when_val)) continue;
+    if (when_vals.empty() || when_val < min_val) min_val = when_val;
+    if (when_vals.empty() || when_val > max_val) max_val = when_val;
+    when_vals.push_back(make_pair(when_val, then_idx(i)));
+  }
+  // Computed unsigned so that it doesn't overflow for widely spread BIGINT values.
+  uint64_t span = static_cast<uint64_t>(max_val) - static_cast<uint64_t>(min_val);
+  if (span < MAX_DENSE_LOOKUP_SIZE &&
+      span < DENSE_LOOKUP_FILL_FACTOR * when_vals.size()) {
+    lookup->type = CaseLookup::DENSE;
+    lookup->min_val = min_val;
+    lookup->dense.resize(span + 1, -1);
+    for (int i = 0; i < when_vals.size(); ++i) {
+      int& entry = lookup->dense[when_vals[i].first - min_val];
+      if (entry == -1) entry = when_vals[i].second;
+    }
+  } else {
+    lookup->type = CaseLookup::INT_HASH;
+    for (int i = 0; i < when_vals.size(); ++i) lookup->int_map.insert(when_vals[i]);
+  }
+  return state->obj_pool()->Add(lookup.release());
+}
+
+int CaseExpr::FindThenChild(const CaseLookup& lookup, ExprContext* ctx, TupleRow* row) {
+  switch (lookup.type) {
+    case CaseLookup::DENSE: {
+      int64_t val;
+      if (!GetIntValue(children_[0], ctx, row, &val)) return -1;
+      uint64_t offset =
+          static_cast<uint64_t>(val) - static_cast<uint64_t>(lookup.min_val);
+      return offset < lookup.dense.size() ? lookup.dense[offset] : -1;
+    }
+    case CaseLookup::INT_HASH: {
+      int64_t val;
+      if (!GetIntValue(children_[0], ctx, row, &val)) return -1;
+      unordered_map<int64_t, int>::const_iterator it = lookup.int_map.find(val);
+      return it == lookup.int_map.end() ? -1 : it->second;
+    }
+    case CaseLookup::STRING_HASH: {
+      StringVal val = children_[0]->GetStringVal(ctx, row);
+      if (val.is_null) return -1;
+      unordered_map<StringValue, int>::const_iterator it =
+          lookup.string_map.find(StringValue::FromStringVal(val));
+      return it == lookup.string_map.end() ? -1 : it->second;
+    }
+    case CaseLookup::INT_RANGE: {
+      int64_t val;
+      if (!GetIntValue(children_[0]->GetChild(0), ctx, row, &val)) return -1;
+      int i = FindFirstMatchingBound(
+          lookup.int_bounds, val, lookup.ascending, lookup.inclusive);
+      return i < num_whens() ? then_idx(i) : -1;
+    }
+    case CaseLookup::DOUBLE_RANGE: {
+      double val;
+      if (!GetDoubleValue(children_[0]->GetChild(0), ctx, row, &val)) return -1;
+      // NaN compares false against every bound.
+      if (isnan(val)) return -1;
+      int i = FindFirstMatchingBound(
+          lookup.double_bounds, val, lookup.ascending, lookup.inclusive);
+      return i < num_whens() ? then_idx(i) : -1;
+    }
+    default:
+      DCHECK(false);
+      return -1;
+  }
+}
+
 string CaseExpr::DebugString() const {
   stringstream out;
   out << "CaseExpr(has_case_expr=" << has_case_expr_
@@ -175,11 +482,27 @@ string CaseExpr::DebugString() const {
 //                                   %"class.impala::TupleRow"* %row)
 //   ret i16 %else_val
 // }
+//
+// CASE exprs with many constant WHEN values are codegened without the chain of
+// comparisons above. An integer CASE with literal WHEN values becomes a switch on the
+// case value:
+//   switch i32 %val, label %return_else_expr [
+//     i32 1, label %return_then_expr
+//     i32 2, label %return_then_expr1
+//     ...
+//   ]
+// and a range chain (see IsRangeChain()) becomes a binary search over its bounds, with
+// one comparison per level:
+// range_search:
+//   %cmp = icmp slt i32 %val, 500
+//   br i1 %cmp, label %range_search1, label %range_search2
+// A STRING CASE with constant WHEN values uses the interpreted hash lookup.
 Status CaseExpr::GetCodegendComputeFn(RuntimeState* state, Function** fn) {
   if (ir_compute_fn_ != NULL) {
     *fn = ir_compute_fn_;
     return Status::OK;
   }
+  if (HasStringLookup()) return GetCodegendComputeFnWrapper(state, fn);
 
   const int num_children = GetNumChildren();
   Function* child_fns[num_children];
@@ -194,6 +517,18 @@ Status CaseExpr::GetCodegendComputeFn(RuntimeState* state, Function** fn) {
 
   Value* args[2];
   Function* function = CreateIrFunctionPrototype(codegen, "CaseExpr", &args);
+  bool codegened = CodegenSwitch(codegen, function, child_fns, args);
+  if (!codegened) {
+    RETURN_IF_ERROR(
+        CodegenRangeSearch(state, codegen, function, child_fns, args, &codegened));
+  }
+  if (codegened) {
+    *fn = codegen->FinalizeFunction(function);
+    DCHECK(*fn != NULL);
+    ir_compute_fn_ = *fn;
+    return Status::OK;
+  }
+
   BasicBlock* eval_case_expr_block = NULL;
 
   // This is the block immediately after the when/then exprs. It will either point to a
@@ -286,6 +621,169 @@ Status CaseExpr::GetCodegendComputeFn(RuntimeState* state, Function** fn) {
   return Status::OK;
 }
 
+BasicBlock* CaseExpr::CodegenDefaultValue(LlvmCodeGen* codegen, Function* function,
+    Function** child_fns, Value** args) {
+  BasicBlock* block = BasicBlock::Create(codegen->context(),
+      has_else_expr() ? "return_else_expr" : "return_null", function);
+  LlvmCodeGen::LlvmBuilder builder(block);
+  if (has_else_expr()) {
+    Value* else_val = CodegenAnyVal::CreateCall(
+        codegen, &builder, child_fns[GetNumChildren() - 1], args, "else_val");
+    builder.CreateRet(else_val);
+  } else {
+    builder.CreateRet(CodegenAnyVal::GetNullVal(codegen, type()));
+  }
+  return block;
+}
+
+bool CaseExpr::CodegenSwitch(LlvmCodeGen* codegen, Function* function,
+    Function** child_fns, Value** args) {
+  if (!has_case_expr_ || !IsIntegerType(children_[0]->type().type)) return false;
+  if (num_whens() < MIN_WHENS_FOR_LOOKUP) return false;
+  vector<int64_t> when_vals;
+  for (int i = 0; i < num_whens(); ++i) {
+    Expr* when = children_[when_idx(i)];
+    if (dynamic_cast<Literal*>(when) == NULL) return false;
+    int64_t when_val;
+    bool is_not_null = GetIntValue(when, NULL, NULL, &when_val);
+    DCHECK(is_not_null);
+    when_vals.push_back(when_val);
+  }
+
+  LLVMContext& context = codegen->context();
+  LlvmCodeGen::LlvmBuilder builder(context);
+  BasicBlock* eval_case_expr_block =
+      BasicBlock::Create(context, "eval_case_expr", function);
+  BasicBlock* switch_block = BasicBlock::Create(context, "switch_case_val", function);
+  BasicBlock* default_value_block =
+      CodegenDefaultValue(codegen, function, child_fns, args);
+
+  builder.SetInsertPoint(eval_case_expr_block);
+  CodegenAnyVal case_val = CodegenAnyVal::CreateCallWrapped(
+      codegen, &builder, children_[0]->type(), child_fns[0], args, "case_val");
+  builder.CreateCondBr(case_val.GetIsNull(), default_value_block, switch_block);
+
+  builder.SetInsertPoint(switch_block);
+  SwitchInst* switch_inst =
+      builder.CreateSwitch(case_val.GetVal(), default_value_block, when_vals.size());
+  // Only the first WHEN with a given value can match.
+  set<int64_t> seen_vals;
+  for (int i = 0; i < when_vals.size(); ++i) {
+    if (!seen_vals.insert(when_vals[i]).second) continue;
+    BasicBlock* return_then_expr_block =
+        BasicBlock::Create(context, "return_then_expr", function, default_value_block);
+    switch_inst->addCase(cast<ConstantInt>(
+        codegen->GetIntConstant(children_[0]->type().type, when_vals[i])),
+        return_then_expr_block);
+    builder.SetInsertPoint(return_then_expr_block);
+    Value* then_val = CodegenAnyVal::CreateCall(
+        codegen, &builder, child_fns[then_idx(i)], args, "then_val");
+    builder.CreateRet(then_val);
+  }
+  return true;
+}
+
+// Emits a binary search for the first of the bounds in [lo, hi) for which the range
+// chain's comparison of 'val' against it is true, and returns the block to branch to
+// for it. The search ends in then_blocks[i] for the i-th bound, or in 'default_block' if
+// no bound matches.
+static BasicBlock* CodegenBoundSearch(LlvmCodeGen* codegen,
+    LlvmCodeGen::LlvmBuilder* builder, Function* function, Value* val,
+    const vector<Value*>& bounds, CmpInst::Predicate pred,
+    const vector<BasicBlock*>& then_blocks, BasicBlock* default_block, int lo, int hi) {
+  if (lo == hi) return lo < then_blocks.size() ? then_blocks[lo] : default_block;
+  int mid = lo + (hi - lo) / 2;
+  BasicBlock* block =
+      BasicBlock::Create(codegen->context(), "range_search", function, default_block);
+  BasicBlock* match_block = CodegenBoundSearch(codegen, builder, function, val, bounds,
+      pred, then_blocks, default_block, lo, mid);
+  BasicBlock* no_match_block = CodegenBoundSearch(codegen, builder, function, val,
+      bounds, pred, then_blocks, default_block, mid + 1, hi);
+  builder->SetInsertPoint(block);
+  Value* cmp = CmpInst::isFPPredicate(pred) ?
+      builder->CreateFCmp(pred, val, bounds[mid], "cmp") :
+      builder->CreateICmp(pred, val, bounds[mid], "cmp");
+  builder->CreateCondBr(cmp, match_block, no_match_block);
+  return block;
+}
+
+Status CaseExpr::CodegenRangeSearch(RuntimeState* state, LlvmCodeGen* codegen,
+    Function* function, Function** child_fns, Value** args, bool* codegened) {
+  *codegened = false;
+  bool ascending;
+  bool inclusive;
+  if (num_whens() < MIN_WHENS_FOR_LOOKUP) return Status::OK;
+  if (!IsRangeChain(&ascending, &inclusive)) return Status::OK;
+
+  Expr* val_expr = children_[0]->GetChild(0);
+  const ColumnType& val_type = val_expr->type();
+  bool is_int = IsIntegerType(val_type.type);
+  vector<int64_t> int_bounds;
+  vector<double> double_bounds;
+  vector<Value*> bounds;
+  for (int i = 0; i < num_whens(); ++i) {
+    Expr* bound = children_[when_idx(i)]->GetChild(1);
+    if (dynamic_cast<Literal*>(bound) == NULL) return Status::OK;
+    if (is_int) {
+      int64_t bound_val;
+      bool is_not_null = GetIntValue(bound, NULL, NULL, &bound_val);
+      DCHECK(is_not_null);
+      int_bounds.push_back(bound_val);
+      bounds.push_back(codegen->GetIntConstant(val_type.type, bound_val));
+    } else {
+      double bound_val;
+      bool is_not_null = GetDoubleValue(bound, NULL, NULL, &bound_val);
+      DCHECK(is_not_null);
+      if (isnan(bound_val)) return Status::OK;
+      double_bounds.push_back(bound_val);
+      bounds.push_back(ConstantFP::get(codegen->GetType(val_type), bound_val));
+    }
+  }
+  if (!IsSorted(int_bounds, ascending)) return Status::OK;
+  if (!IsSorted(double_bounds, ascending)) return Status::OK;
+
+  Function* val_fn;
+  RETURN_IF_ERROR(val_expr->GetCodegendComputeFn(state, &val_fn));
+
+  LLVMContext& context = codegen->context();
+  LlvmCodeGen::LlvmBuilder builder(context);
+  BasicBlock* eval_val_block = BasicBlock::Create(context, "eval_range_val", function);
+  BasicBlock* default_value_block =
+      CodegenDefaultValue(codegen, function, child_fns, args);
+  vector<BasicBlock*> then_blocks;
+  for (int i = 0; i < num_whens(); ++i) {
+    BasicBlock* return_then_expr_block =
+        BasicBlock::Create(context, "return_then_expr", function, default_value_block);
+    builder.SetInsertPoint(return_then_expr_block);
+    Value* then_val = CodegenAnyVal::CreateCall(
+        codegen, &builder, child_fns[then_idx(i)], args, "then_val");
+    builder.CreateRet(then_val);
+    then_blocks.push_back(return_then_expr_block);
+  }
+
+  builder.SetInsertPoint(eval_val_block);
+  CodegenAnyVal val =
+      CodegenAnyVal::CreateCallWrapped(codegen, &builder, val_type, val_fn, args, "val");
+  Value* is_null = val.GetIsNull();
+  Value* raw_val = val.GetVal();
+
+  // Ordered FP comparisons are false for NaN, like the interpreted comparisons.
+  CmpInst::Predicate pred;
+  if (is_int) {
+    pred = ascending ? (inclusive ? CmpInst::ICMP_SLE : CmpInst::ICMP_SLT) :
+        (inclusive ? CmpInst::ICMP_SGE : CmpInst::ICMP_SGT);
+  } else {
+    pred = ascending ? (inclusive ? CmpInst::FCMP_OLE : CmpInst::FCMP_OLT) :
+        (inclusive ? CmpInst::FCMP_OGE : CmpInst::FCMP_OGT);
+  }
+  BasicBlock* search_block = CodegenBoundSearch(codegen, &builder, function, raw_val,
+      bounds, pred, then_blocks, default_value_block, 0, num_whens());
+  builder.SetInsertPoint(eval_val_block);
+  builder.CreateCondBr(is_null, default_value_block, search_block);
+  *codegened = true;
+  return Status::OK;
+}
+
 void CaseExpr::GetChildVal(int child_idx, ExprContext* ctx, TupleRow* row, AnyVal* dst) {
   switch (children()[child_idx]->type().type) {
     case TYPE_BOOLEAN:
@@ -371,6 +869,16 @@ bool CaseExpr::AnyValEq(const ColumnType& type, const AnyVal* v1, const AnyVal*
     DCHECK(state->case_val != NULL); \
     DCHECK(state->when_val != NULL); \
     int num_children = GetNumChildren(); \
+    const CaseLookup* lookup = reinterpret_cast<CaseLookup*>( \
+        fn_ctx->GetFunctionState(FunctionContext::FRAGMENT_LOCAL)); \
+    if (lookup != NULL) { \
+      int then_child = FindThenChild(*lookup, ctx, row); \
+      if (then_child != -1) return children()[then_child]->Get##THEN_TYPE(ctx, row); \
+      if (has_else_expr()) { \
+        return children()[num_children - 1]->Get##THEN_TYPE(ctx, row); \
+      } \
+      return THEN_TYPE::null(); \
+    } \
     if (has_case_expr()) {                               \
       /* All case and when exprs return the same type */ \
       /* (we guaranteed that during analysis). */ \
@@ -24,6 +24,7 @@ using namespace impala_udf;
 namespace impala {
 
 class TExprNode;
+struct CaseLookup;
 
 class CaseExpr: public Expr {
  public:
@@ -60,9 +61,57 @@ class CaseExpr: public Expr {
   bool has_else_expr() { return has_else_expr_; }
 
  private:
+  // CASE exprs with at least this many constant WHEN values are evaluated with a
+  // CaseLookup instead of by testing each WHEN in turn.
+  static const int MIN_WHENS_FOR_LOOKUP = 8;
+
   const bool has_case_expr_;
   const bool has_else_expr_;
 
+  // Returns the number of WHEN/THEN pairs and the child indexes of the i-th pair.
+  int num_whens() const;
+  int when_idx(int i) const { return (has_case_expr_ ? 1 : 0) + 2 * i; }
+  int then_idx(int i) const { return when_idx(i) + 1; }
+
+  // Returns true if this is a searched CASE of the form
+  //   CASE WHEN x < c1 THEN ... WHEN x < c2 THEN ... END
+  // where x is the same numeric slot in every WHEN and c1, c2, ... are constants of the
+  // same type as x. Each WHEN may use <, <=, > or >=, as long as all of them use the same
+  // operator. Sets 'ascending' to true for < and <=, and 'inclusive' for <= and >=.
+  // Whether the constants are sorted is only known once they are evaluated.
+  bool IsRangeChain(bool* ascending, bool* inclusive) const;
+
+  // Returns true if this is a simple CASE on a STRING value whose WHEN values are
+  // constant and that is evaluated with a CaseLookup.
+  bool HasStringLookup() const;
+
+  // Evaluates the constant WHEN values and returns the lookup structure for them, or
+  // NULL if this CASE isn't eligible. The lookup is allocated from the runtime state's
+  // object pool.
+  CaseLookup* CreateLookup(RuntimeState* state, ExprContext* ctx);
+
+  // Returns the index of the THEN child for 'row' according to 'lookup', or -1 if no WHEN
+  // matches.
+  int FindThenChild(const CaseLookup& lookup, ExprContext* ctx, TupleRow* row);
+
+  // Adds a block to 'function' that returns the ELSE value, or NULL if there is no ELSE
+  // expr, and returns it.
+  llvm::BasicBlock* CodegenDefaultValue(LlvmCodeGen* codegen, llvm::Function* function,
+      llvm::Function** child_fns, llvm::Value** args);
+
+  // Codegens a CASE whose integer WHEN values are all literals as a single switch on the
+  // case value, which LLVM lowers to a jump table or a binary search. Returns false if
+  // the CASE isn't eligible, in which case 'function' is unchanged.
+  bool CodegenSwitch(LlvmCodeGen* codegen, llvm::Function* function,
+      llvm::Function** child_fns, llvm::Value** args);
+
+  // Codegens a range chain (see IsRangeChain()) with literal bounds as a binary search
+  // over the bounds. Sets 'codegened' to false if the CASE isn't eligible, in which case
+  // 'function' is unchanged.
+  Status CodegenRangeSearch(RuntimeState* state, LlvmCodeGen* codegen,
+      llvm::Function* function, llvm::Function** child_fns, llvm::Value** args,
+      bool* codegened);
+
   // Populates 'dst' with the result of calling the appropriate Get*Val() function on the
   // specified child expr.
   void GetChildVal(int child_idx, ExprContext* ctx, TupleRow* row, AnyVal* dst);
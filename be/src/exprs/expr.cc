@@ -172,7 +172,7 @@ Status Expr::CreateTreeFromThrift(ObjectPool* pool, const vector<TExprNode>& nod
     DCHECK(root_expr != NULL);
     DCHECK(ctx != NULL);
     *root_expr = expr;
-    *ctx = pool->Add(new ExprContext(expr));
+    *ctx = pool->AddInPlace(new (pool) ExprContext(expr));
   }
   for (int i = 0; i < num_children; i++) {
     *node_idx += 1;
@@ -193,35 +193,35 @@ Status Expr::CreateExpr(ObjectPool* pool, const TExprNode& texpr_node, Expr** ex
     case TExprNodeType::INT_LITERAL:
     case TExprNodeType::STRING_LITERAL:
     case TExprNodeType::DECIMAL_LITERAL:
-      *expr = pool->Add(new Literal(texpr_node));
+      *expr = pool->AddInPlace(new (pool) Literal(texpr_node));
       return Status::OK;
     case TExprNodeType::CASE_EXPR:
       if (!texpr_node.__isset.case_expr) {
         return Status("Case expression not set in thrift node");
       }
-      *expr = pool->Add(new CaseExpr(texpr_node));
+      *expr = pool->AddInPlace(new (pool) CaseExpr(texpr_node));
       return Status::OK;
     case TExprNodeType::COMPOUND_PRED:
       if (texpr_node.fn.name.function_name == "and") {
-        *expr = pool->Add(new AndPredicate(texpr_node));
+        *expr = pool->AddInPlace(new (pool) AndPredicate(texpr_node));
       } else if (texpr_node.fn.name.function_name == "or") {
-        *expr = pool->Add(new OrPredicate(texpr_node));
+        *expr = pool->AddInPlace(new (pool) OrPredicate(texpr_node));
       } else {
         DCHECK_EQ(texpr_node.fn.name.function_name, "not");
-        *expr = pool->Add(new ScalarFnCall(texpr_node));
+        *expr = pool->AddInPlace(new (pool) ScalarFnCall(texpr_node));
       }
       return Status::OK;
     case TExprNodeType::NULL_LITERAL:
-      *expr = pool->Add(new NullLiteral(texpr_node));
+      *expr = pool->AddInPlace(new (pool) NullLiteral(texpr_node));
       return Status::OK;
     case TExprNodeType::SLOT_REF:
       if (!texpr_node.__isset.slot_ref) {
         return Status("Slot reference not set in thrift node");
       }
-      *expr = pool->Add(new SlotRef(texpr_node));
+      *expr = pool->AddInPlace(new (pool) SlotRef(texpr_node));
       return Status::OK;
     case TExprNodeType::TUPLE_IS_NULL_PRED:
-      *expr = pool->Add(new TupleIsNullPredicate(texpr_node));
+      *expr = pool->AddInPlace(new (pool) TupleIsNullPredicate(texpr_node));
       return Status::OK;
     case TExprNodeType::FUNCTION_CALL:
       if (!texpr_node.__isset.fn) {
@@ -230,20 +230,20 @@ Status Expr::CreateExpr(ObjectPool* pool, const TExprNode& texpr_node, Expr** ex
       // Special-case functions that have their own Expr classes
       // TODO: is there a better way to do this?
       if (texpr_node.fn.name.function_name == "if") {
-        *expr = pool->Add(new IfExpr(texpr_node));
+        *expr = pool->AddInPlace(new (pool) IfExpr(texpr_node));
       } else if (texpr_node.fn.name.function_name == "nullif") {
-        *expr = pool->Add(new NullIfExpr(texpr_node));
+        *expr = pool->AddInPlace(new (pool) NullIfExpr(texpr_node));
       } else if (texpr_node.fn.name.function_name == "isnull" ||
                  texpr_node.fn.name.function_name == "ifnull" ||
                  texpr_node.fn.name.function_name == "nvl") {
-        *expr = pool->Add(new IsNullExpr(texpr_node));
+        *expr = pool->AddInPlace(new (pool) IsNullExpr(texpr_node));
       } else if (texpr_node.fn.name.function_name == "coalesce") {
-        *expr = pool->Add(new CoalesceExpr(texpr_node));
+        *expr = pool->AddInPlace(new (pool) CoalesceExpr(texpr_node));
 
       } else if (texpr_node.fn.binary_type == TFunctionBinaryType::HIVE) {
-        *expr = pool->Add(new HiveUdfCall(texpr_node));
+        *expr = pool->AddInPlace(new (pool) HiveUdfCall(texpr_node));
       } else {
-        *expr = pool->Add(new ScalarFnCall(texpr_node));
+        *expr = pool->AddInPlace(new (pool) ScalarFnCall(texpr_node));
       }
       return Status::OK;
     default:
@@ -145,6 +145,9 @@ class Expr {
   const ColumnType& type() const { return type_; }
   bool is_slotref() const { return is_slotref_; }
 
+  // The function this expr calls. Only set for function call exprs (e.g. predicates).
+  const TFunction& fn() const { return fn_; }
+
   const std::vector<Expr*>& children() const { return children_; }
 
   // Returns true if GetValue(NULL) can be called on this expr and always returns the same
@@ -21,6 +21,7 @@
 
 #include "exprs/anyval-util.h"
 #include "exprs/expr.h"
+#include "runtime/string-search.h"
 #include "runtime/string-value.inline.h"
 #include "runtime/tuple-row.h"
 #include "util/url-parser.h"
@@ -500,8 +501,10 @@ StringVal StringFunctions::ParseUrl(
     url_part = UrlParser::GetUrlPart(StringValue::FromStringVal(part));
   }
 
+  // Consecutive parse_url() calls on the same url, e.g. for its host and its path,
+  // share the tokens of the url.
   StringValue result;
-  if (!UrlParser::ParseUrl(StringValue::FromStringVal(url), url_part, &result)) {
+  if (!UrlParser::ParseUrlCached(StringValue::FromStringVal(url), url_part, &result)) {
     // url is malformed, or url_part is invalid.
     if (url_part == UrlParser::INVALID) {
       stringstream ss;
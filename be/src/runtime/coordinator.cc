@@ -341,6 +341,13 @@ Status Coordinator::Exec(QuerySchedule& schedule,
     TExecPlanFragmentParams rpc_params;
     SetExecPlanFragmentParams(schedule, 0, request.fragments[0], 0,
         (*fragment_exec_params)[0], 0, coord, &rpc_params);
+    if (schedule.is_coord_only()) {
+      // Loading and compiling the IR module would take far longer than running the
+      // query interpreted.
+      rpc_params.fragment_instance_ctx.query_ctx.request.query_options
+          .__set_disable_codegen(true);
+      executor_->set_sample_counters(false);
+    }
     RETURN_IF_ERROR(executor_->Prepare(rpc_params));
 
     // Prepare output_expr_ctxs before optimizing the LLVM module. The other exprs of this
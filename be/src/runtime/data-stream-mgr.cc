@@ -100,8 +100,15 @@ Status DataStreamMgr::AddData(
     // errors from receiver-initiated teardowns.
     return Status::OK;
   }
-  recvr->AddBatch(thrift_batch, sender_id);
-  return Status::OK;
+  return recvr->AddBatch(thrift_batch, sender_id);
+}
+
+Status DataStreamMgr::ProbeData(const TUniqueId& fragment_instance_id,
+    PlanNodeId dest_node_id, int sender_id) {
+  shared_ptr<DataStreamRecvr> recvr = FindRecvr(fragment_instance_id, dest_node_id);
+  // If the recvr is gone, the resent batch is dropped by AddData().
+  if (recvr == NULL) return Status::OK;
+  return recvr->ProbeBuffer(sender_id);
 }
 
 Status DataStreamMgr::CloseSender(const TUniqueId& fragment_instance_id,
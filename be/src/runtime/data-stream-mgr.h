@@ -72,15 +72,24 @@ class DataStreamMgr {
   // Adds a row batch to the recvr identified by fragment_instance_id/dest_node_id
   // if the recvr has not been cancelled. sender_id identifies the sender instance
   // from which the data came.
-  // The call blocks if this ends up pushing the stream over its buffering limit;
-  // it unblocks when the consumer removed enough data to make space for
-  // row_batch.
+  // The call never blocks. If adding the batch would push the stream over its
+  // buffering limit, the batch is not added and a RECOVERABLE_ERROR status is
+  // returned; the sender is expected to resend the batch once the consumer had a
+  // chance to remove data. This keeps the backend service threads free to handle other
+  // rpcs while a slow consumer drains its stream.
   // TODO: enforce per-sender quotas (something like 200% of buffer_size/#senders),
   // so that a single sender can't flood the buffer and stall everybody else.
   // Returns OK if successful, error status otherwise.
   Status AddData(const TUniqueId& fragment_instance_id, PlanNodeId dest_node_id,
                  const TRowBatch& thrift_batch, int sender_id);
 
+  // Called by senders with a batch that AddData() turned away, before they resend it.
+  // Returns a RECOVERABLE_ERROR status if the batch would likely be turned away again,
+  // so that the sender only resends it once the consumer has made room. Returns OK
+  // otherwise, including if the recvr is gone.
+  Status ProbeData(const TUniqueId& fragment_instance_id, PlanNodeId dest_node_id,
+                   int sender_id);
+
   // Notifies the recvr associated with the fragment/node id that the specified
   // sender has closed.
   // Returns OK if successful, error status otherwise.
@@ -12,18 +12,23 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <stdlib.h>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
+#include <gutil/strings/substitute.h>
 
 #include "runtime/data-stream-recvr.h"
 #include "runtime/data-stream-mgr.h"
 #include "runtime/row-batch.h"
 #include "runtime/sorted-run-merger.h"
 #include "util/runtime-profile.h"
+#include "util/debug-util.h"
 #include "util/periodic-counter-updater.h"
+#include "util/time.h"
 
 using namespace std;
 using namespace boost;
+using namespace strings;
 
 namespace impala {
 
@@ -42,11 +47,17 @@ class DataStreamRecvr::SenderQueue {
   // must acquire data from the returned batch before the next call to GetBatch().
   Status GetBatch(RowBatch** next_batch);
 
-  // Adds a row batch to this sender queue if this stream has not been cancelled;
-  // blocks if this will make the stream exceed its buffer limit.
-  // If the total size of the batches in this queue would exceed the allowed buffer size,
-  // the queue is considered full and the call blocks until a batch is dequeued.
-  void AddBatch(const TRowBatch& batch);
+  // Adds a row batch to this sender queue if this stream has not been cancelled.
+  // Never blocks: if the queue is not empty and the batch would push the stream over its
+  // buffer limit, the batch is not added and false is returned. The sender is expected
+  // to resend it later. Returns true if the batch was added or the stream is cancelled.
+  bool AddBatch(const TRowBatch& batch);
+
+  // Returns true if a batch that was turned away by AddBatch() would likely be added
+  // now, i.e. if the queue is empty or the consumer has made room for a batch of the
+  // size of the last one that was turned away. Also returns true if the stream is
+  // cancelled. Otherwise sets 'batch_size' to the size of that batch.
+  bool HasRoom(int* batch_size);
 
   // Decrement the number of remaining senders for this queue and signal eos ("new data")
   // if the count drops to 0. The number of senders will be 1 for a merging
@@ -80,9 +91,6 @@ class DataStreamRecvr::SenderQueue {
   // signal arrival of new batch or the eos/cancelled condition
   condition_variable data_arrival_cv_;
 
-  // signal removal of data by stream consumer
-  condition_variable data_removal__cv_;
-
   // queue of (batch length, batch) pairs.  The SenderQueue block owns memory to
   // these batches. They are handed off to the caller via GetBatch.
   typedef list<pair<int, RowBatch*> > RowBatchQueue;
@@ -95,6 +103,9 @@ class DataStreamRecvr::SenderQueue {
 
   // Set to true when the first batch has been received
   bool received_first_batch_;
+
+  // Size of the batch that AddBatch() turned away last, see HasRoom().
+  int last_deferred_batch_size_;
 };
 
 DataStreamRecvr::SenderQueue::SenderQueue(DataStreamRecvr* parent_recvr, int num_senders,
@@ -102,7 +113,8 @@ DataStreamRecvr::SenderQueue::SenderQueue(DataStreamRecvr* parent_recvr, int num
   : recvr_(parent_recvr),
     is_cancelled_(false),
     num_remaining_senders_(num_senders),
-    received_first_batch_(false) {
+    received_first_batch_(false),
+    last_deferred_batch_size_(0) {
 }
 
 Status DataStreamRecvr::SenderQueue::GetBatch(RowBatch** next_batch) {
@@ -132,83 +144,61 @@ Status DataStreamRecvr::SenderQueue::GetBatch(RowBatch** next_batch) {
   DCHECK(!batch_queue_.empty());
   RowBatch* result = batch_queue_.front().second;
   recvr_->num_buffered_bytes_ -= batch_queue_.front().first;
+  recvr_->first_consume_ms_.CompareAndSwap(0, MonotonicMillis());
+  recvr_->num_consumed_bytes_ += batch_queue_.front().first;
   VLOG_ROW << "fetched #rows=" << result->num_rows();
   batch_queue_.pop_front();
-  data_removal__cv_.notify_one();
   current_batch_.reset(result);
   *next_batch = current_batch_.get();
   return Status::OK;
 }
 
-void DataStreamRecvr::SenderQueue::AddBatch(const TRowBatch& thrift_batch) {
+bool DataStreamRecvr::SenderQueue::AddBatch(const TRowBatch& thrift_batch) {
   unique_lock<mutex> l(lock_);
-  if (is_cancelled_) return;
+  if (is_cancelled_) return true;
 
   int batch_size = RowBatch::GetBatchSize(thrift_batch);
-  COUNTER_ADD(recvr_->bytes_received_counter_, batch_size);
   DCHECK_GT(num_remaining_senders_, 0);
 
   // if there's something in the queue and this batch will push us over the
-  // buffer limit we need to wait until the batch gets drained.
+  // buffer limit, the sender has to retry once the consumer has drained the queue.
+  // We don't wait here since that would park the rpc thread that is delivering the
+  // batch, and the thrift server has a limited number of those.
   // Note: It's important that we enqueue thrift_batch regardless of buffer limit if
   // the queue is currently empty. In the case of a merging receiver, batches are
   // received from a specific queue based on data order, and the pipeline will stall
   // if the merger is waiting for data from an empty queue that cannot be filled because
   // the limit has been reached.
-  while (!batch_queue_.empty() && recvr_->ExceedsLimit(batch_size) && !is_cancelled_) {
-    SCOPED_TIMER(recvr_->buffer_full_total_timer_);
-    VLOG_ROW << " wait removal: empty=" << (batch_queue_.empty() ? 1 : 0)
-             << " #buffered=" << recvr_->num_buffered_bytes_
+  if (!batch_queue_.empty() && recvr_->ExceedsLimit(batch_size)) {
+    VLOG_ROW << " defer batch: #buffered=" << recvr_->num_buffered_bytes_
              << " batch_size=" << batch_size << "\n";
-
-    // We only want one thread running the timer at any one time. Only
-    // one thread may lock the try_lock, and that 'winner' starts the
-    // scoped timer.
-    bool got_timer_lock = false;
-    {
-      try_mutex::scoped_try_lock timer_lock(recvr_->buffer_wall_timer_lock_);
-      if (timer_lock) {
-        SCOPED_TIMER(recvr_->buffer_full_wall_timer_);
-        data_removal__cv_.wait(l);
-        got_timer_lock = true;
-      } else {
-        data_removal__cv_.wait(l);
-        got_timer_lock = false;
-      }
-    }
-    // If we had the timer lock, wake up another writer to make sure
-    // that they (if no-one else) starts the timer. The guarantee is
-    // that if no thread has the try_lock, the thread that we wake up
-    // here will obtain it and run the timer.
-    //
-    // We must have given up the try_lock by this point, otherwise the
-    // woken thread might not successfully take the lock once it has
-    // woken up. (In fact, no other thread will run in AddBatch until
-    // this thread exits because of mutual exclusion around lock_, but
-    // it's good not to rely on that fact).
-    //
-    // The timer may therefore be an underestimate by the amount of
-    // time it takes this thread to finish (and yield lock_) and the
-    // notified thread to be woken up and to acquire the try_lock. In
-    // practice, this time is small relative to the total wait time.
-    if (got_timer_lock) data_removal__cv_.notify_one();
+    COUNTER_ADD(recvr_->num_deferred_batches_counter_, 1);
+    last_deferred_batch_size_ = batch_size;
+    return false;
   }
 
-  if (!is_cancelled_) {
-    RowBatch* batch = NULL;
-    {
-      SCOPED_TIMER(recvr_->deserialize_row_batch_timer_);
-      // Note: if this function makes a row batch, the batch *must* be added
-      // to batch_queue_. It is not valid to create the row batch and destroy
-      // it in this thread.
-      batch = new RowBatch(recvr_->row_desc(), thrift_batch, recvr_->mem_tracker());
-    }
-    VLOG_ROW << "added #rows=" << batch->num_rows()
-             << " batch_size=" << batch_size << "\n";
-    batch_queue_.push_back(make_pair(batch_size, batch));
-    recvr_->num_buffered_bytes_ += batch_size;
-    data_arrival_cv_.notify_one();
+  COUNTER_ADD(recvr_->bytes_received_counter_, batch_size);
+  RowBatch* batch = NULL;
+  {
+    SCOPED_TIMER(recvr_->deserialize_row_batch_timer_);
+    // Note: if this function makes a row batch, the batch *must* be added
+    // to batch_queue_. It is not valid to create the row batch and destroy
+    // it in this thread.
+    batch = new RowBatch(recvr_->row_desc(), thrift_batch, recvr_->mem_tracker());
   }
+  VLOG_ROW << "added #rows=" << batch->num_rows()
+           << " batch_size=" << batch_size << "\n";
+  batch_queue_.push_back(make_pair(batch_size, batch));
+  recvr_->num_buffered_bytes_ += batch_size;
+  data_arrival_cv_.notify_one();
+  return true;
+}
+
+bool DataStreamRecvr::SenderQueue::HasRoom(int* batch_size) {
+  lock_guard<mutex> l(lock_);
+  *batch_size = last_deferred_batch_size_;
+  return is_cancelled_ || batch_queue_.empty() ||
+      !recvr_->ExceedsLimit(last_deferred_batch_size_);
 }
 
 void DataStreamRecvr::SenderQueue::DecrementSenders() {
@@ -231,10 +221,9 @@ void DataStreamRecvr::SenderQueue::Cancel() {
                << recvr_->fragment_instance_id()
                << " node_id=" << recvr_->dest_node_id();
   }
-  // Wake up all threads waiting to produce/consume batches.  They will all
+  // Wake up all threads waiting to consume batches.  They will all
   // notice that the stream is cancelled and handle it.
   data_arrival_cv_.notify_all();
-  data_removal__cv_.notify_all();
   PeriodicCounterUpdater::StopTimeSeriesCounter(
       recvr_->bytes_received_time_series_counter_);
 }
@@ -284,6 +273,8 @@ DataStreamRecvr::DataStreamRecvr(DataStreamMgr* stream_mgr, MemTracker* parent_t
     row_desc_(row_desc),
     is_merging_(is_merging),
     num_buffered_bytes_(0),
+    num_consumed_bytes_(0),
+    first_consume_ms_(0),
     profile_(profile) {
   mem_tracker_.reset(new MemTracker(-1, -1, "DataStreamRecvr", parent_tracker));
   // Create one queue per sender if is_merging is true.
@@ -303,8 +294,7 @@ DataStreamRecvr::DataStreamRecvr(DataStreamMgr* stream_mgr, MemTracker* parent_t
       ADD_TIME_SERIES_COUNTER(profile_, "BytesReceived", bytes_received_counter_);
   deserialize_row_batch_timer_ =
       ADD_TIMER(profile_, "DeserializeRowBatchTimer");
-  buffer_full_wall_timer_ = ADD_TIMER(profile_, "SendersBlockedTimer");
-  buffer_full_total_timer_ = ADD_TIMER(profile_, "SendersBlockedTotalTimer(*)");
+  num_deferred_batches_counter_ = ADD_COUNTER(profile_, "DeferredBatches", TUnit::UNIT);
   data_arrival_timer_ = profile_->inactive_timer();
   first_batch_wait_total_timer_ = ADD_TIMER(profile_, "FirstBatchArrivalWaitTime");
 }
@@ -314,10 +304,52 @@ Status DataStreamRecvr::GetNext(RowBatch* output_batch, bool* eos) {
   return merger_->GetNext(output_batch, eos);
 }
 
-void DataStreamRecvr::AddBatch(const TRowBatch& thrift_batch, int sender_id) {
+Status DataStreamRecvr::AddBatch(const TRowBatch& thrift_batch, int sender_id) {
   int use_sender_id = is_merging_ ? sender_id : 0;
   // Add all batches to the same queue if is_merging_ is false.
-  sender_queues_[use_sender_id]->AddBatch(thrift_batch);
+  if (sender_queues_[use_sender_id]->AddBatch(thrift_batch)) return Status::OK;
+  return BufferFullStatus(RowBatch::GetBatchSize(thrift_batch));
+}
+
+Status DataStreamRecvr::ProbeBuffer(int sender_id) {
+  int use_sender_id = is_merging_ ? sender_id : 0;
+  int batch_size;
+  if (sender_queues_[use_sender_id]->HasRoom(&batch_size)) return Status::OK;
+  return BufferFullStatus(batch_size);
+}
+
+const char* DataStreamRecvr::RETRY_AFTER_PREFIX = "Retry after ms: ";
+
+int64_t DataStreamRecvr::GetRetryAfterMs(const TStatus& status) {
+  const string prefix = RETRY_AFTER_PREFIX;
+  for (int i = 0; i < status.error_msgs.size(); ++i) {
+    const string& msg = status.error_msgs[i];
+    if (msg.compare(0, prefix.size(), prefix) != 0) continue;
+    return strtoll(msg.c_str() + prefix.size(), NULL, 10);
+  }
+  return -1;
+}
+
+Status DataStreamRecvr::BufferFullStatus(int batch_size) const {
+  Status status(ErrorMsg(TErrorCode::RECOVERABLE_ERROR, Substitute(
+      "Receiver buffer of fragment instance $0 node $1 is full, resend the batch later",
+      PrintId(fragment_instance_id_), dest_node_id_)));
+  int64_t retry_after_ms = EstimateRetryAfterMs(batch_size);
+  if (retry_after_ms >= 0) {
+    status.AddDetail(Substitute("$0$1", RETRY_AFTER_PREFIX, retry_after_ms));
+  }
+  return status;
+}
+
+int64_t DataStreamRecvr::EstimateRetryAfterMs(int batch_size) const {
+  int64_t first_consume_ms = first_consume_ms_;
+  int64_t consumed_bytes = num_consumed_bytes_;
+  if (first_consume_ms == 0 || consumed_bytes == 0) return -1;
+  // The consumer has to remove this many bytes before the batch fits.
+  int64_t needed_bytes = num_buffered_bytes_ + batch_size - total_buffer_limit_;
+  if (needed_bytes <= 0) return 0;
+  int64_t elapsed_ms = max<int64_t>(MonotonicMillis() - first_consume_ms, 1);
+  return needed_bytes * elapsed_ms / consumed_bytes;
 }
 
 void DataStreamRecvr::RemoveSender(int sender_id) {
@@ -99,9 +99,24 @@ class DataStreamRecvr {
       PlanNodeId dest_node_id, int num_senders, bool is_merging, int total_buffer_limit,
       RuntimeProfile* profile);
 
-  // Add a new batch of rows to the appropriate sender queue, blocking if the queue is
-  // full. Called from DataStreamMgr.
-  void AddBatch(const TRowBatch& thrift_batch, int sender_id);
+  // Add a new batch of rows to the appropriate sender queue. Called from DataStreamMgr.
+  // Does not block if the queue is full; instead the batch is dropped and a
+  // RECOVERABLE_ERROR status is returned, which tells the sender to resend the batch.
+  Status AddBatch(const TRowBatch& thrift_batch, int sender_id);
+
+  // Returns OK if a batch from 'sender_id' that was turned away by AddBatch() would
+  // likely be added now, and a RECOVERABLE_ERROR status otherwise. Lets senders find
+  // out when to resend a batch without sending it. Called from DataStreamMgr.
+  Status ProbeBuffer(int sender_id);
+
+  // Prefix of the detail of the RECOVERABLE_ERROR status of AddBatch() and
+  // ProbeBuffer() that tells the sender in how many ms the receiver expects to have room
+  // for its batch. TTransmitDataResult only has a status, so the hint rides along in its
+  // error messages.
+  static const char* RETRY_AFTER_PREFIX;
+
+  // Returns the hint in ms that a receiver added to 'status', or -1 if it has none.
+  static int64_t GetRetryAfterMs(const TStatus& status);
 
   // Indicate that a particular sender is done. Delegated to the appropriate
   // sender queue. Called from DataStreamMgr.
@@ -116,6 +131,15 @@ class DataStreamRecvr {
     return num_buffered_bytes_ + batch_size > total_buffer_limit_;
   }
 
+  // The RECOVERABLE_ERROR status that tells a sender to resend its batch of
+  // 'batch_size' bytes later, with a hint of when to do so if there is one.
+  Status BufferFullStatus(int batch_size) const;
+
+  // Estimates in how many ms a batch of 'batch_size' bytes will fit into the buffer,
+  // from the rate at which the consumer removed batches so far. Returns -1 if it hasn't
+  // removed any yet.
+  int64_t EstimateRetryAfterMs(int batch_size) const;
+
   // DataStreamMgr instance used to create this recvr. (Not owned)
   DataStreamMgr* mgr_;
 
@@ -124,7 +148,7 @@ class DataStreamRecvr {
   PlanNodeId dest_node_id_;
 
   // soft upper limit on the total amount of buffering allowed for this stream across
-  // all sender queues. we stop acking incoming data once the amount of buffered data
+  // all sender queues. we turn away incoming batches once the amount of buffered data
   // exceeds this value
   int total_buffer_limit_;
 
@@ -138,6 +162,12 @@ class DataStreamRecvr {
   // total number of bytes held across all sender queues.
   AtomicInt<int> num_buffered_bytes_;
 
+  // Total number of bytes of the batches the consumer removed from the sender queues,
+  // and the time in ms at which it removed the first one (0 until then). Used by
+  // EstimateRetryAfterMs().
+  AtomicInt<int64_t> num_consumed_bytes_;
+  AtomicInt<int64_t> first_consume_ms_;
+
   // Memtracker for batches in the sender queue(s).
   boost::scoped_ptr<MemTracker> mem_tracker_;
 
@@ -168,21 +198,9 @@ class DataStreamRecvr {
   // TODO: Turn this into a wall-clock timer.
   RuntimeProfile::Counter* first_batch_wait_total_timer_;
 
-  // Total time (summed across all threads) spent waiting for the
-  // recv buffer to be drained so that new batches can be
-  // added. Remote plan fragments are blocked for the same amount of
-  // time.
-  RuntimeProfile::Counter* buffer_full_total_timer_;
-
-  // Protects access to buffer_full_wall_timer_. We only want one
-  // thread to be running the timer at any time, and we use this
-  // try_mutex to enforce this condition. If a thread does not get
-  // the lock, it continues to execute, but without running the
-  // timer.
-  boost::try_mutex buffer_wall_timer_lock_;
-
-  // Wall time senders spend waiting for the recv buffer to have capacity.
-  RuntimeProfile::Counter* buffer_full_wall_timer_;
+  // Number of batches that were turned away because the recv buffer was full. Each of
+  // them was resent by its sender.
+  RuntimeProfile::Counter* num_deferred_batches_counter_;
 
   // Total time spent waiting for data to arrive in the recv buffer
   RuntimeProfile::Counter* data_arrival_timer_;
@@ -21,6 +21,7 @@
 #include "common/logging.h"
 #include "exprs/expr.h"
 #include "exprs/expr-context.h"
+#include "runtime/data-stream-recvr.h"
 #include "runtime/descriptors.h"
 #include "runtime/tuple-row.h"
 #include "runtime/row-batch.h"
@@ -30,6 +31,7 @@
 #include "runtime/mem-tracker.h"
 #include "util/debug-util.h"
 #include "util/network-util.h"
+#include "util/time.h"
 #include "rpc/thrift-client.h"
 #include "rpc/thrift-util.h"
 
@@ -43,6 +45,19 @@ using namespace apache::thrift;
 using namespace apache::thrift::protocol;
 using namespace apache::thrift::transport;
 
+DEFINE_int32(datastream_sender_retry_initial_ms, 10, "(Advanced) Time in ms a data "
+    "stream sender waits before asking the receiver again whether it has room for a "
+    "batch that it turned away because its buffer was full, if the receiver gave no "
+    "hint of when it will have room. The wait doubles with every further attempt for "
+    "the same batch, up to --datastream_sender_retry_max_ms.");
+DEFINE_int32(datastream_sender_retry_max_ms, 2000, "(Advanced) Maximum time in ms a "
+    "data stream sender waits before asking the receiver again whether it has room for "
+    "a batch that it turned away, also if the receiver hinted at a longer wait.");
+
+// Longest time in ms a sender waiting for room at a receiver sleeps before checking
+// whether its fragment was cancelled.
+static const int CANCELLATION_CHECK_INTERVAL_MS = 100;
+
 namespace impala {
 
 // A channel sends data asynchronously via calls to TransmitData
@@ -50,8 +65,15 @@ namespace impala {
 // It has a fixed-capacity buffer and allows the caller either to add rows to
 // that buffer individually (AddRow()), or circumvent the buffer altogether and send
 // TRowBatches directly (SendBatch()). Either way, there can only be one in-flight RPC
-// at any one time (ie, sending will block if the most recent rpc hasn't finished,
-// which allows the receiver node to throttle the sender by withholding acks).
+// at any one time (ie, sending will block if the most recent rpc hasn't finished).
+// The receiver node throttles the sender by turning away batches while its buffer is
+// full, so that the receiver's rpc threads never wait for the stream's consumer. The
+// channel then holds on to the batch and probes the receiver with TransmitData() calls
+// without a batch. It only resends the batch once a probe reports that the receiver
+// has room. Each refusal carries the receiver's estimate of when it will have room,
+// based on how fast its consumer drains the buffer, which the channel waits for before
+// the next probe. Without an estimate, e.g. before the consumer took the first batch,
+// the channel backs off exponentially.
 // *Not* thread-safe.
 class DataStreamSender::Channel {
  public:
@@ -144,6 +166,15 @@ class DataStreamSender::Channel {
   void TransmitData(int thread_id, const TRowBatch*);
   void TransmitDataHelper(const TRowBatch*);
 
+  // Called after the receiver turned away a batch with 'status'. Probes the receiver
+  // with 'params', which has no batch, until it reports that it has room for the batch.
+  // Returns CANCELLED if the fragment is cancelled in the meantime.
+  Status WaitForReceiver(ImpalaInternalServiceConnection* client,
+      const TTransmitDataParams& params, const TStatus& status);
+
+  // Sleeps for 'wait_ms', but returns CANCELLED as soon as the fragment is cancelled.
+  Status SleepUnlessCancelled(int64_t wait_ms);
+
   Status CloseInternal();
 };
 
@@ -199,27 +230,44 @@ void DataStreamSender::Channel::TransmitDataHelper(const TRowBatch* batch) {
     ImpalaInternalServiceConnection client(client_cache_, address_, &rpc_status_);
     if (!rpc_status_.ok()) return;
 
-    TTransmitDataResult res;
-    {
-      SCOPED_TIMER(parent_->thrift_transmit_timer_);
-      try {
-        client->TransmitData(res, params);
-      } catch (const TException& e) {
-        VLOG_RPC << "Retrying TransmitData: " << e.what();
-        rpc_status_ = client.Reopen();
-        if (!rpc_status_.ok()) {
-          return;
+    while (true) {
+      TTransmitDataResult res;
+      {
+        SCOPED_TIMER(parent_->thrift_transmit_timer_);
+        try {
+          client->TransmitData(res, params);
+        } catch (const TException& e) {
+          VLOG_RPC << "Retrying TransmitData: " << e.what();
+          rpc_status_ = client.Reopen();
+          if (!rpc_status_.ok()) {
+            return;
+          }
+          client->TransmitData(res, params);
         }
-        client->TransmitData(res, params);
       }
-    }
 
-    if (res.status.status_code != TErrorCode::OK) {
-      rpc_status_ = res.status;
-    } else {
-      num_data_bytes_sent_ += RowBatch::GetBatchSize(*batch);
-      VLOG_ROW << "incremented #data_bytes_sent="
-               << num_data_bytes_sent_;
+      if (res.status.status_code == TErrorCode::RECOVERABLE_ERROR) {
+        // The receiver's buffer is full and it didn't keep the batch. Wait for the
+        // consumer to make room and try again.
+        VLOG_ROW << "TransmitData deferred instance_id=" << fragment_instance_id_
+                 << " dest_node=" << dest_node_id_;
+        COUNTER_ADD(parent_->deferred_batches_counter_, 1);
+        TTransmitDataParams probe_params = params;
+        probe_params.__isset.row_batch = false;
+        probe_params.row_batch = TRowBatch();
+        rpc_status_ = WaitForReceiver(&client, probe_params, res.status);
+        if (!rpc_status_.ok()) return;
+        continue;
+      }
+
+      if (res.status.status_code != TErrorCode::OK) {
+        rpc_status_ = res.status;
+      } else {
+        num_data_bytes_sent_ += RowBatch::GetBatchSize(*batch);
+        VLOG_ROW << "incremented #data_bytes_sent="
+                 << num_data_bytes_sent_;
+      }
+      return;
     }
   } catch (TException& e) {
     stringstream msg;
@@ -229,6 +277,48 @@ void DataStreamSender::Channel::TransmitDataHelper(const TRowBatch* batch) {
   }
 }
 
+Status DataStreamSender::Channel::WaitForReceiver(
+    ImpalaInternalServiceConnection* client, const TTransmitDataParams& params,
+    const TStatus& status) {
+  SCOPED_TIMER(parent_->deferred_wait_timer_);
+  int64_t retry_after_ms = DataStreamRecvr::GetRetryAfterMs(status);
+  int64_t backoff_ms = FLAGS_datastream_sender_retry_initial_ms;
+  while (true) {
+    int64_t wait_ms;
+    if (retry_after_ms >= 0) {
+      // Sleep at least 1ms, so that a receiver that underestimates the wait isn't
+      // probed in a tight loop.
+      wait_ms = max<int64_t>(retry_after_ms, 1);
+    } else {
+      wait_ms = backoff_ms;
+      backoff_ms = min<int64_t>(backoff_ms * 2, FLAGS_datastream_sender_retry_max_ms);
+    }
+    RETURN_IF_ERROR(SleepUnlessCancelled(
+        min<int64_t>(wait_ms, FLAGS_datastream_sender_retry_max_ms)));
+    TTransmitDataResult res;
+    try {
+      (*client)->TransmitData(res, params);
+    } catch (const TException& e) {
+      VLOG_RPC << "Retrying TransmitData probe: " << e.what();
+      RETURN_IF_ERROR(client->Reopen());
+      continue;
+    }
+    COUNTER_ADD(parent_->receiver_probes_counter_, 1);
+    if (res.status.status_code != TErrorCode::RECOVERABLE_ERROR) return Status::OK;
+    retry_after_ms = DataStreamRecvr::GetRetryAfterMs(res.status);
+  }
+}
+
+Status DataStreamSender::Channel::SleepUnlessCancelled(int64_t wait_ms) {
+  while (true) {
+    if (parent_->state_->is_cancelled()) return Status::CANCELLED;
+    if (wait_ms <= 0) return Status::OK;
+    int64_t sleep_ms = min<int64_t>(wait_ms, CANCELLATION_CHECK_INTERVAL_MS);
+    SleepForMs(sleep_ms);
+    wait_ms -= sleep_ms;
+  }
+}
+
 void DataStreamSender::Channel::WaitForRpc() {
   SCOPED_TIMER(parent_->state_->total_network_send_timer());
   unique_lock<mutex> l(rpc_thread_lock_);
@@ -345,6 +435,9 @@ DataStreamSender::DataStreamSender(ObjectPool* pool, int sender_id,
     serialize_batch_timer_(NULL),
     thrift_transmit_timer_(NULL),
     bytes_sent_counter_(NULL),
+    deferred_batches_counter_(NULL),
+    deferred_wait_timer_(NULL),
+    receiver_probes_counter_(NULL),
     dest_node_id_(sink.dest_node_id) {
   DCHECK_GT(destinations.size(), 0);
   DCHECK(sink.output_partition.type == TPartitionType::UNPARTITIONED
@@ -403,6 +496,9 @@ Status DataStreamSender::Prepare(RuntimeState* state) {
   serialize_batch_timer_ =
       ADD_TIMER(profile(), "SerializeBatchTime");
   thrift_transmit_timer_ = ADD_TIMER(profile(), "ThriftTransmitTime(*)");
+  deferred_batches_counter_ = ADD_COUNTER(profile(), "DeferredBatches", TUnit::UNIT);
+  deferred_wait_timer_ = ADD_TIMER(profile(), "DeferredBatchWaitTime(*)");
+  receiver_probes_counter_ = ADD_COUNTER(profile(), "ReceiverProbes", TUnit::UNIT);
   network_throughput_ =
       profile()->AddDerivedCounter("NetworkThroughput(*)", TUnit::BYTES_PER_SECOND,
           bind<int64_t>(&RuntimeProfile::UnitsPerSecond, bytes_sent_counter_,
@@ -120,6 +120,15 @@ class DataStreamSender : public DataSink {
   RuntimeProfile::Counter* uncompressed_bytes_counter_;
   boost::scoped_ptr<MemTracker> mem_tracker_;
 
+  // Number of batches that a receiver turned away because its buffer was full, and the
+  // time the channels spent waiting before resending them.
+  RuntimeProfile::Counter* deferred_batches_counter_;
+  RuntimeProfile::Counter* deferred_wait_timer_;
+
+  // Number of times the channels asked a receiver whether it has room for a batch that
+  // it turned away.
+  RuntimeProfile::Counter* receiver_probes_counter_;
+
   // Throughput per time spent in TransmitData
   RuntimeProfile::Counter* network_throughput_;
 
@@ -76,7 +76,10 @@ class ImpalaTestBackend : public ImpalaInternalServiceIf {
 
   virtual void TransmitData(
       TTransmitDataResult& return_val, const TTransmitDataParams& params) {
-    if (!params.eos) {
+    if (!params.__isset.row_batch && !params.eos) {
+      mgr_->ProbeData(params.dest_fragment_instance_id, params.dest_node_id,
+          params.sender_id).SetTStatus(&return_val);
+    } else if (!params.eos) {
       mgr_->AddData(params.dest_fragment_instance_id, params.dest_node_id,
                     params.row_batch, params.sender_id).SetTStatus(&return_val);
     } else {
@@ -478,22 +481,37 @@ class DataStreamTest : public testing::Test {
         &obj_pool_, sender_num, *row_desc_, sink, dest_, channel_buffer_size);
     EXPECT_TRUE(sender.Prepare(&state).ok());
     EXPECT_TRUE(sender.Open(&state).ok());
+    SendBatches(&sender, &state, &sender_info_[sender_num]);
+  }
+
+  // Sends NUM_BATCHES batches with 'sender', which must be open, and closes it.
+  void SendBatches(DataStreamSender* sender, RuntimeState* state, SenderInfo* info) {
     scoped_ptr<RowBatch> batch(CreateRowBatch());
-    SenderInfo& info = sender_info_[sender_num];
     int next_val = 0;
     for (int i = 0; i < NUM_BATCHES; ++i) {
       GetNextBatch(batch.get(), &next_val);
-      VLOG_QUERY << "sender " << sender_num << ": #rows=" << batch->num_rows();
-      info.status = sender.Send(&state, batch.get(), false);
-      if (!info.status.ok()) break;
+      VLOG_QUERY << "sender: #rows=" << batch->num_rows();
+      info->status = sender->Send(state, batch.get(), false);
+      if (!info->status.ok()) break;
     }
-    VLOG_QUERY << "closing sender" << sender_num;
-    sender.Close(&state);
-    info.num_bytes_sent = sender.GetNumDataBytesSent();
+    VLOG_QUERY << "closing sender";
+    sender->Close(state);
+    info->num_bytes_sent = sender->GetNumDataBytesSent();
 
     batch->Reset();
   }
 
+  // Runs SendBatches() in a new thread, which the caller owns.
+  thread* StartSendBatches(DataStreamSender* sender, RuntimeState* state,
+      SenderInfo* info) {
+    return new thread(&DataStreamTest::SendBatches, this, sender, state, info);
+  }
+
+  // Waits until 'counter' is positive, or for at most 10s.
+  static void WaitForCounter(RuntimeProfile::Counter* counter) {
+    for (int i = 0; i < 10000 && counter->value() == 0; ++i) SleepForMs(1);
+  }
+
   void TestStream(TPartitionType::type stream_type, int num_senders,
                   int num_receivers, int buffer_size, bool is_merging) {
     VLOG_QUERY << "Testing stream=" << stream_type << " #senders=" << num_senders
@@ -551,6 +569,123 @@ TEST_F(DataStreamTest, Cancel) {
   EXPECT_TRUE(receiver_info_[1].status.IsCancelled());
 }
 
+TEST_F(DataStreamTest, DeferWhenBufferFull) {
+  TUniqueId instance_id;
+  GetNextInstanceId(&instance_id);
+  RuntimeProfile* profile =
+      obj_pool_.Add(new RuntimeProfile(&obj_pool_, "TestReceiver"));
+  // The buffer is smaller than two batches.
+  shared_ptr<DataStreamRecvr> recvr = stream_mgr_->CreateRecvr(&runtime_state_,
+      *row_desc_, instance_id, DEST_NODE_ID, 1, 512, profile, false);
+  scoped_ptr<RowBatch> batch(CreateRowBatch());
+  GetNextBatch(batch.get(), &next_val_);
+  TRowBatch thrift_batch;
+  batch->Serialize(&thrift_batch);
+
+  // A batch is always accepted if the queue is empty.
+  EXPECT_TRUE(
+      stream_mgr_->AddData(instance_id, DEST_NODE_ID, thrift_batch, 0).ok());
+  // The second one would exceed the buffer limit and is turned away without blocking.
+  Status status = stream_mgr_->AddData(instance_id, DEST_NODE_ID, thrift_batch, 0);
+  EXPECT_TRUE(status.IsRecoverableError());
+  // The consumer hasn't removed a batch yet, so the receiver can't tell when it will
+  // have room.
+  TStatus thrift_status;
+  status.ToThrift(&thrift_status);
+  EXPECT_EQ(-1, DataStreamRecvr::GetRetryAfterMs(thrift_status));
+
+  // Once the consumer has removed the first batch, the resent batch is accepted.
+  RowBatch* received_batch;
+  EXPECT_TRUE(recvr->GetBatch(&received_batch).ok());
+  ASSERT_TRUE(received_batch != NULL);
+  EXPECT_EQ(received_batch->num_rows(), BATCH_CAPACITY);
+  EXPECT_TRUE(
+      stream_mgr_->AddData(instance_id, DEST_NODE_ID, thrift_batch, 0).ok());
+  // Now it can, both when turning away a batch and when probed.
+  status = stream_mgr_->AddData(instance_id, DEST_NODE_ID, thrift_batch, 0);
+  EXPECT_TRUE(status.IsRecoverableError());
+  status.ToThrift(&thrift_status);
+  EXPECT_GE(DataStreamRecvr::GetRetryAfterMs(thrift_status), 0);
+  status = stream_mgr_->ProbeData(instance_id, DEST_NODE_ID, 0);
+  EXPECT_TRUE(status.IsRecoverableError());
+  status.ToThrift(&thrift_status);
+  EXPECT_GE(DataStreamRecvr::GetRetryAfterMs(thrift_status), 0);
+  EXPECT_TRUE(stream_mgr_->CloseSender(instance_id, DEST_NODE_ID, 0).ok());
+  EXPECT_TRUE(recvr->GetBatch(&received_batch).ok());
+  ASSERT_TRUE(received_batch != NULL);
+  EXPECT_TRUE(recvr->GetBatch(&received_batch).ok());
+  EXPECT_TRUE(received_batch == NULL);
+  recvr->Close();
+}
+
+// A sender whose batches are turned away by a slow consumer probes the receiver and
+// resends them once there is room, and all rows arrive.
+TEST_F(DataStreamTest, ResendDeferredBatches) {
+  TUniqueId instance_id;
+  GetNextInstanceId(&instance_id);
+  RuntimeProfile* profile =
+      obj_pool_.Add(new RuntimeProfile(&obj_pool_, "TestReceiver"));
+  // The buffer is smaller than one batch, so batches are only added to an empty queue.
+  shared_ptr<DataStreamRecvr> recvr = stream_mgr_->CreateRecvr(&runtime_state_,
+      *row_desc_, instance_id, DEST_NODE_ID, 1, 512, profile, false);
+  RuntimeState state(TPlanFragmentInstanceCtx(), "", &exec_env_);
+  state.set_desc_tbl(desc_tbl_);
+  state.InitMemTrackers(TUniqueId(), NULL, -1);
+  DataStreamSender sender(&obj_pool_, 0, *row_desc_, broadcast_sink_, dest_, 1024);
+  ASSERT_TRUE(sender.Prepare(&state).ok());
+  ASSERT_TRUE(sender.Open(&state).ok());
+  SenderInfo info;
+  scoped_ptr<thread> sender_thread(StartSendBatches(&sender, &state, &info));
+
+  RowBatch* batch;
+  int64_t next_val = 0;
+  while (recvr->GetBatch(&batch).ok() && batch != NULL) {
+    for (int i = 0; i < batch->num_rows(); ++i) {
+      TupleRow* row = batch->GetRow(i);
+      EXPECT_EQ(next_val++, *static_cast<int64_t*>(row->GetTuple(0)->GetSlot(0)));
+    }
+    SleepForMs(20);
+  }
+  sender_thread->join();
+  EXPECT_TRUE(info.status.ok()) << info.status.GetDetail();
+  EXPECT_EQ(NUM_BATCHES * BATCH_CAPACITY, next_val);
+  EXPECT_GT(info.num_bytes_sent, 0);
+  EXPECT_GT(sender.profile()->GetCounter("DeferredBatches")->value(), 0);
+  int64_t num_probes = sender.profile()->GetCounter("ReceiverProbes")->value();
+  EXPECT_GT(num_probes, 0);
+  // The sender waits for as long as the receiver expects the consumer to take, instead
+  // of probing it every few ms while the consumer sleeps.
+  EXPECT_LE(num_probes, 3 * sender.profile()->GetCounter("DeferredBatches")->value());
+  recvr->Close();
+}
+
+// A sender that waits for room at a receiver whose consumer never gets to the stream
+// gives up when its fragment is cancelled.
+TEST_F(DataStreamTest, CancelDeferredSender) {
+  TUniqueId instance_id;
+  GetNextInstanceId(&instance_id);
+  RuntimeProfile* profile =
+      obj_pool_.Add(new RuntimeProfile(&obj_pool_, "TestReceiver"));
+  shared_ptr<DataStreamRecvr> recvr = stream_mgr_->CreateRecvr(&runtime_state_,
+      *row_desc_, instance_id, DEST_NODE_ID, 1, 512, profile, false);
+  RuntimeState state(TPlanFragmentInstanceCtx(), "", &exec_env_);
+  state.set_desc_tbl(desc_tbl_);
+  state.InitMemTrackers(TUniqueId(), NULL, -1);
+  DataStreamSender sender(&obj_pool_, 0, *row_desc_, broadcast_sink_, dest_, 1024);
+  ASSERT_TRUE(sender.Prepare(&state).ok());
+  ASSERT_TRUE(sender.Open(&state).ok());
+  SenderInfo info;
+  scoped_ptr<thread> sender_thread(StartSendBatches(&sender, &state, &info));
+
+  // The first batch fills the buffer. The receiver is probed for the second one.
+  WaitForCounter(sender.profile()->GetCounter("ReceiverProbes"));
+  EXPECT_GT(sender.profile()->GetCounter("DeferredBatches")->value(), 0);
+  state.set_is_cancelled(true);
+  sender_thread->join();
+  EXPECT_TRUE(info.status.IsCancelled()) << info.status.GetDetail();
+  recvr->Close();
+}
+
 TEST_F(DataStreamTest, BasicTest) {
   // TODO: also test that all client connections have been returned
   TPartitionType::type stream_types[] =
@@ -376,20 +376,20 @@ string RowDescriptor::DebugString() const {
 
 Status DescriptorTbl::Create(ObjectPool* pool, const TDescriptorTable& thrift_tbl,
                              DescriptorTbl** tbl) {
-  *tbl = pool->Add(new DescriptorTbl());
+  *tbl = pool->AddInPlace(new (pool) DescriptorTbl());
   // deserialize table descriptors first, they are being referenced by tuple descriptors
   for (size_t i = 0; i < thrift_tbl.tableDescriptors.size(); ++i) {
     const TTableDescriptor& tdesc = thrift_tbl.tableDescriptors[i];
     TableDescriptor* desc = NULL;
     switch (tdesc.tableType) {
       case TTableType::HDFS_TABLE:
-        desc = pool->Add(new HdfsTableDescriptor(tdesc, pool));
+        desc = pool->AddInPlace(new (pool) HdfsTableDescriptor(tdesc, pool));
         break;
       case TTableType::HBASE_TABLE:
-        desc = pool->Add(new HBaseTableDescriptor(tdesc));
+        desc = pool->AddInPlace(new (pool) HBaseTableDescriptor(tdesc));
         break;
       case TTableType::DATA_SOURCE_TABLE:
-        desc = pool->Add(new DataSourceTableDescriptor(tdesc));
+        desc = pool->AddInPlace(new (pool) DataSourceTableDescriptor(tdesc));
         break;
       default:
         DCHECK(false) << "invalid table type: " << tdesc.tableType;
@@ -399,7 +399,7 @@ Status DescriptorTbl::Create(ObjectPool* pool, const TDescriptorTable& thrift_tb
 
   for (size_t i = 0; i < thrift_tbl.tupleDescriptors.size(); ++i) {
     const TTupleDescriptor& tdesc = thrift_tbl.tupleDescriptors[i];
-    TupleDescriptor* desc = pool->Add(new TupleDescriptor(tdesc));
+    TupleDescriptor* desc = pool->AddInPlace(new (pool) TupleDescriptor(tdesc));
     // fix up table pointer
     if (tdesc.__isset.tableId) {
       desc->table_desc_ = (*tbl)->GetTableDescriptor(tdesc.tableId);
@@ -410,7 +410,7 @@ Status DescriptorTbl::Create(ObjectPool* pool, const TDescriptorTable& thrift_tb
 
   for (size_t i = 0; i < thrift_tbl.slotDescriptors.size(); ++i) {
     const TSlotDescriptor& tdesc = thrift_tbl.slotDescriptors[i];
-    SlotDescriptor* slot_d = pool->Add(new SlotDescriptor(tdesc));
+    SlotDescriptor* slot_d = pool->AddInPlace(new (pool) SlotDescriptor(tdesc));
     (*tbl)->slot_desc_map_[tdesc.id] = slot_d;
 
     // link to parent
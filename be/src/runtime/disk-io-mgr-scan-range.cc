@@ -12,6 +12,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "runtime/disk-io-mgr.h"
 #include "runtime/disk-io-mgr-internal.h"
 #include "util/error-util.h"
@@ -157,9 +161,9 @@ void DiskIoMgr::ScanRange::Cancel(const Status& status) {
   buffer_ready_cv_.notify_all();
   CleanupQueuedBuffers();
 
-  // For cached buffers, we can't close the range until the cached buffer is returned.
-  // Close() is called from DiskIoMgr::ReturnBuffer().
-  if (cached_buffer_ == NULL) Close();
+  // For cached or mapped buffers, we can't close the range until the buffer is
+  // returned. Close() is called from DiskIoMgr::ReturnBuffer().
+  if (!has_zero_copy_buffer()) Close();
 }
 
 void DiskIoMgr::ScanRange::CleanupQueuedBuffers() {
@@ -210,6 +214,7 @@ DiskIoMgr::ScanRange::ScanRange(int capacity)
 DiskIoMgr::ScanRange::~ScanRange() {
   DCHECK(hdfs_file_ == NULL) << "File was not closed.";
   DCHECK(cached_buffer_ == NULL) << "Cached buffer was not released.";
+  DCHECK(mapped_buffer_ == NULL) << "Mapped buffer was not released.";
 }
 
 void DiskIoMgr::ScanRange::Reset(hdfsFS fs, const char* file, int64_t len, int64_t offset,
@@ -224,6 +229,8 @@ void DiskIoMgr::ScanRange::Reset(hdfsFS fs, const char* file, int64_t len, int64
   expected_local_ = expected_local;
   meta_data_ = meta_data;
   cached_buffer_ = NULL;
+  mapped_buffer_ = NULL;
+  mapped_len_ = 0;
   io_mgr_ = NULL;
   reader_ = NULL;
   hdfs_file_ = NULL;
@@ -331,6 +338,11 @@ void DiskIoMgr::ScanRange::Close() {
     hdfs_file_ = NULL;
   } else {
     if (local_file_ == NULL) return;
+    if (mapped_buffer_ != NULL) {
+      munmap(mapped_buffer_, mapped_len_);
+      mapped_buffer_ = NULL;
+      mapped_len_ = 0;
+    }
     fclose(local_file_);
     local_file_ = NULL;
   }
@@ -401,14 +413,17 @@ Status DiskIoMgr::ScanRange::Read(char* buffer, int64_t* bytes_read, bool* eosr)
 }
 
 Status DiskIoMgr::ScanRange::ReadFromCache(bool* read_succeeded) {
-  DCHECK(try_cache_);
+  DCHECK(try_zero_copy_read());
   DCHECK_EQ(bytes_read_, 0);
   *read_succeeded = false;
   Status status = Open();
   if (!status.ok()) return status;
 
-  // Cached reads not supported on local filesystem.
-  if (fs_ == NULL) return Status::OK;
+  // Cached reads not supported on local filesystem, but local files can be mapped.
+  if (fs_ == NULL) {
+    if (!io_mgr_->mmap_local_reads_) return Status::OK;
+    return ReadFromMappedFile(read_succeeded);
+  }
 
   {
     unique_lock<mutex> hdfs_lock(hdfs_lock_);
@@ -430,18 +445,59 @@ Status DiskIoMgr::ScanRange::ReadFromCache(bool* read_succeeded) {
   // the block is cached.
   DCHECK_EQ(bytes_read, len());
 
+  EnqueueZeroCopyBuffer(reinterpret_cast<char*>(buffer), bytes_read);
+  *read_succeeded = true;
+  return Status::OK;
+}
+
+Status DiskIoMgr::ScanRange::ReadFromMappedFile(bool* read_succeeded) {
+  DCHECK(fs_ == NULL);
+  *read_succeeded = false;
+  {
+    unique_lock<mutex> hdfs_lock(hdfs_lock_);
+    if (is_cancelled_) return Status::CANCELLED;
+    DCHECK(local_file_ != NULL);
+    DCHECK(mapped_buffer_ == NULL);
+
+    // Accessing a mapping past the end of the file raises SIGBUS, so only map ranges
+    // that are entirely within the file. Any error falls back to the normal read path.
+    int fd = fileno(local_file_);
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || offset_ + len_ > file_stat.st_size) {
+      return Status::OK;
+    }
+    // The mapping must start at a page boundary.
+    static const int64_t page_size = sysconf(_SC_PAGESIZE);
+    int64_t map_offset = offset_ - offset_ % page_size;
+    int64_t map_len = len_ + (offset_ - map_offset);
+    void* mapping = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, fd, map_offset);
+    if (mapping == MAP_FAILED) {
+      VLOG_FILE << "mmap() failed for file " << file_ << ": " << GetStrErrMsg();
+      return Status::OK;
+    }
+    // The range is consumed front to back. Start read-ahead for all of it right away.
+    madvise(mapping, map_len, MADV_SEQUENTIAL);
+    madvise(mapping, map_len, MADV_WILLNEED);
+    mapped_buffer_ = mapping;
+    mapped_len_ = map_len;
+  }
+
+  EnqueueZeroCopyBuffer(
+      reinterpret_cast<char*>(mapped_buffer_) + (mapped_len_ - len_), len_);
+  *read_succeeded = true;
+  return Status::OK;
+}
+
+void DiskIoMgr::ScanRange::EnqueueZeroCopyBuffer(char* buffer, int64_t len) {
   // Create a single buffer desc for the entire scan range and enqueue that.
-  BufferDescriptor* desc = io_mgr_->GetBufferDesc(
-      reader_, this, reinterpret_cast<char*>(buffer), 0);
-  desc->len_ = bytes_read;
+  BufferDescriptor* desc = io_mgr_->GetBufferDesc(reader_, this, buffer, 0);
+  desc->len_ = len;
   desc->scan_range_offset_ = 0;
   desc->eosr_ = true;
-  bytes_read_ = bytes_read;
+  bytes_read_ = len;
   EnqueueBuffer(desc);
   if (reader_->bytes_read_counter_ != NULL) {
-    COUNTER_ADD(reader_->bytes_read_counter_, bytes_read);
+    COUNTER_ADD(reader_->bytes_read_counter_, len);
   }
-  *read_succeeded = true;
   ++reader_->num_used_buffers_;
-  return Status::OK;
 }
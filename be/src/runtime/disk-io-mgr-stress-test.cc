@@ -20,7 +20,8 @@ using namespace impala;
 using namespace std;
 
 // Simple utility to run the disk io stress test.  A optional second parameter
-// can be passed to control how long to run this test (0 for forever).
+// can be passed to control how long to run this test (0 for forever, alternating
+// between reading through io buffers and through mapped files).
 
 // TODO: make these configurable once we decide how to run BE tests with args
 const int DEFAULT_DURATION_SEC = 1;
@@ -28,6 +29,8 @@ const int NUM_DISKS = 5;
 const int NUM_THREADS_PER_DISK = 5;
 const int NUM_CLIENTS = 10;
 const bool TEST_CANCELLATION = true;
+// Duration of each run with and without mmap when running indefinitely.
+const int INDEFINITE_RUN_DURATION_SEC = 60;
 
 int main(int argc, char** argv) {
   google::InitGoogleLogging(argv[0]);
@@ -48,8 +51,17 @@ int main(int argc, char** argv) {
   } else {
     printf("Running stress test indefinitely.\n");
   }
-  DiskIoMgrStress test(NUM_DISKS, NUM_THREADS_PER_DISK, NUM_CLIENTS, TEST_CANCELLATION);
-  test.Run(duration_sec);
+  // Run once with io buffers and once with mapped files to compare the two read paths.
+  // When running indefinitely, alternate between the two so that both are exercised.
+  int run_duration_sec = duration_sec != 0 ? duration_sec : INDEFINITE_RUN_DURATION_SEC;
+  for (int i = 0; duration_sec == 0 || i < 2; ++i) {
+    bool use_mmap = i % 2 == 1;
+    DiskIoMgrStress test(NUM_DISKS, NUM_THREADS_PER_DISK, NUM_CLIENTS, TEST_CANCELLATION,
+        use_mmap);
+    test.Run(run_duration_sec);
+    printf("%s reads: %ld bytes (%.2f MB/s)\n", use_mmap ? "Mapped" : "Buffered",
+        test.bytes_read(), test.bytes_read() / (1024.0 * 1024.0) / run_duration_sec);
+  }
 
   return 0;
 }
@@ -62,9 +62,10 @@ struct DiskIoMgrStress::Client {
 };
 
 DiskIoMgrStress::DiskIoMgrStress(int num_disks, int num_threads_per_disk,
-     int num_clients, bool includes_cancellation) :
+     int num_clients, bool includes_cancellation, bool use_mmap) :
     num_clients_(num_clients),
-    includes_cancellation_(includes_cancellation) {
+    includes_cancellation_(includes_cancellation),
+    bytes_read_(0) {
 
   time_t rand_seed = time(NULL);
   LOG(INFO) << "Running with rand seed: " << rand_seed;
@@ -72,6 +73,7 @@ DiskIoMgrStress::DiskIoMgrStress(int num_disks, int num_threads_per_disk,
 
   io_mgr_.reset(new DiskIoMgr(
       num_disks, num_threads_per_disk, MIN_READ_BUFFER_SIZE, MAX_READ_BUFFER_SIZE));
+  io_mgr_->set_mmap_local_reads(use_mmap);
   Status status = io_mgr_->Init(&dummy_tracker_);
   CHECK(status.ok());
 
@@ -133,6 +135,7 @@ void DiskIoMgrStress::ClientThread(int client_id) {
         buffer->Return();
         buffer = NULL;
         bytes_read += len;
+        bytes_read_ += len;
 
         CHECK_GE(bytes_read, 0);
         CHECK_LE(bytes_read, expected.size());
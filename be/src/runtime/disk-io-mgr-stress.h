@@ -33,14 +33,19 @@ namespace impala {
 // number of clients.  The clients continuously issue work to the io mgr and
 // asynchronously get cancelled.  The stress test can be run forever or for
 // a fixed duration.  The unit test runs this for a fixed duration.
+// If use_mmap is true, the io mgr reads the files by mapping them (see
+// DiskIoMgr::set_mmap_local_reads()).
 class DiskIoMgrStress {
  public:
   DiskIoMgrStress(int num_disks, int num_threads_per_disk, int num_clients,
-      bool includes_cancellation);
+      bool includes_cancellation, bool use_mmap = false);
 
   // Run the test for 'sec'.  If 0, run forever
   void Run(int sec);
 
+  // Total number of bytes returned to the clients so far.
+  int64_t bytes_read() const { return bytes_read_; }
+
  private:
   struct Client;
 
@@ -70,6 +75,9 @@ class DiskIoMgrStress {
   // If true, tests cancelling readers
   bool includes_cancellation_;
 
+  // Total number of bytes returned to the clients.
+  AtomicInt<int64_t> bytes_read_;
+
   // Flag to signal that client reader threads should exit
   volatile bool shutdown_;
 
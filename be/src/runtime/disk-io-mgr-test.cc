@@ -914,6 +914,12 @@ TEST_F(DiskIoMgrTest, StressTest) {
   test.Run(2); // In seconds
 }
 
+// Same as above, reading the files through mmap().
+TEST_F(DiskIoMgrTest, StressTestMmap) {
+  DiskIoMgrStress test(5, 5, 10, true, true);
+  test.Run(2); // In seconds
+}
+
 TEST_F(DiskIoMgrTest, Buffers) {
   // Test default min/max buffer size
   int min_buffer_size = 1024;
@@ -44,6 +44,11 @@ DEFINE_int32(num_s3_io_threads, 16, "number of S3 I/O threads");
 DEFINE_int32(read_size, 8 * 1024 * 1024, "Read Size (in bytes)");
 DEFINE_int32(min_buffer_size, 1024, "The minimum read buffer size (in bytes)");
 
+// Mapped reads avoid copying data that is already in the page cache into io buffers.
+// Files must not be truncated while they are mapped.
+DEFINE_bool(disk_io_mgr_mmap_local_reads, false, "(Advanced) If true, scan ranges of "
+    "local files are read by mapping the file instead of copying into io buffers.");
+
 // With 1024B through 8MB buffers, this is up to ~2GB of buffers.
 DEFINE_int32(max_free_io_buffers, 128,
     "For each io buffer size, the maximum number of buffers the IoMgr will hold onto");
@@ -113,6 +118,12 @@ class DiskIoMgr::RequestContextCache {
     return all_contexts_.size() == inactive_contexts_.size();
   }
 
+  // Returns the number of contexts that are not inactive.
+  int num_active_contexts() {
+    lock_guard<mutex> l(lock_);
+    return all_contexts_.size() - inactive_contexts_.size();
+  }
+
   string DebugString();
 
  private:
@@ -139,6 +150,10 @@ string DiskIoMgr::RequestContextCache::DebugString() {
   return ss.str();
 }
 
+int DiskIoMgr::num_active_contexts() const {
+  return request_context_cache_->num_active_contexts();
+}
+
 string DiskIoMgr::DebugString() {
   stringstream ss;
   ss << "RequestContexts: " << endl << request_context_cache_->DebugString() << endl;
@@ -185,8 +200,8 @@ void DiskIoMgr::BufferDescriptor::Return() {
 }
 
 void DiskIoMgr::BufferDescriptor::SetMemTracker(MemTracker* tracker) {
-  // Cached buffers don't count towards mem usage.
-  if (scan_range_->cached_buffer_ != NULL) return;
+  // Cached and mapped buffers don't count towards mem usage.
+  if (scan_range_->has_zero_copy_buffer()) return;
   if (mem_tracker_ == tracker) return;
   if (mem_tracker_ != NULL) mem_tracker_->Release(buffer_len_);
   mem_tracker_ = tracker;
@@ -221,6 +236,7 @@ DiskIoMgr::DiskIoMgr() :
     max_buffer_size_(FLAGS_read_size),
     min_buffer_size_(FLAGS_min_buffer_size),
     cached_read_options_(NULL),
+    mmap_local_reads_(FLAGS_disk_io_mgr_mmap_local_reads),
     shut_down_(false),
     total_bytes_read_counter_(TUnit::BYTES),
     read_timer_(TUnit::TIME_NS) {
@@ -237,6 +253,7 @@ DiskIoMgr::DiskIoMgr(int num_local_disks, int threads_per_disk, int min_buffer_s
     max_buffer_size_(max_buffer_size),
     min_buffer_size_(min_buffer_size),
     cached_read_options_(NULL),
+    mmap_local_reads_(FLAGS_disk_io_mgr_mmap_local_reads),
     shut_down_(false),
     total_bytes_read_counter_(TUnit::BYTES),
     read_timer_(TUnit::TIME_NS) {
@@ -477,7 +494,7 @@ Status DiskIoMgr::AddScanRanges(RequestContext* reader,
     DCHECK_NE(ranges[i]->len(), 0);
     ScanRange* range = ranges[i];
 
-    if (range->try_cache_) {
+    if (range->try_zero_copy_read()) {
       if (schedule_immediately) {
         bool cached_read_succeeded;
         RETURN_IF_ERROR(range->ReadFromCache(&cached_read_succeeded));
@@ -523,7 +540,7 @@ Status DiskIoMgr::GetNextRange(RequestContext* reader, ScanRange** range) {
     if (!reader->cached_ranges_.empty()) {
       // We have a cached range.
       *range = reader->cached_ranges_.Dequeue();
-      DCHECK((*range)->try_cache_);
+      DCHECK((*range)->try_zero_copy_read());
       bool cached_read_succeeded;
       RETURN_IF_ERROR((*range)->ReadFromCache(&cached_read_succeeded));
       if (cached_read_succeeded) return Status::OK;
@@ -578,8 +595,8 @@ void DiskIoMgr::ReturnBuffer(BufferDescriptor* buffer_desc) {
 
   RequestContext* reader = buffer_desc->reader_;
   if (buffer_desc->buffer_ != NULL) {
-    if (buffer_desc->scan_range_->cached_buffer_ == NULL) {
-      // Not a cached buffer. Return the io buffer and update mem tracking.
+    if (!buffer_desc->scan_range_->has_zero_copy_buffer()) {
+      // Not a cached or mapped buffer. Return the io buffer and update mem tracking.
       ReturnFreeBuffer(buffer_desc);
     }
     buffer_desc->buffer_ = NULL;
@@ -902,9 +919,9 @@ void DiskIoMgr::HandleReadFinished(DiskQueue* disk_queue, RequestContext* reader
 
   bool queue_full = buffer->scan_range_->EnqueueBuffer(buffer);
   if (buffer->eosr_) {
-    // For cached buffers, we can't close the range until the cached buffer is returned.
-    // Close() is called from DiskIoMgr::ReturnBuffer().
-    if (buffer->scan_range_->cached_buffer_ == NULL) {
+    // For cached or mapped buffers, we can't close the range until the buffer is
+    // returned. Close() is called from DiskIoMgr::ReturnBuffer().
+    if (!buffer->scan_range_->has_zero_copy_buffer()) {
       buffer->scan_range_->Close();
     }
   } else {
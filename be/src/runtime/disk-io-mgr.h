@@ -357,12 +357,36 @@ class DiskIoMgr {
     // of bytes read. Updates range to keep track of where in the file we are.
     Status Read(char* buffer, int64_t* bytes_read, bool* eosr);
 
-    // Reads from the DN cache. On success, sets cached_buffer_ to the DN buffer
-    // and *read_succeeded to true.
+    // Returns true if this range should first try to read all of its bytes without
+    // copying them into an io buffer, either from the DN cache or, for local files, by
+    // mapping the file (see DiskIoMgr::set_mmap_local_reads()).
+    bool try_zero_copy_read() const {
+      return try_cache_ || (fs_ == NULL && io_mgr_->mmap_local_reads_);
+    }
+
+    // Returns true if the bytes of this range are in cached_buffer_ or mapped_buffer_
+    // rather than in io buffers. The range cannot be closed until that buffer is
+    // returned.
+    bool has_zero_copy_buffer() const {
+      return cached_buffer_ != NULL || mapped_buffer_ != NULL;
+    }
+
+    // Reads from the DN cache, or from a mapping of the file if this is a local file.
+    // On success, sets cached_buffer_ (or mapped_buffer_) and *read_succeeded to true
+    // and enqueues a single buffer for the entire range.
     // If the data is not cached, returns ok() and *read_succeeded is set to false.
     // Returns a non-ok status if it ran into a non-continuable error.
     Status ReadFromCache(bool* read_succeeded);
 
+    // Maps the bytes of this local file range with mmap() and enqueues them as a single
+    // buffer. If mapping fails (e.g. the range extends past the end of the file),
+    // returns ok() with *read_succeeded set to false so the caller falls back to the
+    // normal read path. Open() must have been called.
+    Status ReadFromMappedFile(bool* read_succeeded);
+
+    // Enqueues a single buffer for the entire range. Used for zero-copy reads.
+    void EnqueueZeroCopyBuffer(char* buffer, int64_t len);
+
     // Pointer to caller specified metadata. This is untouched by the io manager
     // and the caller can put whatever auxiliary data in here.
     void* meta_data_;
@@ -394,6 +418,11 @@ class DiskIoMgr {
     // and all the bytes for the range are in this buffer.
     struct hadoopRzBuffer* cached_buffer_;
 
+    // If non-null, the start of the page-aligned mapping of this local file range of
+    // mapped_len_ bytes. Unmapped in Close(), i.e. once the buffer is returned.
+    void* mapped_buffer_;
+    int64_t mapped_len_;
+
     // Lock protecting fields below.
     // This lock should not be taken during Open/Read/Close.
     boost::mutex lock_;
@@ -491,6 +520,14 @@ class DiskIoMgr {
   // Initialize the IoMgr. Must be called once before any of the other APIs.
   Status Init(MemTracker* process_mem_tracker);
 
+  // If true, ranges of local files are read by mapping them into memory instead of
+  // copying them into io buffers. Such ranges return a single buffer that points into
+  // the mapping and does not count against any mem tracker. Defaults to
+  // --disk_io_mgr_mmap_local_reads. Must be called before any ranges are added.
+  void set_mmap_local_reads(bool mmap_local_reads) {
+    mmap_local_reads_ = mmap_local_reads;
+  }
+
   // Allocates tracking structure for a request context.
   // Register a new request context which is returned in *request_context.
   // The IoMgr owns the allocated RequestContext object. The caller must call
@@ -598,6 +635,10 @@ class DiskIoMgr {
   // Returns the number of buffers currently owned by all readers.
   int num_buffers_in_readers() const { return num_buffers_in_readers_; }
 
+  // Returns the number of request contexts that were registered and not unregistered
+  // yet.
+  int num_active_contexts() const;
+
   // Dumps the disk IoMgr queues (for readers and disks)
   std::string DebugString();
 
@@ -645,6 +686,9 @@ class DiskIoMgr {
   // Options object for cached hdfs reads. Set on startup and never modified.
   struct hadoopRzOptions* cached_read_options_;
 
+  // If true, local file ranges are read via mmap(). See set_mmap_local_reads().
+  bool mmap_local_reads_;
+
   // True if the IoMgr should be torn down. Worker threads watch for this to
   // know to terminate. This variable is read/written to by different threads.
   volatile bool shut_down_;
@@ -46,6 +46,9 @@
 
 DEFINE_bool(serialize_batch, false, "serialize and deserialize each returned row batch");
 DEFINE_int32(status_report_interval, 5, "interval between profile reports; in seconds");
+DEFINE_bool(overlap_codegen, true, "If true, a fragment's IR module is loaded while its "
+    "plan is set up, and its code is compiled while its scan node issues the initial "
+    "scan ranges.");
 DECLARE_bool(enable_rm);
 
 using namespace std;
@@ -61,7 +64,7 @@ PlanFragmentExecutor::PlanFragmentExecutor(ExecEnv* exec_env,
     const ReportStatusCallback& report_status_cb) :
     exec_env_(exec_env), plan_(NULL), report_status_cb_(report_status_cb),
     report_thread_active_(false), done_(false), prepared_(false), closed_(false),
-    has_thread_token_(false), average_thread_tokens_(NULL),
+    has_thread_token_(false), sample_counters_(true), average_thread_tokens_(NULL),
     mem_usage_sampled_counter_(NULL), thread_usage_sampled_counter_(NULL) {
 }
 
@@ -169,17 +172,75 @@ Status PlanFragmentExecutor::Prepare(const TExecPlanFragmentParams& request) {
   }
   has_thread_token_ = true;
 
-  average_thread_tokens_ = profile()->AddSamplingCounter("AverageThreadTokens",
-      bind<int64_t>(mem_fn(&ThreadResourceMgr::ResourcePool::num_threads),
-          runtime_state_->resource_pool()));
-  mem_usage_sampled_counter_ = profile()->AddTimeSeriesCounter("MemoryUsage",
-      TUnit::BYTES,
-      bind<int64_t>(mem_fn(&MemTracker::consumption),
-          runtime_state_->instance_mem_tracker()));
-  thread_usage_sampled_counter_ = profile()->AddTimeSeriesCounter("ThreadUsage",
-      TUnit::UNIT,
-      bind<int64_t>(mem_fn(&ThreadResourceMgr::ResourcePool::num_threads),
-          runtime_state_->resource_pool()));
+  if (sample_counters_) {
+    average_thread_tokens_ = profile()->AddSamplingCounter("AverageThreadTokens",
+        bind<int64_t>(mem_fn(&ThreadResourceMgr::ResourcePool::num_threads),
+            runtime_state_->resource_pool()));
+    mem_usage_sampled_counter_ = profile()->AddTimeSeriesCounter("MemoryUsage",
+        TUnit::BYTES,
+        bind<int64_t>(mem_fn(&MemTracker::consumption),
+            runtime_state_->instance_mem_tracker()));
+    thread_usage_sampled_counter_ = profile()->AddTimeSeriesCounter("ThreadUsage",
+        TUnit::UNIT,
+        bind<int64_t>(mem_fn(&ThreadResourceMgr::ResourcePool::num_threads),
+            runtime_state_->resource_pool()));
+  }
+
+  // Loading the cross-compiled IR module doesn't depend on the descriptor table or the
+  // plan, so do it while they are set up if the plan is going to need it.
+  scoped_ptr<Thread> codegen_thread;
+  Status codegen_status;
+  if (FLAGS_overlap_codegen && runtime_state_->codegen_enabled() &&
+      PlanUsesCodegen(request.fragment.plan)) {
+    codegen_thread.reset(new Thread("plan-fragment-executor", "create-codegen",
+        &PlanFragmentExecutor::CreateCodegen, this, &codegen_status));
+  }
+  Status status = CreatePlanTree(request);
+  if (codegen_thread.get() != NULL) {
+    codegen_thread->Join();
+    if (status.ok()) status = codegen_status;
+  }
+  RETURN_IF_ERROR(status);
+
+  RuntimeProfile::Counter* prepare_timer = ADD_TIMER(profile(), "PrepareTime");
+  {
+    SCOPED_TIMER(prepare_timer);
+    RETURN_IF_ERROR(plan_->Prepare(runtime_state_.get()));
+  }
+
+  PrintVolumeIds(params.per_node_scan_ranges);
+
+  // set up sink, if required
+  if (request.fragment.__isset.output_sink) {
+    RETURN_IF_ERROR(DataSink::CreateDataSink(
+        obj_pool(), request.fragment.output_sink, request.fragment.output_exprs,
+        params, row_desc(), &sink_));
+    RETURN_IF_ERROR(sink_->Prepare(runtime_state()));
+
+    RuntimeProfile* sink_profile = sink_->profile();
+    if (sink_profile != NULL) {
+      profile()->AddChild(sink_profile);
+    }
+  } else {
+    sink_.reset(NULL);
+  }
+
+  // set up profile counters
+  profile()->AddChild(plan_->runtime_profile());
+  rows_produced_counter_ =
+      ADD_COUNTER(profile(), "RowsProduced", TUnit::UNIT);
+  per_host_mem_usage_ =
+      ADD_COUNTER(profile(), PER_HOST_PEAK_MEM_COUNTER, TUnit::BYTES);
+
+  row_batch_.reset(new RowBatch(plan_->row_desc(), runtime_state_->batch_size(),
+        runtime_state_->instance_mem_tracker()));
+  VLOG(2) << "plan_root=\n" << plan_->DebugString();
+  prepared_ = true;
+  return Status::OK;
+}
+
+Status PlanFragmentExecutor::CreatePlanTree(const TExecPlanFragmentParams& request) {
+  const TPlanFragmentExecParams& params = request.params;
 
   // set up desc tbl
   DescriptorTbl* desc_tbl = NULL;
@@ -226,42 +287,22 @@ Status PlanFragmentExecutor::Prepare(const TExecPlanFragmentParams& request) {
         params.per_node_scan_ranges, scan_node->id(), no_scan_ranges);
     scan_node->SetScanRanges(scan_ranges);
   }
+  return Status::OK;
+}
 
-  RuntimeProfile::Counter* prepare_timer = ADD_TIMER(profile(), "PrepareTime");
-  {
-    SCOPED_TIMER(prepare_timer);
-    RETURN_IF_ERROR(plan_->Prepare(runtime_state_.get()));
-  }
-
-  PrintVolumeIds(params.per_node_scan_ranges);
-
-  // set up sink, if required
-  if (request.fragment.__isset.output_sink) {
-    RETURN_IF_ERROR(DataSink::CreateDataSink(
-        obj_pool(), request.fragment.output_sink, request.fragment.output_exprs,
-        params, row_desc(), &sink_));
-    RETURN_IF_ERROR(sink_->Prepare(runtime_state()));
+void PlanFragmentExecutor::CreateCodegen(Status* status) {
+  LlvmCodeGen* codegen;
+  *status = runtime_state_->GetCodegen(&codegen);
+}
 
-    RuntimeProfile* sink_profile = sink_->profile();
-    if (sink_profile != NULL) {
-      profile()->AddChild(sink_profile);
+bool PlanFragmentExecutor::PlanUsesCodegen(const TPlan& plan) {
+  BOOST_FOREACH(const TPlanNode& node, plan.nodes) {
+    if (node.node_type == TPlanNodeType::AGGREGATION_NODE ||
+        node.node_type == TPlanNodeType::HASH_JOIN_NODE) {
+      return true;
     }
-  } else {
-    sink_.reset(NULL);
   }
-
-  // set up profile counters
-  profile()->AddChild(plan_->runtime_profile());
-  rows_produced_counter_ =
-      ADD_COUNTER(profile(), "RowsProduced", TUnit::UNIT);
-  per_host_mem_usage_ =
-      ADD_COUNTER(profile(), PER_HOST_PEAK_MEM_COUNTER, TUnit::BYTES);
-
-  row_batch_.reset(new RowBatch(plan_->row_desc(), runtime_state_->batch_size(),
-        runtime_state_->instance_mem_tracker()));
-  VLOG(2) << "plan_root=\n" << plan_->DebugString();
-  prepared_ = true;
-  return Status::OK;
+  return false;
 }
 
 void PlanFragmentExecutor::OptimizeLlvmModule() {
@@ -312,9 +353,18 @@ Status PlanFragmentExecutor::Open() {
     report_thread_active_ = true;
   }
 
-  OptimizeLlvmModule();
+  Status status;
+  if (FLAGS_overlap_codegen && runtime_state_->codegen_created()) {
+    // Compile the fragment's code while the scan node starts reading.
+    Thread codegen_thread("plan-fragment-executor", "optimize-llvm-module",
+        &PlanFragmentExecutor::OptimizeLlvmModule, this);
+    status = StartScanIo();
+    codegen_thread.Join();
+  } else {
+    OptimizeLlvmModule();
+  }
 
-  Status status = OpenInternal();
+  if (status.ok()) status = OpenInternal();
   if (!status.ok() && !status.IsCancelled() && !status.IsMemLimitExceeded()) {
     // Log error message in addition to returning in Status. Queries that do not
     // fetch results (e.g. insert) may not receive the message directly and can
@@ -325,6 +375,14 @@ Status PlanFragmentExecutor::Open() {
   return status;
 }
 
+Status PlanFragmentExecutor::StartScanIo() {
+  vector<ExecNode*> scan_nodes;
+  plan_->CollectScanNodes(&scan_nodes);
+  if (scan_nodes.size() != 1) return Status::OK;
+  SCOPED_TIMER(profile()->total_time_counter());
+  return static_cast<ScanNode*>(scan_nodes[0])->StartIo(runtime_state_.get());
+}
+
 Status PlanFragmentExecutor::OpenInternal() {
   {
     SCOPED_TIMER(profile()->total_time_counter());
@@ -552,9 +610,11 @@ void PlanFragmentExecutor::ReleaseThreadToken() {
     if (runtime_state_->query_resource_mgr() != NULL) {
       runtime_state_->query_resource_mgr()->NotifyThreadUsageChange(-1);
     }
-    PeriodicCounterUpdater::StopSamplingCounter(average_thread_tokens_);
-    PeriodicCounterUpdater::StopTimeSeriesCounter(
-        thread_usage_sampled_counter_);
+    if (sample_counters_) {
+      PeriodicCounterUpdater::StopSamplingCounter(average_thread_tokens_);
+      PeriodicCounterUpdater::StopTimeSeriesCounter(
+          thread_usage_sampled_counter_);
+    }
   }
 }
 
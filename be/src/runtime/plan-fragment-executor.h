@@ -37,6 +37,7 @@ class DataStreamMgr;
 class RuntimeProfile;
 class RuntimeState;
 class TRowBatch;
+class TPlan;
 class TPlanExecRequest;
 class TPlanFragment;
 class TPlanFragmentExecParams;
@@ -92,6 +93,12 @@ class PlanFragmentExecutor {
   // The query will be aborted (MEM_LIMIT_EXCEEDED) if it goes over that limit.
   Status Prepare(const TExecPlanFragmentParams& request);
 
+  // If set to false before Prepare(), the fragment's profile gets none of the counters
+  // that are periodically sampled, which saves registering and unregistering them with
+  // PeriodicCounterUpdater. Used for coordinator-only queries, which are expected to
+  // finish before the first sample is taken.
+  void set_sample_counters(bool sample_counters) { sample_counters_ = sample_counters; }
+
   // Start execution. Call this prior to GetNext().
   // If this fragment has a sink, Open() will send all rows produced
   // by the fragment to that sink. Therefore, Open() may block until
@@ -198,6 +205,10 @@ class PlanFragmentExecutor {
   // additional tokens.
   // This is a measure of how much CPU resources this fragment used during the course
   // of the execution.
+  // If false, average_thread_tokens_, mem_usage_sampled_counter_ and
+  // thread_usage_sampled_counter_ are not created.
+  bool sample_counters_;
+
   RuntimeProfile::Counter* average_thread_tokens_;
 
   // Stopwatch for this entire fragment. Started in Prepare(), stopped in Close().
@@ -246,6 +257,26 @@ class PlanFragmentExecutor {
   // in level order).
   void OptimizeLlvmModule();
 
+  // Creates the codegen object of runtime_state_, loading the cross-compiled IR module,
+  // and stores the result in 'status'. Run in a separate thread by Prepare() while the
+  // descriptor table and the plan tree are set up.
+  void CreateCodegen(Status* status);
+
+  // Returns true if 'plan' contains a node that always generates code when codegen is
+  // enabled, so the codegen object is worth creating before the plan is prepared.
+  static bool PlanUsesCodegen(const TPlan& plan);
+
+  // Sets up the descriptor table and creates the plan tree, with the number of senders
+  // of its exchange nodes and the scan ranges of its scan nodes set. Called by
+  // Prepare().
+  Status CreatePlanTree(const TExecPlanFragmentParams& request);
+
+  // Lets the scan node of the fragment start reading its initial scan ranges. Called by
+  // Open() while OptimizeLlvmModule() runs in a separate thread. Does nothing if the
+  // fragment has more than one scan node, since only one scan node of a fragment can
+  // register for thread tokens at a time.
+  Status StartScanIo();
+
   // Executes Open() logic and returns resulting status. Does not set status_.
   // If this plan fragment has no sink, OpenInternal() does nothing.
   // If this plan fragment has a sink and OpenInternal() returns without an
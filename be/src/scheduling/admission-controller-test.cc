@@ -0,0 +1,140 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <boost/scoped_ptr.hpp>
+#include <gtest/gtest.h>
+
+#include "common/init.h"
+#include "common/object-pool.h"
+#include "scheduling/admission-controller.h"
+#include "scheduling/request-pool-service.h"
+#include "statestore/query-schedule.h"
+#include "util/metrics.h"
+#include "util/runtime-profile.h"
+
+using namespace boost;
+using namespace impala;
+using namespace std;
+
+DECLARE_int64(default_pool_max_requests);
+DECLARE_int64(default_pool_max_queued);
+DECLARE_int64(queue_wait_timeout_ms);
+
+namespace impala {
+
+// The pool that all requests resolve to without a fair scheduler configuration.
+static const string POOL_NAME = "default-pool";
+
+class AdmissionControllerTest : public testing::Test {
+ protected:
+  ObjectPool pool_;
+  TQueryExecRequest request_;
+  TQueryOptions query_options_;
+  scoped_ptr<MetricGroup> metrics_;
+  scoped_ptr<RequestPoolService> request_pool_service_;
+  scoped_ptr<AdmissionController> admission_controller_;
+
+  virtual void SetUp() {
+    FLAGS_default_pool_max_requests = 1;
+    FLAGS_default_pool_max_queued = 10;
+    // Requests that are queued time out quickly instead of blocking the test.
+    FLAGS_queue_wait_timeout_ms = 100;
+    metrics_.reset(new MetricGroup("admission-controller-test"));
+    request_pool_service_.reset(new RequestPoolService(metrics_.get()));
+    admission_controller_.reset(new AdmissionController(request_pool_service_.get(),
+        metrics_.get(), "localhost:22000"));
+  }
+
+  QuerySchedule* MakeSchedule(bool is_coord_only) {
+    RuntimeProfile* summary_profile = pool_.Add(new RuntimeProfile(&pool_, "Summary"));
+    QuerySchedule* schedule = pool_.Add(new QuerySchedule(TUniqueId(), request_,
+        query_options_, "user", summary_profile,
+        summary_profile->AddEventSequence("Query Timeline")));
+    schedule->set_request_pool(POOL_NAME);
+    schedule->set_num_hosts(1);
+    schedule->set_is_coord_only(is_coord_only);
+    return schedule;
+  }
+
+  static string AdmissionResult(QuerySchedule* schedule) {
+    const string* result =
+        schedule->summary_profile()->GetInfoString("Admission result");
+    return result == NULL ? "" : *result;
+  }
+};
+
+// Coordinator-only queries are admitted when other queries would be queued, and count
+// as running queries until they are released.
+TEST_F(AdmissionControllerTest, CoordOnlyQueryNotQueued) {
+  QuerySchedule* query = MakeSchedule(false);
+  EXPECT_TRUE(admission_controller_->AdmitQuery(query).ok());
+  EXPECT_TRUE(query->is_admitted());
+  EXPECT_EQ("Admitted immediately", AdmissionResult(query));
+
+  QuerySchedule* coord_only_query = MakeSchedule(true);
+  EXPECT_TRUE(admission_controller_->AdmitQuery(coord_only_query).ok());
+  EXPECT_TRUE(coord_only_query->is_admitted());
+  EXPECT_EQ("Admitted immediately (coordinator-only query)",
+      AdmissionResult(coord_only_query));
+
+  QuerySchedule* queued_query = MakeSchedule(false);
+  EXPECT_FALSE(admission_controller_->AdmitQuery(queued_query).ok());
+  EXPECT_FALSE(queued_query->is_admitted());
+  EXPECT_EQ("Timed out (queued)", AdmissionResult(queued_query));
+
+  // The pool is full until both running queries are released.
+  EXPECT_TRUE(admission_controller_->ReleaseQuery(query).ok());
+  queued_query = MakeSchedule(false);
+  EXPECT_FALSE(admission_controller_->AdmitQuery(queued_query).ok());
+  EXPECT_TRUE(admission_controller_->ReleaseQuery(coord_only_query).ok());
+  query = MakeSchedule(false);
+  EXPECT_TRUE(admission_controller_->AdmitQuery(query).ok());
+  EXPECT_EQ("Admitted immediately", AdmissionResult(query));
+  EXPECT_TRUE(admission_controller_->ReleaseQuery(query).ok());
+}
+
+// Coordinator-only queries are rejected by pools that admit no queries, and by pools
+// whose queue is full.
+TEST_F(AdmissionControllerTest, CoordOnlyQueryRejected) {
+  FLAGS_default_pool_max_requests = 0;
+  QuerySchedule* coord_only_query = MakeSchedule(true);
+  Status status = admission_controller_->AdmitQuery(coord_only_query);
+  EXPECT_FALSE(status.ok());
+  EXPECT_NE(status.GetDetail().find("disabled by requests limit set to 0"),
+      string::npos) << status.GetDetail();
+  EXPECT_FALSE(coord_only_query->is_admitted());
+  EXPECT_EQ("Rejected", AdmissionResult(coord_only_query));
+
+  FLAGS_default_pool_max_requests = 1;
+  FLAGS_default_pool_max_queued = 0;
+  QuerySchedule* query = MakeSchedule(false);
+  EXPECT_TRUE(admission_controller_->AdmitQuery(query).ok());
+  coord_only_query = MakeSchedule(true);
+  status = admission_controller_->AdmitQuery(coord_only_query);
+  EXPECT_FALSE(status.ok());
+  EXPECT_NE(status.GetDetail().find("queue full"), string::npos) << status.GetDetail();
+  EXPECT_FALSE(coord_only_query->is_admitted());
+  // Releasing a query that was not admitted is a no-op.
+  EXPECT_TRUE(admission_controller_->ReleaseQuery(coord_only_query).ok());
+  EXPECT_TRUE(admission_controller_->ReleaseQuery(query).ok());
+}
+
+}
+
+int main(int argc, char **argv) {
+  InitCommonRuntime(argc, argv, false);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -85,6 +85,8 @@ const string QUERY_EVENT_COMPLETED_ADMISSION = "Completed admission";
 // Profile info string for admission result
 const string PROFILE_INFO_KEY_ADMISSION_RESULT = "Admission result";
 const string PROFILE_INFO_VAL_ADMIT_IMMEDIATELY = "Admitted immediately";
+const string PROFILE_INFO_VAL_ADMIT_COORD_ONLY =
+    "Admitted immediately (coordinator-only query)";
 const string PROFILE_INFO_VAL_ADMIT_QUEUED = "Admitted (queued)";
 const string PROFILE_INFO_VAL_REJECTED = "Rejected";
 const string PROFILE_INFO_VAL_TIME_OUT = "Timed out (queued)";
@@ -293,15 +295,31 @@ Status AdmissionController::AdmitQuery(QuerySchedule* schedule) {
     VLOG_QUERY << "Stats: " << DebugPoolStats(pool_name, total_stats, local_stats);
 
     admitStatus = CanAdmitRequest(pool_name, max_requests, mem_limit, *schedule, false);
-    if (admitStatus.ok()) {
+    if (!admitStatus.ok()) {
+      Status rejectStatus = RejectRequest(pool_name, max_requests, mem_limit,
+          max_queued, *schedule);
+      if (!rejectStatus.ok()) {
+        schedule->set_is_admitted(false);
+        schedule->summary_profile()->AddInfoString(PROFILE_INFO_KEY_ADMISSION_RESULT,
+            PROFILE_INFO_VAL_REJECTED);
+        if (pool_metrics != NULL) pool_metrics->local_rejected->Increment(1L);
+        return rejectStatus;
+      }
+    }
+
+    // Coordinator-only queries would be queued, but they don't use any resources of
+    // other backends and finish too quickly to be worth waiting for. They still count
+    // as running queries of the pool.
+    if (admitStatus.ok() || schedule->is_coord_only()) {
       // Execute immediately
       pools_for_updates_.insert(pool_name);
       // The local and total stats get incremented together when we queue so if
       // there were any locally queued queries we should not admit immediately.
-      DCHECK_EQ(local_stats->num_queued, 0);
+      DCHECK(!admitStatus.ok() || local_stats->num_queued == 0);
       schedule->set_is_admitted(true);
       schedule->summary_profile()->AddInfoString(PROFILE_INFO_KEY_ADMISSION_RESULT,
-          PROFILE_INFO_VAL_ADMIT_IMMEDIATELY);
+          admitStatus.ok() ? PROFILE_INFO_VAL_ADMIT_IMMEDIATELY :
+          PROFILE_INFO_VAL_ADMIT_COORD_ONLY);
       ++total_stats->num_running;
       ++local_stats->num_running;
       int64_t mem_estimate = schedule->GetClusterMemoryEstimate();
@@ -317,16 +335,6 @@ Status AdmissionController::AdmitQuery(QuerySchedule* schedule) {
       return Status::OK;
     }
 
-    Status rejectStatus = RejectRequest(pool_name, max_requests, mem_limit, max_queued,
-        *schedule);
-    if (!rejectStatus.ok()) {
-      schedule->set_is_admitted(false);
-      schedule->summary_profile()->AddInfoString(PROFILE_INFO_KEY_ADMISSION_RESULT,
-          PROFILE_INFO_VAL_REJECTED);
-      if (pool_metrics != NULL) pool_metrics->local_rejected->Increment(1L);
-      return rejectStatus;
-    }
-
     // We cannot immediately admit but do not need to reject, so queue the request
     VLOG_QUERY << "Queuing, query id=" << schedule->query_id();
     DCHECK_LT(total_stats->num_queued, max_queued);
@@ -85,7 +85,9 @@ class AdmissionController {
   ~AdmissionController();
 
   // Submits the request for admission. Returns immediately if rejected, but
-  // otherwise blocks until the request is admitted. When this method returns,
+  // otherwise blocks until the request is admitted. Coordinator-only queries (see
+  // QuerySchedule::is_coord_only()) are subject to the same rejection checks, but are
+  // admitted instead of being queued. When this method returns,
   // schedule->is_admitted() is true if and only if the request was admitted.
   // For all calls to AdmitQuery(), ReleaseQuery() should also be called after
   // the query completes to ensure that the pool statistics are updated.
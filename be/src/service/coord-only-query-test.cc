@@ -0,0 +1,151 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <boost/scoped_ptr.hpp>
+#include <gtest/gtest.h>
+
+#include "common/init.h"
+#include "rpc/thrift-client.h"
+#include "service/fe-support.h"
+#include "service/impala-server.h"
+#include "testutil/in-process-servers.h"
+#include "util/impalad-metrics.h"
+
+using namespace apache::hive::service::cli::thrift;
+using namespace boost;
+using namespace impala;
+using namespace std;
+
+DECLARE_int32(be_port);
+DECLARE_int32(beeswax_port);
+DECLARE_bool(enable_coord_only_queries);
+
+typedef ThriftClient<ImpalaHiveServer2ServiceClient> Hs2Client;
+
+// Runs queries that take the coordinator-only path through HS2 and checks when the
+// client learns that it has fetched all rows.
+class CoordOnlyQueryTest : public testing::Test {
+ protected:
+  static InProcessImpalaServer* impala_;
+
+  scoped_ptr<Hs2Client> client_;
+  TSessionHandle session_;
+
+  static void SetUpTestCase() {
+    impala_ = new InProcessImpalaServer("localhost", FLAGS_be_port, 0, 0, "", 0);
+    EXIT_IF_ERROR(impala_->StartWithClientServers(
+        FLAGS_beeswax_port, FLAGS_beeswax_port + 1, false));
+  }
+
+  virtual void SetUp() {
+    FLAGS_enable_coord_only_queries = true;
+    client_.reset(new Hs2Client("localhost", FLAGS_beeswax_port + 1));
+    ASSERT_TRUE(client_->Open().ok());
+    TOpenSessionResp response;
+    TOpenSessionReq request;
+    // Results are returned row by row, which makes them easy to count.
+    request.__set_client_protocol(TProtocolVersion::HIVE_CLI_SERVICE_PROTOCOL_V1);
+    client_->iface()->OpenSession(response, request);
+    ASSERT_EQ(TStatusCode::SUCCESS_STATUS, response.status.statusCode);
+    session_ = response.sessionHandle;
+  }
+
+  virtual void TearDown() {
+    TCloseSessionResp response;
+    TCloseSessionReq request;
+    request.__set_sessionHandle(session_);
+    client_->iface()->CloseSession(response, request);
+    client_->Close();
+  }
+
+  TOperationHandle Execute(const string& stmt) {
+    TExecuteStatementResp response;
+    TExecuteStatementReq request;
+    request.sessionHandle = session_;
+    request.__set_statement(stmt);
+    client_->iface()->ExecuteStatement(response, request);
+    EXPECT_EQ(TStatusCode::SUCCESS_STATUS, response.status.statusCode)
+        << response.status.errorMessage;
+    return response.operationHandle;
+  }
+
+  // Fetches up to 'max_rows' rows and returns the number of rows fetched.
+  // 'has_more_rows' is set to what the server reports.
+  int Fetch(const TOperationHandle& operation, int max_rows, bool* has_more_rows) {
+    TFetchResultsResp response;
+    TFetchResultsReq request;
+    request.operationHandle = operation;
+    request.maxRows = max_rows;
+    client_->iface()->FetchResults(response, request);
+    EXPECT_EQ(TStatusCode::SUCCESS_STATUS, response.status.statusCode)
+        << response.status.errorMessage;
+    *has_more_rows = response.hasMoreRows;
+    return response.results.rows.size();
+  }
+
+  void CloseOperation(const TOperationHandle& operation) {
+    TCloseOperationResp response;
+    TCloseOperationReq request;
+    request.operationHandle = operation;
+    client_->iface()->CloseOperation(response, request);
+    EXPECT_EQ(TStatusCode::SUCCESS_STATUS, response.status.statusCode);
+  }
+};
+
+InProcessImpalaServer* CoordOnlyQueryTest::impala_ = NULL;
+
+// The fetch that returns the last rows also reports that there are no more rows.
+TEST_F(CoordOnlyQueryTest, EosWithLastRows) {
+  int64_t num_coord_only_queries = ImpaladMetrics::NUM_COORD_ONLY_QUERIES->value();
+  TOperationHandle operation = Execute("select 1");
+  EXPECT_EQ(num_coord_only_queries + 1, ImpaladMetrics::NUM_COORD_ONLY_QUERIES->value());
+  bool has_more_rows;
+  EXPECT_EQ(1, Fetch(operation, 1024, &has_more_rows));
+  EXPECT_FALSE(has_more_rows);
+  CloseOperation(operation);
+}
+
+// The end of the results is only looked for once the client has fetched all rows of
+// the current batch.
+TEST_F(CoordOnlyQueryTest, EosAfterBatchIsReturned) {
+  TOperationHandle operation = Execute("select 1 union all select 2");
+  bool has_more_rows;
+  EXPECT_EQ(1, Fetch(operation, 1, &has_more_rows));
+  EXPECT_TRUE(has_more_rows);
+  EXPECT_EQ(1, Fetch(operation, 1, &has_more_rows));
+  EXPECT_FALSE(has_more_rows);
+  CloseOperation(operation);
+}
+
+// Without the fast path, the client needs another fetch to learn that it has all rows.
+TEST_F(CoordOnlyQueryTest, Disabled) {
+  FLAGS_enable_coord_only_queries = false;
+  int64_t num_coord_only_queries = ImpaladMetrics::NUM_COORD_ONLY_QUERIES->value();
+  TOperationHandle operation = Execute("select 1");
+  EXPECT_EQ(num_coord_only_queries, ImpaladMetrics::NUM_COORD_ONLY_QUERIES->value());
+  bool has_more_rows;
+  EXPECT_EQ(1, Fetch(operation, 1024, &has_more_rows));
+  EXPECT_TRUE(has_more_rows);
+  EXPECT_EQ(0, Fetch(operation, 1024, &has_more_rows));
+  EXPECT_FALSE(has_more_rows);
+  CloseOperation(operation);
+}
+
+int main(int argc, char** argv) {
+  InitCommonRuntime(argc, argv, true);
+  InitFeSupport();
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
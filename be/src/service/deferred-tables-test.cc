@@ -0,0 +1,151 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "service/deferred-tables.h"
+
+using namespace impala;
+using namespace std;
+
+static const string ENTRY_KEY = "TABLE:db.tbl";
+
+// Returns the table db.tbl with metadata, as sent by the catalog server.
+static TCatalogObject LoadedTable(int64_t catalog_version) {
+  TCatalogObject table;
+  table.type = TCatalogObjectType::TABLE;
+  table.catalog_version = catalog_version;
+  table.table.db_name = "db";
+  table.table.tbl_name = "tbl";
+  table.table.__set_table_type(TTableType::HDFS_TABLE);
+  table.__isset.table = true;
+  return table;
+}
+
+// The frontend only replaces a table in its catalog with a newer version.
+static void ApplyToCatalog(const TCatalogObject& update, TCatalogObject* table) {
+  if (update.catalog_version > table->catalog_version) *table = update;
+}
+
+// An unreferenced table is replaced by an unloaded table, which the frontend replaces
+// with the fetched metadata once a query references the table.
+TEST(DeferredTablesTest, DeferLoadQuery) {
+  DeferredTables tables;
+  TCatalogObject topic_update = LoadedTable(5);
+  EXPECT_TRUE(tables.Defer(ENTRY_KEY, &topic_update));
+  EXPECT_EQ(1, tables.num_deferred());
+  EXPECT_EQ(TCatalogObjectType::TABLE, topic_update.type);
+  EXPECT_EQ("db", topic_update.table.db_name);
+  EXPECT_EQ("tbl", topic_update.table.tbl_name);
+  EXPECT_FALSE(topic_update.table.__isset.table_type);
+  TCatalogObject local_table = topic_update;
+
+  // Further topic updates are deferred as well.
+  topic_update = LoadedTable(6);
+  EXPECT_TRUE(tables.Defer(ENTRY_KEY, &topic_update));
+  EXPECT_FALSE(topic_update.table.__isset.table_type);
+  ApplyToCatalog(topic_update, &local_table);
+  EXPECT_EQ(1, tables.num_deferred());
+
+  // A query references the table. Its metadata is fetched once, also if it did not
+  // change since the last topic update, and replaces the unloaded table.
+  EXPECT_TRUE(tables.StartLoad(ENTRY_KEY));
+  EXPECT_FALSE(tables.StartLoad(ENTRY_KEY));
+  EXPECT_EQ(0, tables.num_deferred());
+  TCatalogObject fetched_table = LoadedTable(6);
+  ApplyToCatalog(fetched_table, &local_table);
+  EXPECT_TRUE(local_table.table.__isset.table_type);
+  EXPECT_EQ(6, local_table.catalog_version);
+
+  // Topic updates of the queried table are applied in full.
+  topic_update = LoadedTable(7);
+  EXPECT_FALSE(tables.Defer(ENTRY_KEY, &topic_update));
+  EXPECT_TRUE(topic_update.table.__isset.table_type);
+  ApplyToCatalog(topic_update, &local_table);
+  EXPECT_EQ(7, local_table.catalog_version);
+}
+
+// Unloaded tables are older than any table from the catalog server.
+TEST(DeferredTablesTest, UnloadedTableVersion) {
+  DeferredTables tables;
+  TCatalogObject table = LoadedTable(1);
+  EXPECT_TRUE(tables.Defer(ENTRY_KEY, &table));
+  EXPECT_EQ(DeferredTables::UNLOADED_TABLE_CATALOG_VERSION, table.catalog_version);
+  EXPECT_LT(table.catalog_version, 1);
+}
+
+// Tables whose metadata could not be fetched are fetched again by the next query.
+TEST(DeferredTablesTest, LoadFailed) {
+  DeferredTables tables;
+  TCatalogObject table = LoadedTable(5);
+  EXPECT_TRUE(tables.Defer(ENTRY_KEY, &table));
+  EXPECT_TRUE(tables.StartLoad(ENTRY_KEY));
+  tables.LoadFailed(vector<string>(1, ENTRY_KEY));
+  EXPECT_EQ(1, tables.num_deferred());
+  EXPECT_TRUE(tables.StartLoad(ENTRY_KEY));
+  EXPECT_FALSE(tables.StartLoad(ENTRY_KEY));
+}
+
+// Tables that were never deferred, e.g. because a query referenced them before their
+// first topic update, are not fetched and their topic updates are applied in full.
+TEST(DeferredTablesTest, ReferencedBeforeUpdate) {
+  DeferredTables tables;
+  EXPECT_FALSE(tables.StartLoad(ENTRY_KEY));
+  TCatalogObject table = LoadedTable(5);
+  EXPECT_FALSE(tables.Defer(ENTRY_KEY, &table));
+  EXPECT_EQ(5, table.catalog_version);
+  EXPECT_EQ(0, tables.num_deferred());
+}
+
+// Tables modified by DDL on this impalad are kept up to date. Dropped tables are
+// forgotten, so a re-created table is deferred again.
+TEST(DeferredTablesTest, MarkReferencedAndRemove) {
+  DeferredTables tables;
+  TCatalogObject table = LoadedTable(5);
+  EXPECT_TRUE(tables.Defer(ENTRY_KEY, &table));
+  tables.MarkReferenced(ENTRY_KEY);
+  EXPECT_EQ(0, tables.num_deferred());
+  table = LoadedTable(6);
+  EXPECT_FALSE(tables.Defer(ENTRY_KEY, &table));
+
+  tables.Remove(ENTRY_KEY);
+  table = LoadedTable(7);
+  EXPECT_TRUE(tables.Defer(ENTRY_KEY, &table));
+  EXPECT_EQ(1, tables.num_deferred());
+  tables.Remove(ENTRY_KEY);
+  EXPECT_EQ(0, tables.num_deferred());
+}
+
+// A full topic update defers all unreferenced tables again.
+TEST(DeferredTablesTest, ClearDeferred) {
+  DeferredTables tables;
+  TCatalogObject table = LoadedTable(5);
+  EXPECT_TRUE(tables.Defer(ENTRY_KEY, &table));
+  TCatalogObject other_table = LoadedTable(5);
+  EXPECT_TRUE(tables.Defer("TABLE:db.other", &other_table));
+  EXPECT_TRUE(tables.StartLoad("TABLE:db.other"));
+  tables.ClearDeferred();
+  EXPECT_EQ(0, tables.num_deferred());
+  EXPECT_FALSE(tables.StartLoad(ENTRY_KEY));
+  // Referenced tables stay referenced.
+  other_table = LoadedTable(6);
+  EXPECT_FALSE(tables.Defer("TABLE:db.other", &other_table));
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,77 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "service/deferred-tables.h"
+
+#include <algorithm>
+
+#include "common/logging.h"
+
+using namespace boost;
+using namespace impala;
+using namespace std;
+
+const int64_t DeferredTables::UNLOADED_TABLE_CATALOG_VERSION;
+
+bool DeferredTables::Defer(const string& entry_key, TCatalogObject* catalog_object) {
+  DCHECK_EQ(catalog_object->type, TCatalogObjectType::TABLE);
+  lock_guard<mutex> l(lock_);
+  if (referenced_.find(entry_key) != referenced_.end()) return false;
+  // The frontend treats a table without metadata like a table that the catalog server
+  // has not loaded yet, and asks for it to be loaded when a query references it.
+  TCatalogObject unloaded_table;
+  unloaded_table.type = TCatalogObjectType::TABLE;
+  unloaded_table.catalog_version = UNLOADED_TABLE_CATALOG_VERSION;
+  unloaded_table.table.db_name = catalog_object->table.db_name;
+  unloaded_table.table.tbl_name = catalog_object->table.tbl_name;
+  unloaded_table.__isset.table = true;
+  swap(*catalog_object, unloaded_table);
+  deferred_.insert(entry_key);
+  return true;
+}
+
+bool DeferredTables::StartLoad(const string& entry_key) {
+  lock_guard<mutex> l(lock_);
+  // Topic updates for this table are applied in full from now on, including any that
+  // arrive while its metadata is fetched.
+  referenced_.insert(entry_key);
+  return deferred_.erase(entry_key) > 0;
+}
+
+void DeferredTables::LoadFailed(const vector<string>& entry_keys) {
+  lock_guard<mutex> l(lock_);
+  deferred_.insert(entry_keys.begin(), entry_keys.end());
+}
+
+void DeferredTables::MarkReferenced(const string& entry_key) {
+  lock_guard<mutex> l(lock_);
+  deferred_.erase(entry_key);
+  referenced_.insert(entry_key);
+}
+
+void DeferredTables::Remove(const string& entry_key) {
+  lock_guard<mutex> l(lock_);
+  deferred_.erase(entry_key);
+  referenced_.erase(entry_key);
+}
+
+void DeferredTables::ClearDeferred() {
+  lock_guard<mutex> l(lock_);
+  deferred_.clear();
+}
+
+int DeferredTables::num_deferred() {
+  lock_guard<mutex> l(lock_);
+  return deferred_.size();
+}
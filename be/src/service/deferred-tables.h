@@ -0,0 +1,84 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPALA_SERVICE_DEFERRED_TABLES_H
+#define IMPALA_SERVICE_DEFERRED_TABLES_H
+
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_set.hpp>
+
+#include "gen-cpp/CatalogObjects_types.h"
+
+namespace impala {
+
+// Tracks which tables of the catalog topic have their metadata applied to the local
+// catalog, see --load_catalog_tables_on_demand. Tables are identified by their topic
+// entry keys.
+// The metadata of a table that no query on this impalad has referenced is replaced
+// with an unloaded table (see Defer()). The frontend asks for such a table to be
+// loaded when a query references it, which marks the table as referenced (see
+// StartLoad()). From then on, its topic updates are applied in full.
+// Thread-safe.
+class DeferredTables {
+ public:
+  // Catalog version of the unloaded tables created by Defer(). It is lower than the
+  // version of any object from the catalog server, so that the frontend replaces an
+  // unloaded table with its metadata once that is fetched, even if the table did not
+  // change in the meantime.
+  static const int64_t UNLOADED_TABLE_CATALOG_VERSION = 0;
+
+  // If the table 'catalog_object' with the topic entry key 'entry_key' was not
+  // referenced, replaces it with an unloaded table that only has the table's name,
+  // records it as deferred and returns true. Returns false and leaves 'catalog_object'
+  // unchanged otherwise.
+  bool Defer(const std::string& entry_key, TCatalogObject* catalog_object);
+
+  // Marks the table as referenced. Returns true if it was deferred, in which case the
+  // caller must fetch its metadata and call LoadFailed() if that does not succeed.
+  bool StartLoad(const std::string& entry_key);
+
+  // Records the tables as deferred again after their metadata could not be fetched or
+  // applied, so that they are fetched again when the next query references them.
+  void LoadFailed(const std::vector<std::string>& entry_keys);
+
+  // Marks the table as referenced without fetching its metadata, e.g. because the
+  // caller applies its metadata itself.
+  void MarkReferenced(const std::string& entry_key);
+
+  // Forgets the table, e.g. because it was dropped.
+  void Remove(const std::string& entry_key);
+
+  // Forgets all deferred tables, e.g. because a full topic update replaces the whole
+  // local catalog. Referenced tables stay referenced.
+  void ClearDeferred();
+
+  // Number of deferred tables.
+  int num_deferred();
+
+ private:
+  // Protects all fields below.
+  boost::mutex lock_;
+
+  // Tables whose metadata was replaced with an unloaded table by Defer().
+  boost::unordered_set<std::string> deferred_;
+
+  // Tables that were referenced by a query on this impalad.
+  boost::unordered_set<std::string> referenced_;
+};
+
+}
+
+#endif
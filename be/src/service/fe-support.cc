@@ -283,9 +283,17 @@ Java_com_cloudera_impala_service_FeSupport_NativePrioritizeLoad(
   TPrioritizeLoadRequest request;
   DeserializeThriftMsg(env, thrift_struct, &request);
 
-  CatalogOpExecutor catalog_op_executor(ExecEnv::GetInstance(), NULL, NULL);
   TPrioritizeLoadResponse result;
-  Status status = catalog_op_executor.PrioritizeLoad(request, &result);
+  Status status;
+  // Tables whose metadata this impalad has not applied yet can be loaded without waiting
+  // for the catalog server.
+  ImpalaServer* impala_server = ExecEnv::GetInstance()->impala_server();
+  if (impala_server != NULL) {
+    status = impala_server->LoadTablesOnDemand(request.object_descs);
+    if (!status.ok()) LOG(WARNING) << status.GetDetail();
+  }
+  CatalogOpExecutor catalog_op_executor(ExecEnv::GetInstance(), NULL, NULL);
+  status = catalog_op_executor.PrioritizeLoad(request, &result);
   if (!status.ok()) {
     LOG(ERROR) << status.GetDetail();
     // Create a new Status, copy in this error, then update the result.
@@ -181,7 +181,7 @@ void ImpalaServer::query(QueryHandle& query_handle, const Query& query) {
   // raise Syntax error or access violation; it's likely to be syntax/analysis error
   // TODO: that may not be true; fix this
   shared_ptr<QueryExecState> exec_state;
-  RAISE_IF_ERROR(Execute(&query_ctx, session, &exec_state),
+  RAISE_IF_ERROR(Execute(&query_ctx, session, false, &exec_state),
       SQLSTATE_SYNTAX_ERROR_OR_ACCESS_VIOLATION);
 
   exec_state->UpdateQueryState(QueryState::RUNNING);
@@ -222,7 +222,7 @@ void ImpalaServer::executeAndWait(QueryHandle& query_handle, const Query& query,
 
   // raise Syntax error or access violation; it's likely to be syntax/analysis error
   // TODO: that may not be true; fix this
-  RAISE_IF_ERROR(Execute(&query_ctx, session, &exec_state),
+  RAISE_IF_ERROR(Execute(&query_ctx, session, false, &exec_state),
       SQLSTATE_SYNTAX_ERROR_OR_ACCESS_VIOLATION);
 
   exec_state->UpdateQueryState(QueryState::RUNNING);
@@ -359,9 +359,10 @@ QueryState::type ImpalaServer::get_state(const QueryHandle& handle) {
   QueryHandleToTUniqueId(handle, &query_id);
   VLOG_ROW << "get_state(): query_id=" << PrintId(query_id);
 
-  lock_guard<mutex> l(query_exec_state_map_lock_);
-  QueryExecStateMap::iterator entry = query_exec_state_map_.find(query_id);
-  if (entry != query_exec_state_map_.end()) {
+  QueryExecStateMap::Shard& shard = query_exec_state_map_.GetShard(query_id);
+  lock_guard<mutex> l(shard.lock);
+  QueryExecStateMap::Map::iterator entry = shard.map.find(query_id);
+  if (entry != shard.map.end()) {
     return entry->second->query_state();
   } else {
     VLOG_QUERY << "ImpalaServer::get_state invalid handle";
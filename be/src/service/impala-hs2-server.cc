@@ -74,6 +74,12 @@ namespace impala {
 
 const string IMPALA_RESULT_CACHING_OPT = "impala.resultset.cache.size";
 
+// Execute statement option that marks a statement as a prepared statement. Set to
+// "true" for statements that a client runs repeatedly. The plan of a prepared
+// statement is cached, so executing the same statement again in a session with the
+// same settings skips parsing, analysis and planning.
+const string IMPALA_PREPARED_STMT_OPT = "impala.prepared.statement";
+
 // Utility functions for computing the size of HS2 Thrift structs in bytes.
 static inline
 int64_t ByteSize(const thrift::TColumnValue& val) {
@@ -539,6 +545,7 @@ Status ImpalaServer::TExecuteStatementReqToTQueryContext(
     map<string, string>::const_iterator conf_itr = execute_request.confOverlay.begin();
     for (; conf_itr != execute_request.confOverlay.end(); ++conf_itr) {
       if (conf_itr->first == IMPALA_RESULT_CACHING_OPT) continue;
+      if (conf_itr->first == IMPALA_PREPARED_STMT_OPT) continue;
       if (conf_itr->first == ChildQuery::PARENT_QUERY_OPT) {
         if (ParseId(conf_itr->second, &query_ctx->parent_query_id)) {
           query_ctx->__isset.parent_query_id = true;
@@ -564,9 +571,8 @@ void ImpalaServer::OpenSession(TOpenSessionResp& return_val,
   // Generate session ID and the secret
   TUniqueId session_id;
   {
-    lock_guard<mutex> l(uuid_lock_);
-    uuid secret = uuid_generator_();
-    uuid session_uuid = uuid_generator_();
+    uuid secret = GenerateRandomUUID();
+    uuid session_uuid = GenerateRandomUUID();
     return_val.sessionHandle.sessionId.guid.assign(
         session_uuid.begin(), session_uuid.end());
     return_val.sessionHandle.sessionId.secret.assign(secret.begin(), secret.end());
@@ -621,14 +627,17 @@ void ImpalaServer::OpenSession(TOpenSessionResp& return_val,
 
   // Put the session state in session_state_map_
   {
-    lock_guard<mutex> l(session_state_map_lock_);
-    session_state_map_.insert(make_pair(session_id, state));
+    SessionStateMap::Shard& shard = session_state_map_.GetShard(session_id);
+    lock_guard<mutex> l(shard.lock);
+    shard.map.insert(make_pair(session_id, state));
   }
 
   {
-    lock_guard<mutex> l(connection_to_sessions_map_lock_);
     const TUniqueId& connection_id = ThriftServer::GetThreadConnectionId();
-    connection_to_sessions_map_[connection_id].push_back(session_id);
+    ConnectionToSessionMap::Shard& shard =
+        connection_to_sessions_map_.GetShard(connection_id);
+    lock_guard<mutex> l(shard.lock);
+    shard.map[connection_id].push_back(session_id);
   }
 
   ImpaladMetrics::IMPALA_SERVER_NUM_OPEN_HS2_SESSIONS->Increment(1L);
@@ -704,6 +713,7 @@ void ImpalaServer::ExecuteStatement(TExecuteStatementResp& return_val,
 
   // Optionally enable result caching to allow restarting fetches.
   int64_t cache_num_rows = -1;
+  bool is_prepared_stmt = false;
   if (request.__isset.confOverlay) {
     map<string, string>::const_iterator iter =
         request.confOverlay.find(IMPALA_RESULT_CACHING_OPT);
@@ -717,10 +727,21 @@ void ImpalaServer::ExecuteStatement(TExecuteStatementResp& return_val,
                 iter->second, IMPALA_RESULT_CACHING_OPT)), SQLSTATE_GENERAL_ERROR);
       }
     }
+    iter = request.confOverlay.find(IMPALA_PREPARED_STMT_OPT);
+    if (iter != request.confOverlay.end()) {
+      StringParser::ParseResult parse_result;
+      is_prepared_stmt = StringParser::StringToBool(
+          iter->second.c_str(), iter->second.size(), &parse_result);
+      if (parse_result != StringParser::PARSE_SUCCESS) {
+        HS2_RETURN_IF_ERROR(
+            return_val, Status(Substitute("Invalid value '$0' for '$1' option.",
+                iter->second, IMPALA_PREPARED_STMT_OPT)), SQLSTATE_GENERAL_ERROR);
+      }
+    }
   }
 
   shared_ptr<QueryExecState> exec_state;
-  status = Execute(&query_ctx, session, &exec_state);
+  status = Execute(&query_ctx, session, is_prepared_stmt, &exec_state);
   HS2_RETURN_IF_ERROR(return_val, status, SQLSTATE_GENERAL_ERROR);
 
   // Optionally enable result caching on the QueryExecState.
@@ -899,9 +920,10 @@ void ImpalaServer::GetOperationStatus(TGetOperationStatusResp& return_val,
       request.operationHandle.operationId, &query_id, &secret), SQLSTATE_GENERAL_ERROR);
   VLOG_ROW << "GetOperationStatus(): query_id=" << PrintId(query_id);
 
-  lock_guard<mutex> l(query_exec_state_map_lock_);
-  QueryExecStateMap::iterator entry = query_exec_state_map_.find(query_id);
-  if (entry != query_exec_state_map_.end()) {
+  QueryExecStateMap::Shard& shard = query_exec_state_map_.GetShard(query_id);
+  lock_guard<mutex> l(shard.lock);
+  QueryExecStateMap::Map::iterator entry = shard.map.find(query_id);
+  if (entry != shard.map.end()) {
     QueryState::type query_state = entry->second->query_state();
     TOperationState::type operation_state = QueryStateToTOperationState(query_state);
     return_val.__set_operationState(operation_state);
@@ -966,8 +988,8 @@ void ImpalaServer::GetResultSetMetadata(TGetResultSetMetadataResp& return_val,
       request.operationHandle.operationId, &query_id, &secret), SQLSTATE_GENERAL_ERROR);
   VLOG_QUERY << "GetResultSetMetadata(): query_id=" << PrintId(query_id);
 
-  // Look up the session ID (which takes session_state_map_lock_) before taking the query
-  // exec state lock.
+  // Look up the session ID (which takes a query_exec_state_map_ shard lock) before taking
+  // the query exec state lock.
   TUniqueId session_id;
   if (!GetSessionIdForQuery(query_id, &session_id)) {
     HS2_RETURN_ERROR(return_val, "Invalid query handle", SQLSTATE_GENERAL_ERROR);
@@ -25,6 +25,7 @@
 #include "gen-cpp/beeswax_types.h"
 #include "thrift/protocol/TDebugProtocol.h"
 #include "util/redactor.h"
+#include "util/string-parser.h"
 #include "util/summary-util.h"
 #include "util/url-coding.h"
 
@@ -102,6 +103,11 @@ void ImpalaServer::RegisterWebserverCallbacks(Webserver* webserver) {
       query_plan_text_callback, false);
   webserver->RegisterUrlCallback("/query_stmt", "query_stmt.tmpl",
       query_plan_text_callback, false);
+
+  Webserver::UrlCallback archived_queries_callback =
+      bind<void>(mem_fn(&ImpalaServer::ArchivedQueriesUrlCallback), this, _1, _2);
+  webserver->RegisterUrlCallback("/archived_queries", "archived_queries.tmpl",
+      archived_queries_callback);
 }
 
 void ImpalaServer::HadoopVarzUrlCallback(const Webserver::ArgumentMap& args,
@@ -200,16 +206,102 @@ void ImpalaServer::QueryProfileEncodedUrlCallback(const Webserver::ArgumentMap&
 
 void ImpalaServer::InflightQueryIdsUrlCallback(const Webserver::ArgumentMap& args,
     Document* document) {
-  lock_guard<mutex> l(query_exec_state_map_lock_);
   stringstream ss;
-  BOOST_FOREACH(const QueryExecStateMap::value_type& exec_state, query_exec_state_map_) {
-    ss << exec_state.second->query_id() << "\n";
+  for (int i = 0; i < QueryExecStateMap::num_shards; ++i) {
+    QueryExecStateMap::Shard& shard = query_exec_state_map_.shard(i);
+    lock_guard<mutex> l(shard.lock);
+    BOOST_FOREACH(const QueryExecStateMap::Map::value_type& exec_state, shard.map) {
+      ss << exec_state.second->query_id() << "\n";
+    }
   }
   document->AddMember(Webserver::ENABLE_RAW_JSON_KEY, true, document->GetAllocator());
   Value query_ids(ss.str().c_str(), document->GetAllocator());
   document->AddMember("contents", query_ids, document->GetAllocator());
 }
 
+void ImpalaServer::ArchivedQueriesUrlCallback(const Webserver::ArgumentMap& args,
+    Document* document) {
+  if (profile_archive_.get() == NULL) {
+    Value error("The profile archive is disabled, see --archive_query_profiles",
+        document->GetAllocator());
+    document->AddMember("error", error, document->GetAllocator());
+    return;
+  }
+
+  int limit = 100;
+  int64_t before = 0;
+  int64_t before_seq = 0;
+  Webserver::ArgumentMap::const_iterator it = args.find("limit");
+  if (it != args.end()) {
+    StringParser::ParseResult result;
+    limit = StringParser::StringToInt<int>(it->second.c_str(), it->second.size(),
+        &result);
+    if (result != StringParser::PARSE_SUCCESS || limit <= 0) {
+      Value error(Substitute("Invalid 'limit' argument: $0", it->second).c_str(),
+          document->GetAllocator());
+      document->AddMember("error", error, document->GetAllocator());
+      return;
+    }
+  }
+  it = args.find("before");
+  if (it != args.end()) {
+    StringParser::ParseResult result;
+    before = StringParser::StringToInt<int64_t>(it->second.c_str(), it->second.size(),
+        &result);
+    if (result != StringParser::PARSE_SUCCESS) {
+      Value error(Substitute("Invalid 'before' argument: $0", it->second).c_str(),
+          document->GetAllocator());
+      document->AddMember("error", error, document->GetAllocator());
+      return;
+    }
+  }
+  it = args.find("before_seq");
+  if (it != args.end()) {
+    StringParser::ParseResult result;
+    before_seq = StringParser::StringToInt<int64_t>(it->second.c_str(),
+        it->second.size(), &result);
+    if (result != StringParser::PARSE_SUCCESS) {
+      Value error(Substitute("Invalid 'before_seq' argument: $0", it->second).c_str(),
+          document->GetAllocator());
+      document->AddMember("error", error, document->GetAllocator());
+      return;
+    }
+  }
+
+  vector<ProfileArchive::Entry> entries;
+  profile_archive_->GetEntries(before, before_seq, limit, &entries);
+  Value archived_queries(kArrayType);
+  BOOST_FOREACH(const ProfileArchive::Entry& entry, entries) {
+    Value entry_json(kObjectType);
+    Value query_id(PrintId(entry.query_id).c_str(), document->GetAllocator());
+    entry_json.AddMember("query_id", query_id, document->GetAllocator());
+    Value user(entry.effective_user.c_str(), document->GetAllocator());
+    entry_json.AddMember("effective_user", user, document->GetAllocator());
+    Value stmt(entry.stmt.c_str(), document->GetAllocator());
+    entry_json.AddMember("stmt", stmt, document->GetAllocator());
+    Value state(entry.query_state.c_str(), document->GetAllocator());
+    entry_json.AddMember("state", state, document->GetAllocator());
+    Value start_time(entry.start_time.c_str(), document->GetAllocator());
+    entry_json.AddMember("start_time", start_time, document->GetAllocator());
+    Value end_time(entry.end_time.c_str(), document->GetAllocator());
+    entry_json.AddMember("end_time", end_time, document->GetAllocator());
+    entry_json.AddMember("archive_time", entry.archive_time_ms,
+        document->GetAllocator());
+    archived_queries.PushBack(entry_json, document->GetAllocator());
+  }
+  document->AddMember("archived_queries", archived_queries, document->GetAllocator());
+  document->AddMember("num_archived_queries", profile_archive_->num_archived_queries(),
+      document->GetAllocator());
+  document->AddMember("num_dropped_profiles", profile_archive_->num_dropped_profiles(),
+      document->GetAllocator());
+  if (entries.size() == limit) {
+    document->AddMember("next_before", entries.back().archive_time_ms,
+        document->GetAllocator());
+    document->AddMember("next_before_seq", entries.back().sequence,
+        document->GetAllocator());
+  }
+}
+
 void ImpalaServer::QueryStateToJson(const ImpalaServer::QueryStateRecord& record,
     Value* value, Document* document) {
   Value user(record.effective_user.c_str(), document->GetAllocator());
@@ -267,10 +359,10 @@ void ImpalaServer::QueryStateToJson(const ImpalaServer::QueryStateRecord& record
 void ImpalaServer::QueryStateUrlCallback(const Webserver::ArgumentMap& args,
     Document* document) {
   set<QueryStateRecord, QueryStateRecord> sorted_query_records;
-  {
-    lock_guard<mutex> l(query_exec_state_map_lock_);
-    BOOST_FOREACH(
-        const QueryExecStateMap::value_type& exec_state, query_exec_state_map_) {
+  for (int i = 0; i < QueryExecStateMap::num_shards; ++i) {
+    QueryExecStateMap::Shard& shard = query_exec_state_map_.shard(i);
+    lock_guard<mutex> l(shard.lock);
+    BOOST_FOREACH(const QueryExecStateMap::Map::value_type& exec_state, shard.map) {
       // TODO: Do this in the browser so that sorts on other keys are possible.
       sorted_query_records.insert(QueryStateRecord(*exec_state.second));
     }
@@ -318,50 +410,54 @@ void ImpalaServer::QueryStateUrlCallback(const Webserver::ArgumentMap& args,
 
 void ImpalaServer::SessionsUrlCallback(const Webserver::ArgumentMap& args,
     Document* document) {
-  lock_guard<mutex> l(session_state_map_lock_);
   Value sessions(kArrayType);
-  BOOST_FOREACH(const SessionStateMap::value_type& session, session_state_map_) {
-    shared_ptr<SessionState> state = session.second;
-    Value session_json(kObjectType);
-    Value type(PrintTSessionType(state->session_type).c_str(),
-        document->GetAllocator());
-    session_json.AddMember("type", type, document->GetAllocator());
+  for (int i = 0; i < SessionStateMap::num_shards; ++i) {
+    SessionStateMap::Shard& shard = session_state_map_.shard(i);
+    lock_guard<mutex> l(shard.lock);
+    BOOST_FOREACH(const SessionStateMap::Map::value_type& session, shard.map) {
+      shared_ptr<SessionState> state = session.second;
+      Value session_json(kObjectType);
+      Value type(PrintTSessionType(state->session_type).c_str(),
+          document->GetAllocator());
+      session_json.AddMember("type", type, document->GetAllocator());
 
-    session_json.AddMember("num_queries", state->inflight_queries.size(),
-        document->GetAllocator());
+      session_json.AddMember("num_queries", state->inflight_queries.size(),
+          document->GetAllocator());
 
-    Value user(state->connected_user.c_str(), document->GetAllocator());
-    session_json.AddMember("user", user, document->GetAllocator());
+      Value user(state->connected_user.c_str(), document->GetAllocator());
+      session_json.AddMember("user", user, document->GetAllocator());
 
-    Value delegated_user(state->do_as_user.c_str(), document->GetAllocator());
-    session_json.AddMember("delegated_user", delegated_user, document->GetAllocator());
+      Value delegated_user(state->do_as_user.c_str(), document->GetAllocator());
+      session_json.AddMember("delegated_user", delegated_user, document->GetAllocator());
 
-    Value session_id(PrintId(session.first).c_str(), document->GetAllocator());
-    session_json.AddMember("session_id", session_id, document->GetAllocator());
+      Value session_id(PrintId(session.first).c_str(), document->GetAllocator());
+      session_json.AddMember("session_id", session_id, document->GetAllocator());
 
-    Value network_address(lexical_cast<string>(state->network_address).c_str(),
-        document->GetAllocator());
-    session_json.AddMember("network_address", network_address, document->GetAllocator());
+      Value network_address(lexical_cast<string>(state->network_address).c_str(),
+          document->GetAllocator());
+      session_json.AddMember("network_address", network_address,
+          document->GetAllocator());
 
-    Value default_db(state->database.c_str(), document->GetAllocator());
-    session_json.AddMember("default_database", default_db, document->GetAllocator());
+      Value default_db(state->database.c_str(), document->GetAllocator());
+      session_json.AddMember("default_database", default_db, document->GetAllocator());
 
-    Value start_time(state->start_time.DebugString().c_str(), document->GetAllocator());
-    session_json.AddMember("start_time", start_time, document->GetAllocator());
+      Value start_time(state->start_time.DebugString().c_str(), document->GetAllocator());
+      session_json.AddMember("start_time", start_time, document->GetAllocator());
 
-    Value last_accessed(
-        TimestampValue(session.second->last_accessed_ms / 1000).DebugString().c_str(),
-        document->GetAllocator());
-    session_json.AddMember("last_accessed", last_accessed, document->GetAllocator());
+      Value last_accessed(
+          TimestampValue(session.second->last_accessed_ms / 1000).DebugString().c_str(),
+          document->GetAllocator());
+      session_json.AddMember("last_accessed", last_accessed, document->GetAllocator());
 
-    session_json.AddMember("expired", state->expired, document->GetAllocator());
-    session_json.AddMember("closed", state->closed, document->GetAllocator());
-    session_json.AddMember("ref_count", state->ref_count, document->GetAllocator());
-    sessions.PushBack(session_json, document->GetAllocator());
+      session_json.AddMember("expired", state->expired, document->GetAllocator());
+      session_json.AddMember("closed", state->closed, document->GetAllocator());
+      session_json.AddMember("ref_count", state->ref_count, document->GetAllocator());
+      sessions.PushBack(session_json, document->GetAllocator());
+    }
   }
 
   document->AddMember("sessions", sessions, document->GetAllocator());
-  document->AddMember("num_sessions", session_state_map_.size(), document->GetAllocator());
+  document->AddMember("num_sessions", sessions.Size(), document->GetAllocator());
 }
 
 void ImpalaServer::CatalogUrlCallback(const Webserver::ArgumentMap& args,
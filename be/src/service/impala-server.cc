@@ -39,6 +39,7 @@
 #include "catalog/catalog-util.h"
 #include "common/logging.h"
 #include "common/version.h"
+#include "exec/catalog-op-executor.h"
 #include "rpc/authentication.h"
 #include "rpc/thrift-util.h"
 #include "rpc/thrift-thread.h"
@@ -51,6 +52,7 @@
 #include "runtime/tmp-file-mgr.h"
 #include "service/fragment-exec-state.h"
 #include "service/impala-internal-service.h"
+#include "service/plan-cache.h"
 #include "service/query-exec-state.h"
 #include "service/query-options.h"
 #include "statestore/simple-scheduler.h"
@@ -63,6 +65,7 @@
 #include "util/network-util.h"
 #include "util/parse-util.h"
 #include "util/redactor.h"
+#include "util/stopwatch.h"
 #include "util/string-parser.h"
 #include "util/summary-util.h"
 #include "util/uid-util.h"
@@ -100,7 +103,8 @@ DEFINE_string(default_query_options, "", "key=value pair of default query option
     " impalad, separated by ','");
 DEFINE_int32(query_log_size, 25, "Number of queries to retain in the query log. If -1, "
     "the query log has unbounded size.");
-DEFINE_bool(log_query_to_file, true, "if true, logs completed query profiles to file.");
+DEFINE_bool(log_query_to_file, true, "if true, logs completed query profiles to file. "
+    "Only used if the query profile archive is disabled, see --archive_query_profiles.");
 
 DEFINE_int64(max_result_cache_size, 100000L, "Maximum number of query results a client "
     "may request to be cached on a per-query basis to support restarting fetches. This "
@@ -126,6 +130,14 @@ DEFINE_string(profile_log_dir, "", "The directory in which profile log files are
     " written. If blank, defaults to <log_file_dir>/profiles");
 DEFINE_int32(max_profile_log_file_size, 5000, "The maximum size (in queries) of the "
     "profile log file before a new one is created");
+DEFINE_bool(archive_query_profiles, true, "If true, the profiles of completed queries "
+    "are written in the background to a compact binary archive that can be browsed on "
+    "the debug webpages, see --profile_archive_dir. The archive replaces the profile "
+    "log of --log_query_to_file.");
+DEFINE_string(profile_archive_dir, "", "The directory in which the query profile "
+    "archive is written. If blank, defaults to <log_file_dir>/profile_archive");
+DEFINE_int32(max_archived_queries, 10000, "The maximum number of queries kept in the "
+    "query profile archive. The profiles of older queries are deleted.");
 
 DEFINE_int32(cancellation_thread_pool_size, 5,
     "(Advanced) Size of the thread-pool processing cancellations due to node failure");
@@ -152,6 +164,17 @@ DEFINE_int32(idle_query_timeout, 0, "The time, in seconds, that a query may be i
 
 DEFINE_string(local_nodemanager_url, "", "The URL of the local Yarn Node Manager's HTTP "
     "interface, used to detect if the Node Manager fails");
+DEFINE_int32(plan_cache_capacity, 1024, "(Advanced) Maximum number of query plans to "
+    "cache. Plans of HiveServer2 prepared statements, and of all queries if "
+    "--plan_cache_all_queries is true, are cached and reused when the same statement "
+    "is run again with the same session settings. If 0, plans are never cached.");
+DEFINE_bool(plan_cache_all_queries, false, "(Advanced) If true, the plans of all "
+    "queries are cached, not just those of HiveServer2 prepared statements.");
+DEFINE_bool(load_catalog_tables_on_demand, false, "(Advanced) If true, table metadata "
+    "from the catalog topic is only applied to the local catalog for tables that were "
+    "referenced by a query on this impalad. The metadata of other tables is fetched from "
+    "the catalog server when a query first references them.");
+
 DECLARE_bool(enable_rm);
 DECLARE_bool(compact_catalog_topic);
 
@@ -166,6 +189,13 @@ namespace impala {
 // relative to UTC. The same time zone change was made for the audit log, but the
 // version was kept at 1.0 because there is no known consumer of the timestamp.
 const string PROFILE_LOG_FILE_PREFIX = "impala_profile_log_1.1-";
+
+// Number of profiles in each file of the profile archive.
+const int PROFILE_ARCHIVE_FILE_SIZE = 1000;
+
+// Number of profiles that may wait to be written to the profile archive before
+// further profiles are dropped.
+const int MAX_QUEUED_ARCHIVE_PROFILES = 1000;
 const string AUDIT_EVENT_LOG_FILE_PREFIX = "impala_audit_event_log_1.0-";
 const string LINEAGE_LOG_FILE_PREFIX = "impala_lineage_log_1.0-";
 
@@ -240,7 +270,17 @@ ImpalaServer::ImpalaServer(ExecEnv* exec_env)
     }
   }
 
-  if (!InitProfileLogging().ok()) {
+  Status archive_status = InitProfileArchive();
+  if (!archive_status.ok()) {
+    LOG(ERROR) << "Query profile archive is disabled: " << archive_status.GetDetail();
+    profile_archive_.reset();
+  }
+
+  // The profile log is only written if there is no archive, which holds the same
+  // profiles without encoding them on the query path.
+  if (profile_archive_.get() != NULL) {
+    FLAGS_log_query_to_file = false;
+  } else if (!InitProfileLogging().ok()) {
     LOG(ERROR) << "Query profile archival is disabled";
     FLAGS_log_query_to_file = false;
   }
@@ -284,6 +324,10 @@ ImpalaServer::ImpalaServer(ExecEnv* exec_env)
     }
   }
 
+  if (FLAGS_plan_cache_capacity > 0) {
+    plan_cache_.reset(new PlanCache(FLAGS_plan_cache_capacity));
+  }
+
   RegisterWebserverCallbacks(exec_env->webserver());
 
   // Initialize impalad metrics
@@ -523,14 +567,29 @@ Status ImpalaServer::InitProfileLogging() {
   return Status::OK;
 }
 
+Status ImpalaServer::InitProfileArchive() {
+  if (!FLAGS_archive_query_profiles) return Status::OK;
+
+  if (FLAGS_profile_archive_dir.empty()) {
+    stringstream ss;
+    ss << FLAGS_log_dir << "/profile_archive/";
+    FLAGS_profile_archive_dir = ss.str();
+  }
+  profile_archive_.reset(new ProfileArchive(FLAGS_profile_archive_dir,
+      PROFILE_ARCHIVE_FILE_SIZE, FLAGS_max_archived_queries,
+      MAX_QUEUED_ARCHIVE_PROFILES));
+  return profile_archive_->Init();
+}
+
 Status ImpalaServer::GetRuntimeProfileStr(const TUniqueId& query_id,
     bool base64_encoded, stringstream* output) {
   DCHECK(output != NULL);
   // Search for the query id in the active query map
   {
-    lock_guard<mutex> l(query_exec_state_map_lock_);
-    QueryExecStateMap::const_iterator exec_state = query_exec_state_map_.find(query_id);
-    if (exec_state != query_exec_state_map_.end()) {
+    QueryExecStateMap::Shard& shard = query_exec_state_map_.GetShard(query_id);
+    lock_guard<mutex> l(shard.lock);
+    QueryExecStateMap::Map::const_iterator exec_state = shard.map.find(query_id);
+    if (exec_state != shard.map.end()) {
       if (base64_encoded) {
         exec_state->second->profile().SerializeToArchiveString(output);
       } else {
@@ -544,18 +603,33 @@ Status ImpalaServer::GetRuntimeProfileStr(const TUniqueId& query_id,
   {
     lock_guard<mutex> l(query_log_lock_);
     QueryLogIndex::const_iterator query_record = query_log_index_.find(query_id);
-    if (query_record == query_log_index_.end()) {
-      stringstream ss;
-      ss << "Query id " << PrintId(query_id) << " not found.";
-      return Status(ss.str());
+    if (query_record != query_log_index_.end()) {
+      if (base64_encoded) {
+        (*output) << query_record->second->encoded_profile_str;
+      } else {
+        (*output) << query_record->second->profile_str;
+      }
+      return Status::OK;
     }
-    if (base64_encoded) {
-      (*output) << query_record->second->encoded_profile_str;
-    } else {
-      (*output) << query_record->second->profile_str;
+  }
+
+  // Finally, search the profile archive, which holds many more queries than the log.
+  if (profile_archive_.get() != NULL) {
+    TRuntimeProfileTree tree;
+    if (profile_archive_->GetProfile(query_id, &tree).ok()) {
+      ObjectPool pool;
+      RuntimeProfile* profile = RuntimeProfile::CreateFromThrift(&pool, tree);
+      if (base64_encoded) {
+        profile->SerializeToArchiveString(output);
+      } else {
+        profile->PrettyPrint(output);
+      }
+      return Status::OK;
     }
   }
-  return Status::OK;
+  stringstream ss;
+  ss << "Query id " << PrintId(query_id) << " not found.";
+  return Status(ss.str());
 }
 
 Status ImpalaServer::GetExecSummary(const TUniqueId& query_id, TExecSummary* result) {
@@ -626,8 +700,9 @@ void ImpalaServer::LineageLoggerFlushThread() {
 void ImpalaServer::ArchiveQuery(const QueryExecState& query) {
   const string& encoded_profile_str = query.profile().SerializeToArchiveString();
 
-  // If there was an error initialising archival (e.g. directory is not writeable),
-  // FLAGS_log_query_to_file will have been set to false
+  // If there was an error initialising archival (e.g. directory is not writeable), or
+  // profiles are written to the archive, FLAGS_log_query_to_file will have been set to
+  // false
   if (FLAGS_log_query_to_file) {
     stringstream ss;
     ss << UnixMillis() << " " << query.query_id() << " " << encoded_profile_str;
@@ -641,6 +716,24 @@ void ImpalaServer::ArchiveQuery(const QueryExecState& query) {
     }
   }
 
+  if (profile_archive_.get() != NULL) {
+    ProfileArchive::Entry entry;
+    entry.query_id = query.query_id();
+    entry.effective_user = query.effective_user();
+    entry.stmt = RedactCopy(query.sql_stmt());
+    entry.query_state = _QueryState_VALUES_TO_NAMES.find(query.query_state())->second;
+    entry.start_time = query.start_time().DebugString();
+    entry.end_time = query.end_time().DebugString();
+    // Only the copy of the profile happens here, the archive encodes and writes it
+    // in the background.
+    TRuntimeProfileTree profile;
+    query.profile().ToThrift(&profile);
+    if (!profile_archive_->Archive(entry, &profile)) {
+      LOG_EVERY_N(WARNING, 1000) << "Profile archive is falling behind, dropped "
+                                 << google::COUNTER << " query profiles";
+    }
+  }
+
   if (FLAGS_query_log_size == 0) return;
   QueryStateRecord record(query, true, encoded_profile_str);
   if (query.coord() != NULL) {
@@ -664,6 +757,7 @@ ImpalaServer::~ImpalaServer() {}
 
 Status ImpalaServer::Execute(TQueryCtx* query_ctx,
     shared_ptr<SessionState> session_state,
+    bool is_prepared_stmt,
     shared_ptr<QueryExecState>* exec_state) {
   PrepareQueryContext(query_ctx);
   bool registered_exec_state;
@@ -674,8 +768,8 @@ Status ImpalaServer::Execute(TQueryCtx* query_ctx,
   Redact(&stmt);
   query_ctx->request.__set_redacted_stmt((const string) stmt);
 
-  Status status = ExecuteInternal(*query_ctx, session_state, &registered_exec_state,
-      exec_state);
+  Status status = ExecuteInternal(*query_ctx, session_state, is_prepared_stmt,
+      &registered_exec_state, exec_state);
   if (!status.ok() && registered_exec_state) {
     UnregisterQuery((*exec_state)->query_id(), false, &status);
   }
@@ -685,6 +779,7 @@ Status ImpalaServer::Execute(TQueryCtx* query_ctx,
 Status ImpalaServer::ExecuteInternal(
     const TQueryCtx& query_ctx,
     shared_ptr<SessionState> session_state,
+    bool is_prepared_stmt,
     bool* registered_exec_state,
     shared_ptr<QueryExecState>* exec_state) {
   DCHECK(session_state != NULL);
@@ -703,7 +798,7 @@ Status ImpalaServer::ExecuteInternal(
     // result_metadata are atomic.
     //
     // Note: this acquires the exec_state lock *before* the
-    // query_exec_state_map_ lock. This is the opposite of
+    // query_exec_state_map_ shard lock. This is the opposite of
     // GetQueryExecState(..., true), and therefore looks like a
     // candidate for deadlock. The reason this works here is that
     // GetQueryExecState cannot find exec_state (under the exec state
@@ -718,11 +813,16 @@ Status ImpalaServer::ExecuteInternal(
     RETURN_IF_ERROR(RegisterQuery(session_state, *exec_state));
     *registered_exec_state = true;
 
+    bool plan_cache_hit = false;
     RETURN_IF_ERROR((*exec_state)->UpdateQueryStatus(
-        exec_env_->frontend()->GetExecRequest(query_ctx, &result)));
+        GetExecRequest(query_ctx, is_prepared_stmt, &result, &plan_cache_hit)));
     (*exec_state)->query_events()->MarkEvent("Planning finished");
-    (*exec_state)->summary_profile()->AddEventSequence(
-        result.timeline.name, result.timeline);
+    if (plan_cache_hit) {
+      (*exec_state)->summary_profile()->AddInfoString("Plan Cache", "HIT");
+    } else {
+      (*exec_state)->summary_profile()->AddEventSequence(
+          result.timeline.name, result.timeline);
+    }
     if (result.__isset.result_set_metadata) {
       (*exec_state)->set_result_metadata(result.result_set_metadata);
     }
@@ -751,17 +851,68 @@ Status ImpalaServer::ExecuteInternal(
   return Status::OK;
 }
 
+Status ImpalaServer::GetExecRequest(const TQueryCtx& query_ctx, bool is_prepared_stmt,
+    TExecRequest* result, bool* plan_cache_hit) {
+  *plan_cache_hit = false;
+  // Child queries (e.g. of compute stats) are generated per execution, so are not worth
+  // caching. Plans of statements with volatile functions may embed their values.
+  if (plan_cache_ == NULL || query_ctx.__isset.parent_query_id ||
+      !(is_prepared_stmt || FLAGS_plan_cache_all_queries) ||
+      PlanCache::CallsVolatileFunction(query_ctx.request.stmt)) {
+    return exec_env_->frontend()->GetExecRequest(query_ctx, result);
+  }
+
+  string key;
+  RETURN_IF_ERROR(PlanCache::GetKey(query_ctx, &key));
+  shared_ptr<const TExecRequest> cached_request;
+  if (plan_cache_->Lookup(key, &cached_request)) {
+    ImpaladMetrics::PLAN_CACHE_HITS->Increment(1L);
+    *plan_cache_hit = true;
+    *result = *cached_request;
+    // The cached plan was computed for an earlier execution of the statement. Replace
+    // the per-execution parts of its query context, keeping what the planner added.
+    TQueryCtx& result_ctx = result->query_exec_request.query_ctx;
+    result_ctx.query_id = query_ctx.query_id;
+    result_ctx.now_string = query_ctx.now_string;
+    result_ctx.pid = query_ctx.pid;
+    result_ctx.coord_address = query_ctx.coord_address;
+    result_ctx.session = query_ctx.session;
+    result_ctx.request = query_ctx.request;
+    return Status::OK;
+  }
+
+  ImpaladMetrics::PLAN_CACHE_MISSES->Increment(1L);
+  // Read the generation before planning, so that a plan computed against a catalog
+  // that changed during planning is not cached.
+  int64_t generation = plan_cache_->generation();
+  RETURN_IF_ERROR(exec_env_->frontend()->GetExecRequest(query_ctx, result));
+  // Only plain queries are cached. DDL and DML statements change the catalog or data.
+  // The lineage graph embeds the query id and start time, so it cannot be reused.
+  if (result->stmt_type == TStmtType::QUERY &&
+      !result->query_exec_request.__isset.lineage_graph) {
+    plan_cache_->Insert(key, *result, generation);
+    ImpaladMetrics::PLAN_CACHE_NUM_ENTRIES->set_value(plan_cache_->size());
+  }
+  return Status::OK;
+}
+
+void ImpalaServer::BeginCatalogUpdate() {
+  if (plan_cache_ == NULL) return;
+  plan_cache_->BeginCatalogUpdate();
+  ImpaladMetrics::PLAN_CACHE_NUM_ENTRIES->set_value(0L);
+}
+
+void ImpalaServer::EndCatalogUpdate() {
+  if (plan_cache_ == NULL) return;
+  plan_cache_->EndCatalogUpdate();
+}
+
 void ImpalaServer::PrepareQueryContext(TQueryCtx* query_ctx) {
   query_ctx->__set_pid(getpid());
   query_ctx->__set_now_string(TimestampValue::LocalTime().DebugString());
   query_ctx->__set_coord_address(MakeNetworkAddress(FLAGS_hostname, FLAGS_be_port));
 
-  // Creating a random_generator every time is not free, but
-  // benchmarks show it to be slightly cheaper than contending for a
-  // single generator under a lock (since random_generator is not
-  // thread-safe).
-  random_generator uuid_generator;
-  uuid query_uuid = uuid_generator();
+  uuid query_uuid = GenerateRandomUUID();
   UUIDToTUniqueId(query_uuid, &query_ctx->query_id);
 }
 
@@ -775,16 +926,17 @@ Status ImpalaServer::RegisterQuery(shared_ptr<SessionState> session_state,
   if (session_state->closed) return Status("Session has been closed, ignoring query.");
   const TUniqueId& query_id = exec_state->query_id();
   {
-    lock_guard<mutex> l(query_exec_state_map_lock_);
-    QueryExecStateMap::iterator entry = query_exec_state_map_.find(query_id);
-    if (entry != query_exec_state_map_.end()) {
+    QueryExecStateMap::Shard& shard = query_exec_state_map_.GetShard(query_id);
+    lock_guard<mutex> l(shard.lock);
+    QueryExecStateMap::Map::iterator entry = shard.map.find(query_id);
+    if (entry != shard.map.end()) {
       // There shouldn't be an active query with that same id.
       // (query_id is globally unique)
       stringstream ss;
       ss << "query id " << PrintId(query_id) << " already exists";
       return Status(ErrorMsg(TErrorCode::INTERNAL_ERROR, ss.str()));
     }
-    query_exec_state_map_.insert(make_pair(query_id, exec_state));
+    shard.map.insert(make_pair(query_id, exec_state));
   }
   return Status::OK;
 }
@@ -828,14 +980,15 @@ Status ImpalaServer::UnregisterQuery(const TUniqueId& query_id, bool check_infli
 
   shared_ptr<QueryExecState> exec_state;
   {
-    lock_guard<mutex> l(query_exec_state_map_lock_);
-    QueryExecStateMap::iterator entry = query_exec_state_map_.find(query_id);
-    if (entry == query_exec_state_map_.end()) {
+    QueryExecStateMap::Shard& shard = query_exec_state_map_.GetShard(query_id);
+    lock_guard<mutex> l(shard.lock);
+    QueryExecStateMap::Map::iterator entry = shard.map.find(query_id);
+    if (entry == shard.map.end()) {
       return Status("Invalid or unknown query handle");
     } else {
       exec_state = entry->second;
     }
-    query_exec_state_map_.erase(entry);
+    shard.map.erase(entry);
   }
 
   exec_state->Done();
@@ -912,9 +1065,10 @@ Status ImpalaServer::CloseSessionInternal(const TUniqueId& session_id,
   // Find the session_state and remove it from the map.
   shared_ptr<SessionState> session_state;
   {
-    lock_guard<mutex> l(session_state_map_lock_);
-    SessionStateMap::iterator entry = session_state_map_.find(session_id);
-    if (entry == session_state_map_.end()) {
+    SessionStateMap::Shard& shard = session_state_map_.GetShard(session_id);
+    lock_guard<mutex> l(shard.lock);
+    SessionStateMap::Map::iterator entry = shard.map.find(session_id);
+    if (entry == shard.map.end()) {
       if (ignore_if_absent) {
         return Status::OK;
       } else {
@@ -922,7 +1076,7 @@ Status ImpalaServer::CloseSessionInternal(const TUniqueId& session_id,
       }
     }
     session_state = entry->second;
-    session_state_map_.erase(session_id);
+    shard.map.erase(session_id);
   }
   DCHECK(session_state != NULL);
   if (session_state->session_type == TSessionType::BEESWAX) {
@@ -949,9 +1103,10 @@ Status ImpalaServer::CloseSessionInternal(const TUniqueId& session_id,
 
 Status ImpalaServer::GetSessionState(const TUniqueId& session_id,
     shared_ptr<SessionState>* session_state, bool mark_active) {
-  lock_guard<mutex> l(session_state_map_lock_);
-  SessionStateMap::iterator i = session_state_map_.find(session_id);
-  if (i == session_state_map_.end()) {
+  SessionStateMap::Shard& shard = session_state_map_.GetShard(session_id);
+  lock_guard<mutex> l(shard.lock);
+  SessionStateMap::Map::iterator i = shard.map.find(session_id);
+  if (i == shard.map.end()) {
     *session_state = boost::shared_ptr<SessionState>();
     return Status("Invalid session id");
   } else {
@@ -1007,6 +1162,13 @@ void ImpalaServer::TransmitData(
            << " #rows=" << params.row_batch.num_rows
            << "sender_id=" << params.sender_id
            << " eos=" << (params.eos ? "true" : "false");
+  if (!params.__isset.row_batch && !params.eos) {
+    // A sender asks whether to resend a batch that the receiver turned away.
+    exec_env_->stream_mgr()->ProbeData(params.dest_fragment_instance_id,
+        params.dest_node_id, params.sender_id).SetTStatus(&return_val);
+    return;
+  }
+
   // TODO: fix Thrift so we can simply take ownership of thrift_batch instead
   // of having to copy its data
   if (params.row_batch.num_rows > 0) {
@@ -1015,6 +1177,8 @@ void ImpalaServer::TransmitData(
         params.sender_id);
     status.SetTStatus(&return_val);
     if (!status.ok()) {
+      // A RECOVERABLE_ERROR means the receiver's buffer is full; the sender resends
+      // the whole request, including eos, later.
       // should we close the channel here as well?
       return;
     }
@@ -1132,6 +1296,13 @@ void ImpalaServer::CatalogUpdateCallback(
   if (delta.topic_entries.size() != 0 || delta.topic_deletions.size() != 0)  {
     TUpdateCatalogCacheRequest update_req;
     update_req.__set_is_delta(delta.is_delta);
+    if (FLAGS_load_catalog_tables_on_demand && !delta.is_delta) {
+      // A full update replaces the whole local catalog, so all deferred tables will be
+      // deferred again below.
+      deferred_tables_.ClearDeferred();
+    }
+    // Total size of the topic entries that are applied to the local catalog.
+    int64_t update_size = 0;
     // Process all Catalog updates (new and modified objects) and determine what the
     // new catalog version will be.
     int64_t new_catalog_version = catalog_update_info_.catalog_version;
@@ -1159,6 +1330,11 @@ void ImpalaServer::CatalogUpdateCallback(
         LibCache::instance()->SetNeedsRefresh(catalog_object.data_source.hdfs_location);
       }
 
+      if (!FLAGS_load_catalog_tables_on_demand ||
+          catalog_object.type != TCatalogObjectType::TABLE ||
+          !deferred_tables_.Defer(item.key, &catalog_object)) {
+        update_size += item.value.size();
+      }
       update_req.updated_objects.push_back(catalog_object);
     }
 
@@ -1180,6 +1356,10 @@ void ImpalaServer::CatalogUpdateCallback(
         continue;
       }
       update_req.removed_objects.push_back(catalog_object);
+      if (FLAGS_load_catalog_tables_on_demand &&
+          catalog_object.type == TCatalogObjectType::TABLE) {
+        deferred_tables_.Remove(key);
+      }
       if (catalog_object.type == TCatalogObjectType::FUNCTION ||
           catalog_object.type == TCatalogObjectType::DATA_SOURCE) {
         TCatalogObject dropped_object;
@@ -1199,9 +1379,21 @@ void ImpalaServer::CatalogUpdateCallback(
       }
     }
 
+    if (FLAGS_load_catalog_tables_on_demand) {
+      ImpaladMetrics::CATALOG_NUM_DEFERRED_TABLES->set_value(
+          deferred_tables_.num_deferred());
+    }
+
     // Call the FE to apply the changes to the Impalad Catalog.
     TUpdateCatalogCacheResponse resp;
+    MonotonicStopWatch apply_timer;
+    apply_timer.Start();
+    BeginCatalogUpdate();
     Status s = exec_env_->frontend()->UpdateCatalogCache(update_req, &resp);
+    EndCatalogUpdate();
+    ImpaladMetrics::CATALOG_UPDATE_APPLY_TIME_MS->Update(
+        apply_timer.ElapsedTime() / (1000.0 * 1000.0));
+    ImpaladMetrics::CATALOG_UPDATE_SIZE_BYTES->Update(update_size);
     if (!s.ok()) {
       LOG(ERROR) << "There was an error processing the impalad catalog update. Requesting"
                  << " a full topic update to recover: " << s.GetDetail();
@@ -1256,14 +1448,27 @@ Status ImpalaServer::ProcessCatalogUpdateResult(
     update_req.__set_catalog_service_id(catalog_update_result.catalog_service_id);
 
     if (catalog_update_result.__isset.updated_catalog_object) {
-      update_req.updated_objects.push_back(catalog_update_result.updated_catalog_object);
+      const TCatalogObject& object = catalog_update_result.updated_catalog_object;
+      update_req.updated_objects.push_back(object);
+      if (FLAGS_load_catalog_tables_on_demand &&
+          object.type == TCatalogObjectType::TABLE) {
+        // The table was modified by this impalad, so keep its metadata up to date.
+        deferred_tables_.MarkReferenced(TCatalogObjectToEntryKey(object));
+      }
     }
     if (catalog_update_result.__isset.removed_catalog_object) {
-      update_req.removed_objects.push_back(catalog_update_result.removed_catalog_object);
+      const TCatalogObject& object = catalog_update_result.removed_catalog_object;
+      update_req.removed_objects.push_back(object);
+      if (FLAGS_load_catalog_tables_on_demand &&
+          object.type == TCatalogObjectType::TABLE) {
+        deferred_tables_.Remove(TCatalogObjectToEntryKey(object));
+      }
     }
      // Apply the changes to the local catalog cache.
     TUpdateCatalogCacheResponse resp;
+    BeginCatalogUpdate();
     Status status = exec_env_->frontend()->UpdateCatalogCache(update_req, &resp);
+    EndCatalogUpdate();
     if (!status.ok()) LOG(ERROR) << status.GetDetail();
     RETURN_IF_ERROR(status);
     if (!wait_for_all_subscribers) return Status::OK;
@@ -1299,6 +1504,51 @@ Status ImpalaServer::ProcessCatalogUpdateResult(
   return Status::OK;
 }
 
+Status ImpalaServer::LoadTablesOnDemand(const vector<TCatalogObject>& object_descs) {
+  if (!FLAGS_load_catalog_tables_on_demand) return Status::OK;
+  vector<TCatalogObject> tables_to_fetch;
+  vector<string> entry_keys;
+  BOOST_FOREACH(const TCatalogObject& object_desc, object_descs) {
+    if (object_desc.type != TCatalogObjectType::TABLE) continue;
+    const string& entry_key = TCatalogObjectToEntryKey(object_desc);
+    if (entry_key.empty() || !deferred_tables_.StartLoad(entry_key)) continue;
+    tables_to_fetch.push_back(object_desc);
+    entry_keys.push_back(entry_key);
+  }
+  ImpaladMetrics::CATALOG_NUM_DEFERRED_TABLES->set_value(deferred_tables_.num_deferred());
+  if (tables_to_fetch.empty()) return Status::OK;
+
+  TUpdateCatalogCacheRequest update_req;
+  update_req.__set_is_delta(true);
+  {
+    lock_guard<mutex> l(catalog_version_lock_);
+    update_req.__set_catalog_service_id(catalog_update_info_.catalog_service_id);
+  }
+  CatalogOpExecutor catalog_op_executor(exec_env_, NULL, NULL);
+  Status status;
+  BOOST_FOREACH(const TCatalogObject& object_desc, tables_to_fetch) {
+    update_req.updated_objects.push_back(TCatalogObject());
+    status = catalog_op_executor.GetCatalogObject(object_desc,
+        &update_req.updated_objects.back());
+    if (!status.ok()) break;
+  }
+  if (status.ok()) {
+    TUpdateCatalogCacheResponse resp;
+    status = exec_env_->frontend()->UpdateCatalogCache(update_req, &resp);
+  }
+  if (!status.ok()) {
+    // Fetch the tables again when the next query references them.
+    deferred_tables_.LoadFailed(entry_keys);
+    ImpaladMetrics::CATALOG_NUM_DEFERRED_TABLES->set_value(
+        deferred_tables_.num_deferred());
+    return status;
+  }
+  ImpaladMetrics::CATALOG_NUM_ON_DEMAND_TABLE_LOADS->Increment(tables_to_fetch.size());
+  VLOG_QUERY << "Loaded " << tables_to_fetch.size() << " table(s) on demand: "
+             << join(entry_keys, ", ");
+  return Status::OK;
+}
+
 void ImpalaServer::MembershipCallback(
     const StatestoreSubscriber::TopicDeltaMap& incoming_topic_deltas,
     vector<TTopicDelta>* subscriber_topic_updates) {
@@ -1463,15 +1713,18 @@ void ImpalaServer::ConnectionStart(
     }
 
     {
-      lock_guard<mutex> l(session_state_map_lock_);
+      SessionStateMap::Shard& shard = session_state_map_.GetShard(session_id);
+      lock_guard<mutex> l(shard.lock);
       bool success =
-          session_state_map_.insert(make_pair(session_id, session_state)).second;
+          shard.map.insert(make_pair(session_id, session_state)).second;
       // The session should not have already existed.
       DCHECK(success);
     }
     {
-      lock_guard<mutex> l(connection_to_sessions_map_lock_);
-      connection_to_sessions_map_[connection_context.connection_id].push_back(session_id);
+      ConnectionToSessionMap::Shard& shard =
+          connection_to_sessions_map_.GetShard(connection_context.connection_id);
+      lock_guard<mutex> l(shard.lock);
+      shard.map[connection_context.connection_id].push_back(session_id);
     }
     ImpaladMetrics::IMPALA_SERVER_NUM_OPEN_BEESWAX_SESSIONS->Increment(1L);
   }
@@ -1479,24 +1732,32 @@ void ImpalaServer::ConnectionStart(
 
 void ImpalaServer::ConnectionEnd(
     const ThriftServer::ConnectionContext& connection_context) {
-  unique_lock<mutex> l(connection_to_sessions_map_lock_);
-  ConnectionToSessionMap::iterator it =
-      connection_to_sessions_map_.find(connection_context.connection_id);
+  vector<TUniqueId> session_ids;
+  {
+    ConnectionToSessionMap::Shard& shard =
+        connection_to_sessions_map_.GetShard(connection_context.connection_id);
+    lock_guard<mutex> l(shard.lock);
+    ConnectionToSessionMap::Map::iterator it =
+        shard.map.find(connection_context.connection_id);
 
-  // Not every connection must have an associated session
-  if (it == connection_to_sessions_map_.end()) return;
+    // Not every connection must have an associated session
+    if (it == shard.map.end()) return;
+    session_ids.swap(it->second);
+    shard.map.erase(it);
+  }
 
   LOG(INFO) << "Connection from client " << connection_context.network_address
-            << " closed, closing " << it->second.size() << " associated session(s)";
+            << " closed, closing " << session_ids.size() << " associated session(s)";
 
-  BOOST_FOREACH(const TUniqueId& session_id, it->second) {
+  // The connection's sessions are only closed by this thread, so the shard lock does
+  // not need to be held while closing them.
+  BOOST_FOREACH(const TUniqueId& session_id, session_ids) {
     Status status = CloseSessionInternal(session_id, true);
     if (!status.ok()) {
       LOG(WARNING) << "Error closing session " << session_id << ": "
                    << status.GetDetail();
     }
   }
-  connection_to_sessions_map_.erase(it);
 }
 
 void ImpalaServer::ExpireSessions() {
@@ -1504,34 +1765,36 @@ void ImpalaServer::ExpireSessions() {
     // Sleep for half the session timeout; the maximum delay between a session expiring
     // and this method picking it up is equal to the size of this sleep.
     SleepForMs(FLAGS_idle_session_timeout * 500);
-    lock_guard<mutex> l(session_state_map_lock_);
     int64_t now = UnixMillis();
     VLOG(3) << "Session expiration thread waking up";
-    // TODO: If holding session_state_map_lock_ for the duration of this loop is too
-    // expensive, consider a priority queue.
-    BOOST_FOREACH(SessionStateMap::value_type& session_state, session_state_map_) {
-      unordered_set<TUniqueId> inflight_queries;
-      {
-        lock_guard<mutex> l(session_state.second->lock);
-        if (session_state.second->ref_count > 0) continue;
-        // A session closed by other means is in the process of being removed, and it's
-        // best not to interfere.
-        if (session_state.second->closed || session_state.second->expired) continue;
-        int64_t last_accessed_ms = session_state.second->last_accessed_ms;
-        if (now - last_accessed_ms <= (FLAGS_idle_session_timeout * 1000)) continue;
-        LOG(INFO) << "Expiring session: " << session_state.first << ", user:"
-                  << session_state.second->connected_user << ", last active: "
-                  << TimestampValue(last_accessed_ms / 1000).DebugString();
-        session_state.second->expired = true;
-        ImpaladMetrics::NUM_SESSIONS_EXPIRED->Increment(1L);
-        // Since expired is true, no more queries will be added to the inflight list.
-        inflight_queries.insert(session_state.second->inflight_queries.begin(),
-            session_state.second->inflight_queries.end());
-      }
-      // Unregister all open queries from this session.
-      Status status("Session expired due to inactivity");
-      BOOST_FOREACH(const TUniqueId& query_id, inflight_queries) {
-        cancellation_thread_pool_->Offer(CancellationWork(query_id, status, true));
+    // Only one shard is locked at a time, so other shards stay available to clients.
+    for (int i = 0; i < SessionStateMap::num_shards; ++i) {
+      SessionStateMap::Shard& shard = session_state_map_.shard(i);
+      lock_guard<mutex> l(shard.lock);
+      BOOST_FOREACH(SessionStateMap::Map::value_type& session_state, shard.map) {
+        unordered_set<TUniqueId> inflight_queries;
+        {
+          lock_guard<mutex> l(session_state.second->lock);
+          if (session_state.second->ref_count > 0) continue;
+          // A session closed by other means is in the process of being removed, and it's
+          // best not to interfere.
+          if (session_state.second->closed || session_state.second->expired) continue;
+          int64_t last_accessed_ms = session_state.second->last_accessed_ms;
+          if (now - last_accessed_ms <= (FLAGS_idle_session_timeout * 1000)) continue;
+          LOG(INFO) << "Expiring session: " << session_state.first << ", user:"
+                    << session_state.second->connected_user << ", last active: "
+                    << TimestampValue(last_accessed_ms / 1000).DebugString();
+          session_state.second->expired = true;
+          ImpaladMetrics::NUM_SESSIONS_EXPIRED->Increment(1L);
+          // Since expired is true, no more queries will be added to the inflight list.
+          inflight_queries.insert(session_state.second->inflight_queries.begin(),
+              session_state.second->inflight_queries.end());
+        }
+        // Unregister all open queries from this session.
+        Status status("Session expired due to inactivity");
+        BOOST_FOREACH(const TUniqueId& query_id, inflight_queries) {
+          cancellation_thread_pool_->Offer(CancellationWork(query_id, status, true));
+        }
       }
     }
   }
@@ -1697,9 +1960,10 @@ Status CreateImpalaServer(ExecEnv* exec_env, int beeswax_port, int hs2_port, int
 bool ImpalaServer::GetSessionIdForQuery(const TUniqueId& query_id,
     TUniqueId* session_id) {
   DCHECK(session_id != NULL);
-  lock_guard<mutex> l(query_exec_state_map_lock_);
-  QueryExecStateMap::iterator i = query_exec_state_map_.find(query_id);
-  if (i == query_exec_state_map_.end()) {
+  QueryExecStateMap::Shard& shard = query_exec_state_map_.GetShard(query_id);
+  lock_guard<mutex> l(shard.lock);
+  QueryExecStateMap::Map::iterator i = shard.map.find(query_id);
+  if (i == shard.map.end()) {
     return false;
   } else {
     *session_id = i->second->session_id();
@@ -1709,9 +1973,10 @@ bool ImpalaServer::GetSessionIdForQuery(const TUniqueId& query_id,
 
 shared_ptr<ImpalaServer::QueryExecState> ImpalaServer::GetQueryExecState(
     const TUniqueId& query_id, bool lock) {
-  lock_guard<mutex> l(query_exec_state_map_lock_);
-  QueryExecStateMap::iterator i = query_exec_state_map_.find(query_id);
-  if (i == query_exec_state_map_.end()) {
+  QueryExecStateMap::Shard& shard = query_exec_state_map_.GetShard(query_id);
+  lock_guard<mutex> l(shard.lock);
+  QueryExecStateMap::Map::iterator i = shard.map.find(query_id);
+  if (i == shard.map.end()) {
     return shared_ptr<QueryExecState>();
   } else {
     if (lock) i->second->lock()->lock();
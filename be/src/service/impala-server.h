@@ -30,8 +30,11 @@
 #include "gen-cpp/Frontend_types.h"
 #include "rpc/thrift-server.h"
 #include "common/status.h"
+#include "service/deferred-tables.h"
 #include "service/frontend.h"
+#include "util/container-util.h"
 #include "util/metrics.h"
+#include "util/profile-archive.h"
 #include "util/runtime-profile.h"
 #include "util/simple-logger.h"
 #include "util/thread-pool.h"
@@ -65,6 +68,7 @@ class TSessionState;
 class TQueryOptions;
 class TGetExecSummaryResp;
 class TGetExecSummaryReq;
+class PlanCache;
 
 // An ImpalaServer contains both frontend and backend functionality;
 // it implements ImpalaService (Beeswax), ImpalaHiveServer2Service (HiveServer2)
@@ -235,6 +239,14 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   void CatalogUpdateCallback(const StatestoreSubscriber::TopicDeltaMap& topic_deltas,
       std::vector<TTopicDelta>* topic_updates);
 
+  // Called by the frontend (through FeSupport.PrioritizeLoad()) with the catalog objects
+  // that a query references but that are not loaded in the local catalog. If
+  // --load_catalog_tables_on_demand is true, fetches the metadata of any of these tables
+  // whose topic updates were deferred from the catalog server and applies it to the local
+  // catalog. From then on, topic updates for these tables are applied in full.
+  // A no-op if --load_catalog_tables_on_demand is false.
+  Status LoadTablesOnDemand(const std::vector<TCatalogObject>& object_descs);
+
   // Returns true if Impala is offline (and not accepting queries), false otherwise.
   bool IsOffline() {
     boost::lock_guard<boost::mutex> l(is_offline_lock_);
@@ -307,7 +319,7 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
 
   // Return exec state for given query_id, or NULL if not found.
   // If 'lock' is true, the returned exec state's lock() will be acquired before
-  // the query_exec_state_map_lock_ is released.
+  // the query_exec_state_map_ shard lock is released.
   boost::shared_ptr<QueryExecState> GetQueryExecState(
       const TUniqueId& query_id, bool lock);
 
@@ -326,16 +338,33 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   // been checked out.
   // query_session_state is a snapshot of session state that changes when the
   // query was run. (e.g. default database).
+  // If is_prepared_stmt is true, the statement's plan is cached and reused by later
+  // executions of the same statement (see GetExecRequest()).
   Status Execute(TQueryCtx* query_ctx,
                  boost::shared_ptr<SessionState> session_state,
+                 bool is_prepared_stmt,
                  boost::shared_ptr<QueryExecState>* exec_state);
 
   // Implements Execute() logic, but doesn't unregister query on error.
   Status ExecuteInternal(const TQueryCtx& query_ctx,
                          boost::shared_ptr<SessionState> session_state,
+                         bool is_prepared_stmt,
                          bool* registered_exec_state,
                          boost::shared_ptr<QueryExecState>* exec_state);
 
+  // Returns the exec request for query_ctx in result. Queries are looked up in and added
+  // to plan_cache_ if it is enabled and either is_prepared_stmt or
+  // FLAGS_plan_cache_all_queries is true, so repeated executions skip the frontend.
+  // Sets plan_cache_hit to true if the plan was found in the cache.
+  Status GetExecRequest(const TQueryCtx& query_ctx, bool is_prepared_stmt,
+                        TExecRequest* result, bool* plan_cache_hit);
+
+  // Must be called before and after every change of the local catalog, so that plans
+  // that may refer to changed or dropped objects are neither returned from nor added
+  // to plan_cache_ (see PlanCache::BeginCatalogUpdate()).
+  void BeginCatalogUpdate();
+  void EndCatalogUpdate();
+
   // Registers the query exec state with query_exec_state_map_ using the globally
   // unique query_id and add the query id to session state's open query list.
   // The caller must have checked out the session state.
@@ -457,6 +486,27 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   void InflightQueryIdsUrlCallback(const Webserver::ArgumentMap& args,
       rapidjson::Document* document);
 
+  // Json callback for /archived_queries, which lists the queries in the profile archive,
+  // newest first. Takes optional 'limit' (default 100) and 'before' arguments; 'before'
+  // is an archive time in ms since the epoch, and only queries archived before it are
+  // listed. 'next_before' is the argument that lists the next page.
+  // "archived_queries": [
+  //   {
+  //     "query_id": "7c459a59fb8cefe3:8b7042d55bf19887",
+  //     "effective_user": "henry",
+  //     "stmt": "select sleep(10000)",
+  //     "state": "FINISHED",
+  //     "start_time": "2014-08-07 18:37:47.923614000",
+  //     "end_time": "2014-08-07 18:37:58.146494000",
+  //     "archive_time": 1407461878146
+  //   }
+  // ],
+  // "num_archived_queries": 1,
+  // "num_dropped_profiles": 0,
+  // "next_before": 1407461878146
+  void ArchivedQueriesUrlCallback(const Webserver::ArgumentMap& args,
+      rapidjson::Document* document);
+
   // Json callback for /sessions, which prints a table of active client sessions.
   // "sessions": [
   // {
@@ -497,9 +547,13 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   // directory exists and is writeable, and initialises the first log file.
   // Returns OK unless there is some problem preventing profile log files
   // from being written. If an error is returned, the constructor will disable
-  // profile logging.
+  // profile logging. Only called if the profile archive is disabled.
   Status InitProfileLogging();
 
+  // Creates the profile archive in --profile_archive_dir if --archive_query_profiles is
+  // set. If an error is returned, the constructor will disable the archive.
+  Status InitProfileArchive();
+
   // Checks settings for audit event logging, including whether the output
   // directory exists and is writeable, and initialises the first log file.
   // Returns OK unless there is some problem preventing audit event log files
@@ -536,8 +590,8 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   void LineageLoggerFlushThread();
 
   // Copies a query's state into the query log. Called immediately prior to a
-  // QueryExecState's deletion. Also writes the query profile to the profile log on disk.
-  // Must be called with query_exec_state_map_lock_ held
+  // QueryExecState's deletion. Also writes the query profile to the profile log on disk
+  // and queues it to be written to the profile archive.
   void ArchiveQuery(const QueryExecState& query);
 
   // Checks whether the given user is allowed to delegate as the specified do_as_user.
@@ -732,6 +786,10 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   // <ms-since-epoch> <query-id> <thrift query profile URL encoded and gzipped>
   boost::scoped_ptr<SimpleLogger> profile_logger_;
 
+  // Archive of the profiles of completed queries, which outlives the query log and can
+  // be browsed on the debug webpages. NULL if --archive_query_profiles is false.
+  boost::scoped_ptr<ProfileArchive> profile_archive_;
+
   // Logger for writing audit events, one per line with the format:
   // "<current timestamp>" : { JSON object }
   boost::scoped_ptr<SimpleLogger> audit_event_logger_;
@@ -752,6 +810,10 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   // global, per-server state
   ExecEnv* exec_env_;  // not owned
 
+  // Cache of query plans, keyed by statement and session settings. Cleared whenever the
+  // local catalog changes. NULL if FLAGS_plan_cache_capacity is 0.
+  boost::scoped_ptr<PlanCache> plan_cache_;
+
   // Thread pool to process cancellation requests that come from failed Impala demons to
   // avoid blocking the statestore callback.
   boost::scoped_ptr<ThreadPool<CancellationWork> > cancellation_thread_pool_;
@@ -760,11 +822,11 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   boost::scoped_ptr<Thread> session_timeout_thread_;
 
   // map from query id to exec state; QueryExecState is owned by us and referenced
-  // as a shared_ptr to allow asynchronous deletion
-  typedef boost::unordered_map<TUniqueId, boost::shared_ptr<QueryExecState> >
-      QueryExecStateMap;
+  // as a shared_ptr to allow asynchronous deletion. Sharded by query id so that
+  // concurrent requests for different queries do not contend for a single lock. Each
+  // shard's lock protects that shard's map.
+  typedef ShardedMap<TUniqueId, boost::shared_ptr<QueryExecState> > QueryExecStateMap;
   QueryExecStateMap query_exec_state_map_;
-  boost::mutex query_exec_state_map_lock_;  // protects query_exec_state_map_
 
   // Default query options in the form of TQueryOptions and beeswax::ConfigVariable
   TQueryOptions default_query_options_;
@@ -872,25 +934,20 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   // For access to GetSessionState() / MarkSessionInactive()
   friend class ScopedSessionState;
 
-  // Protects session_state_map_. Should be taken before any query exec-state locks,
-  // including query_exec_state_map_lock_. Should be taken before individual session-state
-  // locks.
-  boost::mutex session_state_map_lock_;
-
-  // A map from session identifier to a structure containing per-session information
-  typedef boost::unordered_map<TUniqueId, boost::shared_ptr<SessionState> >
-    SessionStateMap;
+  // A map from session identifier to a structure containing per-session information,
+  // sharded by session id. A shard's lock should be taken before any query exec-state
+  // locks, including the query_exec_state_map_ shard locks. It should be taken before
+  // individual session-state locks. At most one shard lock may be held at a time.
+  typedef ShardedMap<TUniqueId, boost::shared_ptr<SessionState> > SessionStateMap;
   SessionStateMap session_state_map_;
 
-  // Protects connection_to_sessions_map_. May be taken before session_state_map_lock_.
-  boost::mutex connection_to_sessions_map_lock_;
-
   // Map from a connection ID to the associated list of sessions so that all can be closed
   // when the connection ends. HS2 allows for multiplexing several sessions across a
   // single connection. If a session has already been closed (only possible via HS2) it is
   // not removed from this map to avoid the cost of looking it up.
-  typedef boost::unordered_map<TUniqueId, std::vector<TUniqueId> >
-    ConnectionToSessionMap;
+  // Sharded by connection id. A shard's lock may be taken before a session_state_map_
+  // shard lock.
+  typedef ShardedMap<TUniqueId, std::vector<TUniqueId> > ConnectionToSessionMap;
   ConnectionToSessionMap connection_to_sessions_map_;
 
   // Returns session state for given session_id.
@@ -910,7 +967,7 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   }
 
   // protects query_locations_. Must always be taken after
-  // query_exec_state_map_lock_ if both are required.
+  // a query_exec_state_map_ shard lock if both are required.
   boost::mutex query_locations_lock_;
 
   // A map from backend to the list of queries currently running there.
@@ -930,12 +987,6 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   typedef boost::unordered_map<std::string, TNetworkAddress> BackendAddressMap;
   BackendAddressMap known_backends_;
 
-  // Generate unique session id for HiveServer2 session
-  boost::uuids::random_generator uuid_generator_;
-
-  // Lock to protect uuid_generator
-  boost::mutex uuid_lock_;
-
   // Lock for catalog_update_version_info_, min_subscriber_catalog_topic_version_,
   // and catalog_version_update_cv_
   boost::mutex catalog_version_lock_;
@@ -966,6 +1017,10 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   // update. Updated with each catalog topic heartbeat from the statestore.
   int64_t min_subscriber_catalog_topic_version_;
 
+  // Tables whose topic updates are not applied in full. Only used if
+  // --load_catalog_tables_on_demand is true.
+  DeferredTables deferred_tables_;
+
   // Map of short usernames of authorized proxy users to the set of user(s) they are
   // allowed to delegate to. Populated by parsing the --authorized_proxy_users_config
   // flag.
@@ -0,0 +1,168 @@
+// Copyright 2014 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <gtest/gtest.h>
+
+#include "service/plan-cache.h"
+
+using namespace boost;
+using namespace impala;
+using namespace std;
+
+TEST(PlanCacheTest, NormalizeStmt) {
+  EXPECT_EQ(PlanCache::NormalizeStmt("select 1"), "select 1");
+  EXPECT_EQ(PlanCache::NormalizeStmt("  select\n\t1 ;; "), "select 1");
+  EXPECT_EQ(PlanCache::NormalizeStmt("select *\n  from t\nwhere a = 1;"),
+      "select * from t where a = 1");
+  // Whitespace in quoted strings and identifiers is significant.
+  EXPECT_EQ(PlanCache::NormalizeStmt("select 'a  b',  \"c\n d\"  from `e  f`"),
+      "select 'a  b', \"c\n d\" from `e  f`");
+  EXPECT_EQ(PlanCache::NormalizeStmt("select 'it\\'s  a'  from t"),
+      "select 'it\\'s  a' from t");
+  // Line comments must keep their newline, otherwise the rest of the statement would
+  // become part of the comment.
+  EXPECT_EQ(PlanCache::NormalizeStmt("select 1 -- c  d\n  from t"),
+      "select 1 -- c  d\n from t");
+  EXPECT_NE(PlanCache::NormalizeStmt("select 1 -- c\nfrom t"),
+      PlanCache::NormalizeStmt("select 1 -- c from t"));
+  EXPECT_EQ(PlanCache::NormalizeStmt("select /* a  b */  1"), "select /* a  b */ 1");
+  // Unterminated quotes and comments are copied to the end of the statement.
+  EXPECT_EQ(PlanCache::NormalizeStmt("select 'a  "), "select 'a  ");
+  EXPECT_EQ(PlanCache::NormalizeStmt("select /* a  "), "select /* a  ");
+}
+
+static string GetKey(const TQueryCtx& query_ctx) {
+  string key;
+  EXPECT_TRUE(PlanCache::GetKey(query_ctx, &key).ok());
+  return key;
+}
+
+TEST(PlanCacheTest, GetKey) {
+  TQueryCtx query_ctx;
+  query_ctx.request.stmt = "select * from t";
+  query_ctx.session.connected_user = "alice";
+  query_ctx.session.database = "default";
+  string key = GetKey(query_ctx);
+  EXPECT_FALSE(key.empty());
+
+  // Fields that differ for each execution of the same statement are ignored.
+  TQueryCtx other_ctx = query_ctx;
+  other_ctx.query_id.hi = 1;
+  other_ctx.query_id.lo = 2;
+  other_ctx.now_string = "2015-01-01 00:00:00";
+  other_ctx.pid = 1234;
+  other_ctx.session.session_id.lo = 3;
+  other_ctx.session.network_address.hostname = "localhost";
+  other_ctx.session.network_address.port = 21000;
+  other_ctx.request.stmt = "  select *\n  from t;";
+  other_ctx.request.__set_redacted_stmt("select * from t");
+  EXPECT_EQ(key, GetKey(other_ctx));
+
+  // A different statement, user, database or query options give a different key.
+  other_ctx = query_ctx;
+  other_ctx.request.stmt = "select * from u";
+  EXPECT_NE(key, GetKey(other_ctx));
+  other_ctx = query_ctx;
+  other_ctx.session.connected_user = "bob";
+  EXPECT_NE(key, GetKey(other_ctx));
+  other_ctx = query_ctx;
+  other_ctx.session.__set_delegated_user("bob");
+  EXPECT_NE(key, GetKey(other_ctx));
+  other_ctx = query_ctx;
+  other_ctx.session.database = "functional";
+  EXPECT_NE(key, GetKey(other_ctx));
+  other_ctx = query_ctx;
+  other_ctx.request.query_options.__set_num_nodes(1);
+  EXPECT_NE(key, GetKey(other_ctx));
+  other_ctx = query_ctx;
+  other_ctx.request.query_options.__set_mem_limit(1024 * 1024);
+  EXPECT_NE(key, GetKey(other_ctx));
+}
+
+TEST(PlanCacheTest, LruEviction) {
+  PlanCache cache(2);
+  TExecRequest request;
+  shared_ptr<const TExecRequest> plan;
+  cache.Insert("a", request, cache.generation());
+  cache.Insert("b", request, cache.generation());
+  EXPECT_EQ(cache.size(), 2);
+  // Looking up "a" makes "b" the least recently used plan.
+  EXPECT_TRUE(cache.Lookup("a", &plan));
+  cache.Insert("c", request, cache.generation());
+  EXPECT_EQ(cache.size(), 2);
+  EXPECT_TRUE(cache.Lookup("a", &plan));
+  EXPECT_FALSE(cache.Lookup("b", &plan));
+  EXPECT_TRUE(cache.Lookup("c", &plan));
+  // Inserting an existing key replaces its plan.
+  cache.Insert("c", request, cache.generation());
+  EXPECT_EQ(cache.size(), 2);
+}
+
+TEST(PlanCacheTest, CatalogUpdate) {
+  PlanCache cache(10);
+  TExecRequest request;
+  shared_ptr<const TExecRequest> plan;
+  cache.Insert("a", request, cache.generation());
+  // Planned before the update started.
+  int64_t before_update = cache.generation();
+  cache.BeginCatalogUpdate();
+  EXPECT_EQ(0, cache.size());
+  EXPECT_FALSE(cache.Lookup("a", &plan));
+  cache.Insert("b", request, before_update);
+  EXPECT_FALSE(cache.Lookup("b", &plan));
+  // Planned while the update is in progress, against either version of the catalog.
+  int64_t during_update = cache.generation();
+  cache.Insert("b", request, during_update);
+  EXPECT_FALSE(cache.Lookup("b", &plan));
+  cache.EndCatalogUpdate();
+  cache.Insert("b", request, during_update);
+  EXPECT_FALSE(cache.Lookup("b", &plan));
+  cache.Insert("b", request, cache.generation());
+  EXPECT_TRUE(cache.Lookup("b", &plan));
+
+  // Concurrent updates: nothing is added until the last one ends.
+  cache.BeginCatalogUpdate();
+  cache.BeginCatalogUpdate();
+  cache.EndCatalogUpdate();
+  cache.Insert("c", request, cache.generation());
+  EXPECT_FALSE(cache.Lookup("c", &plan));
+  cache.EndCatalogUpdate();
+  cache.Insert("c", request, cache.generation());
+  EXPECT_TRUE(cache.Lookup("c", &plan));
+}
+
+TEST(PlanCacheTest, CallsVolatileFunction) {
+  EXPECT_TRUE(PlanCache::CallsVolatileFunction("select now()"));
+  EXPECT_TRUE(PlanCache::CallsVolatileFunction("select * from t where ts < NOW ()"));
+  EXPECT_TRUE(PlanCache::CallsVolatileFunction(
+      "select * from t where p = year(current_timestamp())"));
+  EXPECT_TRUE(PlanCache::CallsVolatileFunction("select unix_timestamp()"));
+  EXPECT_TRUE(PlanCache::CallsVolatileFunction(
+      "select a from t limit cast(rand() * 10 as int)"));
+  EXPECT_TRUE(PlanCache::CallsVolatileFunction("select random() from t"));
+  EXPECT_FALSE(PlanCache::CallsVolatileFunction("select a, b from t where a = 1"));
+  // Only calls count, not columns, strings or comments with the same name.
+  EXPECT_FALSE(PlanCache::CallsVolatileFunction("select now, rand from t"));
+  EXPECT_FALSE(PlanCache::CallsVolatileFunction("select 'now()' from t"));
+  EXPECT_FALSE(PlanCache::CallsVolatileFunction("select 'it\\'s now()' from t"));
+  EXPECT_FALSE(PlanCache::CallsVolatileFunction("select a from t -- now()\n"));
+  EXPECT_FALSE(PlanCache::CallsVolatileFunction("select /* rand() */ a from t"));
+  EXPECT_FALSE(PlanCache::CallsVolatileFunction("select nows(), my_rand() from t"));
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
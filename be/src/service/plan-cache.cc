@@ -0,0 +1,194 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "service/plan-cache.h"
+
+#include <ctype.h>
+#include <boost/algorithm/string.hpp>
+
+#include "common/logging.h"
+#include "rpc/thrift-util.h"
+
+using namespace boost;
+using namespace boost::algorithm;
+using namespace impala;
+using namespace std;
+
+PlanCache::PlanCache(int capacity)
+  : capacity_(capacity),
+    generation_(0),
+    num_catalog_updates_(0) {
+  DCHECK_GT(capacity, 0);
+}
+
+Status PlanCache::GetKey(const TQueryCtx& query_ctx, string* key) {
+  TQueryCtx key_ctx = query_ctx;
+  // Clear everything that is different for each execution of the same statement.
+  key_ctx.query_id = TUniqueId();
+  key_ctx.now_string.clear();
+  key_ctx.pid = 0;
+  key_ctx.session.session_id = TUniqueId();
+  key_ctx.session.network_address = TNetworkAddress();
+  key_ctx.request.stmt = NormalizeStmt(query_ctx.request.stmt);
+  key_ctx.request.redacted_stmt.clear();
+  key_ctx.request.__isset.redacted_stmt = false;
+
+  ThriftSerializer serializer(true);
+  vector<uint8_t> buffer;
+  RETURN_IF_ERROR(serializer.Serialize(&key_ctx, &buffer));
+  key->assign(buffer.begin(), buffer.end());
+  return Status::OK;
+}
+
+string PlanCache::NormalizeStmt(const string& stmt) {
+  string result;
+  result.reserve(stmt.size());
+  // Length of 'result' up to the end of the last quoted string or comment.
+  int verbatim_len = 0;
+  bool pending_space = false;
+  int i = 0;
+  while (i < stmt.size()) {
+    char c = stmt[i];
+    if (isspace(c)) {
+      pending_space = !result.empty();
+      ++i;
+      continue;
+    }
+    if (pending_space) result.push_back(' ');
+    pending_space = false;
+
+    // Find the end of the token starting at i that must be copied verbatim.
+    int end = i + 1;
+    if (c == '\'' || c == '"' || c == '`') {
+      // Quoted string or identifier. Strings may contain escaped quotes.
+      while (end < stmt.size() && stmt[end] != c) {
+        if (stmt[end] == '\\' && c != '`') ++end;
+        ++end;
+      }
+      ++end;
+    } else if (c == '-' && i + 1 < stmt.size() && stmt[i + 1] == '-') {
+      // Comment up to and including the end of the line.
+      while (end < stmt.size() && stmt[end] != '\n') ++end;
+      ++end;
+    } else if (c == '/' && i + 1 < stmt.size() && stmt[i + 1] == '*') {
+      size_t comment_end = stmt.find("*/", i + 2);
+      end = comment_end == string::npos ? stmt.size() : comment_end + 2;
+    }
+    end = min(end, static_cast<int>(stmt.size()));
+    result.append(stmt, i, end - i);
+    if (end - i > 1) verbatim_len = result.size();
+    i = end;
+  }
+  // Trailing semicolons do not change the statement.
+  while (result.size() > verbatim_len && (result[result.size() - 1] == ';' ||
+      isspace(result[result.size() - 1]))) {
+    result.resize(result.size() - 1);
+  }
+  return result;
+}
+
+bool PlanCache::CallsVolatileFunction(const string& stmt) {
+  static const char* VOLATILE_FUNCTIONS[] =
+      {"now", "current_timestamp", "unix_timestamp", "rand", "random"};
+  int i = 0;
+  while (i < stmt.size()) {
+    char c = stmt[i];
+    if (c == '\'' || c == '"' || c == '`') {
+      // Skip quoted strings and identifiers, as NormalizeStmt() does.
+      ++i;
+      while (i < stmt.size() && stmt[i] != c) {
+        if (stmt[i] == '\\' && c != '`') ++i;
+        ++i;
+      }
+      ++i;
+    } else if (c == '-' && i + 1 < stmt.size() && stmt[i + 1] == '-') {
+      while (i < stmt.size() && stmt[i] != '\n') ++i;
+    } else if (c == '/' && i + 1 < stmt.size() && stmt[i + 1] == '*') {
+      size_t comment_end = stmt.find("*/", i + 2);
+      i = comment_end == string::npos ? stmt.size() : comment_end + 2;
+    } else if (isalpha(c) || c == '_') {
+      int end = i + 1;
+      while (end < stmt.size() && (isalnum(stmt[end]) || stmt[end] == '_')) ++end;
+      string name = stmt.substr(i, end - i);
+      // The identifier is a function name if it is followed by '('.
+      int next = end;
+      while (next < stmt.size() && isspace(stmt[next])) ++next;
+      if (next < stmt.size() && stmt[next] == '(') {
+        for (int j = 0; j < sizeof(VOLATILE_FUNCTIONS) / sizeof(char*); ++j) {
+          if (iequals(name, VOLATILE_FUNCTIONS[j])) return true;
+        }
+      }
+      i = end;
+    } else {
+      ++i;
+    }
+  }
+  return false;
+}
+
+bool PlanCache::Lookup(const string& key, shared_ptr<const TExecRequest>* request) {
+  lock_guard<mutex> l(lock_);
+  EntryMap::iterator it = entry_map_.find(key);
+  if (it == entry_map_.end()) return false;
+  // Move the plan to the front of the LRU list.
+  entries_.splice(entries_.begin(), entries_, it->second);
+  *request = it->second->second;
+  return true;
+}
+
+void PlanCache::Insert(const string& key, const TExecRequest& request,
+    int64_t generation) {
+  // Copy the plan before taking the lock.
+  shared_ptr<const TExecRequest> plan(new TExecRequest(request));
+  lock_guard<mutex> l(lock_);
+  if (generation != generation_ || num_catalog_updates_ > 0) return;
+  EntryMap::iterator it = entry_map_.find(key);
+  if (it != entry_map_.end()) {
+    // Another query planned the same statement concurrently.
+    it->second->second = plan;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return;
+  }
+  if (entries_.size() >= capacity_) {
+    entry_map_.erase(entries_.back().first);
+    entries_.pop_back();
+  }
+  entries_.push_front(make_pair(key, plan));
+  entry_map_[key] = entries_.begin();
+}
+
+void PlanCache::BeginCatalogUpdate() {
+  lock_guard<mutex> l(lock_);
+  entries_.clear();
+  entry_map_.clear();
+  ++generation_;
+  ++num_catalog_updates_;
+}
+
+void PlanCache::EndCatalogUpdate() {
+  lock_guard<mutex> l(lock_);
+  DCHECK_GT(num_catalog_updates_, 0);
+  ++generation_;
+  --num_catalog_updates_;
+}
+
+int64_t PlanCache::generation() {
+  lock_guard<mutex> l(lock_);
+  return generation_;
+}
+
+int PlanCache::size() {
+  lock_guard<mutex> l(lock_);
+  return entries_.size();
+}
@@ -0,0 +1,110 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPALA_SERVICE_PLAN_CACHE_H
+#define IMPALA_SERVICE_PLAN_CACHE_H
+
+#include <list>
+#include <string>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+#include "common/status.h"
+#include "gen-cpp/Frontend_types.h"
+#include "gen-cpp/ImpalaInternalService_types.h"
+
+namespace impala {
+
+// LRU cache of the TExecRequests returned by Frontend::GetExecRequest(), used to skip
+// parsing, analysis and planning of repeated statements.
+// Plans are keyed by the query context with all per-execution fields (e.g. the query
+// id) cleared and the statement text normalized (see GetKey()). A plan is therefore
+// only reused for the same statement run by the same user with the same default
+// database and query options.
+// Plans depend on the catalog, so every change of the local catalog must be bracketed
+// by BeginCatalogUpdate() and EndCatalogUpdate(). Plans also depend on the time of
+// planning, when constant exprs such as partition pruning predicates are folded, so
+// statements that call volatile functions must not be cached (see
+// CallsVolatileFunction()).
+// Thread-safe.
+class PlanCache {
+ public:
+  // Creates a cache that holds at most 'capacity' plans.
+  PlanCache(int capacity);
+
+  // Computes the cache key for 'query_ctx'.
+  static Status GetKey(const TQueryCtx& query_ctx, std::string* key);
+
+  // Returns 'stmt' with each run of whitespace collapsed to a single space and leading
+  // and trailing whitespace and semicolons removed. Quoted strings, quoted identifiers
+  // and comments are left untouched.
+  static std::string NormalizeStmt(const std::string& stmt);
+
+  // Returns true if 'stmt' calls a function whose result differs between executions,
+  // i.e. now(), current_timestamp(), unix_timestamp(), rand() or random(), which the
+  // planner may have folded into a constant. unix_timestamp() counts even with
+  // arguments. Calls within the definitions of views that 'stmt' references are not
+  // found.
+  static bool CallsVolatileFunction(const std::string& stmt);
+
+  // Returns the cached plan for 'key' in 'request', or false if there is none.
+  bool Lookup(const std::string& key, boost::shared_ptr<const TExecRequest>* request);
+
+  // Caches 'request' for 'key', evicting the least recently used plan if the cache is
+  // full. 'generation' is the value of generation() before 'request' was planned. The
+  // plan is dropped if a catalog update started since then or is in progress.
+  void Insert(const std::string& key, const TExecRequest& request, int64_t generation);
+
+  // Removes all plans. Must be called before the local catalog is changed, so that no
+  // plan that may refer to changed or dropped objects is returned once the change is
+  // visible. Until the matching EndCatalogUpdate(), no plans are added, since they may
+  // have been computed against either version of the catalog.
+  void BeginCatalogUpdate();
+
+  // Must be called once the change of the local catalog is complete, whether or not it
+  // succeeded.
+  void EndCatalogUpdate();
+
+  // Incremented by BeginCatalogUpdate() and EndCatalogUpdate().
+  int64_t generation();
+
+  // Number of cached plans.
+  int size();
+
+ private:
+  typedef std::pair<std::string, boost::shared_ptr<const TExecRequest> > Entry;
+  typedef std::list<Entry> EntryList;
+
+  const int capacity_;
+
+  // Protects all fields below.
+  boost::mutex lock_;
+
+  // Cached plans, most recently used first.
+  EntryList entries_;
+
+  // Key => position of the key's plan in entries_.
+  typedef boost::unordered_map<std::string, EntryList::iterator> EntryMap;
+  EntryMap entry_map_;
+
+  int64_t generation_;
+
+  // Number of catalog updates in progress.
+  int num_catalog_updates_;
+};
+
+}
+
+#endif
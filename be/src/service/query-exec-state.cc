@@ -46,6 +46,13 @@ DECLARE_string(catalog_service_host);
 DECLARE_bool(enable_rm);
 DECLARE_int64(max_result_cache_size);
 
+DEFINE_bool(enable_coord_only_queries, true, "If true, queries that the planner turned "
+    "into a single unpartitioned fragment, and that scan at most "
+    "--coord_only_query_max_scan_bytes, run entirely in the coordinator's process "
+    "without codegen, and are never queued by admission control.");
+DEFINE_int64(coord_only_query_max_scan_bytes, 1024L * 1024L, "The maximum number of "
+    "bytes a query may scan to run as a coordinator-only query.");
+
 namespace impala {
 
 // Keys into the info string map of the runtime profile referring to specific
@@ -54,6 +61,10 @@ static const string PER_HOST_MEM_KEY = "Estimated Per-Host Mem";
 static const string PER_HOST_VCORES_KEY = "Estimated Per-Host VCores";
 static const string TABLES_MISSING_STATS_KEY = "Tables Missing Stats";
 
+// Key of the info string that reports whether a query ran in the coordinator's process
+// only.
+static const string EXECUTION_PATH_KEY = "Execution Path";
+
 ImpalaServer::QueryExecState::QueryExecState(
     const TQueryCtx& query_ctx, ExecEnv* exec_env, Frontend* frontend,
     ImpalaServer* server, shared_ptr<SessionState> session)
@@ -387,6 +398,13 @@ Status ImpalaServer::QueryExecState::ExecQueryOrDmlRequest(
   }
   schedule_.reset(new QuerySchedule(query_id(), query_exec_request,
       exec_request_.query_options, effective_user(), &summary_profile_, query_events_));
+  if (IsCoordOnlyQuery(query_exec_request)) {
+    schedule_->set_is_coord_only(true);
+    summary_profile_.AddInfoString(EXECUTION_PATH_KEY, "Coordinator only");
+    ImpaladMetrics::NUM_COORD_ONLY_QUERIES->Increment(1L);
+  } else {
+    summary_profile_.AddInfoString(EXECUTION_PATH_KEY, "Distributed");
+  }
   coord_.reset(new Coordinator(exec_env_, query_events_));
   Status status = exec_env_->scheduler()->Schedule(coord_.get(), schedule_.get());
   summary_profile_.AddInfoString("Request Pool", schedule_->request_pool());
@@ -421,6 +439,30 @@ Status ImpalaServer::QueryExecState::ExecQueryOrDmlRequest(
   return Status::OK;
 }
 
+bool ImpalaServer::QueryExecState::IsCoordOnlyQuery(
+    const TQueryExecRequest& query_exec_request) {
+  // With resource management the query needs a reservation even if it only runs in the
+  // coordinator, so it must be scheduled as usual.
+  if (!FLAGS_enable_coord_only_queries || FLAGS_enable_rm) return false;
+  if (query_exec_request.stmt_type != TStmtType::QUERY) return false;
+  if (query_exec_request.fragments.size() != 1) return false;
+  if (query_exec_request.fragments[0].partition.type != TPartitionType::UNPARTITIONED) {
+    return false;
+  }
+  int64_t scan_bytes = 0;
+  map<TPlanNodeId, vector<TScanRangeLocations> >::const_iterator entry;
+  for (entry = query_exec_request.per_node_scan_ranges.begin();
+      entry != query_exec_request.per_node_scan_ranges.end(); ++entry) {
+    BOOST_FOREACH(const TScanRangeLocations& locations, entry->second) {
+      // The size of other scan ranges, e.g. hbase key ranges, is not known.
+      if (!locations.scan_range.__isset.hdfs_file_split) return false;
+      scan_bytes += locations.scan_range.hdfs_file_split.length;
+      if (scan_bytes > FLAGS_coord_only_query_max_scan_bytes) return false;
+    }
+  }
+  return true;
+}
+
 Status ImpalaServer::QueryExecState::ExecDdlRequest() {
   string op_type = catalog_op_type() == TCatalogOpType::DDL ?
       PrintTDdlType(ddl_type()) : PrintTCatalogOpType(catalog_op_type());
@@ -709,6 +751,13 @@ Status ImpalaServer::QueryExecState::FetchRowsInternal(const int32_t max_rows,
   }
   ExprContext::FreeLocalAllocations(output_expr_ctxs_);
 
+  // Coordinator-only queries rarely return more than one batch, and fetching the next
+  // one doesn't wait for any other backend. Look for the end of the results now, so the
+  // client learns about it from this fetch instead of needing another round trip.
+  if (schedule_->is_coord_only() && current_batch_row_ >= current_batch_->num_rows()) {
+    RETURN_IF_ERROR(FetchNextBatch());
+  }
+
   // Update the result cache if necessary.
   if (result_cache_max_size_ > 0 && result_cache_.get() != NULL) {
     int rows_fetched_from_coord = fetched_rows->size() - num_rows_fetched_from_cache;
@@ -46,7 +46,7 @@ class QueryExecStateCleaner;
 // servicing query-related requests from the client.
 // Thread safety: this class is generally not thread-safe, callers need to
 // synchronize access explicitly via lock().
-// To avoid deadlocks, the caller must *not* acquire query_exec_state_map_lock_
+// To avoid deadlocks, the caller must *not* acquire a query_exec_state_map_ shard lock
 // while holding the exec state's lock.
 // TODO: Consider renaming to RequestExecState for consistency.
 // TODO: Compute stats is the only stmt that requires child queries. Once the
@@ -326,6 +326,12 @@ class ImpalaServer::QueryExecState {
   // Non-blocking.
   Status ExecQueryOrDmlRequest(const TQueryExecRequest& query_exec_request);
 
+  // Returns true if 'query_exec_request' can run entirely in the coordinator's process,
+  // without codegen and without being queued: it must be a query with a single
+  // unpartitioned fragment that scans at most FLAGS_coord_only_query_max_scan_bytes of
+  // hdfs data.
+  static bool IsCoordOnlyQuery(const TQueryExecRequest& query_exec_request);
+
   // Core logic of executing a ddl statement. May internally initiate execution of
   // queries (e.g., compute stats) or dml (e.g., create table as select)
   Status ExecDdlRequest();
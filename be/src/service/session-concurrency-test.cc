@@ -0,0 +1,162 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <boost/thread/thread.hpp>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "rpc/thrift-client.h"
+#include "service/impala-server.h"
+#include "testutil/in-process-servers.h"
+#include "common/init.h"
+#include "service/fe-support.h"
+#include "util/impalad-metrics.h"
+#include "util/time.h"
+
+using namespace apache::thrift;
+using namespace apache::hive::service::cli::thrift;
+using namespace boost;
+using namespace impala;
+using namespace std;
+
+DECLARE_int32(be_port);
+DECLARE_int32(beeswax_port);
+DECLARE_int32(fe_service_threads);
+
+// Every open HS2 connection occupies one of the 'fe_service_threads' workers of the
+// server until it is closed, so all threads together must keep fewer sessions open
+// than there are workers, or the test deadlocks.
+static const int NUM_THREADS = 8;
+static const int SESSIONS_PER_THREAD = 4;
+
+typedef ThriftClient<ImpalaHiveServer2ServiceClient> Hs2Client;
+
+// How far a session got. Every session of a successful run ends up CLOSED.
+enum SessionState {
+  NOT_OPENED,
+  OPENED,
+  QUERIED,
+  CLOSED
+};
+
+// Runs a trivial query in 'session' and fetches its result. Returns false if any of the
+// calls did not succeed.
+static bool ExecuteQuery(Hs2Client* client, const TSessionHandle& session) {
+  TExecuteStatementResp exec_response;
+  TExecuteStatementReq exec_request;
+  exec_request.sessionHandle = session;
+  exec_request.__set_statement("select 1");
+  client->iface()->ExecuteStatement(exec_response, exec_request);
+  if (exec_response.status.statusCode != TStatusCode::SUCCESS_STATUS) return false;
+
+  TFetchResultsResp fetch_response;
+  TFetchResultsReq fetch_request;
+  fetch_request.operationHandle = exec_response.operationHandle;
+  fetch_request.maxRows = 1024;
+  do {
+    client->iface()->FetchResults(fetch_response, fetch_request);
+  } while (fetch_response.status.statusCode == TStatusCode::SUCCESS_STATUS &&
+      fetch_response.hasMoreRows);
+  bool success = fetch_response.status.statusCode == TStatusCode::SUCCESS_STATUS;
+
+  TCloseOperationResp close_response;
+  TCloseOperationReq close_request;
+  close_request.operationHandle = exec_response.operationHandle;
+  client->iface()->CloseOperation(close_response, close_request);
+  return success && close_response.status.statusCode == TStatusCode::SUCCESS_STATUS;
+}
+
+// Opens 'SESSIONS_PER_THREAD' HS2 sessions, each on its own connection, runs a query in
+// each of them and closes half of them. The other half are closed when their
+// connections are closed. Records how far each session got in 'states', which has one
+// entry per session of this thread.
+static void OpenAndCloseSessions(SessionState* states) {
+  // clients[i] is the connection of sessions[i], which is states[i].
+  vector<Hs2Client*> clients(SESSIONS_PER_THREAD, NULL);
+  vector<TSessionHandle> sessions(SESSIONS_PER_THREAD);
+  for (int i = 0; i < SESSIONS_PER_THREAD; ++i) {
+    states[i] = NOT_OPENED;
+    clients[i] = new Hs2Client("localhost", FLAGS_beeswax_port + 1);
+    if (!clients[i]->Open().ok()) continue;
+    TOpenSessionResp response;
+    TOpenSessionReq request;
+    clients[i]->iface()->OpenSession(response, request);
+    if (response.status.statusCode != TStatusCode::SUCCESS_STATUS) continue;
+    sessions[i] = response.sessionHandle;
+    states[i] = OPENED;
+  }
+  for (int i = 0; i < SESSIONS_PER_THREAD; ++i) {
+    if (states[i] == OPENED && ExecuteQuery(clients[i], sessions[i])) {
+      states[i] = QUERIED;
+    }
+  }
+  for (int i = 0; i < SESSIONS_PER_THREAD; ++i) {
+    if (states[i] != QUERIED) continue;
+    if (i % 2 == 0) {
+      TCloseSessionResp response;
+      TCloseSessionReq request;
+      request.__set_sessionHandle(sessions[i]);
+      clients[i]->iface()->CloseSession(response, request);
+      if (response.status.statusCode != TStatusCode::SUCCESS_STATUS) continue;
+    }
+    states[i] = CLOSED;
+  }
+  for (int i = 0; i < SESSIONS_PER_THREAD; ++i) {
+    clients[i]->Close();
+    delete clients[i];
+  }
+}
+
+// Opens many sessions from concurrent clients and runs a query in each of them. Every
+// session must open, run its query and close, and afterwards the session metrics and
+// the sharded session maps must agree.
+TEST(SessionTest, TestConcurrentSessions) {
+  ASSERT_LT(NUM_THREADS * SESSIONS_PER_THREAD, FLAGS_fe_service_threads);
+  InProcessImpalaServer* impala =
+      new InProcessImpalaServer("localhost", FLAGS_be_port, 0, 0, "", 0);
+  EXIT_IF_ERROR(
+      impala->StartWithClientServers(FLAGS_beeswax_port, FLAGS_beeswax_port + 1, false));
+  IntGauge* hs2_session_metric =
+      impala->metrics()->FindMetricForTesting<IntGauge>(
+          ImpaladMetricKeys::IMPALA_SERVER_NUM_OPEN_HS2_SESSIONS);
+  DCHECK(hs2_session_metric != NULL);
+  EXPECT_EQ(hs2_session_metric->value(), 0L);
+
+  vector<SessionState> states(NUM_THREADS * SESSIONS_PER_THREAD, NOT_OPENED);
+  thread_group threads;
+  for (int i = 0; i < NUM_THREADS; ++i) {
+    threads.add_thread(
+        new thread(&OpenAndCloseSessions, &states[i * SESSIONS_PER_THREAD]));
+  }
+  threads.join_all();
+  for (int i = 0; i < states.size(); ++i) {
+    EXPECT_EQ(CLOSED, states[i]) << "Session " << i % SESSIONS_PER_THREAD
+        << " of thread " << i / SESSIONS_PER_THREAD;
+  }
+
+  // Sessions of closed connections are closed asynchronously by the server.
+  int64_t start = UnixMillis();
+  while (hs2_session_metric->value() != 0 && UnixMillis() - start < 5000) {
+    SleepForMs(100);
+  }
+  ASSERT_EQ(hs2_session_metric->value(), 0L) << "Sessions were not closed within 5s";
+}
+
+int main(int argc, char** argv) {
+  InitCommonRuntime(argc, argv, true);
+  InitFeSupport();
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -69,7 +69,8 @@ QuerySchedule::QuerySchedule(const TUniqueId& query_id,
     num_backends_(0),
     num_hosts_(0),
     num_scan_ranges_(0),
-    is_admitted_(false) {
+    is_admitted_(false),
+    is_coord_only_(false) {
   fragment_exec_params_.resize(request.fragments.size());
   // map from plan node id to fragment index in exec_request.fragments
   vector<PlanNodeId> per_node_fragment_idx;
@@ -117,6 +117,8 @@ class QuerySchedule {
   }
   bool is_admitted() const { return is_admitted_; }
   void set_is_admitted(bool is_admitted) { is_admitted_ = is_admitted; }
+  bool is_coord_only() const { return is_coord_only_; }
+  void set_is_coord_only(bool is_coord_only) { is_coord_only_ = is_coord_only; }
   RuntimeProfile* summary_profile() { return summary_profile_; }
   RuntimeProfile::EventSequence* query_events() { return query_events_; }
 
@@ -169,6 +171,10 @@ class QuerySchedule {
   // Indicates if the query has been admitted for execution.
   bool is_admitted_;
 
+  // Indicates if the query is small enough to run entirely in the coordinator's process.
+  // Such queries are never queued by admission control and run without codegen.
+  bool is_coord_only_;
+
   // Resolves unique_hosts_ to node mgr addresses. Valid only after SetUniqueHosts() has
   // been called.
   boost::scoped_ptr<ResourceResolver> resource_resolver_;
@@ -14,6 +14,7 @@
 
 #include "testutil/impalad-query-executor.h"
 
+#include <algorithm>
 #include <boost/algorithm/string/join.hpp>
 #include <boost/algorithm/string.hpp>
 
@@ -96,6 +97,7 @@ Status ImpaladQueryExecutor::Exec(
     return Status(ss.str());
   }
   current_row_ = 0;
+  eos_ = false;
   query_in_progress_ = true;
   if (col_schema != NULL) *col_schema = resultsMetadata.schema.fieldSchemas;
   return Status::OK;
@@ -131,6 +133,23 @@ Status ImpaladQueryExecutor::FetchResult(string* row) {
   return Status::OK;
 }
 
+Status ImpaladQueryExecutor::FetchAll(vector<string>* rows) {
+  rows->clear();
+  while (!eos_) {
+    string row;
+    try {
+      RETURN_IF_ERROR(FetchResult(&row));
+    } catch (BeeswaxException& e) {
+      stringstream ss;
+      ss << e.SQLState << ": " << e.message;
+      return Status(ss.str());
+    }
+    if (row.empty()) break;
+    rows->push_back(row);
+  }
+  return Status::OK;
+}
+
 Status ImpaladQueryExecutor::FetchResult(vector<void*>* row) {
   return Status("ImpaladQueryExecutor::FetchResult(vector<void*>) not supported");
 }
@@ -165,4 +184,37 @@ RuntimeProfile* ImpaladQueryExecutor::query_profile() {
   return NULL;
 }
 
+Status ImpaladQueryExecutor::GetRuntimeProfile(string* profile) {
+  if (!query_in_progress_) return Status("No query in progress");
+  try {
+    client_->iface()->GetRuntimeProfile(*profile, query_handle_);
+  } catch (BeeswaxException& e) {
+    stringstream ss;
+    ss << e.SQLState << ": " << e.message;
+    return Status(ss.str());
+  }
+  return Status::OK;
+}
+
+int64_t ImpaladQueryExecutor::GetCounterValue(const string& profile,
+    const string& name) {
+  // Counters are printed as "   - <name>: <pretty value>", followed by the raw value in
+  // parentheses if the pretty value is abbreviated, e.g. "   - RowsRead: 1.50K (1500)".
+  const string prefix = "- " + name + ": ";
+  int64_t result = -1;
+  stringstream ss(profile);
+  string line;
+  while (getline(ss, line)) {
+    size_t pos = line.find(prefix);
+    if (pos == string::npos) continue;
+    // Only the counter itself, not one whose name ends in 'name'.
+    if (line.find_first_not_of(' ') != pos) continue;
+    const char* value = line.c_str() + pos + prefix.size();
+    size_t raw_pos = line.find(" (", pos + prefix.size());
+    if (raw_pos != string::npos) value = line.c_str() + raw_pos + 2;
+    result = max(result, static_cast<int64_t>(strtoll(value, NULL, 10)));
+  }
+  return result;
+}
+
 }
@@ -64,6 +64,10 @@ class ImpaladQueryExecutor {
   // Returns OK if successful, otherwise error.
   Status FetchResult(std::string* row);
 
+  // Sets 'rows' to all remaining rows of the current query, as FetchResult(string*)
+  // returns them.
+  Status FetchAll(std::vector<std::string>* rows);
+
   // Return single row as vector of raw values.
   // Indicates end-of-stream by returning empty 'row'.
   // Returns OK if successful, otherwise error.
@@ -79,6 +83,17 @@ class ImpaladQueryExecutor {
   // Returns the counters for the entire query
   RuntimeProfile* query_profile();
 
+  // Sets 'profile' to the pretty-printed runtime profile of the current query. Once all
+  // rows have been fetched, it includes the final counters of all fragments.
+  Status GetRuntimeProfile(std::string* profile);
+
+  // Returns the largest value of the counter 'name' in the pretty-printed 'profile', or
+  // -1 if it does not appear. The largest value is that of the busiest fragment
+  // instance, or of the averaged fragment, which is as large. For counters that are not
+  // plain counts, returns the leading number of the pretty-printed value, which is
+  // only meaningful to check whether the counter is 0.
+  static int64_t GetCounterValue(const std::string& profile, const std::string& name);
+
   bool eos() { return eos_; }
 
   void setExecOptions(const std::vector<std::string>& exec_options) {
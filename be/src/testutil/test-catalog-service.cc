@@ -0,0 +1,102 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "testutil/test-catalog-service.h"
+
+#include <boost/shared_ptr.hpp>
+#include <gutil/strings/substitute.h>
+
+#include "common/logging.h"
+#include "rpc/thrift-server.h"
+#include "testutil/test-table.h"
+
+DECLARE_int32(catalog_service_port);
+
+using boost::shared_ptr;
+using namespace apache::thrift;
+using namespace std;
+using namespace strings;
+
+namespace impala {
+
+Status TestCatalogService::Start() {
+  shared_ptr<TestCatalogService> handler(new TestCatalogService());
+  shared_ptr<TProcessor> processor(new CatalogServiceProcessor(handler));
+  // Not deleted, like the servers of InProcessImpalaServer.
+  ThriftServer* server = new ThriftServer("TestCatalogService", processor,
+      FLAGS_catalog_service_port, NULL, NULL, 5);
+  return server->Start();
+}
+
+void TestCatalogService::UpdateCatalog(TUpdateCatalogResponse& resp,
+    const TUpdateCatalogRequest& req) {
+  TestTable* table = TestTable::Find(req.db_name, req.target_table);
+  Status status;
+  if (table == NULL) {
+    status = Status(Substitute("Not a test table: $0.$1", req.db_name, req.target_table));
+  } else {
+    status = table->ToThrift(&resp.result.updated_catalog_object);
+  }
+  if (status.ok()) {
+    resp.result.__isset.updated_catalog_object = true;
+  } else {
+    LOG(ERROR) << status.GetDetail();
+  }
+  // A version of 0 lets the impalad return as soon as it applied the table.
+  resp.result.__set_version(0);
+  resp.result.__set_catalog_service_id(TUniqueId());
+  TStatus thrift_status;
+  status.ToThrift(&thrift_status);
+  resp.result.__set_status(thrift_status);
+}
+
+// Returns the error of the unsupported 'request'.
+static TStatus NotSupported(const string& request) {
+  TStatus thrift_status;
+  Status(Substitute("$0 is not supported by TestCatalogService", request))
+      .ToThrift(&thrift_status);
+  return thrift_status;
+}
+
+void TestCatalogService::ExecDdl(TDdlExecResponse& resp, const TDdlExecRequest& req) {
+  resp.result.__set_status(NotSupported("ExecDdl"));
+}
+
+void TestCatalogService::ResetMetadata(TResetMetadataResponse& resp,
+    const TResetMetadataRequest& req) {
+  resp.result.__set_status(NotSupported("ResetMetadata"));
+}
+
+void TestCatalogService::GetFunctions(TGetFunctionsResponse& resp,
+    const TGetFunctionsRequest& req) {
+  resp.__set_status(NotSupported("GetFunctions"));
+}
+
+void TestCatalogService::GetCatalogObject(TGetCatalogObjectResponse& resp,
+    const TGetCatalogObjectRequest& req) {
+  // The response has no status. The impalad fails on the empty object.
+  LOG(ERROR) << "GetCatalogObject is not supported by TestCatalogService";
+}
+
+void TestCatalogService::PrioritizeLoad(TPrioritizeLoadResponse& resp,
+    const TPrioritizeLoadRequest& req) {
+  resp.__set_status(NotSupported("PrioritizeLoad"));
+}
+
+void TestCatalogService::SentryAdminCheck(TSentryAdminCheckResponse& resp,
+    const TSentryAdminCheckRequest& req) {
+  resp.__set_status(NotSupported("SentryAdminCheck"));
+}
+
+}
@@ -0,0 +1,51 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPALA_TESTUTIL_TEST_CATALOG_SERVICE_H
+#define IMPALA_TESTUTIL_TEST_CATALOG_SERVICE_H
+
+#include "common/status.h"
+#include "gen-cpp/CatalogService.h"
+
+namespace impala {
+
+// Stands in for the catalog server of an in-process impalad, so that tests can run
+// inserts into TestTables. UpdateCatalog(), which the coordinator calls once an insert
+// has moved its files into place, is answered with the table as it is on disk, which
+// the impalad then adds to its catalog. All other requests fail.
+class TestCatalogService : public CatalogServiceIf {
+ public:
+  // Starts the service on --catalog_service_port, where impalads expect the catalog
+  // server. --catalog_service_host must be this host.
+  static Status Start();
+
+  virtual void UpdateCatalog(TUpdateCatalogResponse& resp,
+      const TUpdateCatalogRequest& req);
+
+  virtual void ExecDdl(TDdlExecResponse& resp, const TDdlExecRequest& req);
+  virtual void ResetMetadata(TResetMetadataResponse& resp,
+      const TResetMetadataRequest& req);
+  virtual void GetFunctions(TGetFunctionsResponse& resp,
+      const TGetFunctionsRequest& req);
+  virtual void GetCatalogObject(TGetCatalogObjectResponse& resp,
+      const TGetCatalogObjectRequest& req);
+  virtual void PrioritizeLoad(TPrioritizeLoadResponse& resp,
+      const TPrioritizeLoadRequest& req);
+  virtual void SentryAdminCheck(TSentryAdminCheckResponse& resp,
+      const TSentryAdminCheckRequest& req);
+};
+
+}
+
+#endif
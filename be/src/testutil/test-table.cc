@@ -0,0 +1,347 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "testutil/test-table.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sys/stat.h>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <gutil/strings/substitute.h>
+
+#include "common/logging.h"
+#include "gen-cpp/CatalogService_types.h"
+#include "gen-cpp/ImpalaInternalService_constants.h"
+#include "gen-cpp/hive_metastore_types.h"
+#include "runtime/exec-env.h"
+#include "service/frontend.h"
+
+using namespace boost;
+using namespace boost::algorithm;
+using namespace std;
+using namespace strings;
+
+namespace impala {
+
+static const string NULL_PARTITION_KEY_VALUE = "__HIVE_DEFAULT_PARTITION__";
+
+// Protects tables and the table ids and catalog versions handed out so far.
+static mutex tables_lock;
+// The created tables by name, for Find().
+static map<string, TestTable*> tables;
+static int64_t last_table_id = 0;
+// Starts above the versions that tests give to databases and functions.
+static int64_t last_catalog_version = 1000;
+
+TestTable::TestTable(const string& name, const string& dir,
+    THdfsFileFormat::type file_format)
+  : name_(name),
+    dir_(dir),
+    file_format_(file_format),
+    block_size_(0),
+    id_(-1) {
+}
+
+TestTable::~TestTable() {
+  lock_guard<mutex> l(tables_lock);
+  map<string, TestTable*>::iterator it = tables.find(name_);
+  if (it != tables.end() && it->second == this) tables.erase(it);
+}
+
+static TColumn MakeColumn(const string& name, PrimitiveType type, int position) {
+  TColumn column;
+  column.__set_columnName(name);
+  column.__set_columnType(ColumnType(type).ToThrift());
+  column.__set_position(position);
+  return column;
+}
+
+void TestTable::AddColumn(const string& name, PrimitiveType type) {
+  columns_.push_back(MakeColumn(name, type, 0));
+}
+
+void TestTable::AddPartitionColumn(const string& name, PrimitiveType type) {
+  DCHECK(type == TYPE_INT || type == TYPE_STRING) << TypeToString(type);
+  partition_columns_.push_back(MakeColumn(name, type, 0));
+}
+
+Status TestTable::Create() {
+  try {
+    filesystem::remove_all(dir_);
+    filesystem::create_directories(dir_);
+  } catch (std::exception& e) {
+    return Status(Substitute("Could not create $0: $1", dir_, e.what()));
+  }
+  lock_guard<mutex> l(tables_lock);
+  if (id_ == -1) id_ = ++last_table_id;
+  tables[name_] = this;
+  return Status::OK;
+}
+
+Status TestTable::WriteFile(const string& partition, const string& file_name,
+    const string& contents) {
+  const string partition_dir = partition.empty() ? dir_ : dir_ + "/" + partition;
+  try {
+    filesystem::create_directories(partition_dir);
+  } catch (std::exception& e) {
+    return Status(Substitute("Could not create $0: $1", partition_dir, e.what()));
+  }
+  const string path = partition_dir + "/" + file_name;
+  ofstream file(path.c_str());
+  file << contents;
+  file.close();
+  if (!file.good()) return Status(Substitute("Could not write $0", path));
+  return Status::OK;
+}
+
+Status TestTable::Update() {
+  TUpdateCatalogCacheRequest request;
+  request.__set_is_delta(true);
+  request.__set_catalog_service_id(TUniqueId());
+  // The default database, at a version that doesn't replace it, and with it its
+  // tables, if it was already added.
+  TCatalogObject db;
+  db.__set_type(TCatalogObjectType::DATABASE);
+  db.__set_catalog_version(1);
+  db.db.__set_db_name("default");
+  db.__isset.db = true;
+  request.updated_objects.push_back(db);
+  request.updated_objects.push_back(TCatalogObject());
+  RETURN_IF_ERROR(ToThrift(&request.updated_objects.back()));
+  TUpdateCatalogCacheResponse response;
+  return ExecEnv::GetInstance()->frontend()->UpdateCatalogCache(request, &response);
+}
+
+// Returns true for the files and directories that Hive ignores, e.g. the staging
+// directory of inserts.
+static bool IsHidden(const filesystem::path& path) {
+  const string name = path.filename().string();
+  return name.empty() || name[0] == '.' || name[0] == '_';
+}
+
+Status TestTable::ToThrift(TCatalogObject* catalog_object) const {
+  DCHECK_NE(id_, -1) << "Create() was not called";
+  // The partition directories, sorted so that partition ids are stable, with their
+  // partition key values.
+  map<string, vector<string> > partitions;
+  if (partition_columns_.empty()) {
+    partitions[dir_];
+  } else {
+    try {
+      filesystem::recursive_directory_iterator it(dir_), end;
+      for (; it != end; ++it) {
+        if (IsHidden(it->path()) || !filesystem::is_directory(it->status())) {
+          if (filesystem::is_directory(it->status())) it.no_push();
+          continue;
+        }
+        if (it.level() + 1 < partition_columns_.size()) continue;
+        it.no_push();
+        // The directories below 'dir_' are "<key>=<value>".
+        vector<string> values;
+        filesystem::path path = it->path();
+        for (int i = 0; i < partition_columns_.size(); ++i) {
+          const string component = path.filename().string();
+          size_t eq = component.find('=');
+          if (eq == string::npos) break;
+          values.insert(values.begin(), component.substr(eq + 1));
+          path = path.parent_path();
+        }
+        if (values.size() != partition_columns_.size()) continue;
+        partitions[it->path().string()] = values;
+      }
+    } catch (std::exception& e) {
+      return Status(Substitute("Could not list $0: $1", dir_, e.what()));
+    }
+  }
+
+  catalog_object->__set_type(TCatalogObjectType::TABLE);
+  {
+    lock_guard<mutex> l(tables_lock);
+    catalog_object->__set_catalog_version(++last_catalog_version);
+  }
+  TTable& tbl = catalog_object->table;
+  tbl.__set_db_name("default");
+  tbl.__set_tbl_name(name_);
+  tbl.__set_id(id_);
+  tbl.__set_access_level(TAccessLevel::READ_WRITE);
+  tbl.__set_table_type(TTableType::HDFS_TABLE);
+  tbl.__set_clustering_columns(partition_columns_);
+  tbl.__set_columns(columns_);
+  // The frontend numbers columns with the partition columns first.
+  for (int i = 0; i < tbl.clustering_columns.size(); ++i) {
+    tbl.clustering_columns[i].__set_position(i);
+  }
+  for (int i = 0; i < tbl.columns.size(); ++i) {
+    tbl.columns[i].__set_position(partition_columns_.size() + i);
+  }
+  tbl.table_stats.__set_num_rows(-1);
+  tbl.__isset.table_stats = true;
+
+  // The frontend creates the table from its metastore object.
+  Apache::Hadoop::Hive::Table& ms_table = tbl.metastore_table;
+  ms_table.__set_dbName("default");
+  ms_table.__set_tableName(name_);
+  ms_table.__set_tableType("MANAGED_TABLE");
+  ms_table.sd.__set_location("file://" + dir_);
+  if (file_format_ == THdfsFileFormat::PARQUET) {
+    ms_table.sd.__set_inputFormat("parquet.hive.DeprecatedParquetInputFormat");
+    ms_table.sd.__set_outputFormat("parquet.hive.DeprecatedParquetOutputFormat");
+    ms_table.sd.serdeInfo.__set_serializationLib("parquet.hive.serde.ParquetHiveSerDe");
+  } else {
+    DCHECK_EQ(file_format_, THdfsFileFormat::TEXT);
+    ms_table.sd.__set_inputFormat("org.apache.hadoop.mapred.TextInputFormat");
+    ms_table.sd.__set_outputFormat(
+        "org.apache.hadoop.hive.ql.io.HiveIgnoreKeyTextOutputFormat");
+    ms_table.sd.serdeInfo.__set_serializationLib(
+        "org.apache.hadoop.hive.serde2.lazy.LazySimpleSerDe");
+    ms_table.sd.serdeInfo.parameters["field.delim"] = ",";
+  }
+  for (int i = 0; i < tbl.columns.size(); ++i) {
+    Apache::Hadoop::Hive::FieldSchema field;
+    field.__set_name(tbl.columns[i].columnName);
+    field.__set_type(to_lower_copy(
+        TypeToString(ColumnType(tbl.columns[i].columnType).type)));
+    ms_table.sd.cols.push_back(field);
+  }
+  for (int i = 0; i < tbl.clustering_columns.size(); ++i) {
+    Apache::Hadoop::Hive::FieldSchema field;
+    field.__set_name(tbl.clustering_columns[i].columnName);
+    field.__set_type(to_lower_copy(TypeToString(
+        ColumnType(tbl.clustering_columns[i].columnType).type)));
+    ms_table.partitionKeys.push_back(field);
+  }
+  tbl.__isset.metastore_table = true;
+
+  THdfsTable& hdfs_table = tbl.hdfs_table;
+  hdfs_table.__set_hdfsBaseDir("file://" + dir_);
+  hdfs_table.__set_nullPartitionKeyValue(NULL_PARTITION_KEY_VALUE);
+  hdfs_table.__set_nullColumnValue("\\N");
+  for (int i = 0; i < tbl.clustering_columns.size(); ++i) {
+    hdfs_table.colNames.push_back(tbl.clustering_columns[i].columnName);
+  }
+  for (int i = 0; i < tbl.columns.size(); ++i) {
+    hdfs_table.colNames.push_back(tbl.columns[i].columnName);
+  }
+  TNetworkAddress host;
+  host.__set_hostname("localhost");
+  host.__set_port(0);
+  hdfs_table.network_addresses.push_back(host);
+  hdfs_table.__isset.network_addresses = true;
+
+  // The default partition, which inserts into new partitions use as a template.
+  RETURN_IF_ERROR(AddPartition("", vector<string>(),
+      g_ImpalaInternalService_constants.DEFAULT_PARTITION_ID, &hdfs_table));
+  int64_t partition_id = 0;
+  for (map<string, vector<string> >::const_iterator it = partitions.begin();
+       it != partitions.end(); ++it) {
+    RETURN_IF_ERROR(AddPartition(it->first, it->second, partition_id++, &hdfs_table));
+  }
+  tbl.__isset.hdfs_table = true;
+  catalog_object->__isset.table = true;
+  return Status::OK;
+}
+
+Status TestTable::AddPartition(const string& partition_dir, const vector<string>& values,
+    int64_t id, THdfsTable* hdfs_table) const {
+  THdfsPartition partition;
+  partition.__set_lineDelim('\n');
+  partition.__set_fieldDelim(',');
+  partition.__set_collectionDelim(',');
+  partition.__set_mapKeyDelim(',');
+  partition.__set_escapeChar(0);
+  partition.__set_fileFormat(file_format_);
+  partition.__set_blockSize(block_size_);
+  partition.__set_access_level(TAccessLevel::READ_WRITE);
+  partition.__set_id(id);
+  for (int i = 0; i < values.size(); ++i) {
+    partition.partitionKeyExprs.push_back(
+        MakePartitionKeyExpr(partition_columns_[i], values[i]));
+  }
+  partition.__isset.partitionKeyExprs = true;
+  if (id == g_ImpalaInternalService_constants.DEFAULT_PARTITION_ID) {
+    hdfs_table->partitions[id] = partition;
+    return Status::OK;
+  }
+  partition.__set_location("file://" + partition_dir);
+
+  vector<filesystem::path> files;
+  try {
+    filesystem::directory_iterator it(partition_dir), end;
+    for (; it != end; ++it) {
+      if (IsHidden(it->path()) || !filesystem::is_regular_file(it->status())) continue;
+      files.push_back(it->path());
+    }
+  } catch (std::exception& e) {
+    return Status(Substitute("Could not list $0: $1", partition_dir, e.what()));
+  }
+  sort(files.begin(), files.end());
+  for (int i = 0; i < files.size(); ++i) {
+    struct stat file_stat;
+    if (stat(files[i].string().c_str(), &file_stat) != 0) {
+      return Status(Substitute("Could not stat $0", files[i].string()));
+    }
+    THdfsFileDesc file_desc;
+    file_desc.__set_file_name(files[i].filename().string());
+    file_desc.__set_length(file_stat.st_size);
+    file_desc.__set_compression(THdfsCompression::NONE);
+    file_desc.__set_last_modification_time(file_stat.st_mtime * 1000L);
+    int64_t block_size = block_size_ > 0 ? block_size_ : file_stat.st_size;
+    for (int64_t offset = 0; offset < file_stat.st_size; offset += block_size) {
+      THdfsFileBlock block;
+      block.__set_offset(offset);
+      block.__set_length(min<int64_t>(block_size, file_stat.st_size - offset));
+      block.replica_host_idxs.push_back(0);
+      file_desc.file_blocks.push_back(block);
+    }
+    partition.file_desc.push_back(file_desc);
+  }
+  partition.__isset.file_desc = true;
+  hdfs_table->partitions[id] = partition;
+  return Status::OK;
+}
+
+TExpr TestTable::MakePartitionKeyExpr(const TColumn& column, const string& value) {
+  TExprNode node;
+  node.__set_type(column.columnType);
+  node.__set_num_children(0);
+  if (value == NULL_PARTITION_KEY_VALUE) {
+    node.__set_node_type(TExprNodeType::NULL_LITERAL);
+  } else if (ColumnType(column.columnType).type == TYPE_INT) {
+    node.__set_node_type(TExprNodeType::INT_LITERAL);
+    TIntLiteral int_literal;
+    int_literal.__set_value(atoi(value.c_str()));
+    node.__set_int_literal(int_literal);
+  } else {
+    node.__set_node_type(TExprNodeType::STRING_LITERAL);
+    TStringLiteral string_literal;
+    string_literal.__set_value(value);
+    node.__set_string_literal(string_literal);
+  }
+  TExpr expr;
+  expr.nodes.push_back(node);
+  return expr;
+}
+
+TestTable* TestTable::Find(const string& db_name, const string& tbl_name) {
+  if (db_name != "default") return NULL;
+  lock_guard<mutex> l(tables_lock);
+  map<string, TestTable*>::iterator it = tables.find(tbl_name);
+  return it == tables.end() ? NULL : it->second;
+}
+
+}
@@ -0,0 +1,104 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPALA_TESTUTIL_TEST_TABLE_H
+#define IMPALA_TESTUTIL_TEST_TABLE_H
+
+#include <string>
+#include <vector>
+
+#include "common/status.h"
+#include "runtime/types.h"
+#include "gen-cpp/CatalogObjects_types.h"
+
+namespace impala {
+
+// A table in the default database over the files in a local directory, which tests add
+// to the catalog of an in-process impalad as a catalog update from the catalog server
+// would. Partitions are the 'key=value' subdirectories of the table's directory, as
+// Hive lays them out. Files and directories whose names start with '.' or '_' are
+// ignored. Text files are comma-delimited, with '\N' for NULL.
+//
+// Example usage:
+// TestTable table("text_tbl", "/tmp/my-test/text_tbl", THdfsFileFormat::TEXT);
+// table.AddColumn("i", TYPE_INT);
+// table.AddPartitionColumn("p", TYPE_INT);
+// RETURN_IF_ERROR(table.Create());
+// RETURN_IF_ERROR(table.WriteFile("p=1", "data.txt", "1\n2\n"));
+// RETURN_IF_ERROR(table.Update());
+class TestTable {
+ public:
+  TestTable(const std::string& name, const std::string& dir,
+      THdfsFileFormat::type file_format);
+  ~TestTable();
+
+  void AddColumn(const std::string& name, PrimitiveType type);
+
+  // Partition columns are INT or STRING.
+  void AddPartitionColumn(const std::string& name, PrimitiveType type);
+
+  // Files are split into blocks of 'block_size' bytes. 0, the default, makes every
+  // file a single block.
+  void set_block_size(int64_t block_size) { block_size_ = block_size; }
+
+  // Removes the table's directory if it exists and creates it empty. The table can be
+  // found with Find() from then on.
+  Status Create();
+
+  // Writes 'contents' to the file 'file_name' in the directory of 'partition', e.g.
+  // "p=1" or "p=1/q=a", which is created if needed. 'partition' is empty for
+  // unpartitioned tables.
+  Status WriteFile(const std::string& partition, const std::string& file_name,
+      const std::string& contents);
+
+  // Adds the table with the partitions and files that are on disk to the catalog of the
+  // in-process impalad, replacing any earlier version of it. Must be called again after
+  // the files changed, other than by inserts, which TestCatalogService applies.
+  Status Update();
+
+  // Sets 'catalog_object' to the table with the partitions and files that are on disk,
+  // at a catalog version above that of all earlier calls.
+  Status ToThrift(TCatalogObject* catalog_object) const;
+
+  const std::string& name() const { return name_; }
+  const std::string& dir() const { return dir_; }
+
+  // Returns the table 'db_name'.'tbl_name' if it was created, otherwise NULL.
+  static TestTable* Find(const std::string& db_name, const std::string& tbl_name);
+
+ private:
+  const std::string name_;
+  const std::string dir_;
+  const THdfsFileFormat::type file_format_;
+  int64_t block_size_;
+
+  // Assigned in Create().
+  int64_t id_;
+
+  std::vector<TColumn> columns_;
+  std::vector<TColumn> partition_columns_;
+
+  // Adds the partition in 'partition_dir' with 'values' for the partition columns and
+  // its files to 'hdfs_table'. 'values' is empty for unpartitioned tables.
+  Status AddPartition(const std::string& partition_dir,
+      const std::vector<std::string>& values, int64_t id, THdfsTable* hdfs_table) const;
+
+  // Returns the partition key literal for the 'value' of the partition column
+  // 'column', where '__HIVE_DEFAULT_PARTITION__' stands for NULL.
+  static TExpr MakePartitionKeyExpr(const TColumn& column, const std::string& value);
+};
+
+}
+
+#endif
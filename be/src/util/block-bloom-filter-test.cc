@@ -0,0 +1,75 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "util/block-bloom-filter.h"
+#include "util/cpu-info.h"
+
+using namespace std;
+
+namespace impala {
+
+static uint64_t HashInt(int64_t v) {
+  return BlockBloomFilter::Hash(&v, sizeof(v));
+}
+
+TEST(BlockBloomFilter, InsertFind) {
+  vector<uint8_t> directory(64 * 1024);
+  BlockBloomFilter filter(&directory[0], directory.size());
+  for (int64_t i = 0; i < 10000; ++i) filter.Insert(HashInt(i));
+  // No false negatives.
+  for (int64_t i = 0; i < 10000; ++i) EXPECT_TRUE(filter.Find(HashInt(i)));
+
+  // ~20 bits per value, so false positives should be rare.
+  int false_positives = 0;
+  for (int64_t i = 10000; i < 20000; ++i) false_positives += filter.Find(HashInt(i));
+  EXPECT_LT(false_positives, 100);
+}
+
+TEST(BlockBloomFilter, Fold) {
+  vector<uint8_t> directory(1024 * 1024);
+  BlockBloomFilter filter(&directory[0], directory.size());
+  for (int64_t i = 0; i < 1000; ++i) filter.Insert(HashInt(i));
+  EXPECT_LT(filter.Fill(), 0.01);
+
+  int64_t len = filter.Fold(0.5);
+  EXPECT_LT(len, directory.size());
+  EXPECT_TRUE(BlockBloomFilter::IsValidSize(len));
+  EXPECT_LE(filter.Fill(), 0.5);
+  EXPECT_GT(filter.Fill(), 0.25);
+
+  // Re-reading the folded directory must find every inserted value.
+  BlockBloomFilter folded(&directory[0], len);
+  for (int64_t i = 0; i < 1000; ++i) EXPECT_TRUE(folded.Find(HashInt(i)));
+  int false_positives = 0;
+  for (int64_t i = 1000; i < 11000; ++i) false_positives += folded.Find(HashInt(i));
+  EXPECT_LT(false_positives, 500);
+}
+
+TEST(BlockBloomFilter, FoldEmpty) {
+  vector<uint8_t> directory(4096);
+  BlockBloomFilter filter(&directory[0], directory.size());
+  EXPECT_EQ(filter.Fold(0.5), BlockBloomFilter::BYTES_PER_BLOCK);
+  EXPECT_FALSE(filter.Find(HashInt(1)));
+}
+
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  impala::CpuInfo::Init();
+  return RUN_ALL_TESTS();
+}
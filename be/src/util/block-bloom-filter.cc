@@ -0,0 +1,57 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/block-bloom-filter.h"
+
+using namespace impala;
+
+const int BlockBloomFilter::BYTES_PER_BLOCK;
+
+// Same constants as the Parquet format's split block Bloom filter.
+const uint32_t BlockBloomFilter::SALT[WORDS_PER_BLOCK] = {
+  0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+  0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+int64_t BlockBloomFilter::NumBitsSetIfHalved() const {
+  DCHECK_GT(num_blocks_, 1);
+  const uint64_t* words = reinterpret_cast<const uint64_t*>(directory_);
+  int64_t half_words = num_blocks_ * BYTES_PER_BLOCK / sizeof(uint64_t) / 2;
+  int64_t num_bits = 0;
+  for (int64_t i = 0; i < half_words; ++i) {
+    num_bits += BitUtil::Popcount(words[i] | words[i + half_words]);
+  }
+  return num_bits;
+}
+
+int64_t BlockBloomFilter::Fold(double max_fill) {
+  while (num_blocks_ > 1) {
+    int64_t half_bits = num_blocks_ * BYTES_PER_BLOCK * 8 / 2;
+    if (NumBitsSetIfHalved() > max_fill * half_bits) break;
+    int64_t half_words = num_blocks_ * WORDS_PER_BLOCK / 2;
+    for (int64_t i = 0; i < half_words; ++i) {
+      directory_[i] |= directory_[i + half_words];
+    }
+    num_blocks_ /= 2;
+  }
+  return len();
+}
+
+double BlockBloomFilter::Fill() const {
+  const uint64_t* words = reinterpret_cast<const uint64_t*>(directory_);
+  int64_t num_words = num_blocks_ * BYTES_PER_BLOCK / sizeof(uint64_t);
+  int64_t num_bits = 0;
+  for (int64_t i = 0; i < num_words; ++i) num_bits += BitUtil::Popcount(words[i]);
+  return static_cast<double>(num_bits) / (num_blocks_ * BYTES_PER_BLOCK * 8);
+}
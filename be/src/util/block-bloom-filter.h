@@ -0,0 +1,106 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_UTIL_BLOCK_BLOOM_FILTER_H
+#define IMPALA_UTIL_BLOCK_BLOOM_FILTER_H
+
+#include "common/logging.h"
+#include "util/bit-util.h"
+#include "util/hash-util.h"
+
+namespace impala {
+
+// Split block Bloom filter (Putze et al., "Cache-, Hash- and Space-Efficient Bloom
+// Filters"). The filter is a directory of 32-byte blocks. Each value selects one block
+// using the upper 32 bits of its hash and sets one bit in each of the block's eight
+// 32-bit words using the lower 32 bits, so an insert or a probe touches a single cache
+// line.
+// The filter does not own its directory. The directory is a plain little endian byte
+// array, so a filter can be written to a file as is and probed after reading it back.
+// The number of blocks is a power of two so that a sparsely populated filter can be
+// shrunk by folding its upper half into its lower half (see Fold()).
+class BlockBloomFilter {
+ public:
+  static const int BYTES_PER_BLOCK = 32;
+
+  // 'directory' must be 'len' bytes, where 'len' is a power of two and a multiple of
+  // BYTES_PER_BLOCK (see IsValidSize()). The directory must be zeroed for an empty
+  // filter.
+  BlockBloomFilter(uint8_t* directory, int64_t len)
+    : directory_(reinterpret_cast<uint32_t*>(directory)),
+      num_blocks_(len / BYTES_PER_BLOCK) {
+    DCHECK(IsValidSize(len)) << len;
+  }
+
+  static bool IsValidSize(int64_t len) {
+    return len >= BYTES_PER_BLOCK && (len & (len - 1)) == 0;
+  }
+
+  // Returns the hash used by Insert() and Find() for 'len' bytes at 'data'. This must
+  // not change since filters are persisted.
+  static uint64_t Hash(const void* data, int len) {
+    return HashUtil::MurmurHash2_64(data, len, HASH_SEED);
+  }
+
+  void Insert(uint64_t hash) {
+    uint32_t* block = BlockForHash(hash);
+    uint32_t key = static_cast<uint32_t>(hash);
+    for (int i = 0; i < WORDS_PER_BLOCK; ++i) {
+      block[i] |= 1U << ((key * SALT[i]) >> 27);
+    }
+  }
+
+  // Returns false if the value with 'hash' was definitely not inserted.
+  bool Find(uint64_t hash) const {
+    const uint32_t* block = BlockForHash(hash);
+    uint32_t key = static_cast<uint32_t>(hash);
+    for (int i = 0; i < WORDS_PER_BLOCK; ++i) {
+      if ((block[i] & (1U << ((key * SALT[i]) >> 27))) == 0) return false;
+    }
+    return true;
+  }
+
+  // Repeatedly halves the filter, as long as the fraction of bits set in the halved
+  // filter stays at or below 'max_fill'. Halving ORs block i + n/2 into block i, which
+  // keeps all inserted values since Insert() picks blocks with the low bits of the
+  // block hash. Returns the new directory length in bytes.
+  int64_t Fold(double max_fill);
+
+  // Fraction of bits set in the filter.
+  double Fill() const;
+
+  int64_t len() const { return num_blocks_ * BYTES_PER_BLOCK; }
+
+ private:
+  static const int WORDS_PER_BLOCK = BYTES_PER_BLOCK / sizeof(uint32_t);
+  static const uint64_t HASH_SEED = 0x4b1e0f7bULL;
+
+  // Odd constants used to derive the bit set in each word of a block.
+  static const uint32_t SALT[WORDS_PER_BLOCK];
+
+  uint32_t* BlockForHash(uint64_t hash) const {
+    return directory_ + WORDS_PER_BLOCK * ((hash >> 32) & (num_blocks_ - 1));
+  }
+
+  // Returns the number of bits that would be set if the filter were halved.
+  int64_t NumBitsSetIfHalved() const;
+
+  uint32_t* directory_;
+  int64_t num_blocks_;
+};
+
+}
+
+#endif
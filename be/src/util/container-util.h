@@ -17,8 +17,11 @@
 #define IMPALA_UTIL_CONTAINER_UTIL_H
 
 #include <map>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/unordered_map.hpp>
 
+#include "common/logging.h"
 #include "util/hash-util.h"
 #include "gen-cpp/Types_types.h"
 
@@ -99,6 +102,51 @@ void MergeMapValues(const std::map<K, V>& src, std::map<K, V>* dst) {
   }
 }
 
+// A boost::unordered_map split into NUM_SHARDS independently locked shards, so that
+// threads operating on different keys rarely contend for the same lock. Keys are
+// assigned to shards by their boost::hash. Callers take a shard's lock themselves:
+//   ShardedMap<K, V>::Shard& shard = map.GetShard(key);
+//   boost::lock_guard<boost::mutex> l(shard.lock);
+//   shard.map.find(key);
+// Operations over all entries must visit each shard in turn, so they do not see a
+// consistent snapshot of the whole map.
+template <typename K, typename V, int NUM_SHARDS = 16>
+class ShardedMap {
+ public:
+  typedef boost::unordered_map<K, V> Map;
+
+  struct Shard {
+    // Protects map.
+    boost::mutex lock;
+    Map map;
+  };
+
+  static const int num_shards = NUM_SHARDS;
+
+  Shard& GetShard(const K& key) {
+    return shards_[boost::hash<K>()(key) % NUM_SHARDS];
+  }
+
+  Shard& shard(int i) {
+    DCHECK_GE(i, 0);
+    DCHECK_LT(i, NUM_SHARDS);
+    return shards_[i];
+  }
+
+  // Returns the total number of entries. Takes each shard's lock in turn.
+  size_t size() {
+    size_t result = 0;
+    for (int i = 0; i < NUM_SHARDS; ++i) {
+      boost::lock_guard<boost::mutex> l(shards_[i].lock);
+      result += shards_[i].map.size();
+    }
+    return result;
+  }
+
+ private:
+  Shard shards_[NUM_SHARDS];
+};
+
 }
 
 #endif
@@ -14,6 +14,7 @@
 
 #include "util/hdfs-util.h"
 
+#include <errno.h>
 #include <sstream>
 #include <string.h>
 
@@ -48,6 +49,26 @@ Status GetLastModificationTime(const hdfsFS& connection, const char* filename,
   return Status::OK;
 }
 
+Status GetLastModificationTimes(const hdfsFS& connection, const char* dir,
+    unordered_map<string, time_t>* last_mod_times) {
+  int num_entries = 0;
+  errno = 0;
+  hdfsFileInfo* infos = hdfsListDirectory(connection, dir, &num_entries);
+  // An empty directory is also returned as NULL, but without an error.
+  if (infos == NULL && errno != 0) {
+    return Status(GetHdfsErrorMsg("Failed to list directory ", dir));
+  }
+  for (int i = 0; i < num_entries; ++i) {
+    if (infos[i].mKind != kObjectKindFile) continue;
+    // mName is the full path.
+    const char* name = strrchr(infos[i].mName, '/');
+    name = name == NULL ? infos[i].mName : name + 1;
+    (*last_mod_times)[name] = infos[i].mLastMod;
+  }
+  if (infos != NULL) hdfsFreeFileInfo(infos, num_entries);
+  return Status::OK;
+}
+
 bool IsHiddenFile(const string& filename) {
   return !filename.empty() && (filename[0] == '.' || filename[0] == '_');
 }
@@ -18,6 +18,7 @@
 
 #include <string>
 #include <hdfs.h>
+#include <boost/unordered_map.hpp>
 #include "common/status.h"
 
 namespace impala {
@@ -35,6 +36,12 @@ Status GetFileSize(const hdfsFS& connection, const char* filename, int64_t* file
 Status GetLastModificationTime(const hdfsFS& connection, const char* filename,
                                time_t* last_mod_time);
 
+// Sets 'last_mod_times' to the last modification times in seconds of the files in the
+// directory 'dir', by file name, from a single listing of the directory.
+// This should not be called in a fast path.
+Status GetLastModificationTimes(const hdfsFS& connection, const char* dir,
+    boost::unordered_map<std::string, time_t>* last_mod_times);
+
 bool IsHiddenFile(const std::string& filename);
 
 // Copy the file at 'src_path' from 'src_conn' to 'dst_path' in 'dst_conn'.
@@ -64,6 +64,14 @@ const char* ImpaladMetricKeys::CATALOG_NUM_TABLES =
     "catalog.num-tables";
 const char* ImpaladMetricKeys::CATALOG_READY =
     "catalog.ready";
+const char* ImpaladMetricKeys::CATALOG_NUM_DEFERRED_TABLES =
+    "catalog.num-deferred-tables";
+const char* ImpaladMetricKeys::CATALOG_NUM_ON_DEMAND_TABLE_LOADS =
+    "catalog.num-on-demand-table-loads";
+const char* ImpaladMetricKeys::CATALOG_UPDATE_SIZE_BYTES =
+    "catalog.update-size-bytes";
+const char* ImpaladMetricKeys::CATALOG_UPDATE_APPLY_TIME_MS =
+    "catalog.update-apply-time-ms";
 const char* ImpaladMetricKeys::NUM_FILES_OPEN_FOR_INSERT =
     "impala-server.num-files-open-for-insert";
 const char* ImpaladMetricKeys::IMPALA_SERVER_NUM_OPEN_HS2_SESSIONS =
@@ -76,10 +84,18 @@ const char* ImpaladMetricKeys::NUM_QUERIES_EXPIRED =
     "impala-server.num-queries-expired";
 const char* ImpaladMetricKeys::NUM_QUERIES_SPILLED =
     "impala-server.num-queries-spilled";
+const char* ImpaladMetricKeys::NUM_COORD_ONLY_QUERIES =
+    "impala-server.num-coordinator-only-queries";
 const char* ImpaladMetricKeys::RESULTSET_CACHE_TOTAL_NUM_ROWS =
     "impala-server.resultset-cache.total-num-rows";
 const char* ImpaladMetricKeys::RESULTSET_CACHE_TOTAL_BYTES =
     "impala-server.resultset-cache.total-bytes";
+const char* ImpaladMetricKeys::PLAN_CACHE_HITS =
+    "impala-server.plan-cache.hits";
+const char* ImpaladMetricKeys::PLAN_CACHE_MISSES =
+    "impala-server.plan-cache.misses";
+const char* ImpaladMetricKeys::PLAN_CACHE_NUM_ENTRIES =
+    "impala-server.plan-cache.num-entries";
 
 // These are created by impala-server during startup.
 // =======
@@ -89,12 +105,17 @@ IntCounter* ImpaladMetrics::IMPALA_SERVER_NUM_FRAGMENTS = NULL;
 IntCounter* ImpaladMetrics::IMPALA_SERVER_NUM_QUERIES = NULL;
 IntCounter* ImpaladMetrics::NUM_QUERIES_EXPIRED = NULL;
 IntCounter* ImpaladMetrics::NUM_QUERIES_SPILLED = NULL;
+IntCounter* ImpaladMetrics::NUM_COORD_ONLY_QUERIES = NULL;
 IntCounter* ImpaladMetrics::NUM_RANGES_MISSING_VOLUME_ID = NULL;
 IntCounter* ImpaladMetrics::NUM_RANGES_PROCESSED = NULL;
 IntCounter* ImpaladMetrics::NUM_SESSIONS_EXPIRED = NULL;
+IntCounter* ImpaladMetrics::CATALOG_NUM_ON_DEMAND_TABLE_LOADS = NULL;
+IntCounter* ImpaladMetrics::PLAN_CACHE_HITS = NULL;
+IntCounter* ImpaladMetrics::PLAN_CACHE_MISSES = NULL;
 
 // Gauges
 IntGauge* ImpaladMetrics::CATALOG_NUM_DBS = NULL;
+IntGauge* ImpaladMetrics::CATALOG_NUM_DEFERRED_TABLES = NULL;
 IntGauge* ImpaladMetrics::CATALOG_NUM_TABLES = NULL;
 IntGauge* ImpaladMetrics::IMPALA_SERVER_NUM_OPEN_BEESWAX_SESSIONS = NULL;
 IntGauge* ImpaladMetrics::IMPALA_SERVER_NUM_OPEN_HS2_SESSIONS = NULL;
@@ -109,6 +130,7 @@ IntGauge* ImpaladMetrics::IO_MGR_CACHED_BYTES_READ = NULL;
 IntGauge* ImpaladMetrics::IO_MGR_BYTES_WRITTEN = NULL;
 IntGauge* ImpaladMetrics::MEM_POOL_TOTAL_BYTES = NULL;
 IntGauge* ImpaladMetrics::NUM_FILES_OPEN_FOR_INSERT = NULL;
+IntGauge* ImpaladMetrics::PLAN_CACHE_NUM_ENTRIES = NULL;
 IntGauge* ImpaladMetrics::RESULTSET_CACHE_TOTAL_NUM_ROWS = NULL;
 IntGauge* ImpaladMetrics::RESULTSET_CACHE_TOTAL_BYTES = NULL;
 
@@ -118,6 +140,10 @@ BooleanProperty* ImpaladMetrics::IMPALA_SERVER_READY = NULL;
 StringProperty* ImpaladMetrics::IMPALA_SERVER_START_TIME = NULL;
 StringProperty* ImpaladMetrics::IMPALA_SERVER_VERSION = NULL;
 
+// Stats
+StatsMetric<double>* ImpaladMetrics::CATALOG_UPDATE_SIZE_BYTES = NULL;
+StatsMetric<double>* ImpaladMetrics::CATALOG_UPDATE_APPLY_TIME_MS = NULL;
+
 void ImpaladMetrics::CreateMetrics(MetricGroup* m) {
   // Initialize impalad metrics
   IMPALA_SERVER_START_TIME = m->AddProperty<string>(
@@ -133,6 +159,8 @@ void ImpaladMetrics::CreateMetrics(MetricGroup* m) {
       ImpaladMetricKeys::NUM_QUERIES_EXPIRED, 0L);
   NUM_QUERIES_SPILLED = m->AddCounter(
       ImpaladMetricKeys::NUM_QUERIES_SPILLED, 0L);
+  NUM_COORD_ONLY_QUERIES = m->AddCounter(
+      ImpaladMetricKeys::NUM_COORD_ONLY_QUERIES, 0L);
   IMPALA_SERVER_NUM_FRAGMENTS = m->AddCounter(
       ImpaladMetricKeys::IMPALA_SERVER_NUM_FRAGMENTS, 0L);
   IMPALA_SERVER_NUM_OPEN_HS2_SESSIONS = m->AddGauge<int64_t>(
@@ -145,6 +173,12 @@ void ImpaladMetrics::CreateMetrics(MetricGroup* m) {
       ImpaladMetricKeys::RESULTSET_CACHE_TOTAL_NUM_ROWS, 0L);
   RESULTSET_CACHE_TOTAL_BYTES = m->AddGauge(
       ImpaladMetricKeys::RESULTSET_CACHE_TOTAL_BYTES, 0L);
+  PLAN_CACHE_HITS = m->AddCounter(
+      ImpaladMetricKeys::PLAN_CACHE_HITS, 0L);
+  PLAN_CACHE_MISSES = m->AddCounter(
+      ImpaladMetricKeys::PLAN_CACHE_MISSES, 0L);
+  PLAN_CACHE_NUM_ENTRIES = m->AddGauge<int64_t>(
+      ImpaladMetricKeys::PLAN_CACHE_NUM_ENTRIES, 0L);
 
   // Initialize scan node metrics
   NUM_RANGES_PROCESSED = m->AddCounter(
@@ -190,6 +224,14 @@ void ImpaladMetrics::CreateMetrics(MetricGroup* m) {
       ImpaladMetricKeys::CATALOG_NUM_TABLES, 0L);
   CATALOG_READY = m->AddProperty<bool>(
       ImpaladMetricKeys::CATALOG_READY, false);
+  CATALOG_NUM_DEFERRED_TABLES = m->AddGauge<int64_t>(
+      ImpaladMetricKeys::CATALOG_NUM_DEFERRED_TABLES, 0L);
+  CATALOG_NUM_ON_DEMAND_TABLE_LOADS = m->AddCounter(
+      ImpaladMetricKeys::CATALOG_NUM_ON_DEMAND_TABLE_LOADS, 0L);
+  CATALOG_UPDATE_SIZE_BYTES = m->RegisterMetric(new StatsMetric<double>(
+      ImpaladMetricKeys::CATALOG_UPDATE_SIZE_BYTES, TUnit::BYTES));
+  CATALOG_UPDATE_APPLY_TIME_MS = m->RegisterMetric(new StatsMetric<double>(
+      ImpaladMetricKeys::CATALOG_UPDATE_APPLY_TIME_MS, TUnit::TIME_MS));
 }
 
 }
@@ -17,6 +17,7 @@
 #define IMPALA_UTIL_IMPALAD_METRICS_H
 
 #include "util/metrics.h"
+#include "util/collection-metrics.h"
 
 namespace impala {
 
@@ -97,6 +98,20 @@ class ImpaladMetricKeys {
   // a catalog server with an unexpected ID.
   static const char* CATALOG_READY;
 
+  // Number of tables whose metadata was received from the catalog topic but not yet
+  // applied to the local catalog, see --load_catalog_tables_on_demand.
+  static const char* CATALOG_NUM_DEFERRED_TABLES;
+
+  // Number of tables whose metadata was fetched from the catalog server because a query
+  // referenced them.
+  static const char* CATALOG_NUM_ON_DEMAND_TABLE_LOADS;
+
+  // Size of the catalog topic entries applied to the local catalog per update.
+  static const char* CATALOG_UPDATE_SIZE_BYTES;
+
+  // Time spent applying each catalog update to the local catalog.
+  static const char* CATALOG_UPDATE_APPLY_TIME_MS;
+
   // Number of files open for insert
   static const char* NUM_FILES_OPEN_FOR_INSERT;
 
@@ -109,11 +124,24 @@ class ImpaladMetricKeys {
   // Number of queries that spilled.
   static const char* NUM_QUERIES_SPILLED;
 
+  // Number of queries that ran entirely in the coordinator's process without admission
+  // control or codegen.
+  static const char* NUM_COORD_ONLY_QUERIES;
+
   // Total number of rows cached to support HS2 FETCH_FIRST.
   static const char* RESULTSET_CACHE_TOTAL_NUM_ROWS;
 
   // Total bytes consumed for rows cached to support HS2 FETCH_FIRST.
   static const char* RESULTSET_CACHE_TOTAL_BYTES;
+
+  // Number of queries whose plan was found in the plan cache.
+  static const char* PLAN_CACHE_HITS;
+
+  // Number of plan cache lookups that had to plan the query.
+  static const char* PLAN_CACHE_MISSES;
+
+  // Number of plans in the plan cache.
+  static const char* PLAN_CACHE_NUM_ENTRIES;
 };
 
 // Global impalad-wide metrics.  This is useful for objects that want to update metrics
@@ -128,11 +156,16 @@ class ImpaladMetrics {
   static IntCounter* IMPALA_SERVER_NUM_QUERIES;
   static IntCounter* NUM_QUERIES_EXPIRED;
   static IntCounter* NUM_QUERIES_SPILLED;
+  static IntCounter* NUM_COORD_ONLY_QUERIES;
   static IntCounter* NUM_RANGES_MISSING_VOLUME_ID;
   static IntCounter* NUM_RANGES_PROCESSED;
   static IntCounter* NUM_SESSIONS_EXPIRED;
+  static IntCounter* CATALOG_NUM_ON_DEMAND_TABLE_LOADS;
+  static IntCounter* PLAN_CACHE_HITS;
+  static IntCounter* PLAN_CACHE_MISSES;
   // Gauges
   static IntGauge* CATALOG_NUM_DBS;
+  static IntGauge* CATALOG_NUM_DEFERRED_TABLES;
   static IntGauge* CATALOG_NUM_TABLES;
   static IntGauge* IMPALA_SERVER_NUM_OPEN_BEESWAX_SESSIONS;
   static IntGauge* IMPALA_SERVER_NUM_OPEN_HS2_SESSIONS;
@@ -147,6 +180,7 @@ class ImpaladMetrics {
   static IntGauge* IO_MGR_BYTES_WRITTEN;
   static IntGauge* MEM_POOL_TOTAL_BYTES;
   static IntGauge* NUM_FILES_OPEN_FOR_INSERT;
+  static IntGauge* PLAN_CACHE_NUM_ENTRIES;
   static IntGauge* RESULTSET_CACHE_TOTAL_NUM_ROWS;
   static IntGauge* RESULTSET_CACHE_TOTAL_BYTES;
   // Properties
@@ -155,6 +189,10 @@ class ImpaladMetrics {
   static StringProperty* IMPALA_SERVER_START_TIME;
   static StringProperty* IMPALA_SERVER_VERSION;
 
+  // Stats
+  static StatsMetric<double>* CATALOG_UPDATE_SIZE_BYTES;
+  static StatsMetric<double>* CATALOG_UPDATE_APPLY_TIME_MS;
+
   // Creates and initializes all metrics above in 'm'.
   static void CreateMetrics(MetricGroup* m);
 };
@@ -0,0 +1,247 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+#include <gutil/strings/substitute.h>
+
+#include "common/init.h"
+#include "common/object-pool.h"
+#include "util/profile-archive.h"
+#include "util/runtime-profile.h"
+
+using namespace boost;
+using namespace std;
+using namespace strings;
+
+namespace impala {
+
+static const string ARCHIVE_DIR = "/tmp/profile-archive-test";
+
+// Builds the profile of a query with 'num_instances' fragment instances, which all
+// share their counter names.
+static void MakeProfile(int seed, int num_instances, TRuntimeProfileTree* tree) {
+  ObjectPool pool;
+  RuntimeProfile query(&pool, "Query");
+  query.AddInfoString("Sql Statement", "select * from t");
+  RuntimeProfile::EventSequence* events = query.AddEventSequence("Query Timeline");
+  events->Start();
+  events->MarkEvent("Planning finished");
+  events->MarkEvent("Rows available");
+  for (int i = 0; i < num_instances; ++i) {
+    RuntimeProfile* instance = pool.Add(new RuntimeProfile(&pool, "Instance"));
+    query.AddChild(instance);
+    instance->AddCounter("RowsReturned", TUnit::UNIT)->Set(seed * i);
+    instance->AddCounter("PeakMemoryUsage", TUnit::BYTES)->Set(-1L * seed);
+    instance->AddInfoString("Host", "host");
+  }
+  query.ToThrift(tree);
+}
+
+static TUniqueId MakeId(int i) {
+  TUniqueId id;
+  id.hi = i;
+  id.lo = -i;
+  return id;
+}
+
+static void ArchiveQuery(ProfileArchive* archive, int i) {
+  ProfileArchive::Entry entry;
+  entry.query_id = MakeId(i);
+  entry.stmt = Substitute("select $0", i);
+  TRuntimeProfileTree tree;
+  MakeProfile(i, 4, &tree);
+  EXPECT_TRUE(archive->Archive(entry, &tree));
+  EXPECT_TRUE(tree.nodes.empty());
+}
+
+// Returns the number of files in ARCHIVE_DIR.
+static int NumFiles() {
+  int num_files = 0;
+  for (filesystem::directory_iterator it(ARCHIVE_DIR);
+       it != filesystem::directory_iterator(); ++it) {
+    ++num_files;
+  }
+  return num_files;
+}
+
+TEST(ProfileArchiveTest, EncodeDecode) {
+  TRuntimeProfileTree tree;
+  MakeProfile(3, 10, &tree);
+  string encoded;
+  ProfileArchive::EncodeProfile(tree, &encoded);
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(encoded.data());
+
+  TRuntimeProfileTree decoded;
+  EXPECT_TRUE(ProfileArchive::DecodeProfile(data, encoded.size(), &decoded).ok());
+  EXPECT_TRUE(decoded == tree);
+
+  // Truncated profiles are rejected.
+  for (int len = 0; len < encoded.size(); len += 7) {
+    TRuntimeProfileTree truncated;
+    EXPECT_FALSE(ProfileArchive::DecodeProfile(data, len, &truncated).ok()) << len;
+  }
+}
+
+TEST(ProfileArchiveTest, ArchiveAndReload) {
+  filesystem::remove_all(ARCHIVE_DIR);
+  {
+    // Index the last 7 of 10 queries, 3 per file.
+    ProfileArchive archive(ARCHIVE_DIR, 3, 7, 100);
+    ASSERT_TRUE(archive.Init().ok());
+    for (int i = 0; i < 10; ++i) {
+      ArchiveQuery(&archive, i);
+    }
+    archive.WaitForWrites();
+    EXPECT_EQ(archive.num_archived_queries(), 7);
+    EXPECT_EQ(archive.num_dropped_profiles(), 0);
+
+    for (int i = 0; i < 10; ++i) {
+      TRuntimeProfileTree tree;
+      Status status = archive.GetProfile(MakeId(i), &tree);
+      if (i < 3) {
+        EXPECT_FALSE(status.ok());
+        continue;
+      }
+      ASSERT_TRUE(status.ok()) << status.GetDetail();
+      TRuntimeProfileTree expected;
+      MakeProfile(i, 4, &expected);
+      EXPECT_EQ(tree.nodes.size(), expected.nodes.size());
+      EXPECT_EQ(tree.nodes[1].counters, expected.nodes[1].counters);
+    }
+
+    vector<ProfileArchive::Entry> entries;
+    archive.GetEntries(0, 0, 5, &entries);
+    ASSERT_EQ(entries.size(), 5);
+    EXPECT_EQ(entries[0].stmt, "select 9");
+    EXPECT_EQ(entries[4].stmt, "select 5");
+  }
+
+  // The file of the first three queries was deleted once they were all evicted.
+  EXPECT_EQ(NumFiles(), 3);
+
+  // The index is rebuilt from the files.
+  ProfileArchive archive(ARCHIVE_DIR, 3, 7, 100);
+  ASSERT_TRUE(archive.Init().ok());
+  EXPECT_EQ(archive.num_archived_queries(), 7);
+  TRuntimeProfileTree tree;
+  EXPECT_TRUE(archive.GetProfile(MakeId(9), &tree).ok());
+  vector<ProfileArchive::Entry> entries;
+  archive.GetEntries(0, 0, 100, &entries);
+  ASSERT_EQ(entries.size(), 7);
+  EXPECT_EQ(entries[0].stmt, "select 9");
+  EXPECT_EQ(entries[6].stmt, "select 3");
+
+  // Entries before the newest one.
+  vector<ProfileArchive::Entry> older;
+  archive.GetEntries(entries[0].archive_time_ms, entries[0].sequence, 100, &older);
+  ASSERT_EQ(older.size(), 6);
+  EXPECT_EQ(older[0].stmt, "select 8");
+  filesystem::remove_all(ARCHIVE_DIR);
+}
+
+// Every file is deleted once all of its entries are evicted, both while profiles are
+// archived and while the index is rebuilt with a smaller limit.
+TEST(ProfileArchiveTest, EvictedFilesAreDeleted) {
+  filesystem::remove_all(ARCHIVE_DIR);
+  {
+    // One query per file, the last 2 of which are indexed.
+    ProfileArchive archive(ARCHIVE_DIR, 1, 2, 100);
+    ASSERT_TRUE(archive.Init().ok());
+    for (int i = 0; i < 10; ++i) {
+      ArchiveQuery(&archive, i);
+    }
+    archive.WaitForWrites();
+    EXPECT_EQ(archive.num_archived_queries(), 2);
+    EXPECT_EQ(NumFiles(), 2);
+  }
+  {
+    // The file of query 8 is evicted while loading. Init() starts a new, empty file.
+    ProfileArchive archive(ARCHIVE_DIR, 1, 1, 100);
+    ASSERT_TRUE(archive.Init().ok());
+    EXPECT_EQ(archive.num_archived_queries(), 1);
+    TRuntimeProfileTree tree;
+    EXPECT_TRUE(archive.GetProfile(MakeId(9), &tree).ok());
+    EXPECT_EQ(NumFiles(), 2);
+  }
+  // The empty file of the previous archive is deleted when it is loaded.
+  ProfileArchive archive(ARCHIVE_DIR, 1, 1, 100);
+  ASSERT_TRUE(archive.Init().ok());
+  EXPECT_EQ(archive.num_archived_queries(), 1);
+  EXPECT_EQ(NumFiles(), 2);
+  ArchiveQuery(&archive, 10);
+  archive.WaitForWrites();
+  TRuntimeProfileTree tree;
+  EXPECT_TRUE(archive.GetProfile(MakeId(10), &tree).ok());
+  EXPECT_EQ(NumFiles(), 1);
+  filesystem::remove_all(ARCHIVE_DIR);
+}
+
+// Paging with the archive time and sequence of the last entry of each page visits
+// every entry once, although many queries are archived within the same millisecond.
+TEST(ProfileArchiveTest, Paging) {
+  filesystem::remove_all(ARCHIVE_DIR);
+  const int NUM_QUERIES = 50;
+  ProfileArchive archive(ARCHIVE_DIR, 8, 100, 100);
+  ASSERT_TRUE(archive.Init().ok());
+  for (int i = 0; i < NUM_QUERIES; ++i) {
+    ArchiveQuery(&archive, i);
+  }
+  archive.WaitForWrites();
+
+  vector<ProfileArchive::Entry> all_entries;
+  archive.GetEntries(0, 0, 100, &all_entries);
+  ASSERT_EQ(all_entries.size(), NUM_QUERIES);
+  for (int i = 1; i < all_entries.size(); ++i) {
+    // Newest first, ordered by archive time and sequence.
+    EXPECT_GE(all_entries[i - 1].archive_time_ms, all_entries[i].archive_time_ms);
+    EXPECT_GT(all_entries[i - 1].sequence, all_entries[i].sequence);
+  }
+
+  for (int page_size = 1; page_size <= 7; ++page_size) {
+    vector<ProfileArchive::Entry> visited;
+    vector<ProfileArchive::Entry> page;
+    archive.GetEntries(0, 0, page_size, &page);
+    while (!page.empty()) {
+      EXPECT_LE(page.size(), page_size);
+      visited.insert(visited.end(), page.begin(), page.end());
+      page.clear();
+      archive.GetEntries(visited.back().archive_time_ms, visited.back().sequence,
+          page_size, &page);
+    }
+    ASSERT_EQ(visited.size(), NUM_QUERIES) << page_size;
+    for (int i = 0; i < NUM_QUERIES; ++i) {
+      EXPECT_EQ(visited[i].stmt, Substitute("select $0", NUM_QUERIES - 1 - i));
+    }
+  }
+
+  // With a sequence of 0, only entries archived strictly before the given time are
+  // returned.
+  vector<ProfileArchive::Entry> page;
+  archive.GetEntries(all_entries[0].archive_time_ms, 0, 100, &page);
+  for (int i = 0; i < page.size(); ++i) {
+    EXPECT_LT(page[i].archive_time_ms, all_entries[0].archive_time_ms);
+  }
+  filesystem::remove_all(ARCHIVE_DIR);
+}
+
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  impala::InitCommonRuntime(argc, argv, false);
+  return RUN_ALL_TESTS();
+}
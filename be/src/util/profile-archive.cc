@@ -0,0 +1,676 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/profile-archive.h"
+
+#include <algorithm>
+#include <string.h>
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <gutil/strings/substitute.h>
+
+#include "common/logging.h"
+#include "util/debug-util.h"
+#include "util/thread.h"
+#include "util/time.h"
+
+using namespace boost;
+using namespace impala;
+using namespace std;
+using namespace strings;
+
+const string ProfileArchive::ARCHIVE_FILE_PREFIX = "impala_profile_archive_1.0-";
+const string ProfileArchive::ARCHIVE_FILE_MAGIC = "IMPPROF1";
+
+// Records larger than this are treated as corrupt when loading the archive.
+static const uint32_t MAX_RECORD_LEN = 1024 * 1024 * 1024;
+
+namespace {
+
+// Appends varints and strings to a buffer. Strings passed to AppendInternedString()
+// are written to a separate string table the first time they are seen and referred to
+// by their index in the table afterwards.
+class ArchiveWriter {
+ public:
+  ArchiveWriter(string* out) : out_(out) { }
+
+  void AppendVarint(uint64_t v) {
+    while (v >= 0x80) {
+      out_->push_back(static_cast<char>(v | 0x80));
+      v >>= 7;
+    }
+    out_->push_back(static_cast<char>(v));
+  }
+
+  void AppendZigZag(int64_t v) {
+    AppendVarint((static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63));
+  }
+
+  void AppendString(const string& s) {
+    AppendVarint(s.size());
+    out_->append(s);
+  }
+
+  void AppendInternedString(const string& s) {
+    pair<StringTable::iterator, bool> it =
+        string_table_.insert(make_pair(s, string_table_.size()));
+    if (it.second) strings_.push_back(&it.first->first);
+    AppendVarint(it.first->second);
+  }
+
+  // Appends the string table to 'out'.
+  void AppendStringTable(string* out) {
+    ArchiveWriter writer(out);
+    writer.AppendVarint(strings_.size());
+    BOOST_FOREACH(const string* s, strings_) {
+      writer.AppendString(*s);
+    }
+  }
+
+ private:
+  string* out_;
+
+  typedef unordered_map<string, int> StringTable;
+  StringTable string_table_;
+
+  // The keys of 'string_table_' in order of their index.
+  vector<const string*> strings_;
+};
+
+// Reads the values appended by an ArchiveWriter. Reads past the end of the buffer set
+// an error, after which all reads return zero values.
+class ArchiveReader {
+ public:
+  ArchiveReader(const uint8_t* data, int64_t len)
+    : pos_(data), end_(data + len), ok_(true) {
+  }
+
+  uint64_t ReadVarint() {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (pos_ >= end_) return SetError();
+      uint8_t byte = *pos_++;
+      v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) return v;
+    }
+    return SetError();
+  }
+
+  int64_t ReadZigZag() {
+    uint64_t v = ReadVarint();
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+  }
+
+  // Reads a count of elements, each of which takes at least one byte.
+  int ReadCount() {
+    uint64_t count = ReadVarint();
+    if (count > end_ - pos_) return SetError();
+    return count;
+  }
+
+  void ReadString(string* s) {
+    uint64_t len = ReadVarint();
+    if (len > end_ - pos_) {
+      SetError();
+      return;
+    }
+    s->assign(reinterpret_cast<const char*>(pos_), len);
+    pos_ += len;
+  }
+
+  void ReadStringTable() {
+    strings_.resize(ReadCount());
+    for (int i = 0; i < strings_.size(); ++i) {
+      ReadString(&strings_[i]);
+    }
+  }
+
+  const string& ReadInternedString() {
+    uint64_t idx = ReadVarint();
+    if (idx >= strings_.size()) {
+      SetError();
+      return empty_;
+    }
+    return strings_[idx];
+  }
+
+  bool ok() const { return ok_; }
+  const uint8_t* pos() const { return pos_; }
+
+ private:
+  const uint8_t* pos_;
+  const uint8_t* end_;
+  bool ok_;
+  vector<string> strings_;
+  string empty_;
+
+  uint64_t SetError() {
+    ok_ = false;
+    pos_ = end_;
+    return 0;
+  }
+};
+
+}
+
+void ProfileArchive::EncodeProfile(const TRuntimeProfileTree& profile, string* out) {
+  string nodes;
+  ArchiveWriter writer(&nodes);
+  writer.AppendVarint(profile.nodes.size());
+  BOOST_FOREACH(const TRuntimeProfileNode& node, profile.nodes) {
+    writer.AppendInternedString(node.name);
+    writer.AppendVarint(node.num_children);
+    writer.AppendZigZag(node.metadata);
+    writer.AppendVarint(node.indent);
+
+    writer.AppendVarint(node.counters.size());
+    BOOST_FOREACH(const TCounter& counter, node.counters) {
+      writer.AppendInternedString(counter.name);
+      writer.AppendVarint(counter.unit);
+      writer.AppendZigZag(counter.value);
+    }
+
+    writer.AppendVarint(node.info_strings.size());
+    for (map<string, string>::const_iterator it = node.info_strings.begin();
+         it != node.info_strings.end(); ++it) {
+      writer.AppendInternedString(it->first);
+      writer.AppendInternedString(it->second);
+    }
+    writer.AppendVarint(node.info_strings_display_order.size());
+    BOOST_FOREACH(const string& key, node.info_strings_display_order) {
+      writer.AppendInternedString(key);
+    }
+
+    writer.AppendVarint(node.child_counters_map.size());
+    for (map<string, set<string> >::const_iterator it = node.child_counters_map.begin();
+         it != node.child_counters_map.end(); ++it) {
+      writer.AppendInternedString(it->first);
+      writer.AppendVarint(it->second.size());
+      BOOST_FOREACH(const string& child, it->second) {
+        writer.AppendInternedString(child);
+      }
+    }
+
+    // Event timestamps and time series samples are mostly increasing, so they are
+    // stored as deltas.
+    writer.AppendVarint(node.__isset.event_sequences);
+    if (node.__isset.event_sequences) {
+      writer.AppendVarint(node.event_sequences.size());
+      BOOST_FOREACH(const TEventSequence& seq, node.event_sequences) {
+        DCHECK_EQ(seq.labels.size(), seq.timestamps.size());
+        writer.AppendInternedString(seq.name);
+        writer.AppendVarint(seq.labels.size());
+        int64_t prev = 0;
+        for (int i = 0; i < seq.labels.size(); ++i) {
+          writer.AppendInternedString(seq.labels[i]);
+          writer.AppendZigZag(seq.timestamps[i] - prev);
+          prev = seq.timestamps[i];
+        }
+      }
+    }
+
+    writer.AppendVarint(node.__isset.time_series_counters);
+    if (node.__isset.time_series_counters) {
+      writer.AppendVarint(node.time_series_counters.size());
+      BOOST_FOREACH(const TTimeSeriesCounter& counter, node.time_series_counters) {
+        writer.AppendInternedString(counter.name);
+        writer.AppendVarint(counter.unit);
+        writer.AppendVarint(counter.period_ms);
+        writer.AppendVarint(counter.values.size());
+        int64_t prev = 0;
+        BOOST_FOREACH(int64_t value, counter.values) {
+          writer.AppendZigZag(value - prev);
+          prev = value;
+        }
+      }
+    }
+  }
+  writer.AppendStringTable(out);
+  out->append(nodes);
+}
+
+Status ProfileArchive::DecodeProfile(const uint8_t* data, int64_t len,
+    TRuntimeProfileTree* profile) {
+  ArchiveReader reader(data, len);
+  reader.ReadStringTable();
+  profile->nodes.resize(reader.ReadCount());
+  for (int n = 0; n < profile->nodes.size() && reader.ok(); ++n) {
+    TRuntimeProfileNode& node = profile->nodes[n];
+    node.name = reader.ReadInternedString();
+    node.num_children = reader.ReadVarint();
+    node.metadata = reader.ReadZigZag();
+    node.indent = reader.ReadVarint() != 0;
+
+    node.counters.resize(reader.ReadCount());
+    BOOST_FOREACH(TCounter& counter, node.counters) {
+      counter.name = reader.ReadInternedString();
+      counter.unit = static_cast<TUnit::type>(reader.ReadVarint());
+      counter.value = reader.ReadZigZag();
+    }
+
+    int num_info_strings = reader.ReadCount();
+    for (int i = 0; i < num_info_strings; ++i) {
+      const string& key = reader.ReadInternedString();
+      node.info_strings[key] = reader.ReadInternedString();
+    }
+    node.info_strings_display_order.resize(reader.ReadCount());
+    BOOST_FOREACH(string& key, node.info_strings_display_order) {
+      key = reader.ReadInternedString();
+    }
+
+    int num_child_counters = reader.ReadCount();
+    for (int i = 0; i < num_child_counters; ++i) {
+      set<string>& children = node.child_counters_map[reader.ReadInternedString()];
+      int num_children = reader.ReadCount();
+      for (int j = 0; j < num_children; ++j) {
+        children.insert(reader.ReadInternedString());
+      }
+    }
+
+    if (reader.ReadVarint() != 0) {
+      node.__set_event_sequences(vector<TEventSequence>(reader.ReadCount()));
+      BOOST_FOREACH(TEventSequence& seq, node.event_sequences) {
+        seq.name = reader.ReadInternedString();
+        int num_events = reader.ReadCount();
+        seq.labels.resize(num_events);
+        seq.timestamps.resize(num_events);
+        int64_t prev = 0;
+        for (int i = 0; i < num_events; ++i) {
+          seq.labels[i] = reader.ReadInternedString();
+          prev += reader.ReadZigZag();
+          seq.timestamps[i] = prev;
+        }
+      }
+    }
+
+    if (reader.ReadVarint() != 0) {
+      node.__set_time_series_counters(vector<TTimeSeriesCounter>(reader.ReadCount()));
+      BOOST_FOREACH(TTimeSeriesCounter& counter, node.time_series_counters) {
+        counter.name = reader.ReadInternedString();
+        counter.unit = static_cast<TUnit::type>(reader.ReadVarint());
+        counter.period_ms = reader.ReadVarint();
+        counter.values.resize(reader.ReadCount());
+        int64_t prev = 0;
+        BOOST_FOREACH(int64_t& value, counter.values) {
+          prev += reader.ReadZigZag();
+          value = prev;
+        }
+      }
+    }
+  }
+  if (!reader.ok()) return Status("Corrupt archived query profile");
+  return Status::OK;
+}
+
+void ProfileArchive::EncodeRecord(const Entry& entry, const TRuntimeProfileTree* profile,
+    string* out) {
+  ArchiveWriter writer(out);
+  writer.AppendZigZag(entry.query_id.hi);
+  writer.AppendZigZag(entry.query_id.lo);
+  writer.AppendZigZag(entry.archive_time_ms);
+  writer.AppendString(entry.effective_user);
+  writer.AppendString(entry.stmt);
+  writer.AppendString(entry.query_state);
+  writer.AppendString(entry.start_time);
+  writer.AppendString(entry.end_time);
+  if (profile != NULL) EncodeProfile(*profile, out);
+}
+
+Status ProfileArchive::DecodeRecordSummary(const uint8_t* data, int64_t len,
+    Entry* entry, int64_t* profile_offset) {
+  ArchiveReader reader(data, len);
+  entry->query_id.hi = reader.ReadZigZag();
+  entry->query_id.lo = reader.ReadZigZag();
+  entry->archive_time_ms = reader.ReadZigZag();
+  reader.ReadString(&entry->effective_user);
+  reader.ReadString(&entry->stmt);
+  reader.ReadString(&entry->query_state);
+  reader.ReadString(&entry->start_time);
+  reader.ReadString(&entry->end_time);
+  if (!reader.ok()) return Status("Corrupt archived query summary");
+  *profile_offset = reader.pos() - data;
+  return Status::OK;
+}
+
+ProfileArchive::ProfileArchive(const string& archive_dir, int max_entries_per_file,
+    int max_archived_queries, int max_queued_profiles)
+  : archive_dir_(archive_dir),
+    max_entries_per_file_(max_entries_per_file),
+    max_archived_queries_(max_archived_queries),
+    max_queued_profiles_(max_queued_profiles),
+    shutdown_(false),
+    num_dropped_profiles_(0),
+    num_in_flight_(0),
+    next_sequence_(0),
+    file_size_(0),
+    num_file_entries_(0) {
+  DCHECK_GT(max_entries_per_file_, 0);
+  DCHECK_GT(max_archived_queries_, 0);
+}
+
+ProfileArchive::~ProfileArchive() {
+  if (writer_thread_.get() != NULL) {
+    {
+      lock_guard<mutex> l(queue_lock_);
+      shutdown_ = true;
+    }
+    queue_cv_.notify_all();
+    writer_thread_->Join();
+  }
+  BOOST_FOREACH(QueuedProfile* queued, queue_) {
+    delete queued;
+  }
+}
+
+Status ProfileArchive::Init() {
+  try {
+    if (!filesystem::exists(archive_dir_)) {
+      LOG(INFO) << "Profile archive directory does not exist, creating: "
+                << archive_dir_;
+      filesystem::create_directories(archive_dir_);
+    }
+    if (!filesystem::is_directory(archive_dir_)) {
+      return Status(Substitute("Profile archive path is not a directory: $0",
+          archive_dir_));
+    }
+
+    // File names end in their creation time, which has the same number of digits for
+    // all files, so sorting them by name sorts them by age.
+    vector<string> file_names;
+    for (filesystem::directory_iterator it(archive_dir_);
+         it != filesystem::directory_iterator(); ++it) {
+      string name = it->path().filename().string();
+      if (name.compare(0, ARCHIVE_FILE_PREFIX.size(), ARCHIVE_FILE_PREFIX) == 0) {
+        file_names.push_back(it->path().string());
+      }
+    }
+    sort(file_names.begin(), file_names.end());
+    BOOST_FOREACH(const string& file_name, file_names) {
+      Status status = LoadFile(file_name);
+      if (!status.ok()) {
+        LOG(WARNING) << "Could not load profile archive file " << file_name << ": "
+                     << status.GetDetail();
+      }
+    }
+  } catch (const std::exception& e) {
+    return Status(Substitute("Could not initialize profile archive in $0: $1",
+        archive_dir_, e.what()));
+  }
+  // Files that were loaded but hold no indexed entries are stale.
+  {
+    lock_guard<mutex> l(index_lock_);
+    for (map<string, int>::iterator it = file_entry_counts_.begin();
+         it != file_entry_counts_.end();) {
+      if (it->second == 0) {
+        boost::system::error_code ec;
+        filesystem::remove(it->first, ec);
+        file_entry_counts_.erase(it++);
+      } else {
+        ++it;
+      }
+    }
+  }
+  RETURN_IF_ERROR(RollFile());
+  LOG(INFO) << "Archiving query profiles to " << archive_dir_ << ", "
+            << entries_.size() << " archived queries loaded";
+  writer_thread_.reset(new Thread("impala-server", "profile-archive-writer",
+      &ProfileArchive::WriterThread, this));
+  return Status::OK;
+}
+
+Status ProfileArchive::LoadFile(const string& file_name) {
+  ifstream file(file_name.c_str(), ios::in | ios::binary);
+  if (!file.is_open()) return Status(Substitute("Could not open $0", file_name));
+  {
+    lock_guard<mutex> l(index_lock_);
+    file_entry_counts_[file_name] = 0;
+    // Keeps AddToIndex() from deleting the file while it is loaded. Init() deletes it
+    // afterwards if none of its entries remain.
+    file_name_ = file_name;
+  }
+  string magic(ARCHIVE_FILE_MAGIC.size(), '\0');
+  file.read(&magic[0], magic.size());
+  if (!file || magic != ARCHIVE_FILE_MAGIC) {
+    return Status(Substitute("$0 is not a profile archive", file_name));
+  }
+
+  int64_t offset = magic.size();
+  vector<uint8_t> buffer;
+  while (true) {
+    uint32_t len;
+    file.read(reinterpret_cast<char*>(&len), sizeof(len));
+    if (file.gcount() == 0 && file.eof()) break;
+    // A record that was only partially written before a crash ends the file.
+    if (!file || len > MAX_RECORD_LEN) {
+      return Status(Substitute("Truncated record at offset $0", offset));
+    }
+    buffer.resize(len);
+    file.read(reinterpret_cast<char*>(buffer.data()), len);
+    if (!file) return Status(Substitute("Truncated record at offset $0", offset));
+
+    Entry entry;
+    int64_t profile_offset;
+    RETURN_IF_ERROR(DecodeRecordSummary(buffer.data(), len, &entry, &profile_offset));
+    entry.file_name = file_name;
+    entry.offset = offset;
+    entry.len = len + sizeof(len);
+    {
+      lock_guard<mutex> l(index_lock_);
+      AddToIndex(entry);
+    }
+    offset += entry.len;
+  }
+  return Status::OK;
+}
+
+Status ProfileArchive::RollFile() {
+  if (file_.is_open()) file_.close();
+  int64_t ms_since_epoch = UnixMillis();
+  string file_name;
+  do {
+    file_name = Substitute("$0/$1$2", archive_dir_, ARCHIVE_FILE_PREFIX,
+        ms_since_epoch++);
+  } while (filesystem::exists(file_name));
+  {
+    lock_guard<mutex> l(index_lock_);
+    // AddToIndex() keeps the previous file while it is written to, even if all of its
+    // entries were evicted, so delete it now.
+    map<string, int>::iterator count = file_entry_counts_.find(file_name_);
+    if (count != file_entry_counts_.end() && count->second == 0) RemoveFile(count);
+    file_name_ = file_name;
+    file_entry_counts_[file_name_] = 0;
+  }
+  file_.open(file_name_.c_str(), ios::out | ios::binary | ios::trunc);
+  if (!file_.is_open()) {
+    return Status(Substitute("Could not open profile archive file: $0", file_name_));
+  }
+  file_.write(ARCHIVE_FILE_MAGIC.data(), ARCHIVE_FILE_MAGIC.size());
+  file_size_ = ARCHIVE_FILE_MAGIC.size();
+  num_file_entries_ = 0;
+  return Status::OK;
+}
+
+bool ProfileArchive::Archive(const Entry& entry, TRuntimeProfileTree* profile) {
+  QueuedProfile* queued = new QueuedProfile();
+  queued->entry = entry;
+  queued->entry.archive_time_ms = UnixMillis();
+  queued->profile.nodes.swap(profile->nodes);
+  {
+    lock_guard<mutex> l(queue_lock_);
+    if (queue_.size() >= max_queued_profiles_) {
+      ++num_dropped_profiles_;
+      delete queued;
+      return false;
+    }
+    queue_.push_back(queued);
+  }
+  queue_cv_.notify_one();
+  return true;
+}
+
+void ProfileArchive::WriterThread() {
+  while (true) {
+    scoped_ptr<QueuedProfile> queued;
+    {
+      unique_lock<mutex> l(queue_lock_);
+      while (queue_.empty() && !shutdown_) queue_cv_.wait(l);
+      if (queue_.empty()) break;
+      queued.reset(queue_.front());
+      queue_.pop_front();
+      ++num_in_flight_;
+    }
+    Status status = WriteRecord(queued.get());
+    if (!status.ok()) {
+      LOG_EVERY_N(WARNING, 1000) << "Could not archive query profile ("
+                                 << google::COUNTER << " attempts failed): "
+                                 << status.GetDetail();
+    }
+    queued.reset();
+    {
+      lock_guard<mutex> l(queue_lock_);
+      --num_in_flight_;
+      if (queue_.empty() && num_in_flight_ == 0) drained_cv_.notify_all();
+    }
+  }
+}
+
+Status ProfileArchive::WriteRecord(QueuedProfile* queued) {
+  if (num_file_entries_ >= max_entries_per_file_ || !file_.is_open()) {
+    RETURN_IF_ERROR(RollFile());
+  }
+  // Leave room for the record length, which is filled in once the record is encoded.
+  string record(sizeof(uint32_t), '\0');
+  EncodeRecord(queued->entry, &queued->profile, &record);
+  uint32_t len = record.size() - sizeof(uint32_t);
+  memcpy(&record[0], &len, sizeof(len));
+
+  file_.write(record.data(), record.size());
+  // Flush so that the record can be read back as soon as it is in the index.
+  file_.flush();
+  if (!file_) {
+    // Start a new file for the next record rather than appending to a file whose
+    // contents are unknown.
+    file_.close();
+    return Status(Substitute("Could not write to profile archive file: $0",
+        file_name_));
+  }
+
+  Entry& entry = queued->entry;
+  entry.file_name = file_name_;
+  entry.offset = file_size_;
+  entry.len = record.size();
+  file_size_ += record.size();
+  ++num_file_entries_;
+  lock_guard<mutex> l(index_lock_);
+  AddToIndex(entry);
+  return Status::OK;
+}
+
+void ProfileArchive::AddToIndex(const Entry& entry) {
+  int64_t min_archive_time_ms = entries_.empty() ? 0 : entries_.back().archive_time_ms;
+  entries_.push_back(entry);
+  Entry& added = entries_.back();
+  added.archive_time_ms = max(added.archive_time_ms, min_archive_time_ms);
+  added.sequence = next_sequence_++;
+  index_[entry.query_id] = &added;
+  ++file_entry_counts_[entry.file_name];
+
+  while (entries_.size() > max_archived_queries_) {
+    const Entry& oldest = entries_.front();
+    QueryIndex::iterator it = index_.find(oldest.query_id);
+    if (it != index_.end() && it->second == &oldest) index_.erase(it);
+    map<string, int>::iterator count = file_entry_counts_.find(oldest.file_name);
+    DCHECK(count != file_entry_counts_.end());
+    if (--count->second == 0 && count->first != file_name_) RemoveFile(count);
+    entries_.pop_front();
+  }
+}
+
+void ProfileArchive::RemoveFile(map<string, int>::iterator count) {
+  DCHECK_EQ(count->second, 0);
+  boost::system::error_code ec;
+  filesystem::remove(count->first, ec);
+  if (ec) {
+    LOG(WARNING) << "Could not remove profile archive file " << count->first << ": "
+                 << ec.message();
+  }
+  file_entry_counts_.erase(count);
+}
+
+Status ProfileArchive::GetProfile(const TUniqueId& query_id,
+    TRuntimeProfileTree* profile) {
+  Entry entry;
+  {
+    lock_guard<mutex> l(index_lock_);
+    QueryIndex::const_iterator it = index_.find(query_id);
+    if (it == index_.end()) {
+      return Status(Substitute("Query id $0 not found.", PrintId(query_id)));
+    }
+    entry = *it->second;
+  }
+
+  ifstream file(entry.file_name.c_str(), ios::in | ios::binary);
+  vector<uint8_t> buffer(entry.len);
+  file.seekg(entry.offset);
+  file.read(reinterpret_cast<char*>(buffer.data()), entry.len);
+  if (!file) {
+    return Status(Substitute("Could not read archived profile of query $0 from $1",
+        PrintId(query_id), entry.file_name));
+  }
+  const uint8_t* body = buffer.data() + sizeof(uint32_t);
+  int64_t body_len = entry.len - sizeof(uint32_t);
+  Entry summary;
+  int64_t profile_offset;
+  RETURN_IF_ERROR(DecodeRecordSummary(body, body_len, &summary, &profile_offset));
+  if (summary.query_id != query_id) {
+    return Status(Substitute("Archived profile of query $0 is corrupt",
+        PrintId(query_id)));
+  }
+  return DecodeProfile(body + profile_offset, body_len - profile_offset, profile);
+}
+
+// Orders entries by archive time and sequence.
+static bool EntryLessThan(const ProfileArchive::Entry& entry,
+    const pair<int64_t, int64_t>& time_and_sequence) {
+  return make_pair(entry.archive_time_ms, entry.sequence) < time_and_sequence;
+}
+
+void ProfileArchive::GetEntries(int64_t before_time_ms, int64_t before_sequence,
+    int limit, vector<Entry>* entries) {
+  lock_guard<mutex> l(index_lock_);
+  deque<Entry>::const_iterator end = entries_.end();
+  if (before_time_ms > 0) {
+    end = lower_bound(entries_.begin(), entries_.end(),
+        make_pair(before_time_ms, before_sequence), EntryLessThan);
+  }
+  for (deque<Entry>::const_iterator it = end;
+       it != entries_.begin() && entries->size() < limit;) {
+    entries->push_back(*--it);
+  }
+}
+
+int64_t ProfileArchive::num_archived_queries() {
+  lock_guard<mutex> l(index_lock_);
+  return index_.size();
+}
+
+int64_t ProfileArchive::num_dropped_profiles() {
+  lock_guard<mutex> l(queue_lock_);
+  return num_dropped_profiles_;
+}
+
+void ProfileArchive::WaitForWrites() {
+  unique_lock<mutex> l(queue_lock_);
+  while (!queue_.empty() || num_in_flight_ > 0) drained_cv_.wait(l);
+}
@@ -0,0 +1,230 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_UTIL_PROFILE_ARCHIVE_H
+#define IMPALA_UTIL_PROFILE_ARCHIVE_H
+
+#include <deque>
+#include <fstream>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+#include "common/status.h"
+#include "gen-cpp/RuntimeProfile_types.h"
+#include "gen-cpp/Types_types.h"
+#include "util/uid-util.h"
+
+namespace impala {
+
+class Thread;
+
+// An on-disk archive of the profiles of completed queries, indexed in memory by query
+// id and by archival time.
+//
+// Profiles are handed to Archive() and written by a background thread, so the caller
+// only pays for the copy of the profile into a TRuntimeProfileTree. Each profile is
+// stored in a compact binary format in which every string (profile names, counter
+// names, info string keys, event labels) is written once per profile and referred to
+// by index afterwards. The counters of every fragment instance share their names, so
+// profiles stay small without being compressed, and decoding one is cheap enough to do
+// on every webserver request.
+//
+// Records are appended to files in 'archive_dir', which are rolled every
+// 'max_entries_per_file' records. The index holds a short summary of each of the
+// 'max_archived_queries' most recently archived queries; files whose records have all
+// been evicted from the index are deleted. On Init() the index is rebuilt from the
+// files already in 'archive_dir', so the archive survives restarts.
+//
+// Record layout, after a file header of ARCHIVE_FILE_MAGIC:
+//   <uint32 record len> <summary> <profile>
+// All integers in the summary and the profile are varints (zigzag encoded if signed).
+class ProfileArchive {
+ public:
+  // Summary of an archived query.
+  struct Entry {
+    TUniqueId query_id;
+
+    // Milliseconds since the epoch at which the query was archived. Entries are
+    // ordered by this and by 'sequence'. Set to the archive time of the previous entry
+    // if the clock went backwards, so that the index stays ordered.
+    int64_t archive_time_ms;
+
+    // Number of the entry in the order in which entries were added to the index, which
+    // tells apart entries archived within the same millisecond. Not stored in the
+    // archive, but reassigned when the index is rebuilt.
+    int64_t sequence;
+
+    std::string effective_user;
+    std::string stmt;
+    std::string query_state;
+    std::string start_time;
+    std::string end_time;
+
+    // Location of the record in the archive.
+    std::string file_name;
+    int64_t offset;
+    int32_t len;
+
+    Entry() : archive_time_ms(0), sequence(0), offset(0), len(0) { }
+  };
+
+  // Prefix of the names of the archive files, followed by the time in ms at which the
+  // file was created.
+  static const std::string ARCHIVE_FILE_PREFIX;
+
+  static const std::string ARCHIVE_FILE_MAGIC;
+
+  // Up to 'max_queued_profiles' profiles may wait to be written; further profiles are
+  // dropped until the writer catches up.
+  ProfileArchive(const std::string& archive_dir, int max_entries_per_file,
+      int max_archived_queries, int max_queued_profiles);
+
+  // Stops the writer thread after it has written all queued profiles.
+  ~ProfileArchive();
+
+  // Creates 'archive_dir' if necessary, rebuilds the index from the files in it and
+  // starts the writer thread. Must be called once before any other method.
+  Status Init();
+
+  // Queues the profile of a completed query to be archived. The contents of 'profile'
+  // are swapped out, leaving it empty. 'entry' only needs the query id and the
+  // descriptive fields to be set. Returns false if the profile was dropped because
+  // the queue is full.
+  bool Archive(const Entry& entry, TRuntimeProfileTree* profile);
+
+  // Reads and decodes the archived profile of 'query_id'. Returns an error if the
+  // query is not in the index or its record could not be read.
+  Status GetProfile(const TUniqueId& query_id, TRuntimeProfileTree* profile);
+
+  // Copies the summaries of up to 'limit' archived queries into 'entries', newest
+  // first. If 'before_time_ms' is positive, only entries that are ordered before the
+  // entry with the archive time 'before_time_ms' and the sequence 'before_sequence' are
+  // returned. Passing the archive time and sequence of the last entry returned by the
+  // previous call pages through the archive without skipping or repeating entries,
+  // also if several entries share an archive time.
+  void GetEntries(int64_t before_time_ms, int64_t before_sequence, int limit,
+      std::vector<Entry>* entries);
+
+  // Number of queries in the index.
+  int64_t num_archived_queries();
+
+  // Number of profiles dropped because the writer thread fell behind.
+  int64_t num_dropped_profiles();
+
+  // Blocks until every profile queued so far has been written and indexed. Used by
+  // tests.
+  void WaitForWrites();
+
+  // Appends the compact encoding of 'profile' to 'out'.
+  static void EncodeProfile(const TRuntimeProfileTree& profile, std::string* out);
+
+  // Decodes a profile encoded by EncodeProfile().
+  static Status DecodeProfile(const uint8_t* data, int64_t len,
+      TRuntimeProfileTree* profile);
+
+ private:
+  struct QueuedProfile {
+    Entry entry;
+    TRuntimeProfileTree profile;
+  };
+
+  // Encodes 'entry' and 'profile' (if non-NULL) as the body of a record.
+  static void EncodeRecord(const Entry& entry, const TRuntimeProfileTree* profile,
+      std::string* out);
+
+  // Decodes the summary at the start of a record body into 'entry' and sets
+  // 'profile_offset' to the offset of the encoded profile within the body.
+  static Status DecodeRecordSummary(const uint8_t* data, int64_t len, Entry* entry,
+      int64_t* profile_offset);
+
+  // Reads all records of 'file_name' into the index.
+  Status LoadFile(const std::string& file_name);
+
+  // Writes queued profiles until the archive is destroyed.
+  void WriterThread();
+
+  // Appends one record to the current file, rolling it if needed, and adds it to the
+  // index. Only called by the writer thread.
+  Status WriteRecord(QueuedProfile* queued);
+
+  // Opens a new archive file and writes its header.
+  Status RollFile();
+
+  // Adds 'entry' to the index, evicting the oldest entries and deleting the files
+  // they leave empty if the index is full. Must be called with index_lock_ held.
+  void AddToIndex(const Entry& entry);
+
+  // Deletes the archive file of 'count', whose entries have all been evicted, and
+  // removes it from file_entry_counts_. Must be called with index_lock_ held.
+  void RemoveFile(std::map<std::string, int>::iterator count);
+
+  const std::string archive_dir_;
+  const int max_entries_per_file_;
+  const int max_archived_queries_;
+  const int max_queued_profiles_;
+
+  // Protects queue_, shutdown_, num_dropped_profiles_ and num_in_flight_.
+  boost::mutex queue_lock_;
+
+  // Signalled when a profile is queued or the archive is shut down.
+  boost::condition_variable queue_cv_;
+
+  // Signalled when the writer thread has drained the queue.
+  boost::condition_variable drained_cv_;
+
+  std::list<QueuedProfile*> queue_;
+  bool shutdown_;
+  int64_t num_dropped_profiles_;
+
+  // Number of profiles taken off queue_ that have not been written yet.
+  int num_in_flight_;
+
+  // Protects entries_, index_, file_entry_counts_, next_sequence_ and file_name_.
+  boost::mutex index_lock_;
+
+  // Index entries in archival order. Elements are only added at the back and removed
+  // at the front, so pointers to them in 'index_' stay valid.
+  std::deque<Entry> entries_;
+
+  typedef boost::unordered_map<TUniqueId, const Entry*> QueryIndex;
+  QueryIndex index_;
+
+  // Number of entries in the index from each archive file.
+  std::map<std::string, int> file_entry_counts_;
+
+  // Sequence of the next entry added to the index.
+  int64_t next_sequence_;
+
+  // The file being written to and its number of records. Only used by the writer
+  // thread, which also holds index_lock_ when it changes 'file_name_', so that
+  // AddToIndex() never deletes the file being written to. While Init() rebuilds the
+  // index, 'file_name_' is the file being loaded.
+  std::ofstream file_;
+  std::string file_name_;
+  int64_t file_size_;
+  int num_file_entries_;
+
+  boost::scoped_ptr<Thread> writer_thread_;
+};
+
+}
+
+#endif
@@ -58,6 +58,11 @@ void ProgressUpdater::Update(int64_t delta) {
   }
 }
 
+void ProgressUpdater::AddToTotal(int64_t delta) {
+  DCHECK_GE(delta, 0);
+  total_ += delta;
+}
+
 string ProgressUpdater::ToString() const {
   stringstream ss;
   int64_t num_complete = num_complete_;
@@ -48,6 +48,9 @@ class ProgressUpdater {
   // VLOG_PROGRESS
   void Update(int64_t delta);
 
+  // 'delta' more work items were discovered, e.g. because a work item was split.
+  void AddToTotal(int64_t delta);
+
   // Returns if all tasks are done.
   bool done() const { return num_complete_ >= total_; }
 
@@ -61,7 +64,7 @@ class ProgressUpdater {
  private:
   std::string label_;
   int logging_level_;
-  int64_t total_;
+  AtomicInt<int64_t> total_;
   int update_period_;
 
   AtomicInt<int64_t> num_complete_;
@@ -290,6 +290,31 @@ TEST(RedactorTest, ChangeInputSize) {
   ASSERT_REDACTED_EQ("add1234", "add################");
 }
 
+TEST(RedactorTest, TriggerPrefilter) {
+  // All rules have triggers, so inputs without a trigger are skipped without evaluating
+  // any regex. Triggers must still be found at any offset and in any case if the rule is
+  // case-insensitive.
+  TempRulesFile rules_file(
+      "{"
+      "  \"version\": 1,"
+      "  \"rules\": ["
+      "    {\"trigger\": \"pwd=\", \"search\": \"pwd=[a-z]+\", \"replace\": \"pwd=*\"},"
+      "    {\"trigger\": \"ssn\", \"caseSensitive\": false, \"search\": \"[0-9]{3}\","
+      "        \"replace\": \"###\"}"
+      "  ]"
+      "}");
+  string error = SetRedactionRulesFromFile(rules_file.name());
+  ASSERT_EQ("", error);
+  ASSERT_UNREDACTED("pw=abc 123 ss");
+  ASSERT_UNREDACTED("a string that is longer than sixteen bytes, 123");
+  ASSERT_REDACTED_EQ("pwd=abc", "pwd=*");
+  ASSERT_REDACTED_EQ("0123456789abcdefpwd=abc", "0123456789abcdefpwd=*");
+  ASSERT_REDACTED_EQ("0123456789abcdepwd=abc", "0123456789abcdepwd=*");
+  ASSERT_REDACTED_EQ("a string that is longer than sixteen bytes, 123 SSN",
+      "a string that is longer than sixteen bytes, ### SSN");
+  ASSERT_REDACTED_EQ("123 sSn", "### sSn");
+}
+
 TEST(RedactorTest, MultiThreaded) {
   TempRulesFile rules_file(
       "{"
@@ -14,8 +14,10 @@
 
 #include "redactor.h"
 
+#include <algorithm>
+#include <cctype>  // tolower, toupper
 #include <cerrno>
-#include <cstring>  // strcmp, strcasestr
+#include <cstring>  // strcmp, strcasestr, strncasecmp
 #include <ostream>
 #include <sstream>
 #include <sys/stat.h>
@@ -27,19 +29,24 @@
 #include <rapidjson/rapidjson.h>
 #include <rapidjson/reader.h>
 #include <re2/re2.h>
+#include <re2/set.h>
 #include <re2/stringpiece.h>
 
 #include "common/logging.h"
+#include "util/sse-util.h"
 
 namespace impala {
 
 using rapidjson::Document;
 using rapidjson::Value;
+using std::binary_search;
 using std::endl;
 using std::map;
 using std::ostream;
 using std::ostringstream;
+using std::sort;
 using std::string;
+using std::unique;
 using std::vector;
 using strings::Substitute;
 
@@ -92,6 +99,35 @@ typedef vector<Rule> Rules;
 // The actual rules in effect, if any.
 static Rules* g_rules;
 
+// Filters that are built from g_rules by CompileRules() to skip rules that cannot change
+// a given string.
+struct RulesFilter {
+  RulesFilter() : search_set(NULL), all_rules_have_triggers(false) { }
+  ~RulesFilter() { delete search_set; }
+
+  // The search patterns of all rules, in rule order. Only rules whose search pattern
+  // matches the input need to be applied, until a rule changes the input. NULL if the
+  // set could not be compiled, in which case all rules are applied.
+  re2::RE2::Set* search_set;
+
+  // True if every rule has a non-empty trigger. If so, an input that contains none of
+  // the triggers cannot be changed by any rule.
+  bool all_rules_have_triggers;
+
+  // The distinct first bytes of all triggers, with both cases for case-insensitive
+  // triggers. Only set if all_rules_have_triggers is true and there are at most
+  // MAX_FIRST_BYTES of them. Used by ContainsTrigger() to find candidate trigger
+  // positions 16 bytes at a time.
+  static const int MAX_FIRST_BYTES = 8;
+  vector<char> trigger_first_bytes;
+};
+
+static RulesFilter* g_rules_filter;
+
+// Memory budget of the RE2::Set. The set holds the programs of all rules plus a DFA
+// cache, so it needs more than the default budget of a single RE2.
+static const int64_t SEARCH_SET_MAX_MEM = 64 * 1024 * 1024;
+
 string NameOfTypeOfJsonValue(const Value& value) {
   switch (value.GetType()) {
     case rapidjson::kNullType:
@@ -257,9 +293,112 @@ EXTRACT_VALUE(Bool, bool)
   }
 };
 
+// Builds g_rules_filter from g_rules.
+static void CompileRules() {
+  delete g_rules_filter;
+  g_rules_filter = NULL;
+  if (g_rules->empty()) return;
+  g_rules_filter = new RulesFilter();
+
+  Regex::Options options;
+  options.set_max_mem(SEARCH_SET_MAX_MEM);
+  re2::RE2::Set* search_set = new re2::RE2::Set(options, Regex::UNANCHORED);
+  bool set_ok = true;
+  bool all_rules_have_triggers = true;
+  vector<char> first_bytes;
+  for (Rules::const_iterator rule = g_rules->begin(); rule != g_rules->end(); ++rule) {
+    // The index of each pattern in the set must be the index of its rule.
+    const string& pattern = rule->case_sensitive() ? rule->search_pattern.pattern() :
+        "(?i:" + rule->search_pattern.pattern() + ")";
+    if (search_set->Add(pattern, NULL) != rule - g_rules->begin()) set_ok = false;
+
+    if (rule->trigger.empty()) {
+      all_rules_have_triggers = false;
+      continue;
+    }
+    char c = rule->trigger[0];
+    if (rule->case_sensitive()) {
+      first_bytes.push_back(c);
+    } else {
+      first_bytes.push_back(tolower(c));
+      first_bytes.push_back(toupper(c));
+    }
+  }
+  if (set_ok && search_set->Compile()) {
+    g_rules_filter->search_set = search_set;
+  } else {
+    LOG(WARNING) << "Could not compile the redaction rules into a single regex set, "
+                 << "falling back to applying the rules one at a time.";
+    delete search_set;
+  }
+
+  g_rules_filter->all_rules_have_triggers = all_rules_have_triggers;
+  if (all_rules_have_triggers) {
+    sort(first_bytes.begin(), first_bytes.end());
+    first_bytes.erase(unique(first_bytes.begin(), first_bytes.end()), first_bytes.end());
+    if (first_bytes.size() <= RulesFilter::MAX_FIRST_BYTES) {
+      g_rules_filter->trigger_first_bytes.swap(first_bytes);
+    }
+  }
+}
+
+// Returns true if 'rule's trigger occurs in 'value' at 'pos'.
+static inline bool TriggerAt(const Rule& rule, const string& value, int pos) {
+  if (pos + rule.trigger.size() > value.size()) return false;
+  if (rule.case_sensitive()) {
+    return memcmp(value.data() + pos, rule.trigger.data(), rule.trigger.size()) == 0;
+  }
+  return strncasecmp(value.data() + pos, rule.trigger.c_str(), rule.trigger.size()) == 0;
+}
+
+// Returns false if 'value' does not contain the trigger of any rule. May return true
+// even if it does not. Must only be called if all rules have triggers.
+static bool ContainsTrigger(const string& value) {
+  DCHECK(g_rules_filter->all_rules_have_triggers);
+  const vector<char>& first_bytes = g_rules_filter->trigger_first_bytes;
+  // Too many different first bytes to search for them efficiently.
+  if (first_bytes.empty()) return true;
+
+  // Compares 16 bytes at a time against each first byte. Each match is a candidate
+  // position which is checked against all triggers.
+  __m128i first_byte_regs[RulesFilter::MAX_FIRST_BYTES];
+  for (int i = 0; i < first_bytes.size(); ++i) {
+    first_byte_regs[i] = _mm_set1_epi8(first_bytes[i]);
+  }
+  const char* data = value.data();
+  int len = value.size();
+  int pos = 0;
+  for (; pos + SSEUtil::CHARS_PER_128_BIT_REGISTER <= len;
+       pos += SSEUtil::CHARS_PER_128_BIT_REGISTER) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+    __m128i eq = _mm_cmpeq_epi8(block, first_byte_regs[0]);
+    for (int i = 1; i < first_bytes.size(); ++i) {
+      eq = _mm_or_si128(eq, _mm_cmpeq_epi8(block, first_byte_regs[i]));
+    }
+    int mask = _mm_movemask_epi8(eq);
+    while (mask != 0) {
+      int candidate = pos + __builtin_ctz(mask);
+      for (Rules::const_iterator rule = g_rules->begin(); rule != g_rules->end();
+           ++rule) {
+        if (TriggerAt(*rule, value, candidate)) return true;
+      }
+      mask &= mask - 1;
+    }
+  }
+  for (; pos < len; ++pos) {
+    if (!binary_search(first_bytes.begin(), first_bytes.end(), data[pos])) continue;
+    for (Rules::const_iterator rule = g_rules->begin(); rule != g_rules->end(); ++rule) {
+      if (TriggerAt(*rule, value, pos)) return true;
+    }
+  }
+  return false;
+}
+
 string SetRedactionRulesFromFile(const string& rules_file_path) {
   if (g_rules == NULL) g_rules = new Rules();
   g_rules->clear();
+  delete g_rules_filter;
+  g_rules_filter = NULL;
 
   // Read the file.
   FILE* rules_file = fopen(rules_file_path.c_str(), "r");
@@ -303,13 +442,35 @@ string SetRedactionRulesFromFile(const string& rules_file_path) {
   }
 
   RulesParser rules_parser;
-  return rules_parser.Parse(rules_doc);
+  const string& error_message = rules_parser.Parse(rules_doc);
+  CompileRules();
+  return error_message;
 }
 
 void Redact(string* value, bool* changed) {
   DCHECK(value != NULL);
+  if (changed != NULL) *changed = false;
   if (g_rules == NULL || g_rules->empty()) return;
+  DCHECK(g_rules_filter != NULL);
+  if (g_rules_filter->all_rules_have_triggers && !ContainsTrigger(*value)) return;
+
+  // Indexes of the rules whose search pattern matches 'value', in increasing order.
+  vector<int> matching_rules;
+  bool use_matching_rules = g_rules_filter->search_set != NULL;
+  if (use_matching_rules) {
+    if (!g_rules_filter->search_set->Match(*value, &matching_rules)) return;
+    sort(matching_rules.begin(), matching_rules.end());
+  }
+  vector<int>::const_iterator next_match = matching_rules.begin();
   for (Rules::const_iterator rule = g_rules->begin(); rule != g_rules->end(); ++rule) {
+    if (use_matching_rules) {
+      // Once a rule changed 'value', later rules must be matched against the new value.
+      if (next_match == matching_rules.end() ||
+          *next_match != rule - g_rules->begin()) {
+        continue;
+      }
+      ++next_match;
+    }
     if (rule->case_sensitive()) {
       if (value->find(rule->trigger) == string::npos) continue;
     } else {
@@ -317,7 +478,8 @@ void Redact(string* value, bool* changed) {
     }
     int replacement_count = re2::RE2::GlobalReplace(
         value, rule->search_pattern, rule->replacement);
-    if (changed != NULL && !*changed) *changed = replacement_count;
+    if (replacement_count > 0) use_matching_rules = false;
+    if (changed != NULL && !*changed) *changed = replacement_count > 0;
   }
 }
 
@@ -71,9 +71,9 @@ RuntimeProfile::RuntimeProfile(ObjectPool* pool, const string& name,
     total_async_timer = &total_async_timer_;
     inactive_timer = &inactive_timer_;
   } else {
-    total_time_counter = pool->Add(new AveragedCounter(TUnit::TIME_NS));
-    total_async_timer = pool->Add(new AveragedCounter(TUnit::TIME_NS));
-    inactive_timer = pool->Add(new AveragedCounter(TUnit::TIME_NS));
+    total_time_counter = pool->AddInPlace(new (pool) AveragedCounter(TUnit::TIME_NS));
+    total_async_timer = pool->AddInPlace(new (pool) AveragedCounter(TUnit::TIME_NS));
+    inactive_timer = pool->AddInPlace(new (pool) AveragedCounter(TUnit::TIME_NS));
   }
   counter_map_[TOTAL_TIME_COUNTER_NAME] = total_time_counter;
   counter_map_[ASYNC_TIME_COUNTER_NAME] = total_async_timer;
@@ -116,25 +116,26 @@ RuntimeProfile* RuntimeProfile::CreateFromThrift(ObjectPool* pool,
   DCHECK_LT(*idx, nodes.size());
 
   const TRuntimeProfileNode& node = nodes[*idx];
-  RuntimeProfile* profile = pool->Add(new RuntimeProfile(pool, node.name));
+  RuntimeProfile* profile = pool->AddInPlace(new (pool) RuntimeProfile(pool, node.name));
   profile->metadata_ = node.metadata;
   for (int i = 0; i < node.counters.size(); ++i) {
     const TCounter& counter = node.counters[i];
     profile->counter_map_[counter.name] =
-      pool->Add(new Counter(counter.unit, counter.value));
+      pool->AddInPlace(new (pool) Counter(counter.unit, counter.value));
   }
 
   if (node.__isset.event_sequences) {
     BOOST_FOREACH(const TEventSequence& sequence, node.event_sequences) {
       profile->event_sequence_map_[sequence.name] =
-          pool->Add(new EventSequence(sequence.timestamps, sequence.labels));
+          pool->AddInPlace(new (pool) EventSequence(sequence.timestamps, sequence.labels));
     }
   }
 
   if (node.__isset.time_series_counters) {
     BOOST_FOREACH(const TTimeSeriesCounter& val, node.time_series_counters) {
       profile->time_series_counter_map_[val.name] =
-          pool->Add(new TimeSeriesCounter(val.name, val.unit, val.period_ms, val.values));
+          pool->AddInPlace(new (pool) TimeSeriesCounter(val.name, val.unit,
+              val.period_ms, val.values));
     }
   }
 
@@ -172,7 +173,8 @@ void RuntimeProfile::UpdateAverage(RuntimeProfile* other) {
       // Get the counter with the same name in dst_iter (this->counter_map_)
       // Create one if it doesn't exist.
       if (dst_iter == counter_map_.end()) {
-        avg_counter = pool_->Add(new AveragedCounter(src_iter->second->unit()));
+        avg_counter = pool_->AddInPlace(
+            new (pool_) AveragedCounter(src_iter->second->unit()));
         counter_map_[src_iter->first] = avg_counter;
       } else {
         DCHECK(dst_iter->second->unit() == src_iter->second->unit());
@@ -204,7 +206,8 @@ void RuntimeProfile::UpdateAverage(RuntimeProfile* other) {
       if (j != child_map_.end()) {
         child = j->second;
       } else {
-        child = pool_->Add(new RuntimeProfile(pool_, other_child->name_, true));
+        child = pool_->AddInPlace(
+            new (pool_) RuntimeProfile(pool_, other_child->name_, true));
         child->metadata_ = other_child->metadata_;
         bool indent_other_child = other->children_[i].second;
         child_map_[child->name_] = child;
@@ -235,7 +238,7 @@ void RuntimeProfile::Update(const vector<TRuntimeProfileNode>& nodes, int* idx)
       CounterMap::iterator j = counter_map_.find(tcounter.name);
       if (j == counter_map_.end()) {
         counter_map_[tcounter.name] =
-          pool_->Add(new Counter(tcounter.unit, tcounter.value));
+          pool_->AddInPlace(new (pool_) Counter(tcounter.unit, tcounter.value));
       } else {
         if (j->second->unit() != tcounter.unit) {
           LOG(ERROR) << "Cannot update counters with the same name ("
@@ -284,7 +287,8 @@ void RuntimeProfile::Update(const vector<TRuntimeProfileNode>& nodes, int* idx)
       TimeSeriesCounterMap::iterator it = time_series_counter_map_.find(c.name);
       if (it == time_series_counter_map_.end()) {
         time_series_counter_map_[c.name] =
-            pool_->Add(new TimeSeriesCounter(c.name, c.unit, c.period_ms, c.values));
+            pool_->AddInPlace(new (pool_) TimeSeriesCounter(c.name, c.unit,
+                c.period_ms, c.values));
         it = time_series_counter_map_.find(c.name);
       } else {
         it->second->samples_.SetSamples(c.period_ms, c.values);
@@ -303,7 +307,7 @@ void RuntimeProfile::Update(const vector<TRuntimeProfileNode>& nodes, int* idx)
       if (j != child_map_.end()) {
         child = j->second;
       } else {
-        child = pool_->Add(new RuntimeProfile(pool_, tchild.name));
+        child = pool_->AddInPlace(new (pool_) RuntimeProfile(pool_, tchild.name));
         child->metadata_ = tchild.metadata;
         child_map_[tchild.name] = child;
         children_.push_back(make_pair(child, tchild.indent));
@@ -434,7 +438,7 @@ const string* RuntimeProfile::GetInfoString(const string& key) const {
     }\
     DCHECK(parent_counter_name == ROOT_COUNTER ||\
         counter_map_.find(parent_counter_name) != counter_map_.end());\
-    T* counter = pool_->Add(new T(unit));\
+    T* counter = pool_->AddInPlace(new (pool_) T(unit));\
     counter_map_[name] = counter;\
     set<string>* child_counters =\
         FindOrInsert(&child_counter_map_, parent_counter_name, set<string>());\
@@ -451,7 +455,8 @@ RuntimeProfile::DerivedCounter* RuntimeProfile::AddDerivedCounter(
   DCHECK_EQ(is_averaged_profile_, false);
   lock_guard<mutex> l(counter_map_lock_);
   if (counter_map_.find(name) != counter_map_.end()) return NULL;
-  DerivedCounter* counter = pool_->Add(new DerivedCounter(unit, counter_fn));
+  DerivedCounter* counter =
+      pool_->AddInPlace(new (pool_) DerivedCounter(unit, counter_fn));
   counter_map_[name] = counter;
   set<string>* child_counters =
       FindOrInsert(&child_counter_map_, parent_counter_name, set<string>());
@@ -461,7 +466,7 @@ RuntimeProfile::DerivedCounter* RuntimeProfile::AddDerivedCounter(
 
 RuntimeProfile::ThreadCounters* RuntimeProfile::AddThreadCounters(
     const string& prefix) {
-  ThreadCounters* counter = pool_->Add(new ThreadCounters());
+  ThreadCounters* counter = pool_->AddInPlace(new (pool_) ThreadCounters());
   counter->total_time_ = AddCounter(prefix + THREAD_TOTAL_TIME, TUnit::TIME_NS);
   counter->user_time_ = AddCounter(prefix + THREAD_USER_TIME, TUnit::TIME_NS,
       prefix + THREAD_TOTAL_TIME);
@@ -811,7 +816,7 @@ RuntimeProfile::EventSequence* RuntimeProfile::AddEventSequence(const string& na
   EventSequenceMap::iterator timer_it = event_sequence_map_.find(name);
   if (timer_it != event_sequence_map_.end()) return timer_it->second;
 
-  EventSequence* timer = pool_->Add(new EventSequence());
+  EventSequence* timer = pool_->AddInPlace(new (pool_) EventSequence());
   event_sequence_map_[name] = timer;
   return timer;
 }
@@ -822,7 +827,8 @@ RuntimeProfile::EventSequence* RuntimeProfile::AddEventSequence(const string& na
   EventSequenceMap::iterator timer_it = event_sequence_map_.find(name);
   if (timer_it != event_sequence_map_.end()) return timer_it->second;
 
-  EventSequence* timer = pool_->Add(new EventSequence(from.timestamps, from.labels));
+  EventSequence* timer =
+      pool_->AddInPlace(new (pool_) EventSequence(from.timestamps, from.labels));
   event_sequence_map_[name] = timer;
   return timer;
 }
@@ -853,7 +859,8 @@ RuntimeProfile::TimeSeriesCounter* RuntimeProfile::AddTimeSeriesCounter(
   lock_guard<mutex> l(time_series_counter_map_lock_);
   TimeSeriesCounterMap::iterator it = time_series_counter_map_.find(name);
   if (it != time_series_counter_map_.end()) return it->second;
-  TimeSeriesCounter* counter = pool_->Add(new TimeSeriesCounter(name, unit, fn));
+  TimeSeriesCounter* counter =
+      pool_->AddInPlace(new (pool_) TimeSeriesCounter(name, unit, fn));
   time_series_counter_map_[name] = counter;
   PeriodicCounterUpdater::RegisterTimeSeriesCounter(counter);
   return counter;
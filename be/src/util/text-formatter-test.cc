@@ -0,0 +1,287 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <gtest/gtest.h>
+
+#include "runtime/raw-value.h"
+#include "runtime/timestamp-value.h"
+#include "util/decimal-util.h"
+#include "util/text-formatter.h"
+
+using namespace std;
+
+namespace impala {
+
+// Formats 'value' of 'type' with TextFormatter and checks that the result is the same
+// as that of RawValue::PrintValue() with a stream, as used by the text table writer.
+template <typename T>
+void TestFormat(const T& value, const ColumnType& type, int scale = -1) {
+  stringstream ss;
+  ss.precision(RawValue::ASCII_PRECISION);
+  RawValue::PrintValue(&value, type, scale, &ss);
+
+  int max_len = TextFormatter::MaxLength(type, scale);
+  ASSERT_GT(max_len, 0);
+  string buf(max_len, '\0');
+  int len;
+  switch (type.type) {
+    case TYPE_BOOLEAN:
+      len = TextFormatter::FormatBool(*reinterpret_cast<const bool*>(&value), &buf[0]);
+      break;
+    case TYPE_TINYINT:
+      len = TextFormatter::FormatInt(*reinterpret_cast<const int8_t*>(&value), &buf[0]);
+      break;
+    case TYPE_SMALLINT:
+      len = TextFormatter::FormatInt(*reinterpret_cast<const int16_t*>(&value), &buf[0]);
+      break;
+    case TYPE_INT:
+      len = TextFormatter::FormatInt(*reinterpret_cast<const int32_t*>(&value), &buf[0]);
+      break;
+    case TYPE_BIGINT:
+      len = TextFormatter::FormatInt(*reinterpret_cast<const int64_t*>(&value), &buf[0]);
+      break;
+    case TYPE_FLOAT:
+      len = TextFormatter::FormatFloat(
+          *reinterpret_cast<const float*>(&value), scale, &buf[0]);
+      break;
+    case TYPE_DOUBLE:
+      len = TextFormatter::FormatDouble(
+          *reinterpret_cast<const double*>(&value), scale, &buf[0]);
+      break;
+    case TYPE_TIMESTAMP:
+      len = TextFormatter::FormatTimestamp(
+          *reinterpret_cast<const TimestampValue*>(&value), &buf[0]);
+      break;
+    case TYPE_DECIMAL:
+      switch (type.GetByteSize()) {
+        case 4:
+          len = TextFormatter::FormatDecimal(
+              *reinterpret_cast<const Decimal4Value*>(&value), type.scale, &buf[0]);
+          break;
+        case 8:
+          len = TextFormatter::FormatDecimal(
+              *reinterpret_cast<const Decimal8Value*>(&value), type.scale, &buf[0]);
+          break;
+        default:
+          len = TextFormatter::FormatDecimal(
+              *reinterpret_cast<const Decimal16Value*>(&value), type.scale, &buf[0]);
+      }
+      break;
+    default:
+      FAIL() << type;
+  }
+  EXPECT_LE(len, max_len);
+  EXPECT_EQ(ss.str(), buf.substr(0, len)) << type << " scale " << scale;
+}
+
+TEST(TextFormatterTest, Bool) {
+  TestFormat(true, TYPE_BOOLEAN);
+  TestFormat(false, TYPE_BOOLEAN);
+}
+
+TEST(TextFormatterTest, Int) {
+  int64_t values[] = {0, 1, -1, 9, 10, 99, 100, 101, 999, 1000, 12345, -12345, 99999,
+      100000, 1234567890, -1234567890, 9999999999999LL, 10000000000000LL,
+      numeric_limits<int64_t>::max(), numeric_limits<int64_t>::min()};
+  for (int i = 0; i < sizeof(values) / sizeof(int64_t); ++i) {
+    TestFormat(values[i], TYPE_BIGINT);
+    TestFormat(static_cast<int32_t>(values[i]), TYPE_INT);
+    TestFormat(static_cast<int16_t>(values[i]), TYPE_SMALLINT);
+    TestFormat(static_cast<int8_t>(values[i]), TYPE_TINYINT);
+  }
+  TestFormat(numeric_limits<int32_t>::min(), TYPE_INT);
+  TestFormat(numeric_limits<int16_t>::min(), TYPE_SMALLINT);
+  TestFormat(numeric_limits<int8_t>::min(), TYPE_TINYINT);
+}
+
+TEST(TextFormatterTest, Double) {
+  double values[] = {0, -0.0, 1, -1, 0.5, -0.5, 0.1, 1.0 / 3, 2.0 / 3, 123456.789,
+      1e15, 1e15 - 1, -1e15 + 1, 1e16, 1e20, 1.5e300, 1e-5, 1e-300, 3.14159265358979,
+      numeric_limits<double>::max(), numeric_limits<double>::min(),
+      numeric_limits<double>::denorm_min(), numeric_limits<double>::infinity(),
+      -numeric_limits<double>::infinity(), numeric_limits<double>::quiet_NaN()};
+  int scales[] = {-1, 0, 1, 2, 5, 10};
+  for (int i = 0; i < sizeof(values) / sizeof(double); ++i) {
+    for (int j = 0; j < sizeof(scales) / sizeof(int); ++j) {
+      TestFormat(values[i], TYPE_DOUBLE, scales[j]);
+      TestFormat(static_cast<float>(values[i]), TYPE_FLOAT, scales[j]);
+    }
+  }
+}
+
+static double Parse(const char* str, double) { return strtod(str, NULL); }
+static float Parse(const char* str, float) { return strtof(str, NULL); }
+
+// Returns the text of 'value' with the fewest significant digits that reads back as
+// 'value', by trying all precisions of printf("%g"). Integers are written as such.
+// printf() writes the closest decimal with each precision, which is the shortest text
+// except at some powers of two, see ShortestPowersOfTwo.
+template <typename T>
+string ShortestText(T value) {
+  if (value == floor(value) && fabs(value) < 1e15 &&
+      !(value == 0 && std::signbit(value))) {
+    stringstream ss;
+    ss << static_cast<int64_t>(value);
+    return ss.str();
+  }
+  char buf[64];
+  for (int precision = 1; precision <= 17; ++precision) {
+    snprintf(buf, sizeof(buf), "%.*g", precision, static_cast<double>(value));
+    if (Parse(buf, value) == value) break;
+  }
+  return buf;
+}
+
+// Formats 'value' with FormatDoubleShortest() and checks that the result is the
+// shortest text that reads back as 'value'.
+void TestShortest(double value) {
+  int max_len = TextFormatter::MaxLength(TYPE_DOUBLE, -1);
+  string buf(max_len, '\0');
+  int len = TextFormatter::FormatDoubleShortest(value, &buf[0]);
+  EXPECT_LE(len, max_len);
+  buf.resize(len);
+  EXPECT_EQ(ShortestText(value), buf);
+  EXPECT_EQ(value, strtod(buf.c_str(), NULL)) << buf;
+}
+
+void TestShortest(float value) {
+  int max_len = TextFormatter::MaxLength(TYPE_FLOAT, -1);
+  string buf(max_len, '\0');
+  int len = TextFormatter::FormatFloatShortest(value, &buf[0]);
+  EXPECT_LE(len, max_len);
+  buf.resize(len);
+  EXPECT_EQ(ShortestText(value), buf);
+  EXPECT_EQ(value, strtof(buf.c_str(), NULL)) << buf;
+}
+
+// Unlike with FormatDouble(), the output reads back as the same value.
+TEST(TextFormatterTest, ShortestDouble) {
+  char buf[32];
+  int len = TextFormatter::FormatDoubleShortest(0.1 + 0.2, buf);
+  EXPECT_EQ("0.30000000000000004", string(buf, len));
+  len = TextFormatter::FormatDouble(0.1 + 0.2, -1, buf);
+  EXPECT_EQ("0.3", string(buf, len));
+  len = TextFormatter::FormatDoubleShortest(0.1, buf);
+  EXPECT_EQ("0.1", string(buf, len));
+  len = TextFormatter::FormatFloatShortest(0.1f, buf);
+  EXPECT_EQ("0.1", string(buf, len));
+  len = TextFormatter::FormatDoubleShortest(numeric_limits<double>::quiet_NaN(), buf);
+  EXPECT_EQ("NaN", string(buf, len));
+  len = TextFormatter::FormatFloatShortest(-numeric_limits<float>::infinity(), buf);
+  EXPECT_EQ("-Infinity", string(buf, len));
+
+  double values[] = {0, -0.0, 1, -1, 0.5, 0.1, 0.7, 1.0 / 3, 2.0 / 3, 123456.789,
+      1e15, 1e15 - 1, 1e15 + 1, 1e16, 1e17 + 16, 1e20, 1e22, 1e23, 1.5e300, 1e-5,
+      1e-300, 5e-324, 3.14159265358979, 9007199254740993.0, 0.30000000000000004,
+      numeric_limits<double>::max(), numeric_limits<double>::min(),
+      numeric_limits<double>::denorm_min(), numeric_limits<double>::epsilon(),
+      numeric_limits<double>::denorm_min() * 3, numeric_limits<double>::min() / 3,
+      numeric_limits<float>::max(), numeric_limits<float>::min(),
+      numeric_limits<float>::denorm_min(), numeric_limits<float>::denorm_min() * 7};
+  for (int i = 0; i < sizeof(values) / sizeof(double); ++i) {
+    TestShortest(values[i]);
+    TestShortest(-values[i]);
+    float float_value = values[i];
+    if (!std::isfinite(float_value)) continue;
+    TestShortest(float_value);
+    TestShortest(-float_value);
+  }
+  srand(0);
+  for (int i = 0; i < 10000; ++i) {
+    // Random bits, which are mostly values that need 16 or 17 digits, and random
+    // decimals with up to 9 digits.
+    uint64_t bits = (static_cast<uint64_t>(rand()) << 42) ^
+        (static_cast<uint64_t>(rand()) << 21) ^ rand();
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    if (std::isfinite(value)) TestShortest(value);
+    uint32_t float_bits = bits;
+    float float_value;
+    memcpy(&float_value, &float_bits, sizeof(float_value));
+    if (std::isfinite(float_value)) TestShortest(float_value);
+    TestShortest((rand() % 2000000000 - 1000000000) / pow(10.0, rand() % 12));
+  }
+}
+
+// The neighbour below a power of two is closer than the one above, so a decimal above
+// the value may read back as it while the closest one with as many digits doesn't.
+TEST(TextFormatterTest, ShortestPowersOfTwo) {
+  char buf[32];
+  int len = TextFormatter::FormatDoubleShortest(ldexp(1.0, -24), buf);
+  EXPECT_EQ("5.960464477539063e-08", string(buf, len));
+  EXPECT_EQ("5.9604644775390625e-08", ShortestText(ldexp(1.0, -24)));
+  len = TextFormatter::FormatFloatShortest(ldexpf(1.0f, 87), buf);
+  EXPECT_EQ("1.5474251e+26", string(buf, len));
+  for (int exponent = -1074; exponent <= 1023; ++exponent) {
+    double value = ldexp(1.0, exponent);
+    len = TextFormatter::FormatDoubleShortest(value, buf);
+    string text(buf, len);
+    EXPECT_EQ(value, strtod(text.c_str(), NULL)) << text;
+    EXPECT_LE(text.size(), ShortestText(value).size()) << text;
+  }
+  for (int exponent = -149; exponent <= 127; ++exponent) {
+    float value = ldexpf(1.0f, exponent);
+    len = TextFormatter::FormatFloatShortest(value, buf);
+    string text(buf, len);
+    EXPECT_EQ(value, strtof(text.c_str(), NULL)) << text;
+    EXPECT_LE(text.size(), ShortestText(value).size()) << text;
+  }
+}
+
+TEST(TextFormatterTest, Decimal) {
+  int64_t values[] = {0, 1, -1, 9, 10, 123, -123, 1000, 99999, -99999, 123456789};
+  int scales[] = {0, 1, 2, 5, 9};
+  for (int i = 0; i < sizeof(values) / sizeof(int64_t); ++i) {
+    for (int j = 0; j < sizeof(scales) / sizeof(int); ++j) {
+      TestFormat(Decimal4Value(values[i]), ColumnType::CreateDecimalType(9, scales[j]));
+      TestFormat(Decimal8Value(values[i] * 1000000000LL),
+          ColumnType::CreateDecimalType(18, scales[j]));
+      TestFormat(
+          Decimal16Value(static_cast<int128_t>(values[i]) * 1000000000000000000LL),
+          ColumnType::CreateDecimalType(38, scales[j]));
+    }
+  }
+  TestFormat(Decimal4Value(999999999), ColumnType::CreateDecimalType(9, 9));
+  TestFormat(Decimal4Value(-999999999), ColumnType::CreateDecimalType(9, 9));
+  TestFormat(Decimal16Value(DecimalUtil::MAX_UNSCALED_DECIMAL),
+      ColumnType::CreateDecimalType(38, 38));
+  TestFormat(Decimal16Value(-DecimalUtil::MAX_UNSCALED_DECIMAL),
+      ColumnType::CreateDecimalType(38, 0));
+}
+
+TEST(TextFormatterTest, Timestamp) {
+  const char* values[] = {"2015-01-31 23:59:59.123456789", "1400-01-01 00:00:00",
+      "9999-12-31 23:59:59.999999999", "2015-06-01 12:00:00.000000001",
+      "2015-06-01 12:00:00.1", "2015-06-01"};
+  for (int i = 0; i < sizeof(values) / sizeof(const char*); ++i) {
+    TimestampValue ts(values[i], strlen(values[i]));
+    ASSERT_TRUE(ts.HasDateOrTime()) << values[i];
+    TestFormat(ts, TYPE_TIMESTAMP);
+  }
+}
+
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  impala::DecimalUtil::InitMaxUnscaledDecimal();
+  return RUN_ALL_TESTS();
+}
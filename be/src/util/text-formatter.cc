@@ -0,0 +1,524 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/text-formatter.h"
+
+#include <cfloat>
+#include <cmath>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "runtime/raw-value.h"
+#include "runtime/timestamp-value.h"
+
+using namespace std;
+
+using namespace boost::gregorian;
+using namespace boost::posix_time;
+
+namespace impala {
+
+const char TextFormatter::DIGIT_PAIRS[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// Doubles with an absolute value below this that hold an integer are written as
+// integers. All of them have fewer digits than RawValue::ASCII_PRECISION, so printf()
+// would not use the exponent notation for them either.
+static const double MAX_INTEGRAL_DOUBLE = 1e15;
+
+int TextFormatter::MaxLength(const ColumnType& type, int scale) {
+  switch (type.type) {
+    case TYPE_BOOLEAN: return 5;
+    case TYPE_TINYINT: return 4;
+    case TYPE_SMALLINT: return 6;
+    case TYPE_INT: return 11;
+    case TYPE_BIGINT: return 20;
+    case TYPE_FLOAT:
+    case TYPE_DOUBLE:
+      // Sign, digits, point and exponent of "%.16g" fit in 32 characters. With a fixed
+      // number of fractional digits, the whole part has up to DBL_MAX_10_EXP + 1 digits.
+      return scale > -1 ? DBL_MAX_10_EXP + 3 + scale : 32;
+    case TYPE_DECIMAL:
+      // Sign, leading zero and decimal point.
+      return type.precision + 3;
+    case TYPE_TIMESTAMP: return MAX_TIMESTAMP_LENGTH;
+    default:
+      return -1;
+  }
+}
+
+int TextFormatter::FormatSpecialDouble(double value, char* buf) {
+  if (UNLIKELY(!std::isfinite(value))) {
+    // See RawValue::PrintValue() for why these are written as Java does.
+    if (std::isnan(value)) {
+      memcpy(buf, "NaN", 3);
+      return 3;
+    }
+    if (value < 0) {
+      memcpy(buf, "-Infinity", 9);
+      return 9;
+    }
+    memcpy(buf, "Infinity", 8);
+    return 8;
+  }
+  // Most values in text tables that are stored as doubles hold integers, e.g. ids and
+  // amounts. -0.0 is excluded since it is written with its sign.
+  if (fabs(value) < MAX_INTEGRAL_DOUBLE && value == floor(value) &&
+      !(value == 0 && std::signbit(value))) {
+    return FormatInt(static_cast<int64_t>(value), buf);
+  }
+  return -1;
+}
+
+int TextFormatter::FormatDouble(double value, int scale, char* buf) {
+  int len = FormatSpecialDouble(value, buf);
+  if (len >= 0) {
+    if (scale > 0 && std::isfinite(value)) {
+      buf[len++] = '.';
+      memset(buf + len, '0', scale);
+      len += scale;
+    }
+    return len;
+  }
+  int max_len = MaxLength(ColumnType(TYPE_DOUBLE), scale);
+  if (scale > -1) {
+    len = snprintf(buf, max_len + 1, "%.*f", scale, value);
+  } else {
+    len = snprintf(buf, max_len + 1, "%.*g", RawValue::ASCII_PRECISION, value);
+  }
+  DCHECK_GT(len, 0);
+  DCHECK_LE(len, max_len);
+  return len;
+}
+
+// Shortest round-trip digits with Grisu3, from Loitsch, "Printing Floating-Point
+// Numbers Quickly and Accurately with Integers" (PLDI 2010). The value and the
+// boundaries of its rounding interval are scaled by a cached power of ten into a range
+// in which the digits are generated with 64-bit integer arithmetic. For about 0.5% of
+// doubles, Grisu3 cannot prove that its digits are the shortest and closest ones, and
+// the callers fall back to trying "%.*g" with increasing precisions.
+
+// A floating point number f * 2^e with a 64-bit significand and no hidden bit.
+struct DiyFp {
+  uint64_t f;
+  int e;
+
+  DiyFp(uint64_t f, int e) : f(f), e(e) { }
+
+  // Returns this number shifted so that the highest bit of its significand is set.
+  DiyFp Normalize() const {
+    DiyFp result = *this;
+    while ((result.f & 0xffc0000000000000ULL) == 0) {
+      result.f <<= 10;
+      result.e -= 10;
+    }
+    while ((result.f & 0x8000000000000000ULL) == 0) {
+      result.f <<= 1;
+      --result.e;
+    }
+    return result;
+  }
+
+  // Returns the upper 64 bits of the product of the significands, rounded.
+  DiyFp Multiply(const DiyFp& other) const {
+    const uint64_t M32 = 0xffffffffULL;
+    uint64_t a = f >> 32;
+    uint64_t b = f & M32;
+    uint64_t c = other.f >> 32;
+    uint64_t d = other.f & M32;
+    uint64_t ac = a * c;
+    uint64_t bc = b * c;
+    uint64_t ad = a * d;
+    uint64_t bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & M32) + (bc & M32) + (1ULL << 31);
+    return DiyFp(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), e + other.e + 64);
+  }
+};
+
+// Normalized powers of ten 10^k for k = -348, -340, ..., 340: the significand, its
+// binary exponent and k.
+struct CachedPower {
+  uint64_t significand;
+  int16_t binary_exponent;
+  int16_t decimal_exponent;
+};
+
+static const CachedPower CACHED_POWERS[] = {
+  {0xfa8fd5a0081c0288ULL, -1220, -348},
+  {0xbaaee17fa23ebf76ULL, -1193, -340},
+  {0x8b16fb203055ac76ULL, -1166, -332},
+  {0xcf42894a5dce35eaULL, -1140, -324},
+  {0x9a6bb0aa55653b2dULL, -1113, -316},
+  {0xe61acf033d1a45dfULL, -1087, -308},
+  {0xab70fe17c79ac6caULL, -1060, -300},
+  {0xff77b1fcbebcdc4fULL, -1034, -292},
+  {0xbe5691ef416bd60cULL, -1007, -284},
+  {0x8dd01fad907ffc3cULL, -980, -276},
+  {0xd3515c2831559a83ULL, -954, -268},
+  {0x9d71ac8fada6c9b5ULL, -927, -260},
+  {0xea9c227723ee8bcbULL, -901, -252},
+  {0xaecc49914078536dULL, -874, -244},
+  {0x823c12795db6ce57ULL, -847, -236},
+  {0xc21094364dfb5637ULL, -821, -228},
+  {0x9096ea6f3848984fULL, -794, -220},
+  {0xd77485cb25823ac7ULL, -768, -212},
+  {0xa086cfcd97bf97f4ULL, -741, -204},
+  {0xef340a98172aace5ULL, -715, -196},
+  {0xb23867fb2a35b28eULL, -688, -188},
+  {0x84c8d4dfd2c63f3bULL, -661, -180},
+  {0xc5dd44271ad3cdbaULL, -635, -172},
+  {0x936b9fcebb25c996ULL, -608, -164},
+  {0xdbac6c247d62a584ULL, -582, -156},
+  {0xa3ab66580d5fdaf6ULL, -555, -148},
+  {0xf3e2f893dec3f126ULL, -529, -140},
+  {0xb5b5ada8aaff80b8ULL, -502, -132},
+  {0x87625f056c7c4a8bULL, -475, -124},
+  {0xc9bcff6034c13053ULL, -449, -116},
+  {0x964e858c91ba2655ULL, -422, -108},
+  {0xdff9772470297ebdULL, -396, -100},
+  {0xa6dfbd9fb8e5b88fULL, -369, -92},
+  {0xf8a95fcf88747d94ULL, -343, -84},
+  {0xb94470938fa89bcfULL, -316, -76},
+  {0x8a08f0f8bf0f156bULL, -289, -68},
+  {0xcdb02555653131b6ULL, -263, -60},
+  {0x993fe2c6d07b7facULL, -236, -52},
+  {0xe45c10c42a2b3b06ULL, -210, -44},
+  {0xaa242499697392d3ULL, -183, -36},
+  {0xfd87b5f28300ca0eULL, -157, -28},
+  {0xbce5086492111aebULL, -130, -20},
+  {0x8cbccc096f5088ccULL, -103, -12},
+  {0xd1b71758e219652cULL, -77, -4},
+  {0x9c40000000000000ULL, -50, 4},
+  {0xe8d4a51000000000ULL, -24, 12},
+  {0xad78ebc5ac620000ULL, 3, 20},
+  {0x813f3978f8940984ULL, 30, 28},
+  {0xc097ce7bc90715b3ULL, 56, 36},
+  {0x8f7e32ce7bea5c70ULL, 83, 44},
+  {0xd5d238a4abe98068ULL, 109, 52},
+  {0x9f4f2726179a2245ULL, 136, 60},
+  {0xed63a231d4c4fb27ULL, 162, 68},
+  {0xb0de65388cc8ada8ULL, 189, 76},
+  {0x83c7088e1aab65dbULL, 216, 84},
+  {0xc45d1df942711d9aULL, 242, 92},
+  {0x924d692ca61be758ULL, 269, 100},
+  {0xda01ee641a708deaULL, 295, 108},
+  {0xa26da3999aef774aULL, 322, 116},
+  {0xf209787bb47d6b85ULL, 348, 124},
+  {0xb454e4a179dd1877ULL, 375, 132},
+  {0x865b86925b9bc5c2ULL, 402, 140},
+  {0xc83553c5c8965d3dULL, 428, 148},
+  {0x952ab45cfa97a0b3ULL, 455, 156},
+  {0xde469fbd99a05fe3ULL, 481, 164},
+  {0xa59bc234db398c25ULL, 508, 172},
+  {0xf6c69a72a3989f5cULL, 534, 180},
+  {0xb7dcbf5354e9beceULL, 561, 188},
+  {0x88fcf317f22241e2ULL, 588, 196},
+  {0xcc20ce9bd35c78a5ULL, 614, 204},
+  {0x98165af37b2153dfULL, 641, 212},
+  {0xe2a0b5dc971f303aULL, 667, 220},
+  {0xa8d9d1535ce3b396ULL, 694, 228},
+  {0xfb9b7cd9a4a7443cULL, 720, 236},
+  {0xbb764c4ca7a44410ULL, 747, 244},
+  {0x8bab8eefb6409c1aULL, 774, 252},
+  {0xd01fef10a657842cULL, 800, 260},
+  {0x9b10a4e5e9913129ULL, 827, 268},
+  {0xe7109bfba19c0c9dULL, 853, 276},
+  {0xac2820d9623bf429ULL, 880, 284},
+  {0x80444b5e7aa7cf85ULL, 907, 292},
+  {0xbf21e44003acdd2dULL, 933, 300},
+  {0x8e679c2f5e44ff8fULL, 960, 308},
+  {0xd433179d9c8cb841ULL, 986, 316},
+  {0x9e19db92b4e31ba9ULL, 1013, 324},
+  {0xeb96bf6ebadf77d9ULL, 1039, 332},
+  {0xaf87023b9bf0ee6bULL, 1066, 340},
+};
+
+static const int MIN_CACHED_DECIMAL_EXPONENT = -348;
+static const int CACHED_DECIMAL_EXPONENT_STEP = 8;
+
+// The scaled value has a binary exponent in this range, so that the digits before the
+// decimal point fit into 32 bits and those after it into the rest of 64 bits.
+static const int MIN_TARGET_EXPONENT = -60;
+static const int MAX_TARGET_EXPONENT = -32;
+
+static const uint32_t SMALL_POWERS_OF_TEN[] = {0, 1, 10, 100, 1000, 10000, 100000,
+    1000000, 10000000, 100000000, 1000000000};
+
+// Returns the cached power of ten c with which a value with the binary exponent 'e'
+// scales into the target range, and sets 'decimal_exponent' to its exponent.
+static DiyFp GetCachedPower(int e, int* decimal_exponent) {
+  // 1 / log2(10)
+  const double D_1_LOG2_10 = 0.30102999566398114;
+  int k = static_cast<int>(ceil((MIN_TARGET_EXPONENT - (e + 64) + 63) * D_1_LOG2_10));
+  int idx = (k - MIN_CACHED_DECIMAL_EXPONENT - 1) / CACHED_DECIMAL_EXPONENT_STEP + 1;
+  const CachedPower& power = CACHED_POWERS[idx];
+  DCHECK_GE(e + power.binary_exponent + 64, MIN_TARGET_EXPONENT);
+  DCHECK_LE(e + power.binary_exponent + 64, MAX_TARGET_EXPONENT);
+  *decimal_exponent = power.decimal_exponent;
+  return DiyFp(power.significand, power.binary_exponent);
+}
+
+// Moves the last digit of 'digits' towards the scaled value as long as the digits stay
+// within the rounding interval, and returns whether they are provably the closest
+// shortest digits. The distances are those of Grisu3's DigitGen, in units of
+// 'ten_kappa', the weight of the last digit.
+static bool RoundWeed(char* digits, int num_digits, uint64_t distance_too_high_w,
+    uint64_t unsafe_interval, uint64_t rest, uint64_t ten_kappa, uint64_t unit) {
+  uint64_t small_distance = distance_too_high_w - unit;
+  uint64_t big_distance = distance_too_high_w + unit;
+  while (rest < small_distance && unsafe_interval - rest >= ten_kappa &&
+      (rest + ten_kappa < small_distance ||
+       small_distance - rest >= rest + ten_kappa - small_distance)) {
+    --digits[num_digits - 1];
+    rest += ten_kappa;
+  }
+  if (rest < big_distance && unsafe_interval - rest >= ten_kappa &&
+      (rest + ten_kappa < big_distance ||
+       big_distance - rest > rest + ten_kappa - big_distance)) {
+    return false;
+  }
+  return 2 * unit <= rest && rest <= unsafe_interval - 4 * unit;
+}
+
+// Generates the shortest digits of 'w' that lie between 'low' and 'high', which have
+// the same exponent. Sets 'kappa' to the decimal exponent of the last digit.
+static bool DigitGen(const DiyFp& low, const DiyFp& w, const DiyFp& high, char* digits,
+    int* num_digits, int* kappa) {
+  uint64_t unit = 1;
+  uint64_t too_low = low.f - unit;
+  uint64_t too_high = high.f + unit;
+  uint64_t unsafe_interval = too_high - too_low;
+  int shift = -w.e;
+  uint64_t one = 1ULL << shift;
+  uint32_t integrals = too_high >> shift;
+  uint64_t fractionals = too_high & (one - 1);
+
+  // The largest power of ten that is at most 'integrals', which has at most 64 - shift
+  // bits.
+  int exponent_plus_one = (((64 - shift) + 1) * 1233 >> 12) + 1;
+  if (integrals < SMALL_POWERS_OF_TEN[exponent_plus_one]) --exponent_plus_one;
+  uint32_t divisor = SMALL_POWERS_OF_TEN[exponent_plus_one];
+  *kappa = exponent_plus_one;
+  *num_digits = 0;
+  while (*kappa > 0) {
+    digits[(*num_digits)++] = '0' + integrals / divisor;
+    integrals %= divisor;
+    --*kappa;
+    uint64_t rest = (static_cast<uint64_t>(integrals) << shift) + fractionals;
+    if (rest < unsafe_interval) {
+      return RoundWeed(digits, *num_digits, too_high - w.f, unsafe_interval, rest,
+          static_cast<uint64_t>(divisor) << shift, unit);
+    }
+    divisor /= 10;
+  }
+  while (true) {
+    fractionals *= 10;
+    unit *= 10;
+    unsafe_interval *= 10;
+    digits[(*num_digits)++] = '0' + (fractionals >> shift);
+    fractionals &= one - 1;
+    --*kappa;
+    if (fractionals < unsafe_interval) {
+      return RoundWeed(digits, *num_digits, (too_high - w.f) * unit, unsafe_interval,
+          fractionals, one, unit);
+    }
+  }
+}
+
+// Sets 'digits' and 'decimal_exponent' to the shortest digits D of the positive value
+// f * 2^e, such that D * 10^decimal_exponent reads back as the value. The neighbours
+// of the value are half an ulp away, or a quarter of an ulp below if 'f' is the
+// smallest significand of its binade. Returns false if Grisu3 fails.
+static bool Grisu3(uint64_t f, int e, bool lower_boundary_is_closer, char* digits,
+    int* num_digits, int* decimal_exponent) {
+  DiyFp w = DiyFp(f, e).Normalize();
+  DiyFp plus = DiyFp((f << 1) + 1, e - 1).Normalize();
+  DiyFp minus = lower_boundary_is_closer ?
+      DiyFp((f << 2) - 1, e - 2) : DiyFp((f << 1) - 1, e - 1);
+  minus.f <<= minus.e - plus.e;
+  minus.e = plus.e;
+  DCHECK_EQ(w.e, plus.e);
+  int mk;
+  DiyFp ten_mk = GetCachedPower(w.e, &mk);
+  int kappa;
+  bool success = DigitGen(minus.Multiply(ten_mk), w.Multiply(ten_mk),
+      plus.Multiply(ten_mk), digits, num_digits, &kappa);
+  *decimal_exponent = -mk + kappa;
+  return success;
+}
+
+// Writes 'digits' * 10^'decimal_exponent' in the notation of printf("%g") with the
+// precision 'num_digits', and returns the number of characters written.
+static int WriteShortest(bool negative, const char* digits, int num_digits,
+    int decimal_exponent, char* buf) {
+  char* p = buf;
+  if (negative) *p++ = '-';
+  // Exponent of the first digit in scientific notation.
+  int exponent = num_digits + decimal_exponent - 1;
+  if (exponent < -4 || exponent >= num_digits) {
+    *p++ = digits[0];
+    if (num_digits > 1) {
+      *p++ = '.';
+      memcpy(p, digits + 1, num_digits - 1);
+      p += num_digits - 1;
+    }
+    *p++ = 'e';
+    *p++ = exponent < 0 ? '-' : '+';
+    int abs_exponent = exponent < 0 ? -exponent : exponent;
+    if (abs_exponent < 10) *p++ = '0';
+    return p + TextFormatter::FormatUint(abs_exponent, p) - buf;
+  }
+  if (exponent < 0) {
+    *p++ = '0';
+    *p++ = '.';
+    memset(p, '0', -exponent - 1);
+    p += -exponent - 1;
+    memcpy(p, digits, num_digits);
+    return p + num_digits - buf;
+  }
+  memcpy(p, digits, exponent + 1);
+  p += exponent + 1;
+  if (exponent + 1 < num_digits) {
+    *p++ = '.';
+    memcpy(p, digits + exponent + 1, num_digits - exponent - 1);
+    p += num_digits - exponent - 1;
+  }
+  return p - buf;
+}
+
+// Writes the shortest digits of the nonzero value (-1)^negative * f * 2^e that Grisu3
+// finds, or returns -1 if it fails.
+static int FormatGrisu3(bool negative, uint64_t f, int e, bool lower_boundary_is_closer,
+    char* buf) {
+  // Grisu3 generates at most 17 digits for a double.
+  char digits[DBL_DIG + 3];
+  int num_digits;
+  int decimal_exponent;
+  if (!Grisu3(f, e, lower_boundary_is_closer, digits, &num_digits, &decimal_exponent)) {
+    return -1;
+  }
+  DCHECK_LE(num_digits, DBL_DIG + 2);
+  DCHECK_NE(digits[num_digits - 1], '0');
+  return WriteShortest(negative, digits, num_digits, decimal_exponent, buf);
+}
+
+int TextFormatter::FormatDoubleShortest(double value, char* buf) {
+  int len = FormatSpecialDouble(value, buf);
+  if (len >= 0) return len;
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  int biased_exponent = (bits >> 52) & 0x7ff;
+  uint64_t fraction = bits & ((1ULL << 52) - 1);
+  // -0.0 is the only zero that gets here and is left to snprintf().
+  if (biased_exponent != 0 || fraction != 0) {
+    // Subnormal values have no hidden bit and the exponent of the smallest normal ones.
+    len = biased_exponent == 0 ?
+        FormatGrisu3(bits >> 63, fraction, -1074, false, buf) :
+        FormatGrisu3(bits >> 63, fraction | (1ULL << 52), biased_exponent - 1075,
+            fraction == 0 && biased_exponent > 1, buf);
+    if (len >= 0) return len;
+  }
+  // Any decimal with up to DBL_DIG significant digits survives a round trip through a
+  // normal double, so if a shorter one parses to 'value', "%.15g" writes it. Otherwise
+  // the closest decimal with 16 digits is tried. 17 digits always parse back to
+  // 'value'. Subnormal values have fewer significant bits and are tried with all
+  // precisions, e.g. the smallest one is written as "5e-324".
+  int max_len = MaxLength(ColumnType(TYPE_DOUBLE), -1);
+  for (int precision = fabs(value) < DBL_MIN ? 1 : DBL_DIG; ; ++precision) {
+    len = snprintf(buf, max_len + 1, "%.*g", precision, value);
+    DCHECK_GT(len, 0);
+    DCHECK_LE(len, max_len);
+    if (precision == DBL_DIG + 2 || strtod(buf, NULL) == value) return len;
+  }
+}
+
+int TextFormatter::FormatFloatShortest(float value, char* buf) {
+  int len = FormatSpecialDouble(value, buf);
+  if (len >= 0) return len;
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  int biased_exponent = (bits >> 23) & 0xff;
+  uint32_t fraction = bits & ((1U << 23) - 1);
+  if (biased_exponent != 0 || fraction != 0) {
+    len = biased_exponent == 0 ?
+        FormatGrisu3(bits >> 31, fraction, -149, false, buf) :
+        FormatGrisu3(bits >> 31, fraction | (1U << 23), biased_exponent - 150,
+            fraction == 0 && biased_exponent > 1, buf);
+    if (len >= 0) return len;
+  }
+  // As in FormatDoubleShortest(), with the FLT_DIG to FLT_DIG + 3 digits of a float.
+  int max_len = MaxLength(ColumnType(TYPE_FLOAT), -1);
+  for (int precision = fabs(value) < FLT_MIN ? 1 : FLT_DIG; ; ++precision) {
+    len = snprintf(buf, max_len + 1, "%.*g", precision, value);
+    DCHECK_GT(len, 0);
+    DCHECK_LE(len, max_len);
+    if (precision == FLT_DIG + 3 || strtof(buf, NULL) == value) return len;
+  }
+}
+
+int TextFormatter::FormatTimestamp(const TimestampValue& value, char* buf) {
+  const time_duration& time = value.time();
+  if (UNLIKELY(!value.HasDateAndTime() || time.is_negative() || time.hours() > 99)) {
+    string str = value.DebugString();
+    int len = str.size();
+    DCHECK_LE(len, static_cast<int>(MAX_TIMESTAMP_LENGTH));
+    if (len > MAX_TIMESTAMP_LENGTH) len = MAX_TIMESTAMP_LENGTH;
+    memcpy(buf, str.data(), len);
+    return len;
+  }
+  // Same output as to_iso_extended_string() of the date and to_simple_string() of the
+  // time, e.g. "2015-01-31 23:59:59.123456789".
+  const date::ymd_type ymd = value.date().year_month_day();
+  char* p = buf + FormatUint(ymd.year, buf);
+  *p++ = '-';
+  memcpy(p, &DIGIT_PAIRS[ymd.month * 2], 2);
+  p += 2;
+  *p++ = '-';
+  memcpy(p, &DIGIT_PAIRS[ymd.day * 2], 2);
+  p += 2;
+  *p++ = ' ';
+  memcpy(p, &DIGIT_PAIRS[time.hours() * 2], 2);
+  p += 2;
+  *p++ = ':';
+  memcpy(p, &DIGIT_PAIRS[time.minutes() * 2], 2);
+  p += 2;
+  *p++ = ':';
+  memcpy(p, &DIGIT_PAIRS[time.seconds() * 2], 2);
+  p += 2;
+  int64_t frac = time.fractional_seconds();
+  if (frac != 0) {
+    *p++ = '.';
+    // Zero-pad to the resolution of time_duration, as to_simple_string() does.
+    int num_digits = time_duration::num_fractional_digits();
+    char digits[20];
+    int len = FormatUint(frac, digits);
+    DCHECK_LE(len, num_digits);
+    memset(p, '0', num_digits - len);
+    p += num_digits - len;
+    memcpy(p, digits, len);
+    p += len;
+  }
+  return p - buf;
+}
+
+}
@@ -0,0 +1,174 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_UTIL_TEXT_FORMATTER_H
+#define IMPALA_UTIL_TEXT_FORMATTER_H
+
+#include <string.h>
+#include <boost/cstdint.hpp>
+
+#include "common/compiler-util.h"
+#include "common/logging.h"
+#include "runtime/decimal-value.h"
+#include "runtime/types.h"
+
+namespace impala {
+
+class TimestampValue;
+
+// Utility functions to write the text representation of values into a caller-provided
+// buffer. The output is identical to that of RawValue::PrintValue() with a stream, but
+// it avoids the locale handling, sentries and virtual calls of iostreams: integers are
+// written two digits at a time from a table of digit pairs, and doubles that hold an
+// integer are written as integers. FormatDoubleShortest() and FormatFloatShortest()
+// instead write the shortest text that parses back to the same value, whose digits
+// they generate with Grisu3 rather than snprintf().
+// Each function returns the number of characters written. The buffer must have room for
+// at least MaxLength() characters of the value's type.
+class TextFormatter {
+ public:
+  // Returns the maximum number of characters written for a value of 'type'. 'scale' is
+  // the output scale of floating point values as in RawValue::PrintValue(), or -1.
+  // Returns -1 for types that these functions don't format (strings).
+  static int MaxLength(const ColumnType& type, int scale);
+
+  static int FormatBool(bool value, char* buf) {
+    if (value) {
+      memcpy(buf, "true", 4);
+      return 4;
+    }
+    memcpy(buf, "false", 5);
+    return 5;
+  }
+
+  static int FormatUint(uint64_t value, char* buf) {
+    int len = NumDigits(value);
+    char* p = buf + len;
+    while (value >= 100) {
+      int idx = (value % 100) * 2;
+      value /= 100;
+      *--p = DIGIT_PAIRS[idx + 1];
+      *--p = DIGIT_PAIRS[idx];
+    }
+    if (value >= 10) {
+      int idx = value * 2;
+      *--p = DIGIT_PAIRS[idx + 1];
+      *--p = DIGIT_PAIRS[idx];
+    } else {
+      *--p = '0' + value;
+    }
+    DCHECK(p == buf);
+    return len;
+  }
+
+  static int FormatInt(int64_t value, char* buf) {
+    if (value < 0) {
+      *buf = '-';
+      // Negate as unsigned so that the minimum int64_t doesn't overflow.
+      return 1 + FormatUint(0 - static_cast<uint64_t>(value), buf + 1);
+    }
+    return FormatUint(value, buf);
+  }
+
+  // Formats like a stream with precision RawValue::ASCII_PRECISION, or with that
+  // precision set to 'scale' and std::fixed if 'scale' > -1. Non-finite values are
+  // written as Java does, i.e. "NaN", "Infinity" and "-Infinity".
+  static int FormatDouble(double value, int scale, char* buf);
+
+  // Floats are written with the digits of their double value, as streams do.
+  static int FormatFloat(float value, int scale, char* buf) {
+    return FormatDouble(value, scale, buf);
+  }
+
+  // Writes the fewest significant digits that parse back to 'value' with strtod(), in
+  // the notation of printf("%g"), e.g. 0.1 + 0.2 as "0.30000000000000004" where
+  // FormatDouble() writes "0.3". Of several such digits, the closest to 'value' are
+  // written. Integers and non-finite values are written as by FormatDouble(). Writes at
+  // most MaxLength() characters with a scale of -1.
+  static int FormatDoubleShortest(double value, char* buf);
+
+  // Same as FormatDoubleShortest() for the float 'value', e.g. 0.1f as "0.1" rather
+  // than with the digits of its double value.
+  static int FormatFloatShortest(float value, char* buf);
+
+  // Formats like DecimalValue::ToString(): the whole part without leading zeros but with
+  // at least one digit, followed by 'scale' fractional digits.
+  template <typename T>
+  static int FormatDecimal(const DecimalValue<T>& value, int scale, char* buf);
+
+  // Formats like TimestampValue::DebugString(), e.g. "2015-01-31 23:59:59.123456789".
+  static int FormatTimestamp(const TimestampValue& value, char* buf);
+
+ private:
+  // "00", "01", ..., "99" without separators.
+  static const char DIGIT_PAIRS[201];
+
+  // Maximum number of characters of a timestamp, with some room for the values that
+  // TimestampValue::DebugString() formats specially.
+  static const int MAX_TIMESTAMP_LENGTH = 64;
+
+  // Writes 'value' if it is not finite or holds an integer that is written as such, and
+  // returns the number of characters written. Returns -1 otherwise.
+  static int FormatSpecialDouble(double value, char* buf);
+
+  static int NumDigits(uint64_t value) {
+    int result = 1;
+    while (true) {
+      if (value < 10) return result;
+      if (value < 100) return result + 1;
+      if (value < 1000) return result + 2;
+      if (value < 10000) return result + 3;
+      value /= 10000;
+      result += 4;
+    }
+  }
+};
+
+template <typename T>
+inline int TextFormatter::FormatDecimal(const DecimalValue<T>& value, int scale,
+    char* buf) {
+  char* p = buf;
+  T remaining_value = value.value();
+  if (remaining_value < 0) {
+    *p++ = '-';
+    remaining_value = -remaining_value;
+  }
+  // Write the digits in reverse order, padded with zeros so that the whole part has at
+  // least one digit.
+  char digits[40];
+  int num_digits = 0;
+  if (sizeof(T) <= sizeof(int64_t)) {
+    char tmp[20];
+    int len = FormatUint(static_cast<uint64_t>(remaining_value), tmp);
+    while (len > 0) digits[num_digits++] = tmp[--len];
+  } else {
+    do {
+      digits[num_digits++] = '0' + static_cast<int>(remaining_value % 10);
+      remaining_value /= 10;
+    } while (remaining_value != 0);
+  }
+  DCHECK_LE(scale + 1, static_cast<int>(sizeof(digits)));
+  while (num_digits < scale + 1) digits[num_digits++] = '0';
+  for (int i = num_digits - 1; i >= scale; --i) *p++ = digits[i];
+  if (scale > 0) {
+    *p++ = '.';
+    for (int i = scale - 1; i >= 0; --i) *p++ = digits[i];
+  }
+  return p - buf;
+}
+
+}
+
+#endif
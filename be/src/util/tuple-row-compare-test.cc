@@ -0,0 +1,216 @@
+// Copyright 2015 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "util/tuple-row-compare.h"
+
+using namespace std;
+
+namespace impala {
+
+// Reference Z-order: compares the bits of all keys interleaved, most significant bit
+// first and, within the same bit, earlier keys first.
+static int CompareInterleaved(const vector<uint64_t>& lhs, const vector<uint64_t>& rhs) {
+  for (int bit = 63; bit >= 0; --bit) {
+    for (int i = 0; i < lhs.size(); ++i) {
+      uint64_t l = (lhs[i] >> bit) & 1;
+      uint64_t r = (rhs[i] >> bit) & 1;
+      if (l != r) return l < r ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+static int Sign(int v) {
+  return v < 0 ? -1 : (v > 0 ? 1 : 0);
+}
+
+class ZOrderTest : public testing::Test {
+ protected:
+  // Compares rows with the keys 'lhs' and 'rhs' with ZOrderComparison.
+  static int CompareZOrder(const vector<uint64_t>& lhs, const vector<uint64_t>& rhs) {
+    TupleRowComparator::ZOrderComparison comparison;
+    for (int i = 0; i < lhs.size(); ++i) comparison.AddKey(lhs[i], rhs[i]);
+    return comparison.Result();
+  }
+
+  template <typename T>
+  static uint64_t ZOrderKey(T v, const ColumnType& type) {
+    return TupleRowComparator::ZOrderKey(&v, type);
+  }
+
+  static uint64_t NullZOrderKey(const ColumnType& type) {
+    return TupleRowComparator::ZOrderKey(NULL, type);
+  }
+
+  // Returns the keys of a row with two INT columns.
+  static vector<uint64_t> IntKeys(int32_t a, int32_t b) {
+    vector<uint64_t> keys;
+    keys.push_back(ZOrderKey(a, TYPE_INT));
+    keys.push_back(ZOrderKey(b, TYPE_INT));
+    return keys;
+  }
+
+  static bool ZOrderLess(const pair<int, int>& lhs, const pair<int, int>& rhs) {
+    return CompareZOrder(IntKeys(lhs.first, lhs.second),
+        IntKeys(rhs.first, rhs.second)) < 0;
+  }
+};
+
+// Sorting a 4x4 grid visits it along the Z curve.
+TEST_F(ZOrderTest, Grid) {
+  vector<pair<int, int> > points;
+  for (int a = 3; a >= 0; --a) {
+    for (int b = 3; b >= 0; --b) points.push_back(make_pair(a, b));
+  }
+  sort(points.begin(), points.end(), ZOrderLess);
+  int expected[][2] = {{0, 0}, {0, 1}, {1, 0}, {1, 1}, {0, 2}, {0, 3}, {1, 2}, {1, 3},
+      {2, 0}, {2, 1}, {3, 0}, {3, 1}, {2, 2}, {2, 3}, {3, 2}, {3, 3}};
+  ASSERT_EQ(16, points.size());
+  for (int i = 0; i < points.size(); ++i) {
+    EXPECT_EQ(expected[i][0], points[i].first) << i;
+    EXPECT_EQ(expected[i][1], points[i].second) << i;
+  }
+}
+
+// The comparison agrees with actually interleaving the bits of the keys, including for
+// negative values.
+TEST_F(ZOrderTest, Interleaving) {
+  for (int a1 = -8; a1 < 8; ++a1) {
+    for (int b1 = -8; b1 < 8; ++b1) {
+      for (int a2 = -8; a2 < 8; ++a2) {
+        for (int b2 = -8; b2 < 8; ++b2) {
+          vector<uint64_t> lhs = IntKeys(a1, b1);
+          vector<uint64_t> rhs = IntKeys(a2, b2);
+          ASSERT_EQ(CompareInterleaved(lhs, rhs), Sign(CompareZOrder(lhs, rhs)))
+              << "(" << a1 << ", " << b1 << ") vs (" << a2 << ", " << b2 << ")";
+        }
+      }
+    }
+  }
+
+  // Random 64-bit keys, with up to 4 columns.
+  srand(0);
+  for (int i = 0; i < 100000; ++i) {
+    int num_keys = 1 + i % 4;
+    vector<uint64_t> lhs, rhs;
+    for (int j = 0; j < num_keys; ++j) {
+      // Sharing high bits makes the keys differ at various positions.
+      uint64_t shared = static_cast<uint64_t>(rand()) << 40;
+      int shift = rand() % 64;
+      lhs.push_back(shared ^ ((static_cast<uint64_t>(rand()) << 31 | rand()) >> shift));
+      rhs.push_back(shared ^ ((static_cast<uint64_t>(rand()) << 31 | rand()) >> shift));
+    }
+    if (i % 7 == 0) rhs[0] = lhs[0];
+    ASSERT_EQ(CompareInterleaved(lhs, rhs), Sign(CompareZOrder(lhs, rhs)));
+    ASSERT_EQ(0, CompareZOrder(lhs, lhs));
+  }
+}
+
+// Keys preserve the order of signed values and span the full 64 bits.
+TEST_F(ZOrderTest, SignedValues) {
+  EXPECT_EQ(0, ZOrderKey(numeric_limits<int8_t>::min(), TYPE_TINYINT));
+  EXPECT_LT(ZOrderKey<int8_t>(-1, TYPE_TINYINT), ZOrderKey<int8_t>(0, TYPE_TINYINT));
+  EXPECT_LT(ZOrderKey<int8_t>(0, TYPE_TINYINT), ZOrderKey<int8_t>(1, TYPE_TINYINT));
+  EXPECT_EQ(0xff00000000000000ULL,
+      ZOrderKey(numeric_limits<int8_t>::max(), TYPE_TINYINT));
+
+  EXPECT_EQ(0, ZOrderKey(numeric_limits<int16_t>::min(), TYPE_SMALLINT));
+  EXPECT_LT(ZOrderKey<int16_t>(-1, TYPE_SMALLINT), ZOrderKey<int16_t>(0, TYPE_SMALLINT));
+  EXPECT_LT(ZOrderKey<int16_t>(0, TYPE_SMALLINT), ZOrderKey<int16_t>(1, TYPE_SMALLINT));
+
+  EXPECT_EQ(0, ZOrderKey(numeric_limits<int32_t>::min(), TYPE_INT));
+  EXPECT_LT(ZOrderKey<int32_t>(-1, TYPE_INT), ZOrderKey<int32_t>(0, TYPE_INT));
+  EXPECT_LT(ZOrderKey<int32_t>(0, TYPE_INT), ZOrderKey<int32_t>(1, TYPE_INT));
+
+  EXPECT_EQ(0, ZOrderKey(numeric_limits<int64_t>::min(), TYPE_BIGINT));
+  EXPECT_LT(ZOrderKey<int64_t>(-1, TYPE_BIGINT), ZOrderKey<int64_t>(0, TYPE_BIGINT));
+  EXPECT_LT(ZOrderKey<int64_t>(0, TYPE_BIGINT), ZOrderKey<int64_t>(1, TYPE_BIGINT));
+  EXPECT_EQ(numeric_limits<uint64_t>::max(),
+      ZOrderKey(numeric_limits<int64_t>::max(), TYPE_BIGINT));
+
+  double doubles[] = {-numeric_limits<double>::infinity(), -1e300, -1.5, -0.5, -1e-300,
+      0, 1e-300, 0.5, 1.5, 1e300, numeric_limits<double>::infinity()};
+  for (int i = 1; i < sizeof(doubles) / sizeof(double); ++i) {
+    EXPECT_LT(ZOrderKey(doubles[i - 1], TYPE_DOUBLE), ZOrderKey(doubles[i], TYPE_DOUBLE))
+        << doubles[i];
+    if (fabs(doubles[i]) > 1e-30 && fabs(doubles[i]) < 1e30) {
+      EXPECT_LT(ZOrderKey(static_cast<float>(doubles[i - 1]), TYPE_FLOAT),
+          ZOrderKey(static_cast<float>(doubles[i]), TYPE_FLOAT)) << doubles[i];
+    }
+  }
+
+  ColumnType decimal_type = ColumnType::CreateDecimalType(9, 2);
+  EXPECT_LT(ZOrderKey(Decimal4Value(-5), decimal_type),
+      ZOrderKey(Decimal4Value(0), decimal_type));
+  EXPECT_LT(ZOrderKey(Decimal4Value(0), decimal_type),
+      ZOrderKey(Decimal4Value(5), decimal_type));
+  // Decimals beyond the range of a BIGINT are clamped.
+  ColumnType wide_decimal_type = ColumnType::CreateDecimalType(38, 0);
+  int128_t large = static_cast<int128_t>(numeric_limits<int64_t>::max()) * 10;
+  EXPECT_EQ(ZOrderKey(Decimal16Value(large), wide_decimal_type),
+      ZOrderKey(Decimal16Value(large * 2), wide_decimal_type));
+  EXPECT_EQ(0, ZOrderKey(Decimal16Value(-large), wide_decimal_type));
+
+  // A negative value in one column and a positive one in the other.
+  EXPECT_LT(CompareZOrder(IntKeys(-1, 1), IntKeys(1, -1)), 0);
+  EXPECT_LT(CompareZOrder(IntKeys(-100, -100), IntKeys(-1, -1)), 0);
+}
+
+// NULLs map to the lowest key, so they sort first.
+TEST_F(ZOrderTest, Nulls) {
+  ColumnType int_type(TYPE_INT);
+  EXPECT_EQ(0, NullZOrderKey(int_type));
+  EXPECT_EQ(0, NullZOrderKey(TYPE_STRING));
+  EXPECT_EQ(0, NullZOrderKey(TYPE_DOUBLE));
+  EXPECT_LT(NullZOrderKey(TYPE_DOUBLE),
+      ZOrderKey(-numeric_limits<double>::infinity(), TYPE_DOUBLE));
+
+  vector<uint64_t> null_row(2, 0);
+  vector<uint64_t> half_null_row = IntKeys(5, 5);
+  half_null_row[0] = NullZOrderKey(int_type);
+  EXPECT_EQ(0, CompareZOrder(null_row, null_row));
+  EXPECT_LT(CompareZOrder(null_row, half_null_row), 0);
+  EXPECT_LT(CompareZOrder(half_null_row, IntKeys(-1, 5)), 0);
+  EXPECT_GT(CompareZOrder(IntKeys(-1, 5), null_row), 0);
+  // NULL ties with the smallest value of the type.
+  EXPECT_EQ(0, CompareZOrder(null_row,
+      IntKeys(numeric_limits<int32_t>::min(), numeric_limits<int32_t>::min())));
+}
+
+// Strings are ordered by their first 8 bytes.
+TEST_F(ZOrderTest, Strings) {
+  ColumnType type(TYPE_STRING);
+  EXPECT_LT(ZOrderKey(StringValue("ab"), type), ZOrderKey(StringValue("abc"), type));
+  EXPECT_LT(ZOrderKey(StringValue("abc"), type), ZOrderKey(StringValue("abd"), type));
+  EXPECT_LT(ZOrderKey(StringValue("abc"), type), ZOrderKey(StringValue("b"), type));
+  EXPECT_LT(ZOrderKey(StringValue(""), type), ZOrderKey(StringValue("a"), type));
+  EXPECT_EQ(ZOrderKey(StringValue("abcdefgh1"), type),
+      ZOrderKey(StringValue("abcdefgh2"), type));
+}
+
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -16,8 +16,14 @@
 #ifndef IMPALA_UTIL_TUPLE_ROW_COMPARE_H_
 #define IMPALA_UTIL_TUPLE_ROW_COMPARE_H_
 
+#include <string.h>
+#include <limits>
+
 #include "exprs/expr.h"
 #include "exprs/expr-context.h"
+#include "runtime/decimal-value.h"
+#include "runtime/string-value.h"
+#include "runtime/timestamp-value.h"
 #include "runtime/tuple.h"
 #include "runtime/tuple-row.h"
 #include "runtime/descriptors.h"
@@ -26,6 +32,19 @@ namespace impala {
 
 class TupleRowComparator {
  public:
+  // How the values of multiple key exprs are combined into an order.
+  enum KeyOrder {
+    // By the first key, then by the second key, etc.
+    LEXICAL,
+
+    // By the Z-order (Morton order) of the keys, i.e. as if the bits of all keys were
+    // interleaved. Rows that are close in all keys end up close to each other, so each
+    // key clusters the rows, not just the first. Each key is converted to a 64-bit
+    // value that preserves its order (see ZOrderKey()), so e.g. strings are only
+    // ordered by their first 8 bytes. Keys are ascending and NULLs come first.
+    ZORDER
+  };
+
   // Compares two TupleRows based on a set of exprs, in order.
   // We use is_asc to determine, for each expr, if it should be ascending or descending
   // sort order.
@@ -38,7 +57,8 @@ class TupleRowComparator {
       const std::vector<bool>& nulls_first)
       : key_expr_ctxs_lhs_(key_expr_ctxs_lhs),
         key_expr_ctxs_rhs_(key_expr_ctxs_rhs),
-        is_asc_(is_asc) {
+        is_asc_(is_asc),
+        key_order_(LEXICAL) {
     DCHECK_EQ(key_expr_ctxs_lhs.size(), key_expr_ctxs_rhs.size());
     DCHECK_EQ(key_expr_ctxs_lhs.size(), is_asc.size());
     DCHECK_EQ(key_expr_ctxs_lhs.size(), nulls_first.size());
@@ -55,7 +75,20 @@ class TupleRowComparator {
       : key_expr_ctxs_lhs_(key_expr_ctxs_lhs),
         key_expr_ctxs_rhs_(key_expr_ctxs_rhs),
         is_asc_(key_expr_ctxs_lhs.size(), is_asc),
-        nulls_first_(key_expr_ctxs_lhs.size(), nulls_first ? -1 : 1) {
+        nulls_first_(key_expr_ctxs_lhs.size(), nulls_first ? -1 : 1),
+        key_order_(LEXICAL) {
+    DCHECK_EQ(key_expr_ctxs_lhs.size(), key_expr_ctxs_rhs.size());
+  }
+
+  TupleRowComparator(
+      const std::vector<ExprContext*>& key_expr_ctxs_lhs,
+      const std::vector<ExprContext*>& key_expr_ctxs_rhs,
+      KeyOrder key_order)
+      : key_expr_ctxs_lhs_(key_expr_ctxs_lhs),
+        key_expr_ctxs_rhs_(key_expr_ctxs_rhs),
+        is_asc_(key_expr_ctxs_lhs.size(), true),
+        nulls_first_(key_expr_ctxs_lhs.size(), -1),
+        key_order_(key_order) {
     DCHECK_EQ(key_expr_ctxs_lhs.size(), key_expr_ctxs_rhs.size());
   }
 
@@ -63,6 +96,7 @@ class TupleRowComparator {
   // than rhs, or 0 if they are equal. All exprs (key_exprs_lhs_ and key_exprs_rhs_)
   // must have been prepared and opened before calling this.
   int Compare(TupleRow* lhs, TupleRow* rhs) const {
+    if (UNLIKELY(key_order_ == ZORDER)) return CompareZOrder(lhs, rhs);
     for (int i = 0; i < key_expr_ctxs_lhs_.size(); ++i) {
       void* lhs_value = key_expr_ctxs_lhs_[i]->GetValue(lhs);
       void* rhs_value = key_expr_ctxs_rhs_[i]->GetValue(rhs);
@@ -97,10 +131,141 @@ class TupleRowComparator {
   }
 
  private:
+  friend class ZOrderTest;
+
+  // Compares two rows in Z-order, given the ZOrderKey()s of their keys one key at a
+  // time. Instead of interleaving the bits, this finds the key whose values differ in
+  // the most significant bit and compares the rows by that key (Chan, "Closest-point
+  // problems simplified on the RAM"). On ties, earlier keys win. Used by
+  // CompareZOrder().
+  class ZOrderComparison {
+   public:
+    ZOrderComparison() : msb_xor_(0), lhs_key_(0), rhs_key_(0) { }
+
+    void AddKey(uint64_t lhs_key, uint64_t rhs_key) {
+      uint64_t x = lhs_key ^ rhs_key;
+      // True if the highest bit set in 'x' is higher than the highest bit in msb_xor_.
+      if (msb_xor_ < x && msb_xor_ < (msb_xor_ ^ x)) {
+        msb_xor_ = x;
+        lhs_key_ = lhs_key;
+        rhs_key_ = rhs_key;
+      }
+    }
+
+    // Returns a negative value if lhs is less than rhs, a positive value if lhs is
+    // greater than rhs, or 0 if they are equal.
+    int Result() const {
+      if (lhs_key_ == rhs_key_) return 0;
+      return lhs_key_ < rhs_key_ ? -1 : 1;
+    }
+
+   private:
+    uint64_t msb_xor_;
+    uint64_t lhs_key_;
+    uint64_t rhs_key_;
+  };
+
+  // Maps 'value' of 'type' to a 64-bit value with the same order. Fixed-size values are
+  // left-aligned so that every type spans the full range. Only the first 8 bytes of
+  // strings and the range of a BIGINT of decimals are kept. NULL maps to 0,
+  // i.e. NULLs sort first, tied with the smallest value of integer and decimal types.
+  static uint64_t ZOrderKey(void* value, const ColumnType& type) {
+    if (value == NULL) return 0;
+    const uint64_t SIGN_BIT = 1ULL << 63;
+    switch (type.type) {
+      case TYPE_BOOLEAN:
+        return static_cast<uint64_t>(*reinterpret_cast<bool*>(value)) << 63;
+      case TYPE_TINYINT:
+        return (static_cast<uint64_t>(*reinterpret_cast<int8_t*>(value)) << 56) ^
+            SIGN_BIT;
+      case TYPE_SMALLINT:
+        return (static_cast<uint64_t>(*reinterpret_cast<int16_t*>(value)) << 48) ^
+            SIGN_BIT;
+      case TYPE_INT:
+        return (static_cast<uint64_t>(*reinterpret_cast<int32_t*>(value)) << 32) ^
+            SIGN_BIT;
+      case TYPE_BIGINT:
+        return static_cast<uint64_t>(*reinterpret_cast<int64_t*>(value)) ^ SIGN_BIT;
+      case TYPE_FLOAT:
+      case TYPE_DOUBLE: {
+        double d = type.type == TYPE_FLOAT ?
+            *reinterpret_cast<float*>(value) : *reinterpret_cast<double*>(value);
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        // Negative values sort in reverse order of their bits.
+        return (bits & SIGN_BIT) ? ~bits : bits | SIGN_BIT;
+      }
+      case TYPE_TIMESTAMP: {
+        const TimestampValue* ts = reinterpret_cast<TimestampValue*>(value);
+        if (ts->date().is_special()) return 0;
+        // Day numbers fit in 27 bits and microseconds of a day in 37 bits.
+        return (static_cast<uint64_t>(ts->date().day_number()) << 37) +
+            ts->time().total_microseconds();
+      }
+      case TYPE_STRING:
+      case TYPE_VARCHAR:
+      case TYPE_CHAR: {
+        const char* ptr;
+        int len;
+        if (type.type == TYPE_CHAR) {
+          ptr = StringValue::CharSlotToPtr(value, type);
+          len = type.len;
+        } else {
+          const StringValue* sv = reinterpret_cast<StringValue*>(value);
+          ptr = sv->ptr;
+          len = sv->len;
+        }
+        uint64_t key = 0;
+        for (int i = 0; i < 8; ++i) {
+          key <<= 8;
+          if (i < len) key |= static_cast<uint8_t>(ptr[i]);
+        }
+        return key;
+      }
+      case TYPE_DECIMAL: {
+        int64_t v;
+        switch (type.GetByteSize()) {
+          case 4:
+            v = reinterpret_cast<Decimal4Value*>(value)->value();
+            break;
+          case 8:
+            v = reinterpret_cast<Decimal8Value*>(value)->value();
+            break;
+          case 16: {
+            int128_t v16 = reinterpret_cast<Decimal16Value*>(value)->value();
+            v = static_cast<int64_t>(std::max<int128_t>(
+                std::min<int128_t>(v16, std::numeric_limits<int64_t>::max()),
+                std::numeric_limits<int64_t>::min()));
+            break;
+          }
+          default:
+            DCHECK(false);
+            return 0;
+        }
+        return static_cast<uint64_t>(v) ^ SIGN_BIT;
+      }
+      default:
+        DCHECK(false) << type;
+        return 0;
+    }
+  }
+
+  // Compare() for ZORDER (see ZOrderComparison).
+  int CompareZOrder(TupleRow* lhs, TupleRow* rhs) const {
+    ZOrderComparison comparison;
+    for (int i = 0; i < key_expr_ctxs_lhs_.size(); ++i) {
+      const ColumnType& type = key_expr_ctxs_lhs_[i]->root()->type();
+      comparison.AddKey(ZOrderKey(key_expr_ctxs_lhs_[i]->GetValue(lhs), type),
+          ZOrderKey(key_expr_ctxs_rhs_[i]->GetValue(rhs), type));
+    }
+    return comparison.Result();
+  }
+
   std::vector<ExprContext*> key_expr_ctxs_lhs_;
   std::vector<ExprContext*> key_expr_ctxs_rhs_;
   std::vector<bool> is_asc_;
   std::vector<int8_t> nulls_first_;
+  KeyOrder key_order_;
 };
 
 // Compares the equality of two Tuples, going slot by slot.
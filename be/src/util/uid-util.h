@@ -16,6 +16,7 @@
 #ifndef IMPALA_UTIL_UID_UTIL_H
 #define IMPALA_UTIL_UID_UTIL_H
 
+#include <boost/thread/tss.hpp>
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_generators.hpp>
 
@@ -49,6 +50,14 @@ inline T CastTUniqueId(const F& from) {
   return to;
 }
 
+// Returns a random UUID. Each thread has its own generator, since generators are not
+// thread-safe and are expensive to seed, so this does not take any locks.
+inline boost::uuids::uuid GenerateRandomUUID() {
+  static boost::thread_specific_ptr<boost::uuids::random_generator> generator;
+  if (generator.get() == NULL) generator.reset(new boost::uuids::random_generator());
+  return (*generator)();
+}
+
 // generates a 16 byte UUID
 inline string GenerateUUIDString() {
   boost::uuids::basic_random_generator<boost::mt19937> gen;
@@ -13,8 +13,16 @@
 // limitations under the License.
 
 #include "util/url-parser.h"
+
+#include <string.h>
+#include <boost/thread/tss.hpp>
+
+#include "common/compiler-util.h"
+#include "runtime/string-search.h"
 #include "runtime/string-value.inline.h"
+#include "util/sse-util.h"
 
+using namespace boost;
 using namespace std;
 
 namespace impala {
@@ -27,128 +35,409 @@ const StringValue UrlParser::url_protocol(const_cast<char*>("PROTOCOL"), 8);
 const StringValue UrlParser::url_query(const_cast<char*>("QUERY"), 5);
 const StringValue UrlParser::url_ref(const_cast<char*>("REF"), 3);
 const StringValue UrlParser::url_userinfo(const_cast<char*>("USERINFO"), 8);
-const StringValue UrlParser::protocol(const_cast<char*>("://"), 3);
-const StringValue UrlParser::at(const_cast<char*>("@"), 1);
-const StringValue UrlParser::slash(const_cast<char*>("/"), 1);
-const StringValue UrlParser::colon(const_cast<char*>(":"), 1);
-const StringValue UrlParser::question(const_cast<char*>("?"), 1);
-const StringValue UrlParser::hash(const_cast<char*>("#"), 1);
-const StringSearch UrlParser::protocol_search(&protocol);
-const StringSearch UrlParser::at_search(&at);
-const StringSearch UrlParser::slash_search(&slash);
-const StringSearch UrlParser::colon_search(&colon);
-const StringSearch UrlParser::question_search(&question);
-const StringSearch UrlParser::hash_search(&hash);
+
+// Returns the position of the first 'c' in [from, end) of str, or -1 if there is none.
+static inline int Find(const StringValue& str, char c, int from, int end) {
+  if (from >= end) return -1;
+  const char* found =
+      reinterpret_cast<const char*>(memchr(str.ptr + from, c, end - from));
+  return found == NULL ? -1 : found - str.ptr;
+}
+
+// Returns the position of the first 'c' in [from, end) of str, given the position of the
+// first 'c' in all of str, or -1 if there is none. Searches str only if the first 'c' is
+// before 'from'.
+static inline int FindFrom(const StringValue& str, char c, int first_pos, int from,
+    int end) {
+  if (first_pos < 0 || first_pos >= end) return -1;
+  if (first_pos >= from) return first_pos;
+  return Find(str, c, from, end);
+}
+
+// Returns the URL of 'tokens' with leading and trailing spaces removed.
+static inline StringValue TrimmedUrl(const StringValue& url,
+    const UrlParser::UrlTokens& tokens) {
+  return StringValue(url.ptr + tokens.start, tokens.len);
+}
+
+// The delimiters recorded by Tokenize(), in the order of 'positions' in Tokenize().
+static const int NUM_DELIMS = 5;
+
+// Returns the index of the delimiter 'c' in the order above, or -1 if 'c' is not one.
+static inline int DelimIndex(char c) {
+  switch (c) {
+    case '/': return 0;
+    case '@': return 1;
+    case '?': return 2;
+    case '#': return 3;
+    case ':': return 4;
+    default: return -1;
+  }
+}
+
+// Returns a bitmask of the bytes of the 16 bytes at 'data' that are delimiters.
+static inline int DelimMask(const char* data) {
+  const __m128i slash = _mm_set1_epi8('/');
+  const __m128i at = _mm_set1_epi8('@');
+  const __m128i question = _mm_set1_epi8('?');
+  const __m128i hash = _mm_set1_epi8('#');
+  const __m128i colon = _mm_set1_epi8(':');
+  __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+  __m128i eq = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(block, slash), _mm_cmpeq_epi8(block, at)),
+      _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, question),
+          _mm_cmpeq_epi8(block, hash)), _mm_cmpeq_epi8(block, colon)));
+  return _mm_movemask_epi8(eq);
+}
+
+// Records the position of each delimiter in 'mask' that was not seen before, where bit
+// i of 'mask' is set if data[block_pos + i] is a delimiter.
+static inline void RecordDelims(const char* data, int block_pos, int mask,
+    int* positions, int* num_found) {
+  while (mask != 0) {
+    int pos = block_pos + __builtin_ctz(mask);
+    mask &= mask - 1;
+    int delim = DelimIndex(data[pos]);
+    if (positions[delim] == -1) {
+      positions[delim] = pos;
+      ++*num_found;
+    }
+  }
+}
+
+// Returns the position of the first "://" in url, or -1 if there is none.
+static inline int FindProtocol(const StringValue& url) {
+  const char* end = url.ptr + url.len;
+  for (const char* colon = url.ptr;
+       (colon = reinterpret_cast<const char*>(memchr(colon, ':', end - colon))) != NULL;
+       ++colon) {
+    if (end - colon >= 3 && colon[1] == '/' && colon[2] == '/') return colon - url.ptr;
+  }
+  return -1;
+}
+
+bool UrlParser::Tokenize(const StringValue& url, UrlTokens* tokens) {
+  // Remove leading and trailing spaces.
+  StringValue trimmed_url = url.Trim();
+  tokens->start = trimmed_url.ptr - url.ptr;
+  tokens->len = trimmed_url.len;
+
+  // All parts require checking for the protocol.
+  tokens->protocol_pos = FindProtocol(trimmed_url);
+  if (tokens->protocol_pos < 0) return false;
+
+  // Positioned to first char after '://'.
+  StringValue protocol_end = trimmed_url.Substring(tokens->protocol_pos + 3);
+  int positions[NUM_DELIMS] = { -1, -1, -1, -1, -1 };
+  int num_found = 0;
+  const char* data = protocol_end.ptr;
+  int len = protocol_end.len;
+  int pos = 0;
+  if (len >= SSEUtil::CHARS_PER_128_BIT_REGISTER) {
+    for (; pos + SSEUtil::CHARS_PER_128_BIT_REGISTER <= len && num_found < NUM_DELIMS;
+         pos += SSEUtil::CHARS_PER_128_BIT_REGISTER) {
+      RecordDelims(data, pos, DelimMask(data + pos), positions, &num_found);
+    }
+    if (pos < len && num_found < NUM_DELIMS) {
+      // Load the last 16 bytes and ignore the ones that were already scanned.
+      int block_pos = len - SSEUtil::CHARS_PER_128_BIT_REGISTER;
+      int mask = DelimMask(data + block_pos) & ~((1 << (pos - block_pos)) - 1);
+      RecordDelims(data, block_pos, mask, positions, &num_found);
+    }
+  } else {
+    for (; pos < len && num_found < NUM_DELIMS; ++pos) {
+      int delim = DelimIndex(data[pos]);
+      if (delim != -1 && positions[delim] == -1) {
+        positions[delim] = pos;
+        ++num_found;
+      }
+    }
+  }
+
+  int offset = tokens->protocol_pos + 3;
+  tokens->slash_pos = positions[0] < 0 ? -1 : positions[0] + offset;
+  tokens->at_pos = positions[1] < 0 ? -1 : positions[1] + offset;
+  tokens->question_pos = positions[2] < 0 ? -1 : positions[2] + offset;
+  tokens->hash_pos = positions[3] < 0 ? -1 : positions[3] + offset;
+  tokens->colon_pos = positions[4] < 0 ? -1 : positions[4] + offset;
+  return true;
+}
+
+// The last URL tokenized by a thread in ParseUrlCached(). The cache is per thread rather
+// than in the THREAD_LOCAL state of parse_url()'s FunctionContext, since each parse_url()
+// call in a query has a FunctionContext of its own. The tokens are offsets into the URL,
+// so they apply to any copy of it.
+struct UrlTokensCache {
+  // URLs longer than this are not cached, to bound the memory and the cost of comparing
+  // against the cached URL.
+  static const int MAX_CACHED_URL_LEN = 4096;
+
+  // Lookups are counted in windows of this many. If none of the lookups of a window
+  // found the URL, e.g. because each row only extracts one part of a URL, copying and
+  // tokenizing every URL costs more than scanning for the one requested part, so the
+  // next NUM_BYPASSED_LOOKUPS calls bypass the cache.
+  static const int LOOKUP_WINDOW = 64;
+  static const int NUM_BYPASSED_LOOKUPS = 4096;
+
+  // Copy of the last URL, and whether it was well formed.
+  string url;
+  bool is_valid;
+  UrlParser::UrlTokens tokens;
+
+  // Number of lookups and of hits in the current window.
+  int num_lookups;
+  int num_hits;
+  // Number of calls left that bypass the cache.
+  int num_bypassed;
+
+  UrlTokensCache() : is_valid(false), num_lookups(0), num_hits(0), num_bypassed(0) { }
+};
+
+// The cache of the calling thread. Accessed through a __thread pointer, which is much
+// cheaper than thread_specific_ptr::get(). The thread_specific_ptr only owns the cache,
+// to delete it when the thread exits.
+static __thread UrlTokensCache* url_tokens_cache;
+static thread_specific_ptr<UrlTokensCache> url_tokens_cache_owner;
+
+bool UrlParser::ParseUrlCached(const StringValue& url, UrlPart part,
+    StringValue* result) {
+  if (url.len > UrlTokensCache::MAX_CACHED_URL_LEN) return ParseUrl(url, part, result);
+  UrlTokensCache* cache = url_tokens_cache;
+  if (UNLIKELY(cache == NULL)) {
+    cache = new UrlTokensCache();
+    url_tokens_cache_owner.reset(cache);
+    url_tokens_cache = cache;
+  }
+  if (cache->num_bypassed > 0) {
+    --cache->num_bypassed;
+    return ParseUrl(url, part, result);
+  }
+  if (url.len == static_cast<int>(cache->url.size()) &&
+      memcmp(url.ptr, cache->url.data(), url.len) == 0) {
+    ++cache->num_hits;
+  } else {
+    cache->url.assign(url.ptr, url.len);
+    cache->is_valid = Tokenize(url, &cache->tokens);
+  }
+  if (++cache->num_lookups == UrlTokensCache::LOOKUP_WINDOW) {
+    if (cache->num_hits == 0) cache->num_bypassed = UrlTokensCache::NUM_BYPASSED_LOOKUPS;
+    cache->num_lookups = 0;
+    cache->num_hits = 0;
+  }
+  if (!cache->is_valid) {
+    result->ptr = NULL;
+    result->len = 0;
+    return false;
+  }
+  return ParseUrl(url, cache->tokens, part, result);
+}
 
 bool UrlParser::ParseUrl(const StringValue& url, UrlPart part, StringValue* result) {
   result->ptr = NULL;
   result->len = 0;
   // Remove leading and trailing spaces.
   StringValue trimmed_url = url.Trim();
-
   // All parts require checking for the protocol.
-  int32_t protocol_pos = protocol_search.Search(&trimmed_url);
+  int protocol_pos = FindProtocol(trimmed_url);
   if (protocol_pos < 0) return false;
-  // Positioned to first char after '://'.
-  StringValue protocol_end = trimmed_url.Substring(protocol_pos + protocol.len);
+  // Position of the first char after '://'.
+  int start = protocol_pos + 3;
+  int len = trimmed_url.len;
 
+  // Only the delimiters of the requested part are searched for, each up to its first
+  // occurrence. This gives the same results as the tokens found by Tokenize().
   switch(part) {
     case AUTHORITY: {
-      // Find first '/'.
-      int32_t end_pos = slash_search.Search(&protocol_end);
-      *result = protocol_end.Substring(0, end_pos);
+      // End at first '/'.
+      int end_pos = Find(trimmed_url, '/', start, len);
+      if (end_pos < 0) end_pos = len;
+      *result = trimmed_url.Substring(start, end_pos - start);
       break;
     }
 
     case FILE:
     case PATH: {
-      // Find first '/'.
-      int32_t start_pos = slash_search.Search(&protocol_end);
+      // Start at first '/'.
+      int start_pos = Find(trimmed_url, '/', start, len);
       if (start_pos < 0) {
         // Return empty string. This is what Hive does.
         return true;
       }
-      StringValue path_start = protocol_end.Substring(start_pos);
-      int32_t end_pos;
+      int end_pos;
       if (part == FILE) {
         // End at '#'.
-        end_pos = hash_search.Search(&path_start);
+        end_pos = Find(trimmed_url, '#', start_pos, len);
       } else {
         // End string at next '?' or '#'.
-        end_pos = question_search.Search(&path_start);
+        end_pos = Find(trimmed_url, '?', start_pos, len);
         if (end_pos < 0) {
           // No '?' was found, look for '#'.
-          end_pos = hash_search.Search(&path_start);
+          end_pos = Find(trimmed_url, '#', start_pos, len);
         }
       }
-      *result = path_start.Substring(0, end_pos);
+      if (end_pos < 0) end_pos = len;
+      *result = trimmed_url.Substring(start_pos, end_pos - start_pos);
       break;
     }
 
     case HOST: {
-      // Find '@'.
-      int32_t start_pos = at_search.Search(&protocol_end);
-      if (start_pos < 0) {
-        // No '@' was found, i.e., no user:pass info was given, start after protocol.
-        start_pos = 0;
-      } else {
-        // Skip '@'.
-        start_pos += at.len;
+      // Start after '@' if user:pass info was given, otherwise after the protocol.
+      int start_pos = Find(trimmed_url, '@', start, len);
+      start_pos = start_pos < 0 ? start : start_pos + 1;
+      // End at the start of the query.
+      int end_pos = Find(trimmed_url, '?', start_pos, len);
+      if (end_pos < 0) end_pos = len;
+      // End at the first '/' to determine host<:port>.
+      int slash_pos = Find(trimmed_url, '/', start_pos, end_pos);
+      if (slash_pos >= 0) end_pos = slash_pos;
+      // End at ':' to strip out port.
+      int colon_pos = Find(trimmed_url, ':', start_pos, end_pos);
+      if (colon_pos >= 0) end_pos = colon_pos;
+      *result = trimmed_url.Substring(start_pos, end_pos - start_pos);
+      break;
+    }
+
+    case PROTOCOL: {
+      *result = trimmed_url.Substring(0, protocol_pos);
+      break;
+    }
+
+    case QUERY: {
+      // Start after first '?'.
+      int question_pos = Find(trimmed_url, '?', start, len);
+      if (question_pos < 0) {
+        // Indicate no query was found.
+        return false;
+      }
+      int start_pos = question_pos + 1;
+      // End string at next '#'.
+      int end_pos = Find(trimmed_url, '#', start_pos, len);
+      if (end_pos < 0) end_pos = len;
+      *result = trimmed_url.Substring(start_pos, end_pos - start_pos);
+      break;
+    }
+
+    case REF: {
+      // Start after '#'.
+      int hash_pos = Find(trimmed_url, '#', start, len);
+      if (hash_pos < 0) {
+        // Indicate no ref was given.
+        return false;
+      }
+      *result = trimmed_url.Substring(hash_pos + 1);
+      break;
+    }
+
+    case USERINFO: {
+      // End at '@'.
+      int at_pos = Find(trimmed_url, '@', start, len);
+      if (at_pos < 0) {
+        // Indicate no user and pass were given.
+        return false;
       }
-      StringValue host_start = protocol_end.Substring(start_pos);
+      *result = trimmed_url.Substring(start, at_pos - start);
+      break;
+    }
 
-      // Find the start of the query
-      int32_t query_start_pos = question_search.Search(&host_start);
-      StringValue url_only = host_start.Substring(0, query_start_pos);
+    case INVALID: return false;
+  }
+  return true;
+}
+
+bool UrlParser::ParseUrl(const StringValue& url, const UrlTokens& tokens, UrlPart part,
+    StringValue* result) {
+  result->ptr = NULL;
+  result->len = 0;
+  StringValue trimmed_url = TrimmedUrl(url, tokens);
+  // Position of the first char after '://'.
+  int start = tokens.protocol_pos + 3;
+  int len = trimmed_url.len;
+
+  switch(part) {
+    case AUTHORITY: {
+      // End at first '/'.
+      int end_pos = tokens.slash_pos < 0 ? len : tokens.slash_pos;
+      *result = trimmed_url.Substring(start, end_pos - start);
+      break;
+    }
 
-      // Find the first '/' in url_only to determine host<:port>
-      int32_t hostport_end_pos = slash_search.Search(&url_only);
-      StringValue hostport = url_only.Substring(0, hostport_end_pos);
+    case FILE:
+    case PATH: {
+      // Start at first '/'.
+      int start_pos = tokens.slash_pos;
+      if (start_pos < 0) {
+        // Return empty string. This is what Hive does.
+        return true;
+      }
+      int end_pos;
+      if (part == FILE) {
+        // End at '#'.
+        end_pos = FindFrom(trimmed_url, '#', tokens.hash_pos, start_pos, len);
+      } else {
+        // End string at next '?' or '#'.
+        end_pos = FindFrom(trimmed_url, '?', tokens.question_pos, start_pos, len);
+        if (end_pos < 0) {
+          // No '?' was found, look for '#'.
+          end_pos = FindFrom(trimmed_url, '#', tokens.hash_pos, start_pos, len);
+        }
+      }
+      if (end_pos < 0) end_pos = len;
+      *result = trimmed_url.Substring(start_pos, end_pos - start_pos);
+      break;
+    }
 
-      // Find ':' to strip out port.
-      int32_t end_pos = colon_search.Search(&hostport);
-      *result = hostport.Substring(0, end_pos);
+    case HOST: {
+      // Start after '@' if user:pass info was given, otherwise after the protocol.
+      int start_pos = tokens.at_pos < 0 ? start : tokens.at_pos + 1;
+      // End at the start of the query.
+      int end_pos = FindFrom(trimmed_url, '?', tokens.question_pos, start_pos, len);
+      if (end_pos < 0) end_pos = len;
+      // End at the first '/' to determine host<:port>.
+      int slash_pos = FindFrom(trimmed_url, '/', tokens.slash_pos, start_pos, end_pos);
+      if (slash_pos >= 0) end_pos = slash_pos;
+      // End at ':' to strip out port.
+      int colon_pos = FindFrom(trimmed_url, ':', tokens.colon_pos, start_pos, end_pos);
+      if (colon_pos >= 0) end_pos = colon_pos;
+      *result = trimmed_url.Substring(start_pos, end_pos - start_pos);
       break;
     }
 
     case PROTOCOL: {
-      *result = trimmed_url.Substring(0, protocol_pos);
+      *result = trimmed_url.Substring(0, tokens.protocol_pos);
       break;
     }
 
     case QUERY: {
-      // Find first '?'.
-      int32_t start_pos = question_search.Search(&protocol_end);
-      if (start_pos < 0) {
+      // Start after first '?'.
+      if (tokens.question_pos < 0) {
         // Indicate no query was found.
         return false;
       }
-      StringValue query_start = protocol_end.Substring(start_pos + question.len);
+      int start_pos = tokens.question_pos + 1;
       // End string at next '#'.
-      int32_t end_pos = hash_search.Search(&query_start);
-      *result = query_start.Substring(0, end_pos);
+      int end_pos = FindFrom(trimmed_url, '#', tokens.hash_pos, start_pos, len);
+      if (end_pos < 0) end_pos = len;
+      *result = trimmed_url.Substring(start_pos, end_pos - start_pos);
       break;
     }
 
     case REF: {
-      // Find '#'.
-      int32_t start_pos = hash_search.Search(&protocol_end);
-      if (start_pos < 0) {
-        // Indicate no user and pass were given.
+      // Start after '#'.
+      if (tokens.hash_pos < 0) {
+        // Indicate no ref was given.
         return false;
       }
-      *result = protocol_end.Substring(start_pos + hash.len);
+      *result = trimmed_url.Substring(tokens.hash_pos + 1);
       break;
     }
 
     case USERINFO: {
-      // Find '@'.
-      int32_t end_pos = at_search.Search(&protocol_end);
-      if (end_pos < 0) {
+      // End at '@'.
+      if (tokens.at_pos < 0) {
         // Indicate no user and pass were given.
         return false;
       }
-      *result = protocol_end.Substring(0, end_pos);
+      *result = trimmed_url.Substring(start, tokens.at_pos - start);
       break;
     }
 
@@ -163,14 +452,42 @@ bool UrlParser::ParseUrlKey(const StringValue& url, UrlPart part,
   if (part != QUERY) {
     return false;
   }
+  if (key.len == 0) return false;
   // Remove leading and trailing spaces.
   StringValue trimmed_url = url.Trim();
+  if (memchr(key.ptr, '?', key.len) != NULL || memchr(key.ptr, '&', key.len) != NULL) {
+    return SearchUrlKey(trimmed_url, key, result);
+  }
+
+  // The key must be preceded by a '?' or a '&' and followed by '=', ignoring malformed
+  // URLs for now. Since the key contains neither, its occurrences cannot overlap a
+  // delimiter, so it suffices to check the text after each delimiter in turn.
+  const char* end = trimmed_url.ptr + trimmed_url.len;
+  for (const char* p = trimmed_url.ptr; p < end; ++p) {
+    if (*p != '?' && *p != '&') continue;
+    const char* key_start = p + 1;
+    if (end - key_start <= key.len) continue;
+    if (memcmp(key_start, key.ptr, key.len) != 0) continue;
+    const char* value_start = key_start + key.len;
+    if (*value_start != '=') continue;
+    ++value_start;
+    // Find ending position of key's value by matching '#' or '&'.
+    const char* value_end = value_start;
+    while (value_end < end && *value_end != '#' && *value_end != '&') ++value_end;
+    *result = StringValue(const_cast<char*>(value_start), value_end - value_start);
+    return true;
+  }
+  return false;
+}
 
+bool UrlParser::SearchUrlKey(const StringValue& trimmed_url, const StringValue& key,
+      StringValue* result) {
   // Search for the key in the url, ignoring malformed URLs for now.
+  StringValue url = trimmed_url;
   StringSearch key_search(&key);
-  while(trimmed_url.len > 0) {
+  while(url.len > 0) {
     // Search for the key in the current substring.
-    int32_t key_pos = key_search.Search(&trimmed_url);
+    int32_t key_pos = key_search.Search(&url);
     bool match = true;
     if (key_pos < 0) {
       return false;
@@ -178,34 +495,34 @@ bool UrlParser::ParseUrlKey(const StringValue& url, UrlPart part,
     // Key pos must be != 0 because it must be preceded by a '?' or a '&'.
     // Check that the char before key_pos is either '?' or '&'.
     if (key_pos == 0 ||
-        (trimmed_url.ptr[key_pos - 1] != '?' && trimmed_url.ptr[key_pos - 1] != '&')) {
+        (url.ptr[key_pos - 1] != '?' && url.ptr[key_pos - 1] != '&')) {
       match = false;
     }
     // Advance substring beyond matching key.
-    trimmed_url = trimmed_url.Substring(key_pos + key.len);
+    url = url.Substring(key_pos + key.len);
     if (!match) {
       continue;
     }
-    if (trimmed_url.len <= 0) {
+    if (url.len <= 0) {
       break;
     }
     // Next character must be '=', otherwise the match cannot be a key in the query part.
-    if (trimmed_url.ptr[0] != '=') {
+    if (url.ptr[0] != '=') {
       continue;
     }
     int32_t pos = 1;
     // Find ending position of key's value by matching '#' or '&'.
-    while(pos < trimmed_url.len) {
-      switch(trimmed_url.ptr[pos]) {
+    while(pos < url.len) {
+      switch(url.ptr[pos]) {
         case '#':
         case '&':
-          *result = trimmed_url.Substring(1, pos - 1);
+          *result = url.Substring(1, pos - 1);
           return true;
       }
       ++pos;
     }
     // Ending position is end of string.
-    *result = trimmed_url.Substring(1);
+    *result = url.Substring(1);
     return true;
   }
   return false;
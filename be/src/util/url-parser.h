@@ -17,7 +17,6 @@
 #define IMPALA_UTIL_URL_PARSER_H
 
 #include "runtime/string-value.h"
-#include "runtime/string-search.h"
 
 namespace impala {
 
@@ -53,11 +52,48 @@ class UrlParser {
     USERINFO
   };
 
+  // Positions of the delimiters of a URL, found by a single scan of it in Tokenize().
+  // All parts of the URL can be extracted from the same UrlTokens. 'start' and 'len'
+  // describe the URL with leading and trailing spaces removed, and all other positions
+  // are offsets into it, or -1 if the delimiter is not present.
+  struct UrlTokens {
+    int start;
+    int len;
+    // Position of the first "://".
+    int protocol_pos;
+    // Positions of the first '/', '@', '?', '#' and ':' after the "://".
+    int slash_pos;
+    int at_pos;
+    int question_pos;
+    int hash_pos;
+    int colon_pos;
+  };
+
+  // Scans url for the positions of its delimiters and places them in tokens.
+  // Returns false if the URL is malformed. True otherwise.
+  static bool Tokenize(const StringValue& url, UrlTokens* tokens);
+
+  // Tries to parse the part from url, given the tokens returned by Tokenize() for it.
+  // Places the result in result.
+  // Returns false if part is invalid or not present in the URL. True otherwise.
+  // If false is returned the contents of results are undefined.
+  static bool ParseUrl(const StringValue& url, const UrlTokens& tokens, UrlPart part,
+      StringValue* result);
+
   // Tries to parse the part from url. Places the result in result.
   // Returns false if the URL is malformed or if part is invalid. True otherwise.
   // If false is returned the contents of results are undefined.
+  // Only scans url as far as needed for part, which is cheaper than Tokenize() if only
+  // one part of the URL is needed.
   static bool ParseUrl(const StringValue& url, UrlPart part, StringValue* result);
 
+  // Same as ParseUrl(url, part, result), but extracts part from the cached tokens of the
+  // last URL tokenized by the calling thread if url is the same. Queries often extract
+  // several parts of a URL with one parse_url() call each, and the calls for a row run
+  // one after the other in the same thread, so they share one tokenization. Falls back
+  // to ParseUrl(url, part, result) while the cache is not being hit.
+  static bool ParseUrlCached(const StringValue& url, UrlPart part, StringValue* result);
+
   // Tries to parse key from url. Places the result in result.
   // Returns false if the URL is malformed or if part is invalid. True otherwise.
   // If false is returned the contents of results are undefined.
@@ -79,21 +115,13 @@ class UrlParser {
   static const StringValue url_query;
   static const StringValue url_ref;
   static const StringValue url_userinfo;
-  // Constants used in searching for URL parts.
-  static const StringValue protocol;
-  static const StringValue at;
-  static const StringValue slash;
-  static const StringValue colon;
-  static const StringValue question;
-  static const StringValue hash;
-  static const StringSearch protocol_search;
-  static const StringSearch at_search;
-  static const StringSearch slash_search;
-  static const StringSearch colon_search;
-  static const StringSearch question_search;
-  static const StringSearch hash_search;
-};
 
+  // Implementation of ParseUrlKey() that searches for every occurrence of key, used for
+  // keys that contain a '?' or '&'. Other keys only need to be compared against the
+  // text following each '?' and '&'.
+  static bool SearchUrlKey(const StringValue& trimmed_url, const StringValue& key,
+      StringValue* result);
+};
 }
 
 #endif